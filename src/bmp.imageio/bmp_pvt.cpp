@@ -35,18 +35,12 @@ namespace bmp_pvt {
 
 
 bool
-BmpFileHeader::read_header (FILE *fd)
+BmpFileHeader::read_header (Filesystem::BufferedReader &file)
 {
-    int byte_count = 0;
-    byte_count += fread (&magic, 1, sizeof (magic), fd);
-    byte_count += fread (&fsize, 1, sizeof (fsize), fd);
-    byte_count += fread (&res1, 1, sizeof (res1), fd);
-    byte_count += fread (&res2, 1, sizeof (res2), fd);
-    byte_count += fread (&offset, 1, sizeof (offset), fd);
-
-    if (bigendian ())
-        swap_endian ();
-    return (byte_count == BMP_HEADER_SIZE);
+    // All fields are little-endian
+    return (file.read_le (&magic) && file.read_le (&fsize) &&
+            file.read_le (&res1) && file.read_le (&res2) &&
+            file.read_le (&offset));
 }
 
 
@@ -95,55 +89,44 @@ BmpFileHeader::swap_endian (void)
 
 
 bool
-DibInformationHeader::read_header (FILE *fd)
+DibInformationHeader::read_header (Filesystem::BufferedReader &file)
 {
-    int byte_count = 0;
-    byte_count += fread (&size, 1, sizeof (size), fd);
+    // All fields are little-endian
+    int64_t start = file.tell ();
+    if (! file.read_le (&size))
+        return false;
 
     if (size == WINDOWS_V3 || size == WINDOWS_V4) {
-        byte_count += fread (&width, 1, sizeof (width), fd);
-        byte_count += fread (&height, 1, sizeof (height), fd);
-        byte_count += fread (&cplanes, 1, sizeof (cplanes), fd);
-        byte_count += fread (&bpp, 1, sizeof (bpp), fd);
-        byte_count += fread (&compression, 1, sizeof (compression), fd);
-        byte_count += fread (&isize, 1, sizeof (isize), fd);
-        byte_count += fread (&hres, 1, sizeof (hres), fd);
-        byte_count += fread (&vres, 1, sizeof (vres), fd);
-        byte_count += fread (&cpalete, 1, sizeof (cpalete), fd);
-        byte_count += fread (&important, 1, sizeof (important), fd);
+        // The fields from width through important are contiguous
+        if (! (file.read_le (&width) && file.read_le (&height) &&
+               file.read_le (&cplanes) && file.read_le (&bpp) &&
+               file.read_le (&compression) && file.read_le (&isize) &&
+               file.read_le (&hres) && file.read_le (&vres) &&
+               file.read_le (&cpalete) && file.read_le (&important)))
+            return false;
         if (size == WINDOWS_V4) {
-            byte_count += fread (&red_mask, 1, sizeof (red_mask), fd);
-            byte_count += fread (&blue_mask, 1, sizeof (blue_mask), fd);
-            byte_count += fread (&green_mask, 1, sizeof (green_mask), fd);
-            byte_count += fread (&cs_type, 1, sizeof (cs_type), fd);
-            byte_count += fread (&red_x, 1, sizeof (red_x), fd);
-            byte_count += fread (&red_y, 1, sizeof (red_y), fd);
-            byte_count += fread (&red_z, 1, sizeof (red_z), fd);
-            byte_count += fread (&green_x, 1, sizeof (green_x), fd);
-            byte_count += fread (&green_y, 1, sizeof (green_y), fd);
-            byte_count += fread (&green_z, 1, sizeof (green_z), fd);
-            byte_count += fread (&blue_x, 1, sizeof (blue_x), fd);
-            byte_count += fread (&blue_y, 1, sizeof (blue_y), fd);
-            byte_count += fread (&blue_z, 1, sizeof (blue_z), fd);
-            byte_count += fread (&gamma_x, 1, sizeof (gamma_x), fd);
-            byte_count += fread (&gamma_y, 1, sizeof (gamma_y), fd);
-            byte_count += fread (&gamma_z, 1, sizeof (gamma_z), fd);
-            int32_t dummy;
-            byte_count += fread (&dummy, 1, sizeof (dummy), fd);
+            if (! (file.read_le (&red_mask) && file.read_le (&blue_mask) &&
+                   file.read_le (&green_mask) && file.read_le (&cs_type) &&
+                   file.read_le (&red_x) && file.read_le (&red_y) &&
+                   file.read_le (&red_z) && file.read_le (&green_x) &&
+                   file.read_le (&green_y) && file.read_le (&green_z) &&
+                   file.read_le (&blue_x) && file.read_le (&blue_y) &&
+                   file.read_le (&blue_z) && file.read_le (&gamma_x) &&
+                   file.read_le (&gamma_y) && file.read_le (&gamma_z)))
+                return false;
+            file.skip (4);   // dummy
         }
     }
     else if (size == OS2_V1) {
-        // this fileds are smaller then in WINDOWS_Vx headers,
-        // so we use hardcoded counts
-        byte_count += fread (&width, 1, 2, fd);
-        byte_count += fread (&height, 1, 2, fd);
-        byte_count += fread (&cplanes, 1, 2, fd);
-        byte_count += fread (&bpp, 1, 2, fd);
-        
+        // this fileds are smaller then in WINDOWS_Vx headers
+        uint16_t w, h;
+        if (! (file.read_le (&w) && file.read_le (&h) &&
+               file.read_le (&cplanes) && file.read_le (&bpp)))
+            return false;
+        width = w;
+        height = h;
     }
-    if (bigendian ())
-        swap_endian ();
-    return (byte_count == size);
+    return (file.tell () - start == size && file.tell () <= (int64_t)file.size ());
 }
 
 
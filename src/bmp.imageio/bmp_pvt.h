@@ -34,6 +34,7 @@
 #include "imageio.h"
 using namespace OpenImageIO;
 #include "fmath.h"
+#include "filesystem.h"
 
 
 
@@ -60,7 +61,7 @@ namespace bmp_pvt {
     class BmpFileHeader {
      public:
          // reads informations about BMP file
-         bool read_header (FILE *fd);
+         bool read_header (Filesystem::BufferedReader &file);
 
          // writes information about bmp file to given file
          bool write_header (FILE *fd);
@@ -81,7 +82,7 @@ namespace bmp_pvt {
     class DibInformationHeader {
      public:
          // reads informations about bitmap
-         bool read_header (FILE *fd);
+         bool read_header (Filesystem::BufferedReader &file);
 
          // writes informations about bitmap
          bool write_header (FILE *fd);
@@ -134,25 +135,29 @@ namespace bmp_pvt {
 
 class BmpInput : public ImageInput {
  public:
-    BmpInput () { init (); }
+    BmpInput () : m_io_user(NULL) { init (); }
     virtual ~BmpInput () { close (); }
     virtual const char *format_name (void) const { return "bmp"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool close (void);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
  private:
     int m_scanline_size;
     int m_pad_size;
-    FILE *m_fd;
+    Filesystem::BufferedReader m_file;
+    Filesystem::IOProxy *m_io_user;
     bmp_pvt::BmpFileHeader m_bmp_header;
     bmp_pvt::DibInformationHeader m_dib_header;
     std::string m_filename;
     std::vector<bmp_pvt::color_table> m_colortable;
-    fpos_t m_image_start;
+    int64_t m_image_start;
     void init (void) {
         m_scanline_size = 0;
         m_pad_size = 0;
-        m_fd = NULL;
         m_filename.clear ();
         m_colortable.clear ();
     }
@@ -41,6 +41,14 @@ extern "C" {
     DLLEXPORT const char *bmp_input_extensions[] = {
         "bmp", NULL
     };
+    DLLEXPORT bool bmp_input_signature (const unsigned char *header,
+                                        int nbytes) {
+        if (nbytes < 2)
+            return false;
+        int16_t magic = header[0] | (header[1] << 8);
+        return (magic == MAGIC_BM || magic == MAGIC_BA || magic == MAGIC_CI
+                || magic == MAGIC_CP || magic == MAGIC_PT);
+    }
 }
 
 
@@ -51,14 +59,13 @@ BmpInput::open (const std::string &name, ImageSpec &spec)
     // saving 'name' for later use
     m_filename = name;
 
-    m_fd = fopen (m_filename.c_str (), "rb");
-    if (!m_fd) {
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (m_filename))) {
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
 
     // we read header of the file that we think is BMP file
-    if (! m_bmp_header.read_header (m_fd)) {
+    if (! m_bmp_header.read_header (m_file)) {
         error ("\"%s\": wrong bmp header size", m_filename.c_str());
         close ();
         return false;
@@ -69,7 +76,7 @@ BmpInput::open (const std::string &name, ImageSpec &spec)
         close ();
         return false;
     }
-    if (! m_dib_header.read_header (m_fd)) {
+    if (! m_dib_header.read_header (m_file)) {
         error ("\"%s\": wrong bitmap header size", m_filename.c_str());
         close ();
         return false;
@@ -114,7 +121,7 @@ BmpInput::open (const std::string &name, ImageSpec &spec)
 
     // file pointer is set to the beginning of image data
     // we save this position - it will be helpfull in read_native_scanline
-    fgetpos (m_fd, &m_image_start);
+    m_image_start = m_file.tell ();
 
     spec = m_spec;
     return true;
@@ -131,24 +138,31 @@ BmpInput::read_native_scanline (int y, int z, void *data)
     // if the height is positive scanlines are stored bottom-up
     if (m_dib_header.width >= 0)
         y = m_spec.height - y - 1;
-    const int scanline_off = y * m_scanline_size;
+    const int64_t scanline_off = (int64_t)y * m_scanline_size;
 
-    std::vector<unsigned char> fscanline (m_scanline_size);
-    fsetpos (m_fd, &m_image_start);
-    fseek (m_fd, scanline_off, SEEK_CUR);
-    fread (&fscanline[0], 1, m_scanline_size, m_fd);
+    // Decode straight from the reader's buffer into the caller's data
+    m_file.seek (m_image_start + scanline_off);
+    const unsigned char *fscanline = m_file.next (m_scanline_size);
+    if (! fscanline) {
+        error ("Unexpected end of file");
+        return false;
+    }
+    unsigned char *mscanline = (unsigned char *)data;
 
     // in each case we process only first m_spec.scanline_bytes () bytes
     // as only they contain information about pixels. The rest are just
     // because scanline size have to be 32-bit boundary
     if (m_dib_header.bpp == 24 || m_dib_header.bpp == 32) {
-        for (unsigned int i = 0; i < m_spec.scanline_bytes (); i += m_spec.nchannels)
-            std::swap (fscanline[i], fscanline[i+2]);
-        memcpy (data, &fscanline[0], m_spec.scanline_bytes());
+        for (unsigned int i = 0; i < m_spec.scanline_bytes (); i += m_spec.nchannels) {
+            mscanline[i] = fscanline[i+2];
+            mscanline[i+1] = fscanline[i+1];
+            mscanline[i+2] = fscanline[i];
+            if (m_spec.nchannels == 4)
+                mscanline[i+3] = fscanline[i+3];
+        }
         return true;
     }
 
-    std::vector<unsigned char> mscanline (m_spec.scanline_bytes());
     if (m_dib_header.bpp == 16) {
         const uint16_t RED = 0x7C00;
         const uint16_t GREEN = 0x03E0;
@@ -180,9 +194,9 @@ BmpInput::read_native_scanline (int y, int z, void *data)
         }
     }
     if (m_dib_header.bpp == 1) {
-        for (unsigned int i = 0, k = 0; i < fscanline.size (); ++i) {
+        for (unsigned int i = 0, k = 0; i < (unsigned int)m_scanline_size; ++i) {
             for (int j = 7; j >= 0; --j, k+=3) {
-                if (k + 2 >= mscanline.size())
+                if (k + 2 >= m_spec.scanline_bytes())
                     break;
                 int index = 0;
                 if (fscanline[i] & (1 << j))
@@ -193,7 +207,6 @@ BmpInput::read_native_scanline (int y, int z, void *data)
             }
         }
     }
-    memcpy (data, &mscanline[0], m_spec.scanline_bytes());
     return true;
 }
 
@@ -202,10 +215,7 @@ BmpInput::read_native_scanline (int y, int z, void *data)
 bool inline
 BmpInput::close (void)
 {
-    if (m_fd) {
-        fclose (m_fd);
-        m_fd = NULL;
-    }
+    m_file.close ();
     init ();
     return true;
 }
@@ -227,5 +237,5 @@ BmpInput::read_color_table (void)
         entry_size = 3;
     m_colortable.resize (colors);
     for (int i = 0; i < colors; i++)
-        fread (&m_colortable[i], entry_size, 1, m_fd);
+        m_file.read (&m_colortable[i], entry_size);
 }
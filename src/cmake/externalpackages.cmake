@@ -88,11 +88,16 @@ endmacro ()
 
 setup_string (OPENEXR_VERSION 1.6.1 "OpenEXR version number")
 mark_as_advanced (OPENEXR_VERSION)
-#setup_string (OPENEXR_VERSION_DIGITS 010601 "OpenEXR version preprocessor number")
-#mark_as_advanced (OPENEXR_VERSION_DIGITS)
-# FIXME -- should instead do the search & replace automatically, like this
-# way it was done in the old makefiles:
-#     OPENEXR_VERSION_DIGITS ?= 0$(subst .,0,${OPENEXR_VERSION})
+# The same version as one number (e.g. 10601 for 1.6.1), for the
+# preprocessor to compare against
+string (REGEX REPLACE "^([0-9]+).*" "\\1"
+        OPENEXR_VERSION_MAJOR "${OPENEXR_VERSION}")
+string (REGEX REPLACE "^[0-9]+\\.([0-9]+).*" "\\1"
+        OPENEXR_VERSION_MINOR "${OPENEXR_VERSION}")
+string (REGEX REPLACE "^[0-9]+\\.[0-9]+\\.([0-9]+).*" "\\1"
+        OPENEXR_VERSION_PATCH "${OPENEXR_VERSION}")
+math (EXPR OPENEXR_VERSION_DIGITS
+      "${OPENEXR_VERSION_MAJOR}*10000 + ${OPENEXR_VERSION_MINOR}*100 + ${OPENEXR_VERSION_PATCH}")
 setup_path (OPENEXR_HOME "${THIRD_PARTY_TOOLS_HOME}"
             "Location of the OpenEXR library install")
 mark_as_advanced (OPENEXR_HOME)
@@ -124,7 +129,7 @@ if (OPENEXR_INCLUDE_AREA AND OPENEXR_LIBRARY)
 else ()
     message (STATUS "OPENEXR not found!")
 endif ()
-#add_definitions ("-DOPENEXR_VERSION=${OPENEXR_VERSION_DIGITS}")
+add_definitions ("-DOPENEXR_VERSION=${OPENEXR_VERSION_DIGITS}")
 find_package (ZLIB)
 macro (LINK_OPENEXR target)
     target_link_libraries (${target} ${OPENEXR_LIBRARY} ${ZLIB_LIBRARIES})
@@ -60,6 +60,7 @@ public:
     virtual bool seek_subimage (int index, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
     virtual bool read_native_tile (int x, int y, int z, void *data);
+    using ImageInput::read_native_tile;  // Keep the channel subset one
 
 private:
     std::string m_filename;           ///< Stash the filename
@@ -118,6 +119,12 @@ DLLEXPORT const char * dds_input_extensions[] = {
     "dds", NULL
 };
 
+DLLEXPORT bool
+dds_input_signature (const unsigned char *header, int nbytes)
+{
+    return nbytes >= 4 && ! memcmp (header, "DDS ", 4);
+}
+
 };
 
 
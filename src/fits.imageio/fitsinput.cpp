@@ -44,6 +44,10 @@ extern "C" {
     DLLEXPORT const char *fits_input_extensions[] = {
         "fits", NULL
     };
+    DLLEXPORT bool fits_input_signature (const unsigned char *header,
+                                         int nbytes) {
+        return nbytes >= 6 && ! strncmp ((const char *)header, "SIMPLE", 6);
+    }
 }
 
 
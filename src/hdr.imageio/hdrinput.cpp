@@ -29,6 +29,7 @@
 */
 
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <iostream>
@@ -36,6 +37,7 @@
 #include "imageio.h"
 using namespace OpenImageIO;
 #include "fmath.h"
+#include "filesystem.h"
 #include "rgbe.h"
 
 
@@ -56,7 +58,7 @@ using namespace OpenImageIO;
 
 class HdrInput : public ImageInput {
 public:
-    HdrInput () { init(); }
+    HdrInput () : m_io_user(NULL) { init(); }
     virtual ~HdrInput () { close(); }
     virtual const char * format_name (void) const { return "hdr"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
@@ -64,16 +66,22 @@ public:
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool seek_subimage (int index, ImageSpec &newspec);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
 
 private:
     std::string m_filename;       ///< File name
-    FILE *m_fd;                   ///< The open file handle
+    Filesystem::BufferedReader m_file; ///< Where we read from
+    Filesystem::IOProxy *m_io_user; ///< Proxy from set_ioproxy(), if any
     int m_subimage;               ///< What subimage are we looking at?
     int m_next_scanline;          ///< Next scanline to read
+    std::vector<unsigned char> m_rle_buffer; ///< Scratch for RLE decoding
     char rgbe_error[1024];        ///< Buffer for RGBE library error msgs
 
     void init () {
-        m_fd = NULL;
+        m_file.close ();
         m_subimage = -1;
         m_next_scanline = 0;
     }
@@ -91,6 +99,11 @@ extern "C" {
     DLLEXPORT const char *hdr_input_extensions[] = {
         "hdr", "rgbe", NULL
     };
+    DLLEXPORT bool hdr_input_signature (const unsigned char *header,
+                                        int nbytes) {
+        // "#?" followed by the program type, e.g. "#?RADIANCE"
+        return nbytes >= 2 && header[0] == '#' && header[1] == '?';
+    }
 };
 
 
@@ -120,15 +133,16 @@ HdrInput::seek_subimage (int index, ImageSpec &newspec)
     close();
 
     // Check that file exists and can be opened
-    m_fd = fopen (m_filename.c_str(), "rb");
-    if (m_fd == NULL) {
+    // The RGBE routines read a byte or two at a time, so give them
+    // a buffered reader rather than the raw file
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (m_filename))) {
         error ("Could not open file \"%s\"", m_filename.c_str());
         return false;
     }
 
     rgbe_header_info h;
     int width, height;
-    int r = RGBE_ReadHeader (m_fd, &width, &height, &h, rgbe_error);
+    int r = RGBE_ReadHeader (&m_file, &width, &height, &h, rgbe_error);
     if (r != RGBE_RETURN_SUCCESS) {
         error ("%s", rgbe_error);
         close ();
@@ -136,6 +150,7 @@ HdrInput::seek_subimage (int index, ImageSpec &newspec)
     }
 
     m_spec = ImageSpec (width, height, 3, TypeDesc::FLOAT);
+    m_rle_buffer.resize (4 * (size_t)std::max (width, 1));
 
     if (h.valid & RGBE_VALID_GAMMA)
         m_spec.gamma = h.gamma;
@@ -169,7 +184,8 @@ HdrInput::read_native_scanline (int y, int z, void *data)
     }
     while (m_next_scanline <= y) {
         // Keep reading until we're read the scanline we really need
-        int r = RGBE_ReadPixels_RLE (m_fd, (float *)data, m_spec.width, 1, rgbe_error);
+        int r = RGBE_ReadPixels_RLE (&m_file, (float *)data, m_spec.width, 1,
+                                     rgbe_error, &m_rle_buffer[0]);
         ++m_next_scanline;
         if (r != RGBE_RETURN_SUCCESS) {
             error ("%s", rgbe_error);
@@ -184,8 +200,6 @@ HdrInput::read_native_scanline (int y, int z, void *data)
 bool
 HdrInput::close ()
 {
-    if (m_fd)
-        fclose (m_fd);
     init ();   // Reset to initial state
     return true;
 }
@@ -42,21 +42,28 @@ using namespace OpenImageIO;
 
 class HdrOutput : public ImageOutput {
  public:
-    HdrOutput () { init(); }
+    HdrOutput () : m_io_user(NULL) { init(); }
     virtual ~HdrOutput () { close(); }
     virtual const char * format_name (void) const { return "hdr"; }
-    virtual bool supports (const std::string &property) const { return false; }
+    virtual bool supports (const std::string &property) const {
+        return (property == "ioproxy");
+    }
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        bool append=false);
     virtual bool write_scanline (int y, int z, TypeDesc format,
                                  const void *data, stride_t xstride);
     bool close ();
  private:
-    FILE *m_fd;
+    Filesystem::IOProxy *m_io;        ///< Where we write to
+    Filesystem::IOProxy *m_io_user;   ///< Proxy from set_ioproxy(), if any
     std::vector<unsigned char> scratch;
     char rgbe_error[1024];        ///< Buffer for RGBE library error msgs
 
-    void init (void) { m_fd = NULL; }
+    void init (void) { m_io = NULL; }
 };
 
 
@@ -103,10 +110,16 @@ HdrOutput::open (const std::string &name, const ImageSpec &newspec, bool append)
 
     m_spec.set_format (TypeDesc::FLOAT);   // Native rgbe is float32 only
 
-    m_fd = fopen (name.c_str(), "wb");
-    if (m_fd == NULL) {
-        error ("Unable to open file");
-        return false;
+    if (m_io_user) {
+        m_io = m_io_user;
+    } else {
+        m_io = new Filesystem::IOFile (name, Filesystem::IOProxy::Write);
+        if (! m_io->opened ()) {
+            delete m_io;
+            m_io = NULL;
+            error ("Unable to open file");
+            return false;
+        }
     }
 
     rgbe_header_info h;
@@ -127,7 +140,7 @@ HdrOutput::open (const std::string &name, const ImageSpec &newspec, bool append)
     // FIXME -- should we do anything about gamma, exposure, software,
     // pixaspect, primaries?  (N.B. rgbe.c doesn't even handle most of them)
 
-    int r = RGBE_WriteHeader (m_fd, m_spec.width, m_spec.height, &h, rgbe_error);
+    int r = RGBE_WriteHeader (m_io, m_spec.width, m_spec.height, &h, rgbe_error);
     if (r != RGBE_RETURN_SUCCESS)
         error ("%s", rgbe_error);
 
@@ -141,7 +154,7 @@ HdrOutput::write_scanline (int y, int z, TypeDesc format,
                            const void *data, stride_t xstride)
 {
     data = to_native_scanline (format, data, xstride, scratch);
-    int r = RGBE_WritePixels_RLE (m_fd, (float *)data, m_spec.width, 1, rgbe_error);
+    int r = RGBE_WritePixels_RLE (m_io, (float *)data, m_spec.width, 1, rgbe_error);
     if (r != RGBE_RETURN_SUCCESS)
         error ("%s", rgbe_error);
     return (r == RGBE_RETURN_SUCCESS);
@@ -152,9 +165,11 @@ HdrOutput::write_scanline (int y, int z, TypeDesc format,
 bool
 HdrOutput::close ()
 {
-    if (m_fd != NULL) {
-        fclose (m_fd);
-        m_fd = NULL;
+    if (m_io != NULL) {
+        m_io->flush ();
+        if (m_io != m_io_user)
+            delete m_io;
+        m_io = NULL;
     }
     init();
 
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 /* This file contains code to read and write four byte rgbe file format
  developed by Greg Ward.  It handles the conversions between rgbe and
@@ -30,6 +31,9 @@
  3. Change the default programtype string from "RGBE" to "RADIANCE" since
     I noticed that some hdr/rgbe readers (including OS X's preivew util)
     will only accept "RADIANCE" as the programtype.
+
+ Modified by the OpenImageIO team to read and write through an IOProxy
+ rather than a FILE.
 */
 
 #ifdef _CPLUSPLUS
@@ -53,6 +57,49 @@ enum rgbe_error_codes {
   rgbe_memory_error,
 };
 
+/* The routines below read and write through an IOProxy rather than a
+   FILE, and these stand in for the stdio calls they used to make. */
+static char *rgbe_gets(char *buf, int size, Filesystem::IOProxy *fp)
+{
+  int i = 0;
+  while (i < size-1) {
+    char c;
+    if (fp->read(&c, 1) != 1)
+      break;
+    buf[i++] = c;
+    if (c == '\n')
+      break;
+  }
+  if (i == 0)
+    return NULL;
+  buf[i] = 0;
+  return buf;
+}
+
+static int rgbe_printf(Filesystem::IOProxy *fp, const char *format, ...)
+{
+  char buf[256];
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  if (n < 0 || n >= (int)sizeof(buf) || fp->write(buf, n) != (size_t)n)
+    return -1;
+  return n;
+}
+
+static size_t rgbe_read(void *ptr, size_t size, size_t nitems,
+                        Filesystem::IOProxy *fp)
+{
+  return fp->read(ptr, size*nitems) / size;
+}
+
+static size_t rgbe_write(const void *ptr, size_t size, size_t nitems,
+                         Filesystem::IOProxy *fp)
+{
+  return fp->write(ptr, size*nitems) / size;
+}
+
 /* default error routine.  change this to change error handling */
 static int rgbe_error(int rgbe_error_code, const char *msg, char *errbuf)
 {
@@ -127,7 +174,7 @@ rgbe2float(float *red, float *green, float *blue, unsigned char rgbe[4])
 }
 
 /* default minimal header. modify if you want more information in header */
-int RGBE_WriteHeader(FILE *fp, int width, int height, rgbe_header_info *info,
+int RGBE_WriteHeader(Filesystem::IOProxy *fp, int width, int height, rgbe_header_info *info,
                      char *errbuf)
 {
   const char *programtype = "RADIANCE";
@@ -140,26 +187,26 @@ int RGBE_WriteHeader(FILE *fp, int width, int height, rgbe_header_info *info,
 
   if (info && (info->valid & RGBE_VALID_PROGRAMTYPE))
     programtype = info->programtype;
-  if (fprintf(fp,"#?%s\n",programtype) < 0)
+  if (rgbe_printf(fp,"#?%s\n",programtype) < 0)
       return rgbe_error(rgbe_write_error,NULL, errbuf);
   /* The #? is to identify file type, the programtype is optional. */
   if (info && (info->valid & RGBE_VALID_GAMMA)) {
-    if (fprintf(fp,"GAMMA=%g\n",info->gamma) < 0)
+    if (rgbe_printf(fp,"GAMMA=%g\n",info->gamma) < 0)
       return rgbe_error(rgbe_write_error,NULL, errbuf);
   }
   if (info && (info->valid & RGBE_VALID_EXPOSURE)) {
-    if (fprintf(fp,"EXPOSURE=%g\n",info->exposure) < 0)
+    if (rgbe_printf(fp,"EXPOSURE=%g\n",info->exposure) < 0)
       return rgbe_error(rgbe_write_error,NULL, errbuf);
   }
-  if (fprintf(fp,"FORMAT=32-bit_rle_rgbe\n\n") < 0)
+  if (rgbe_printf(fp,"FORMAT=32-bit_rle_rgbe\n\n") < 0)
     return rgbe_error(rgbe_write_error,NULL, errbuf);
-  if (fprintf(fp, "-Y %d +X %d\n", height, width) < 0)
+  if (rgbe_printf(fp, "-Y %d +X %d\n", height, width) < 0)
     return rgbe_error(rgbe_write_error,NULL, errbuf);
   return RGBE_RETURN_SUCCESS;
 }
 
 /* minimal header reading.  modify if you want to parse more information */
-int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
+int RGBE_ReadHeader(Filesystem::IOProxy *fp, int *width, int *height, rgbe_header_info *info,
                     char *errbuf)
 {
   char buf[128];
@@ -173,7 +220,7 @@ int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
     info->programtype[0] = 0;
     info->gamma = info->exposure = 1.0;
   }
-  if (fgets(buf,sizeof(buf)/sizeof(buf[0]),fp) == NULL)
+  if (rgbe_gets(buf,sizeof(buf)/sizeof(buf[0]),fp) == NULL)
     return rgbe_error(rgbe_read_error,NULL, errbuf);
   if ((buf[0] != '#')||(buf[1] != '?')) {
     /* if you want to require the magic token then uncomment the next line */
@@ -187,7 +234,7 @@ int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
       info->programtype[i] = buf[i+2];
     }
     info->programtype[i] = 0;
-    if (fgets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
+    if (rgbe_gets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
       return rgbe_error(rgbe_read_error,NULL, errbuf);
   }
   bool found_FORMAT_line = false;
@@ -209,7 +256,7 @@ int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
       info->exposure = tempf;
       info->valid |= RGBE_VALID_EXPOSURE;
     }
-    if (fgets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
+    if (rgbe_gets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
       return rgbe_error(rgbe_read_error,NULL, errbuf);
   }
   if (strcmp(buf,"\n") != 0) {
@@ -217,7 +264,7 @@ int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
     return rgbe_error(rgbe_format_error,
 		      "missing blank line after FORMAT specifier", errbuf);
   }
-  if (fgets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
+  if (rgbe_gets(buf,sizeof(buf)/sizeof(buf[0]),fp) == 0)
     return rgbe_error(rgbe_read_error,NULL, errbuf);
 
   if (sscanf(buf,"-Y %d +X %d",height,width) == 2) {
@@ -269,7 +316,7 @@ int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
 /* simple write routine that does not use run length encoding */
 /* These routines can be made faster by allocating a larger buffer and
    fread-ing and fwrite-ing the data in larger chunks */
-int RGBE_WritePixels(FILE *fp, float *data, int numpixels,
+int RGBE_WritePixels(Filesystem::IOProxy *fp, float *data, int numpixels,
                      char *errbuf)
 {
   unsigned char rgbe[4];
@@ -278,20 +325,20 @@ int RGBE_WritePixels(FILE *fp, float *data, int numpixels,
     float2rgbe(rgbe,data[RGBE_DATA_RED],
 	       data[RGBE_DATA_GREEN],data[RGBE_DATA_BLUE]);
     data += RGBE_DATA_SIZE;
-    if (fwrite(rgbe, sizeof(rgbe), 1, fp) < 1)
+    if (rgbe_write(rgbe, sizeof(rgbe), 1, fp) < 1)
       return rgbe_error(rgbe_write_error,NULL, errbuf);
   }
   return RGBE_RETURN_SUCCESS;
 }
 
 /* simple read routine.  will not correctly handle run length encoding */
-int RGBE_ReadPixels(FILE *fp, float *data, int numpixels,
+int RGBE_ReadPixels(Filesystem::IOProxy *fp, float *data, int numpixels,
                     char *errbuf)
 {
   unsigned char rgbe[4];
 
   while(numpixels-- > 0) {
-    if (fread(rgbe, sizeof(rgbe), 1, fp) < 1)
+    if (rgbe_read(rgbe, sizeof(rgbe), 1, fp) < 1)
       return rgbe_error(rgbe_read_error,NULL, errbuf);
     rgbe2float(&data[RGBE_DATA_RED],&data[RGBE_DATA_GREEN],
 	       &data[RGBE_DATA_BLUE],rgbe);
@@ -305,7 +352,7 @@ int RGBE_ReadPixels(FILE *fp, float *data, int numpixels,
 /* save some space.  For each scanline, each channel (r,g,b,e) is */
 /* encoded separately for better compression. */
 
-static int RGBE_WriteBytes_RLE(FILE *fp, unsigned char *data, int numbytes,
+static int RGBE_WriteBytes_RLE(Filesystem::IOProxy *fp, unsigned char *data, int numbytes,
                                char *errbuf)
 {
 #define MINRUNLENGTH 4
@@ -329,7 +376,7 @@ static int RGBE_WriteBytes_RLE(FILE *fp, unsigned char *data, int numbytes,
     if ((old_run_count > 1)&&(old_run_count == beg_run - cur)) {
       buf[0] = 128 + old_run_count;   /*write short run*/
       buf[1] = data[cur];
-      if (fwrite(buf,sizeof(buf[0])*2,1,fp) < 1)
+      if (rgbe_write(buf,sizeof(buf[0])*2,1,fp) < 1)
 	return rgbe_error(rgbe_write_error,NULL, errbuf);
       cur = beg_run;
     }
@@ -339,9 +386,9 @@ static int RGBE_WriteBytes_RLE(FILE *fp, unsigned char *data, int numbytes,
       if (nonrun_count > 128) 
 	nonrun_count = 128;
       buf[0] = nonrun_count;
-      if (fwrite(buf,sizeof(buf[0]),1,fp) < 1)
+      if (rgbe_write(buf,sizeof(buf[0]),1,fp) < 1)
 	return rgbe_error(rgbe_write_error,NULL, errbuf);
-      if (fwrite(&data[cur],sizeof(data[0])*nonrun_count,1,fp) < 1)
+      if (rgbe_write(&data[cur],sizeof(data[0])*nonrun_count,1,fp) < 1)
 	return rgbe_error(rgbe_write_error,NULL, errbuf);
       cur += nonrun_count;
     }
@@ -349,7 +396,7 @@ static int RGBE_WriteBytes_RLE(FILE *fp, unsigned char *data, int numbytes,
     if (run_count >= MINRUNLENGTH) {
       buf[0] = 128 + run_count;
       buf[1] = data[beg_run];
-      if (fwrite(buf,sizeof(buf[0])*2,1,fp) < 1)
+      if (rgbe_write(buf,sizeof(buf[0])*2,1,fp) < 1)
 	return rgbe_error(rgbe_write_error,NULL, errbuf);
       cur += run_count;
     }
@@ -358,7 +405,7 @@ static int RGBE_WriteBytes_RLE(FILE *fp, unsigned char *data, int numbytes,
 #undef MINRUNLENGTH
 }
 
-int RGBE_WritePixels_RLE(FILE *fp, float *data, int scanline_width,
+int RGBE_WritePixels_RLE(Filesystem::IOProxy *fp, float *data, int scanline_width,
 			 int num_scanlines, char *errbuf)
 {
   unsigned char rgbe[4];
@@ -377,7 +424,7 @@ int RGBE_WritePixels_RLE(FILE *fp, float *data, int scanline_width,
     rgbe[1] = 2;
     rgbe[2] = scanline_width >> 8;
     rgbe[3] = scanline_width & 0xFF;
-    if (fwrite(rgbe, sizeof(rgbe), 1, fp) < 1) {
+    if (rgbe_write(rgbe, sizeof(rgbe), 1, fp) < 1) {
       free(buffer);
       return rgbe_error(rgbe_write_error,NULL, errbuf);
     }
@@ -404,32 +451,35 @@ int RGBE_WritePixels_RLE(FILE *fp, float *data, int scanline_width,
   return RGBE_RETURN_SUCCESS;
 }
       
-int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
-			int num_scanlines, char *errbuf)
+int RGBE_ReadPixels_RLE(Filesystem::IOProxy *fp, float *data, int scanline_width,
+			int num_scanlines, char *errbuf,
+			unsigned char *scratch)
 {
   unsigned char rgbe[4], *scanline_buffer, *ptr, *ptr_end;
   int i, count;
+  /* only free the scanline buffer if we allocated it */
+  int own_buffer = (scratch == NULL);
   unsigned char buf[2];
 
   if ((scanline_width < 8)||(scanline_width > 0x7fff))
     /* run length encoding is not allowed so read flat*/
     return RGBE_ReadPixels(fp,data,scanline_width*num_scanlines);
-  scanline_buffer = NULL;
+  scanline_buffer = scratch;
   /* read in each successive scanline */
   while(num_scanlines > 0) {
-    if (fread(rgbe,sizeof(rgbe),1,fp) < 1) {
-      free(scanline_buffer);
+    if (rgbe_read(rgbe,sizeof(rgbe),1,fp) < 1) {
+      if (own_buffer) free(scanline_buffer);
       return rgbe_error(rgbe_read_error,NULL, errbuf);
     }
     if ((rgbe[0] != 2)||(rgbe[1] != 2)||(rgbe[2] & 0x80)) {
       /* this file is not run length encoded */
       rgbe2float(&data[0],&data[1],&data[2],rgbe);
       data += RGBE_DATA_SIZE;
-      free(scanline_buffer);
+      if (own_buffer) free(scanline_buffer);
       return RGBE_ReadPixels(fp,data,scanline_width*num_scanlines-1);
     }
     if ((((int)rgbe[2])<<8 | rgbe[3]) != scanline_width) {
-      free(scanline_buffer);
+      if (own_buffer) free(scanline_buffer);
       return rgbe_error(rgbe_format_error,"wrong scanline width", errbuf);
     }
     if (scanline_buffer == NULL)
@@ -443,15 +493,15 @@ int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
     for(i=0;i<4;i++) {
       ptr_end = &scanline_buffer[(i+1)*scanline_width];
       while(ptr < ptr_end) {
-	if (fread(buf,sizeof(buf[0])*2,1,fp) < 1) {
-	  free(scanline_buffer);
+	if (rgbe_read(buf,sizeof(buf[0])*2,1,fp) < 1) {
+	  if (own_buffer) free(scanline_buffer);
 	  return rgbe_error(rgbe_read_error,NULL, errbuf);
 	}
 	if (buf[0] > 128) {
 	  /* a run of the same value */
 	  count = buf[0]-128;
 	  if ((count == 0)||(count > ptr_end - ptr)) {
-	    free(scanline_buffer);
+	    if (own_buffer) free(scanline_buffer);
 	    return rgbe_error(rgbe_format_error,"bad scanline data", errbuf);
 	  }
 	  while(count-- > 0)
@@ -461,13 +511,13 @@ int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
 	  /* a non-run */
 	  count = buf[0];
 	  if ((count == 0)||(count > ptr_end - ptr)) {
-	    free(scanline_buffer);
+	    if (own_buffer) free(scanline_buffer);
 	    return rgbe_error(rgbe_format_error,"bad scanline data", errbuf);
 	  }
 	  *ptr++ = buf[1];
 	  if (--count > 0) {
-	    if (fread(ptr,sizeof(*ptr)*count,1,fp) < 1) {
-	      free(scanline_buffer);
+	    if (rgbe_read(ptr,sizeof(*ptr)*count,1,fp) < 1) {
+	      if (own_buffer) free(scanline_buffer);
 	      return rgbe_error(rgbe_read_error,NULL, errbuf);
 	    }
 	    ptr += count;
@@ -487,7 +537,7 @@ int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
     }
     num_scanlines--;
   }
-  free(scanline_buffer);
+  if (own_buffer) free(scanline_buffer);
   return RGBE_RETURN_SUCCESS;
 }
 
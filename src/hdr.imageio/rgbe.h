@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 
+#include "filesystem.h"
+
 typedef struct {
   int valid;            /* indicate which fields are valid */
   char programtype[16]; /* listed at beginning of file to identify it 
@@ -36,26 +38,32 @@ typedef struct {
 #define RGBE_RETURN_SUCCESS 0
 #define RGBE_RETURN_FAILURE -1
 
+/* All reading and writing goes through an IOProxy (which may be a
+   plain file) rather than a FILE.  (Modified by the OpenImageIO team.) */
+
 /* read or write headers */
 /* you may set rgbe_header_info to null if you want to */
-int RGBE_WriteHeader(FILE *fp, int width, int height, rgbe_header_info *info,
+int RGBE_WriteHeader(Filesystem::IOProxy *fp, int width, int height, rgbe_header_info *info,
                      char *errbuf=NULL);
-int RGBE_ReadHeader(FILE *fp, int *width, int *height, rgbe_header_info *info,
+int RGBE_ReadHeader(Filesystem::IOProxy *fp, int *width, int *height, rgbe_header_info *info,
                     char *errbuf=NULL);
 
 /* read or write pixels */
 /* can read or write pixels in chunks of any size including single pixels*/
-int RGBE_WritePixels(FILE *fp, float *data, int numpixels,
+int RGBE_WritePixels(Filesystem::IOProxy *fp, float *data, int numpixels,
                      char *errbuf=NULL);
-int RGBE_ReadPixels(FILE *fp, float *data, int numpixels,
+int RGBE_ReadPixels(Filesystem::IOProxy *fp, float *data, int numpixels,
                     char *errbuf=NULL);
 
 /* read or write run length encoded files */
 /* must be called to read or write whole scanlines */
-int RGBE_WritePixels_RLE(FILE *fp, float *data, int scanline_width,
+int RGBE_WritePixels_RLE(Filesystem::IOProxy *fp, float *data, int scanline_width,
 			 int num_scanlines, char *errbuf=NULL);
-int RGBE_ReadPixels_RLE(FILE *fp, float *data, int scanline_width,
-			int num_scanlines, char *errbuf=NULL);
+/* scratch, if given, must hold 4*scanline_width bytes and is used */
+/* instead of allocating a buffer on every call */
+int RGBE_ReadPixels_RLE(Filesystem::IOProxy *fp, float *data, int scanline_width,
+			int num_scanlines, char *errbuf=NULL,
+			unsigned char *scratch=NULL);
 
 #endif /* _H_RGBE */
 
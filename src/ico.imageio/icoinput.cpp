@@ -103,6 +103,14 @@ DLLEXPORT const char * ico_input_extensions[] = {
     "ico", NULL
 };
 
+DLLEXPORT bool
+ico_input_signature (const unsigned char *header, int nbytes)
+{
+    // Little-endian reserved == 0, type == 1
+    return (nbytes >= 4 && header[0] == 0 && header[1] == 0
+            && header[2] == 1 && header[3] == 0);
+}
+
 };
 
 
@@ -40,11 +40,13 @@
 #include <boost/tokenizer.hpp>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
 
 #include "argparse.h"
 #include "imageio.h"
 using namespace OpenImageIO;
 #include "sysutil.h"
+#include "thread.h"
 
 
 static std::string uninitialized = "uninitialized \001 HHRU dfvAS: efjl";
@@ -70,6 +72,7 @@ static int orientation = 0;
 static bool rotcw = false, rotccw = false, rot180 = false;
 static bool sRGB = false;
 static bool separate = false, contig = false;
+static int nthreads = 1;
 
 
 
@@ -113,6 +116,7 @@ getargs (int argc, char *argv[])
                 "--rotccw", &rotccw, "Rotate 90 deg counter-clockwise",
                 "--rot180", &rot180, "Rotate 180 deg",
                 "--inplace", &inplace, "Do operations in place on images",
+                "-t %d", &nthreads, "Number of files to convert at once with --inplace (0 = #cores)",
                 "--sRGB", &sRGB, "This file is in sRGB color space",
                 "--separate", &separate, "Force planarconfig separate",
                 "--contig", &contig, "Force planarconfig contig",
@@ -273,19 +277,22 @@ adjust_spec (ImageInput *in, const ImageSpec &inspec, ImageSpec &outspec)
     if (separate)
         outspec.attribute ("planarconfig", "separate");
 
-    if (orientation >= 1)
-        outspec.attribute ("Orientation", orientation);
+    // Work on a local copy: with --inplace -t, several files go through
+    // here at once, and each must start from the command-line value.
+    int orient = orientation;
+    if (orient >= 1)
+        outspec.attribute ("Orientation", orient);
     else {
-        orientation = outspec.get_int_attribute ("Orientation", 1);
-        if (orientation >= 1 && orientation <= 8) {
+        orient = outspec.get_int_attribute ("Orientation", 1);
+        if (orient >= 1 && orient <= 8) {
             static int cw[] = { 0, 6, 7, 8, 5, 2, 3, 4, 1 };
             if (rotcw || rotccw || rot180)
-                orientation = cw[orientation];
+                orient = cw[orient];
             if (rotccw || rot180)
-                orientation = cw[orientation];
+                orient = cw[orient];
             if (rotccw)
-                orientation = cw[orientation];
-            outspec.attribute ("Orientation", orientation);
+                orient = cw[orient];
+            outspec.attribute ("Orientation", orient);
         }
     }
 
@@ -438,6 +445,17 @@ convert_file (const std::string &in_filename, const std::string &out_filename)
 
 
 
+// Convert filenames[begin..end) in place, counting the failures.
+static void
+convert_files (int begin, int end, atomic_int *failures)
+{
+    for (int i = begin;  i < end;  ++i)
+        if (! convert_file (filenames[i], filenames[i]))
+            ++(*failures);
+}
+
+
+
 int
 main (int argc, char *argv[])
 {
@@ -446,8 +464,12 @@ main (int argc, char *argv[])
     bool ok = true;
 
     if (inplace) {
-        BOOST_FOREACH (const std::string &s, filenames)
-            ok &= convert_file (s, s);
+        atomic_int failures;
+        failures = 0;
+        parallel_for (0, (int)filenames.size(),
+                      boost::bind (convert_files, _1, _2, &failures),
+                      nthreads, 1);
+        ok = (failures == 0);
     } else {
         ok = convert_file (filenames[0], filenames[1]);
     }
@@ -44,8 +44,12 @@
 #ifndef OPENIMAGEIO_FILESYSTEM_H
 #define OPENIMAGEIO_FILESYSTEM_H
 
+#include <cstdio>
+#include <cstring>
 #include <string>
+#include <vector>
 #include "export.h"
+#include "fmath.h"      /* for int64_t, swap_endian */
 
 
 #ifdef OPENIMAGEIO_NAMESPACE
@@ -89,6 +93,282 @@ DLLPUBLIC bool path_is_absolute (const std::string &path,
                                  bool dot_is_absolute=false);
 
 
+
+/// Proxy for the I/O that image readers and writers do, so that they
+/// may read from or write to a memory buffer, a socket, or anything
+/// else that can read, seek and tell, not just a file on disk.  To
+/// supply your own callbacks, derive from IOProxy and override read(),
+/// write(), seek() and size().
+class DLLPUBLIC IOProxy {
+public:
+    enum Mode { Closed = 0, Read = 'r', Write = 'w' };
+
+    IOProxy () : m_pos(0), m_mode(Closed) { }
+    IOProxy (const std::string &filename, Mode mode)
+        : m_filename(filename), m_pos(0), m_mode(mode) { }
+    virtual ~IOProxy () { }
+
+    /// A short name for the kind of proxy, e.g. "file".
+    virtual const char *proxytype () const = 0;
+    virtual void close () { m_mode = Closed; }
+    virtual bool opened () const { return mode() != Closed; }
+    /// The current position, in bytes from the beginning.
+    virtual int64_t tell () { return m_pos; }
+    /// Move to the given absolute position; return true on success.
+    virtual bool seek (int64_t offset) { m_pos = offset; return true; }
+    /// Read up to size bytes at the current position into buf,
+    /// returning how many were read.
+    virtual size_t read (void *buf, size_t size) { return 0; }
+    /// Write size bytes from buf at the current position, returning
+    /// how many were written.
+    virtual size_t write (const void *buf, size_t size) { return 0; }
+    /// Total size of the contents, in bytes, or 0 if it isn't known.
+    virtual int64_t size () const { return 0; }
+    virtual void flush () const { }
+    /// If the entire contents are already in memory, return a pointer
+    /// to them so that readers can use them in place rather than
+    /// copying them out with read().  Otherwise return NULL.
+    virtual const void *memory () const { return NULL; }
+
+    Mode mode () const { return m_mode; }
+    const std::string &filename () const { return m_filename; }
+
+protected:
+    std::string m_filename;
+    int64_t m_pos;
+    Mode m_mode;
+};
+
+
+
+/// IOProxy for a file on disk, using stdio.
+class DLLPUBLIC IOFile : public IOProxy {
+public:
+    /// Open the named file for reading or writing; check opened() to
+    /// see if it worked.  If unbuffered is true, stdio does no buffering
+    /// of its own (for callers that do theirs).
+    IOFile (const std::string &filename, Mode mode, bool unbuffered = false);
+    /// Use an already-open FILE, which will not be closed by us.
+    IOFile (FILE *file, Mode mode);
+    virtual ~IOFile ();
+    virtual const char *proxytype () const { return "file"; }
+    virtual void close ();
+    virtual bool seek (int64_t offset);
+    virtual size_t read (void *buf, size_t size);
+    virtual size_t write (const void *buf, size_t size);
+    virtual int64_t size () const { return m_size; }
+    virtual void flush () const;
+
+    FILE *handle () const { return m_file; }
+
+private:
+    FILE *m_file;
+    int64_t m_size;
+    bool m_auto_close;
+};
+
+
+
+/// IOProxy that writes into a vector that grows as needed, either one
+/// the caller provides or one of its own.
+class DLLPUBLIC IOVecOutput : public IOProxy {
+public:
+    IOVecOutput () : IOProxy ("", Write), m_buf(m_local_buf) { }
+    IOVecOutput (std::vector<unsigned char> &buf)
+        : IOProxy ("", Write), m_buf(buf) { }
+    virtual const char *proxytype () const { return "vecoutput"; }
+    virtual size_t read (void *buf, size_t size);
+    virtual size_t write (const void *buf, size_t size);
+    virtual int64_t size () const { return (int64_t) m_buf.size(); }
+    virtual const void *memory () const {
+        return m_buf.empty() ? NULL : &m_buf[0];
+    }
+
+    /// The bytes written so far.
+    std::vector<unsigned char> &buffer () const { return m_buf; }
+
+private:
+    std::vector<unsigned char> &m_buf;
+    std::vector<unsigned char> m_local_buf;
+
+    // Disallow copy construction and assignment -- a copy of one that
+    // uses m_local_buf would still write into the original's.
+    IOVecOutput (const IOVecOutput &);
+    const IOVecOutput & operator= (const IOVecOutput &);
+};
+
+
+
+/// IOProxy that reads from a block of memory that the caller owns and
+/// keeps valid while it's in use.  Nothing is copied.
+class DLLPUBLIC IOMemReader : public IOProxy {
+public:
+    IOMemReader (const void *buf, size_t size)
+        : IOProxy ("", Read), m_buf((const unsigned char *)buf),
+          m_size(size) { }
+    virtual const char *proxytype () const { return "memreader"; }
+    virtual bool seek (int64_t offset) {
+        if (offset < 0)
+            return false;
+        m_pos = offset;
+        return true;
+    }
+    virtual size_t read (void *buf, size_t size);
+    virtual int64_t size () const { return (int64_t) m_size; }
+    virtual const void *memory () const { return m_buf; }
+
+private:
+    const unsigned char *m_buf;
+    size_t m_size;
+};
+
+
+
+/// IOProxy that reads a file by mapping it into memory, so that readers
+/// that know about memory() can use its contents in place.
+class DLLPUBLIC IOMappedFile : public IOProxy {
+public:
+    /// Map the named file; check opened() to see if it worked.
+    IOMappedFile (const std::string &filename);
+    virtual ~IOMappedFile ();
+    virtual const char *proxytype () const { return "mmap"; }
+    virtual void close ();
+    virtual bool seek (int64_t offset) {
+        if (offset < 0)
+            return false;
+        m_pos = offset;
+        return true;
+    }
+    virtual size_t read (void *buf, size_t size);
+    virtual int64_t size () const { return (int64_t) m_size; }
+    virtual const void *memory () const { return m_data; }
+
+private:
+    const unsigned char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_mapping;                ///< Handle of the file mapping
+#endif
+};
+
+
+
+/// Reader for image plugins that parse a file a few bytes at a time.
+/// It reads from a file or another IOProxy in large, block-aligned
+/// chunks, and then hands out the bytes from its own buffer without
+/// any further I/O calls or allocation; if the proxy's contents are all
+/// in memory (memory() != NULL), it doesn't buffer at all and hands out
+/// pointers straight into them.  Seeking is free until the next read.
+/// It is itself an IOProxy, so it may be passed to anything that reads
+/// from one.
+class DLLPUBLIC BufferedReader : public IOProxy {
+public:
+    /// Construct a reader that reads blocksize bytes at a time (rounded
+    /// up to a multiple of the 4k alignment of its reads).
+    BufferedReader (size_t blocksize = 65536);
+    virtual ~BufferedReader ();
+
+    /// Open the named file, mapping it into memory if use_mmap is true
+    /// (and the mapping succeeds), and otherwise reading it with stdio.
+    bool open (const std::string &filename, bool use_mmap = false);
+    /// Read from the given proxy, which the caller still owns and must
+    /// keep open until we're closed.  If the proxy doesn't know its
+    /// size (size() returns 0), it is read right away until a read
+    /// comes up short, and its contents are served from memory.
+    bool open (IOProxy *io);
+
+    virtual const char *proxytype () const { return "buffered"; }
+    virtual void close ();
+    virtual bool seek (int64_t offset) {
+        if (offset < 0)
+            return false;
+        m_pos = offset;
+        return true;
+    }
+    virtual size_t read (void *buf, size_t size) {
+        int64_t offset = m_pos - m_bufstart;
+        if (m_mem || offset < 0 || (size_t)offset + size > m_buflen)
+            return read_uncached (buf, size);
+        memcpy (buf, &m_buf[offset], size);
+        m_pos += size;
+        return size;
+    }
+    virtual int64_t size () const { return m_size; }
+    virtual const void *memory () const { return m_mem; }
+
+    /// Skip over n bytes.
+    bool skip (int64_t n) { return seek (m_pos + n); }
+
+    /// Return a pointer to the next n bytes and advance past them, or
+    /// NULL (without advancing) if fewer than n bytes remain.  The
+    /// pointer is only good until the next call that reads or seeks.
+    const unsigned char *next (size_t n) {
+        if (m_mem) {
+            if (m_pos + (int64_t)n > (int64_t)m_size)
+                return NULL;
+            const unsigned char *p = m_mem + m_pos;
+            m_pos += n;
+            return p;
+        }
+        int64_t offset = m_pos - m_bufstart;
+        if (offset < 0 || (size_t)offset + n > m_buflen) {
+            if (! fill (n))
+                return NULL;
+            offset = m_pos - m_bufstart;
+        }
+        m_pos += n;
+        return &m_buf[offset];
+    }
+
+    /// Read one byte, or return -1 at the end of the file.
+    int getc () {
+        const unsigned char *p = next (1);
+        return p ? *p : -1;
+    }
+
+    /// Read the next line, up to and including the newline (which is
+    /// removed).  Return false if we were already at the end.
+    bool getline (std::string &line);
+
+    /// Read n little-endian values into vals, converting them to the
+    /// native byte order.  Return false if there weren't n of them.
+    template<class T> bool read_le (T *vals, size_t n = 1) {
+        if (read (vals, n * sizeof(T)) != n * sizeof(T))
+            return false;
+        if (bigendian())
+            swap_endian (vals, (int)n);
+        return true;
+    }
+
+    /// Read n big-endian values into vals, converting them to the
+    /// native byte order.  Return false if there weren't n of them.
+    template<class T> bool read_be (T *vals, size_t n = 1) {
+        if (read (vals, n * sizeof(T)) != n * sizeof(T))
+            return false;
+        if (littleendian())
+            swap_endian (vals, (int)n);
+        return true;
+    }
+
+private:
+    IOProxy *m_io;                   ///< Where the bytes come from
+    bool m_own_io;                   ///< Did we create m_io?
+    const unsigned char *m_mem;      ///< m_io->memory(), if any (or
+                                     ///<   m_buf, if we read it all)
+    int64_t m_size;                  ///< Size of the whole file
+    std::vector<unsigned char> m_buf;  ///< Buffered bytes...
+    int64_t m_bufstart;              ///< ...starting at this offset
+    size_t m_buflen;                 ///< How many of m_buf are valid
+    size_t m_blocksize;              ///< How much to read at a time
+
+    // Make the n bytes at m_pos be in the buffer; return false if the
+    // file ends first.
+    bool fill (size_t n);
+    // The rest of read(), for bytes that aren't already buffered.
+    size_t read_uncached (void *buf, size_t size);
+};
+
+
 };  // namespace Filesystem
 
 #ifdef OPENIMAGEIO_NAMESPACE
@@ -37,6 +37,8 @@
 #ifndef OPENIMAGEIO_IMAGEBUF_H
 #define OPENIMAGEIO_IMAGEBUF_H
 
+#include <boost/function.hpp>
+
 #include "imageio.h"
 #include "fmath.h"
 #include "imagecache.h"
@@ -242,6 +244,11 @@ public:
     ///
     void transfer_pixels (ColorTransfer *tfunc);
 
+    /// Apply a color transfer function (in place) to just the pixels
+    /// in the region [xbegin..xend) X [ybegin..yend).
+    void transfer_pixels (ColorTransfer *tfunc,
+                          int xbegin, int xend, int ybegin, int yend);
+
     int orientation () const { return m_orientation; }
 
     int oriented_width () const;
@@ -320,6 +327,18 @@ public:
     ///   }
     /// \endcode
     ///
+    /// Loops that know BUFT may go a whole contiguous run of pixels at
+    /// a time, which is much cheaper than a pixel at a time:
+    /// \code
+    ///   int n;
+    ///   for (  ;  pixel.valid();  pixel.advance (n)) {
+    ///       n = pixel.span();
+    ///       float *p = (float *) pixel.rawptr();
+    ///       for (int i = 0;  i < n*img.nchannels();  ++i)
+    ///           p[i] = ...;
+    ///   }
+    /// \endcode
+    ///
     template<typename BUFT, typename USERT=float>
     class Iterator {
     public:
@@ -357,31 +376,55 @@ public:
         /// Explicitly point the iterator.  This results in an invalid
         /// iterator if outside the previously-designated region.
         void pos (int x, int y) {
-            if (! valid(x,y))
+            if (! valid(x,y)) {
                 m_proxy.set (NULL);
-            else if (m_ib->localpixels())
+                m_span_end = x;
+            } else if (m_ib->localpixels()) {
                 m_proxy.set ((BUFT *)m_ib->pixeladdr (x, y));
-            else
+                m_span_end = m_xend;
+                m_pixel_bytes = m_ib->spec().pixel_bytes();
+            } else {
                 m_proxy.set ((BUFT *)m_ib->retile (m_ib->subimage(), x, y,
                                          m_tile, m_tilexbegin, m_tileybegin));
+                m_span_end = std::min (m_xend, m_tilexbegin +
+                                               m_ib->spec().tile_width);
+                m_pixel_bytes = m_ib->spec().pixel_bytes();
+            }
             m_x = x;  m_y = y;
         }
 
         /// Increment to the next pixel in the region.
         ///
-        void operator++ () {
-            if (++m_x >= m_xend) {
-                m_x = m_xbegin;
-                ++m_y;
-            }
-            pos (m_x, m_y);
-            // FIXME -- we could do the traversal in an even more coherent
-            // pattern, and this may help when we're backed by ImageCache.
-        }
+        void operator++ () { advance (1); }
         /// Increment to the next pixel in the region.
         ///
         void operator++ (int) {
-            (*this)++;
+            ++(*this);
+        }
+
+        /// Return the number of pixels, starting with the current one,
+        /// that lie in the region on this scanline and are contiguous
+        /// in memory -- the rest of the scanline for a local buffer, or
+        /// of the tile row for an ImageCache-backed one (0 if the
+        /// iterator is not valid).  Their data may be accessed directly
+        /// starting at rawptr(), nchannels() values of BUFT per pixel.
+        int span () const { return m_span_end - m_x; }
+
+        /// Move ahead n pixels, where n <= span().  Moving within the
+        /// span is just a pointer increment; only when it reaches the
+        /// end of the span does the iterator find the next one.
+        void advance (int n) {
+            m_x += n;
+            if (m_x < m_span_end) {
+                m_proxy.set ((BUFT *)((char *)m_proxy.get() +
+                                      n * m_pixel_bytes));
+            } else {
+                if (m_x >= m_xend) {
+                    m_x = m_xbegin;
+                    ++m_y;
+                }
+                pos (m_x, m_y);
+            }
         }
 
         /// Assign one Iterator to another
@@ -442,6 +485,8 @@ public:
         DataArrayProxy<BUFT,USERT> m_proxy;
         ImageCache::Tile *m_tile;
         int m_tilexbegin, m_tileybegin;
+        int m_span_end;         ///< One past the last x of this span
+        int m_pixel_bytes;      ///< Bytes between adjacent pixels
     };
 
 
@@ -486,33 +531,57 @@ public:
         /// Explicitly point the iterator.  This results in an invalid
         /// iterator if outside the previously-designated region.
         void pos (int x, int y) {
-            if (! valid(x,y))
+            if (! valid(x,y)) {
                 m_proxy.set (NULL);
-            else if (m_ib->localpixels())
+                m_span_end = x;
+            } else if (m_ib->localpixels()) {
                 m_proxy.set ((BUFT *)m_ib->pixeladdr (x, y));
-            else
+                m_span_end = m_xend;
+                m_pixel_bytes = m_ib->spec().pixel_bytes();
+            } else {
                 m_proxy.set ((BUFT *)m_ib->retile (m_ib->subimage(), x, y,
                                          m_tile, m_tilexbegin, m_tileybegin));
+                m_span_end = std::min (m_xend, m_tilexbegin +
+                                               m_ib->spec().tile_width);
+                m_pixel_bytes = m_ib->spec().pixel_bytes();
+            }
             m_x = x;  m_y = y;
         }
 
         /// Increment to the next pixel in the region.
         ///
-        void operator++ () {
-            if (++m_x >= m_xend) {
-                m_x = m_xbegin;
-                ++m_y;
-            }
-            pos (m_x, m_y);
-            // FIXME -- we could do the traversal in an even more coherent
-            // pattern, and this may help when we're backed by ImageCache.
-        }
+        void operator++ () { advance (1); }
         /// Increment to the next pixel in the region.
         ///
         void operator++ (int) {
             ++(*this);
         }
 
+        /// Return the number of pixels, starting with the current one,
+        /// that lie in the region on this scanline and are contiguous
+        /// in memory -- the rest of the scanline for a local buffer, or
+        /// of the tile row for an ImageCache-backed one (0 if the
+        /// iterator is not valid).  Their data may be accessed directly
+        /// starting at rawptr(), nchannels() values of BUFT per pixel.
+        int span () const { return m_span_end - m_x; }
+
+        /// Move ahead n pixels, where n <= span().  Moving within the
+        /// span is just a pointer increment; only when it reaches the
+        /// end of the span does the iterator find the next one.
+        void advance (int n) {
+            m_x += n;
+            if (m_x < m_span_end) {
+                m_proxy.set ((const BUFT *)((const char *)m_proxy.get() +
+                                            n * m_pixel_bytes));
+            } else {
+                if (m_x >= m_xend) {
+                    m_x = m_xbegin;
+                    ++m_y;
+                }
+                pos (m_x, m_y);
+            }
+        }
+
         /// Assign one ConstIterator to another
         ///
         const ConstIterator & operator= (const ConstIterator &i) {
@@ -566,6 +635,8 @@ public:
         ConstDataArrayProxy<BUFT,USERT> m_proxy;
         ImageCache::Tile *m_tile;
         int m_tilexbegin, m_tileybegin;
+        int m_span_end;         ///< One past the last x of this span
+        int m_pixel_bytes;      ///< Bytes between adjacent pixels
     };
 
 
@@ -607,13 +678,43 @@ protected:
 
 namespace ImageBufAlgo {
 
+/// Set the number of threads that ImageBufAlgo operations will use when
+/// their nthreads parameter is 0.  The initial default of 0 means to
+/// use as many threads as there are hardware cores.
+void DLLPUBLIC set_default_threads (int nthreads);
+
+/// Return the number of threads that ImageBufAlgo operations will use
+/// by default, as set by set_default_threads() (0 means one per core).
+int DLLPUBLIC default_threads ();
+
+/// Signature of a function that processes the pixels in the region
+/// [xbegin..xend) X [ybegin..yend).
+typedef boost::function<void(int xbegin, int xend, int ybegin, int yend)>
+        RegionFunc;
+
+/// Call func on disjoint bands of scanlines that together exactly cover
+/// [xbegin..xend) X [ybegin..yend), running as many as nthreads of them
+/// at once (0 means the default_threads()).  Band boundaries fall at
+/// multiples of yalign scanlines from ybegin, so passing the tile
+/// height of a tiled image keeps any two bands from sharing a tile.
+/// Regions too small to be worth splitting are done entirely by the
+/// calling thread.  The threads come from the process-wide
+/// thread_pool::default_pool() (see thread.h), so there is no thread
+/// creation cost per call.  func must be safe to call concurrently on
+/// disjoint regions.
+void DLLPUBLIC parallel_image (const RegionFunc &func,
+                               int xbegin, int xend, int ybegin, int yend,
+                               int nthreads=0, int yalign=1);
+
 /// Add the pixels of two images A and B, putting the sum in dst.
 /// The 'options' flag controls behaviors, particular of what happens
 /// when A, B, and dst have differing data windows.  Note that dst must
 /// not be the same image as A or B, and all three images must have the
 /// same number of channels.  A and B *must* be float images.
+/// The work is split among nthreads threads (0 means the default).
 
-bool DLLPUBLIC add (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B, int options=0);
+bool DLLPUBLIC add (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
+                    int options=0, int nthreads=0);
 
 /// Enum describing options to be passed to ImageBufAlgo::add.
 /// Multiple options are allowed simultaneously by "or'ing" together.
@@ -633,9 +734,11 @@ enum DLLPUBLIC AddOptions
 /// begin but not including the end pixel (just like STL ranges).  The
 /// cropping can be done one of several ways, specified by the options
 /// parameter, one of: CROP_CUT, CROP_WINDOW, CROP_BLACK, CROP_WHITE,
-/// CROP_TRANS.
+/// CROP_TRANS.  The work is split among nthreads threads (0 means the
+/// default).
 bool DLLPUBLIC crop (ImageBuf &dst, const ImageBuf &src,
-           int xbegin, int xend, int ybegin, int yend, int options);
+           int xbegin, int xend, int ybegin, int yend, int options,
+           int nthreads=0);
 
 enum DLLPUBLIC CropOptions 
 {
@@ -648,10 +751,29 @@ enum DLLPUBLIC CropOptions
 
 
 
-/// Apply a transfer function to the pixel values.
-///
+/// Apply a transfer function to the pixel values.  The work is split
+/// among nthreads threads (0 means the default).
 bool DLLPUBLIC colortransfer (ImageBuf &dst, const ImageBuf &src,
-                              ColorTransfer *tfunc);
+                              ColorTransfer *tfunc, int nthreads=0);
+
+
+/// Resample src to fill the data window of dst, which must already be
+/// allocated (its resolution is the size to resize to) and have the
+/// same number of channels as src.  The data window of src is stretched
+/// to exactly cover that of dst, so any scale factor works, including
+/// different ones in x and y.  The filtername is any known to
+/// Filter1D::create ("box", "triangle", "gaussian", "catmull-rom",
+/// "blackman-harris", "sinc", "mitchell", "b-spline"; the default is
+/// "triangle"), and filterwidth is its full width, measured in dst
+/// pixels when shrinking and in src pixels when enlarging (0 means a
+/// sensible width for that filter).  The image is filtered separably,
+/// in x and then in y, with the filter weights computed once per row
+/// and column.  The work is split among nthreads threads (0 means the
+/// default).  Return true upon success, false if the filter name is not
+/// recognized or the images are not compatible.
+bool DLLPUBLIC resize (ImageBuf &dst, const ImageBuf &src,
+                       const std::string &filtername = std::string(),
+                       float filterwidth = 0.0f, int nthreads = 0);
 
 };  // end namespace ImageBufAlgo
 
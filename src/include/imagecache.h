@@ -92,8 +92,12 @@ public:
     ///     int accept_untiled : if nonzero, accept untiled images, but
     ///                          if zero, reject untiled images (default=1)
     ///     int statistics:level : verbosity of statistics auto-printed.
-    ///     int forcefloat : if nonzero, convert all to float.
+    ///     int forcefloat : if nonzero, convert all to float (otherwise,
+    ///                      uint8, uint16 and half are cached natively).
     ///     int failure_retries : number of times to retry a read before fail.
+    ///     int max_tile_channels : tiles of images with more channels than
+    ///                          this hold only the channels a lookup
+    ///                          asks for (default=4; 0 = always all).
     ///
     virtual bool attribute (const std::string &name, TypeDesc type,
                             const void *val) = 0;
@@ -166,6 +170,29 @@ public:
                              int zbegin, int zend,
                              TypeDesc format, void *result) = 0;
 
+    /// Retrieve a scattered set of npoints individual pixels, the i-th
+    /// of which is at integer pixel coordinates (x[i],y[i]) of
+    /// subimage[i] (or of subimage 0 for all points, if subimage is
+    /// NULL).  Only channels [chbegin..chend) are retrieved, and the
+    /// values are converted to the type specified by format and stored
+    /// contiguously, point after point, beginning at result, which
+    /// must have room for npoints*(chend-chbegin) values.  Requested
+    /// pixels outside the valid pixel data region (or of nonexistant
+    /// subimages) will be filled in with 0 values.
+    ///
+    /// This is much cheaper than calling get_pixels() for each point
+    /// with a 1x1 region: the file is found only once, and the points
+    /// are visited in tile order so each distinct tile is found only
+    /// once per call.
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, otherwise return false.
+    virtual bool get_pixels_gather (ustring filename, int npoints,
+                                    const int *x, const int *y,
+                                    const int *subimage,
+                                    int chbegin, int chend,
+                                    TypeDesc format, void *result) = 0;
+
     /// Define an opaque data type that allows us to have a pointer
     /// to a tile but without exposing any internals.
     class Tile;
@@ -59,6 +59,8 @@
 namespace OPENIMAGEIO_NAMESPACE {
 #endif
 
+namespace Filesystem { class IOProxy; }   // see filesystem.h
+
 /// @namespace OpenImageIO
 /// @brief Main namespace enclosing most OpenImageIO functionality.
 namespace OpenImageIO {
@@ -96,7 +98,9 @@ namespace OpenImageIO {
 /// routines.
 /// Version 10 represents forking from NVIDIA's open source version,
 /// with which we break backwards compatibility.
-#define OPENIMAGEIO_PLUGIN_VERSION 10
+/// Version 11 added ImageInput's scratch buffer and the new native and
+/// channel-subset read entry points, changing its layout and vtable.
+#define OPENIMAGEIO_PLUGIN_VERSION 11
 
 /// Strictly for back-compatibility -- this is deprecated
 ///
@@ -389,13 +393,24 @@ public:
     /// Create and return an ImageInput implementation that is willing
     /// to read the given file.  The plugin_searchpath parameter is a
     /// colon-separated list of directories to search for ImageIO plugin
-    /// DSO/DLL's (not a searchpath for the image itself!).  This will
-    /// actually just try every imageio plugin it can locate, until it
-    /// finds one that's able to open the file without error.  This just
-    /// creates the ImageInput, it does not open the file.
+    /// DSO/DLL's (not a searchpath for the image itself!).  The plugin
+    /// for the file's extension is used without even reading the file;
+    /// if there is none, the plugin is picked by the start of the file
+    /// as in create_by_contents().  This just creates the ImageInput,
+    /// it does not open the file.
     static ImageInput *create (const std::string &filename,
                                const std::string &plugin_searchpath="");
 
+    /// Create and return an ImageInput implementation for the given
+    /// file, chosen by reading the start of the file (and, failing
+    /// that, trying every plugin that can't tell from it) rather than
+    /// by its extension.  If the ImageInput that create() returned
+    /// fails to open the file, this finds the right one for a file
+    /// whose extension is wrong.  Returns NULL if no plugin will read
+    /// the file.
+    static ImageInput *create_by_contents (const std::string &filename,
+                                     const std::string &plugin_searchpath="");
+
     ImageInput () { }
     virtual ~ImageInput () { }
 
@@ -415,9 +430,26 @@ public:
     /// instructions.  ImageInput implementations are free to not
     /// respond to any such requests, so the default implementation is
     /// just to ignore config and call regular open(name,newspec).
+    /// Generally recognized requests:
+    ///     int reduced_subimages : if nonzero, a reader that can decode
+    ///            the image at reduced resolution for much less work
+    ///            than a full decode (e.g. JPEG) may present those
+    ///            decodes as extra subimages, coarsest last, each with
+    ///            an int "reduction" attribute giving its scale factor
+    ///            and each half the size of the one before, rounded
+    ///            down (as MIP levels are).
     virtual bool open (const std::string &name, ImageSpec &newspec,
                        const ImageSpec &config) { return open(name,newspec); }
 
+    /// Read the image through the given IOProxy (for example, straight
+    /// from a memory buffer with Filesystem::IOMemReader) instead of
+    /// opening the named file.  Call it before open(); the name passed
+    /// to open() is then only used in messages, and the proxy stays in
+    /// use until set_ioproxy(NULL).  The caller owns the proxy and must
+    /// keep it alive while it's in use.  Return false if this format
+    /// can't read through a proxy.
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) { return false; }
+
     /// Return a reference to the image format specification of the
     /// current subimage.  Note that the contents of the spec are
     /// invalid before open() or after close().
@@ -470,6 +502,20 @@ public:
         return read_scanline (y, z, TypeDesc::FLOAT, data);
     }
 
+    /// Read multiple scanlines that include pixels (*,y,z) for all
+    /// ybegin <= y < yend, into data, using the strides given and
+    /// converting to the requested data format (z==0 for non-volume
+    /// images).  This is analogous to read_scanline except that it may
+    /// be used to read more than one scanline at a time, which can be
+    /// much more efficient for formats whose codecs decode scanlines in
+    /// blocks.  Strides set to AutoStride imply 'contiguous' data, i.e.,
+    ///     xstride == spec.nchannels*format.size()
+    ///     ystride == xstride*spec.width
+    virtual bool read_scanlines (int ybegin, int yend, int z,
+                                 TypeDesc format, void *data,
+                                 stride_t xstride=AutoStride,
+                                 stride_t ystride=AutoStride);
+
     /// Read the tile that includes pixels (*,y,z) into data, converting
     /// if necessary from the native data format of the file into the
     /// 'format' specified.  (z==0 for non-volume images.)  The stride
@@ -497,6 +543,30 @@ public:
                           AutoStride, AutoStride, AutoStride);
     }
 
+    /// Read only channels [chbegin,chend) of the scanlines ybegin <= y
+    /// < yend, converting to the requested data format.  This is just
+    /// like read_scanlines, except that the pixels placed in data have
+    /// only chend-chbegin channels, so AutoStride implies
+    ///     xstride == (chend-chbegin)*format.size()
+    /// Plugins for formats that store channels separately may read just
+    /// the channels asked for, saving the work of decoding the others.
+    virtual bool read_scanlines (int ybegin, int yend, int z,
+                                 int chbegin, int chend,
+                                 TypeDesc format, void *data,
+                                 stride_t xstride=AutoStride,
+                                 stride_t ystride=AutoStride);
+
+    /// Read only channels [chbegin,chend) of the tile that includes
+    /// pixels (*,y,z), converting to the requested data format.  This is
+    /// just like read_tile, except that the pixels placed in data have
+    /// only chend-chbegin channels, so AutoStride implies
+    ///     xstride == (chend-chbegin)*format.size()
+    virtual bool read_tile (int x, int y, int z, int chbegin, int chend,
+                            TypeDesc format, void *data,
+                            stride_t xstride=AutoStride,
+                            stride_t ystride=AutoStride,
+                            stride_t zstride=AutoStride);
+
     /// Read the entire image of spec.width x spec.height x spec.depth
     /// pixels into data (which must already be sized large enough for
     /// the entire image) with the given strides and in the desired
@@ -539,6 +609,40 @@ public:
         return false;
     }
 
+    /// read_native_scanlines is just like read_native_scanline, except
+    /// that it reads the range of scanlines ybegin <= y < yend into
+    /// contiguous memory, one scanline after another.  The base class
+    /// implementation simply calls read_native_scanline for each line;
+    /// format plugins whose codecs can decode many scanlines at once
+    /// should override it.
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+
+    /// read_native_tiles is just like read_native_tile, except that it
+    /// reads all the tiles covering pixels xbegin <= x < xend, ybegin
+    /// <= y < yend, zbegin <= z < zend into contiguous memory, laid out
+    /// as a single block of (xend-xbegin)*(yend-ybegin)*(zend-zbegin)
+    /// pixels (not tile by tile).  The begin values must be on tile
+    /// boundaries, and each end value must either be on a tile boundary
+    /// or at the edge of the image.  The base class implementation
+    /// reads the tiles one at a time with read_native_tile and copies
+    /// them into place; format plugins whose codecs can decode many
+    /// tiles at once should override it.
+    virtual bool read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                    int zbegin, int zend, void *data);
+
+    /// read_native_scanlines and read_native_tile with a channel range
+    /// are just like their counterparts above, except that they read
+    /// only channels chbegin <= c < chend, into contiguous memory of
+    /// chend-chbegin channels per pixel.  The base class implementations
+    /// read all the channels and copy out the ones asked for; format
+    /// plugins that store channels separately (and so can decode fewer
+    /// of them for less work) should override them.
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        int chbegin, int chend, void *data);
+    virtual bool read_native_tile (int x, int y, int z,
+                                   int chbegin, int chend, void *data);
+
     /// General message passing between client and image input server
     ///
     virtual int send_to_input (const char *format, ...);
@@ -567,6 +671,10 @@ protected:
 
 private:
     mutable std::string m_errmessage;  ///< private storage of error massage
+    std::vector<unsigned char> m_scratch; ///< reused for native pixels
+    std::vector<unsigned char> m_native_scratch; ///< reused by the native
+                                  ///< read fallbacks, which may be handed
+                                  ///< m_scratch as their destination
 };
 
 
@@ -614,6 +722,8 @@ public:
     ///    "empty"          Does this plugin support passing a NULL data
     ///                       pointer to write_scanline or write_tile to
     ///                       indicate that the entire data block is zero?
+    ///    "ioproxy"        Can this plugin write through an IOProxy set
+    ///                       with set_ioproxy()?
     ///
     /// Note that the earlier incarnation of ImageIO that shipped with
     /// NVIDIA's Gelato 2.x had individual supports_foo functions.  When
@@ -633,6 +743,14 @@ public:
     virtual bool open (const std::string &name, const ImageSpec &newspec,
                        bool append=false) = 0;
 
+    /// Write the image through the given IOProxy (for example, into a
+    /// growable memory buffer with Filesystem::IOVecOutput) instead of
+    /// creating the named file.  Call it before open(); the proxy stays
+    /// in use until set_ioproxy(NULL).  The caller owns the proxy and
+    /// must keep it alive while it's in use.  Return false if this
+    /// format can't write through a proxy (see supports("ioproxy")).
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) { return false; }
+
     /// Return a reference to the image format specification of the
     /// current subimage.  Note that the contents of the spec are
     /// invalid before open() or after close().
@@ -657,6 +775,22 @@ public:
                                  const void *data, stride_t xstride=AutoStride)
         { return false; }
 
+    /// Write multiple scanlines that include pixels (*,y,z) for all
+    /// ybegin <= y < yend.  This is analogous to write_scanline except
+    /// that it may be used to write more than one scanline at a time,
+    /// which lets plugins whose codecs work on blocks of scanlines
+    /// (such as compressed strips) encode them together, and perhaps in
+    /// parallel.  Strides set to AutoStride imply 'contiguous' data,
+    /// i.e.,
+    ///     xstride == spec.nchannels*format.size()
+    ///     ystride == xstride*spec.width
+    /// The base class implementation simply calls write_scanline for
+    /// each scanline.
+    virtual bool write_scanlines (int ybegin, int yend, int z,
+                                  TypeDesc format, const void *data,
+                                  stride_t xstride=AutoStride,
+                                  stride_t ystride=AutoStride);
+
     /// Write the tile with (x,y,z) as the upper left corner.  (z is
     /// ignored for 2D non-volume images.)  The three stride values give
     /// the distance (in bytes) between successive pixels, scanlines,
@@ -676,6 +810,24 @@ public:
                              stride_t zstride=AutoStride)
         { return false; }
 
+    /// Write all the tiles covering pixels xbegin <= x < xend, ybegin
+    /// <= y < yend, zbegin <= z < zend, which are laid out in data as a
+    /// single block (not tile by tile).  The begin values must be on
+    /// tile boundaries, and each end value must either be on a tile
+    /// boundary or at the edge of the image.  This lets plugins encode
+    /// many tiles together, and perhaps in parallel.  Strides set to
+    /// AutoStride imply 'contiguous' data, i.e.,
+    ///     xstride == spec.nchannels*format.size()
+    ///     ystride == xstride * (xend-xbegin)
+    ///     zstride == ystride * (yend-ybegin)
+    /// The base class implementation simply calls write_tile for each
+    /// tile, padding the tiles that extend past the region.
+    virtual bool write_tiles (int xbegin, int xend, int ybegin, int yend,
+                              int zbegin, int zend, TypeDesc format,
+                              const void *data, stride_t xstride=AutoStride,
+                              stride_t ystride=AutoStride,
+                              stride_t zstride=AutoStride);
+
     /// Write pixels whose x coords range over xmin..xmax (inclusive), y
     /// coords over ymin..ymax, and z coords over zmin...zmax.  The
     /// three stride values give the distance (in bytes) between
@@ -806,6 +958,49 @@ DLLPUBLIC std::string geterror ();
 ///
 inline std::string error_message () { return OpenImageIO::geterror (); }
 
+/// Set a global attribute controlling OpenImageIO.  Return true
+/// if the name and type were recognized and the attribute was set.
+/// Documented attributes:
+///     int exr_threads : number of threads OpenEXR uses to compress and
+///                       decompress (0 = no threading, the default;
+///                       -1 = one per core).  An individual file may
+///                       ask for fewer with the "openexr:threads"
+///                       attribute in its open() spec or config.
+DLLPUBLIC bool attribute (const std::string &name, TypeDesc type,
+                          const void *val);
+// Shortcuts for common types
+inline bool attribute (const std::string &name, int val) {
+    return attribute (name, TypeDesc::INT, &val);
+}
+inline bool attribute (const std::string &name, float val) {
+    return attribute (name, TypeDesc::FLOAT, &val);
+}
+inline bool attribute (const std::string &name, const char *val) {
+    return attribute (name, TypeDesc::STRING, &val);
+}
+inline bool attribute (const std::string &name, const std::string &val) {
+    return attribute (name, val.c_str());
+}
+
+/// Get the named global attribute, store it in value.  Return true if
+/// the name and type were recognized.
+DLLPUBLIC bool getattribute (const std::string &name, TypeDesc type,
+                             void *val);
+// Shortcuts for common types
+inline bool getattribute (const std::string &name, int &val) {
+    return getattribute (name, TypeDesc::INT, &val);
+}
+inline bool getattribute (const std::string &name, float &val) {
+    return getattribute (name, TypeDesc::FLOAT, &val);
+}
+
+/// Rescan for plugins in plugin_searchpath (and IMAGEIO_LIBRARY_PATH),
+/// for example after new ones have been installed.  Otherwise, each
+/// search path is only scanned the first time ImageInput::create or
+/// ImageOutput::create is asked for a format it doesn't know, and the
+/// catalog of plugins is not searched again after that.
+DLLPUBLIC void refresh_plugins (const std::string &plugin_searchpath="");
+
 /// Helper routine: quantize a value to an integer given the
 /// quantization parameters.
 DLLPUBLIC int quantize (float value, int quant_black, int quant_white,
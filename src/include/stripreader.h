@@ -0,0 +1,179 @@
+/*
+  Copyright 2010 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+  Based on BSD-licensed software Copyright 2004 NVIDIA Corp.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#ifndef OPENIMAGEIO_STRIPREADER_H
+#define OPENIMAGEIO_STRIPREADER_H
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#ifdef OPENIMAGEIO_NAMESPACE
+namespace OPENIMAGEIO_NAMESPACE {
+#endif
+
+namespace OpenImageIO {
+
+
+/// StripReader serves scanline reads for formats whose decoder can only
+/// produce rows in order from the top of the image (JPEG, non-interlaced
+/// PNG).  It keeps the most recently decoded strip of rows, so that
+/// reading rows again soon after handing them out (as ImageCache does
+/// when it autotiles) is a copy rather than a decode from the top of
+/// the file, and it decodes long runs straight into the caller's memory.
+///
+/// A reader derives from it to supply decode() and restart(), and calls
+/// start() each time its decoder is positioned at the first row.
+class StripReader {
+public:
+    StripReader () { start (0, 0); }
+    virtual ~StripReader () { }
+
+    /// Note that the decoder is at the first row of an image height
+    /// rows tall, each rowbytes long as decoded.
+    void start (int height, size_t rowbytes) {
+        m_height = height;
+        m_rowbytes = rowbytes;
+        m_next_scanline = 0;
+        m_strip_begin = 0;
+    }
+
+    /// Which row will the decoder produce next?
+    int next_scanline () const { return m_next_scanline; }
+
+    /// Length of each row as decoded.
+    size_t rowbytes () const { return m_rowbytes; }
+
+    /// Copy rows [ybegin,yend) to data, scanline_bytes apart, decoding
+    /// whatever isn't in the strip.  If scanline_bytes is less than
+    /// rowbytes(), only the start of each row is copied.
+    bool read (int ybegin, int yend, size_t scanline_bytes,
+               unsigned char *data);
+
+protected:
+    /// Decode the next n rows into data, rowbytes() apart.
+    virtual bool decode (int n, unsigned char *data) = 0;
+
+    /// Position the decoder back at the first row, calling start().
+    virtual bool restart () = 0;
+
+private:
+    enum { strip_rows = 64 };   ///< Rows decoded (and kept) at a time
+    int m_height;
+    size_t m_rowbytes;
+    int m_next_scanline;        ///< Which row will be decoded next
+    std::vector<unsigned char> m_strip;  ///< The most recently decoded rows
+    int m_strip_begin;          ///< First row in m_strip (m_next_scanline
+                                ///<   is one past its last)
+
+    bool decode_rows (int n, unsigned char *data) {
+        if (! decode (n, data))
+            return false;
+        m_next_scanline += n;
+        return true;
+    }
+
+    // Make sure row y is in m_strip, decoding the strip of rows that
+    // holds it if necessary, and starting over from the top of the
+    // image only if y precedes the rows already in the strip.
+    bool decode_to (int y);
+};
+
+
+
+inline bool
+StripReader::decode_to (int y)
+{
+    if (y < m_strip_begin) {
+        // User is trying to read an earlier scanline than the ones we
+        // still have.  Easy fix: start decoding again from the top.
+        if (! restart ())
+            return false;
+    }
+    m_strip.resize (strip_rows * m_rowbytes);
+    while (m_next_scanline <= y) {
+        // Keep decoding strips until we have the scanline we really need
+        m_strip_begin = m_next_scanline;
+        if (! decode_rows (std::min ((int)strip_rows, m_height - m_next_scanline),
+                           &m_strip[0]))
+            return false;
+    }
+    return true;
+}
+
+
+
+inline bool
+StripReader::read (int ybegin, int yend, size_t scanline_bytes,
+                   unsigned char *data)
+{
+    for (int y = ybegin;  y < yend;  ) {
+        if (y == m_next_scanline && yend - y > strip_rows
+                && scanline_bytes == m_rowbytes) {
+            // A long run of rows we haven't decoded yet goes straight
+            // into the caller's memory, and we keep a copy of the last
+            // strip's worth of them in case they're asked for again.
+            if (! decode_rows (yend - y, data + (y-ybegin) * scanline_bytes))
+                return false;
+            m_strip.resize (strip_rows * m_rowbytes);
+            m_strip_begin = yend - strip_rows;
+            memcpy (&m_strip[0], data + (m_strip_begin-ybegin) * scanline_bytes,
+                    strip_rows * m_rowbytes);
+            return true;
+        }
+        if (! decode_to (y))
+            return false;
+        // Copy out as many of the rows we need as the strip holds
+        int n = std::min (yend, m_next_scanline) - y;
+        if (scanline_bytes == m_rowbytes)
+            memcpy (data + (y-ybegin) * scanline_bytes,
+                    &m_strip[(y-m_strip_begin) * m_rowbytes],
+                    n * scanline_bytes);
+        else
+            for (int i = 0;  i < n;  ++i)
+                memcpy (data + (y+i-ybegin) * scanline_bytes,
+                        &m_strip[(y+i-m_strip_begin) * m_rowbytes],
+                        scanline_bytes);
+        y += n;
+    }
+    return true;
+}
+
+
+};  // end namespace OpenImageIO
+
+#ifdef OPENIMAGEIO_NAMESPACE
+}; // end namespace OPENIMAGEIO_NAMESPACE
+using namespace OPENIMAGEIO_NAMESPACE;
+#endif
+
+#endif // OPENIMAGEIO_STRIPREADER_H
@@ -54,6 +54,7 @@ namespace OpenImageIO {
 namespace pvt {
 
 class TextureSystemImpl;
+struct TexelKernels;
 
 // Used internally by TextureSystem.  Unfortunately, this is the only
 // clean place to store it.  Sorry, users, this isn't really for you.
@@ -109,7 +110,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeStochastic    ///< Aniso footprint, but take one random
+                             ///<   probe from one level (needs random)
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -174,7 +177,14 @@ private:
     int actualchannels;    // True number of channels read
     typedef bool (*wrap_impl) (int &coord, int width);
     wrap_impl swrap_func, twrap_func;
+    const OpenImageIO::pvt::TexelKernels *texel_kernels; // Filter inner loops
+    int tile_chbegin, tile_chend;  // Channel range of the tiles used
     friend class OpenImageIO::pvt::TextureSystemImpl;
+
+public:
+    // Newer options go here, after everything else, so that the members
+    // above keep the same offsets as in older releases.
+    VaryingRef<float> random;         ///< Random [0,1) for MipModeStochastic
 };
 
 
@@ -233,6 +243,21 @@ public:
     virtual bool getattribute (const std::string &name, char **val) = 0;
     virtual bool getattribute (const std::string &name, std::string &val) = 0;
 
+    /// Define an opaque data type that allows us to have a handle to a
+    /// texture (already having its name resolved) but without exposing
+    /// any internals.
+    class TextureHandle;
+
+    /// Retrieve an opaque handle for fast texture lookups, or NULL if
+    /// the filename names a UDIM texture set rather than a single file.
+    /// Passing the handle to the calls that take one, instead of the
+    /// filename, skips the filename lookup that is otherwise done on
+    /// every call.  The handle is valid for the lifetime of the
+    /// TextureSystem; a handle to a file that could not be found or
+    /// opened is still valid, and lookups with it behave just as
+    /// lookups by its filename would.
+    virtual TextureHandle * get_texture_handle (ustring filename) = 0;
+
     /// Filtered 2D texture lookup for a single point.
     ///
     /// s,t are the texture coordinates; dsdx, dtdx, dsdy, and dtdy are
@@ -248,6 +273,13 @@ public:
                           float s, float t, float dsdx, float dtdx,
                           float dsdy, float dtdy, float *result) = 0;
 
+    /// Slightly faster version of single-point 2D texture lookup that
+    /// takes a TextureHandle rather than a filename.
+    virtual bool texture (TextureHandle *texture_handle,
+                          TextureOptions &options,
+                          float s, float t, float dsdx, float dtdx,
+                          float dsdy, float dtdy, float *result) = 0;
+
     /// Retrieve filtered (possibly anisotropic) texture lookups for
     /// several points at once.
     ///
@@ -257,6 +289,13 @@ public:
     /// beginactive <= i < endactive, and ONLY when runflags[i] is
     /// nonzero.
     ///
+    /// If filename contains the token "<UDIM>", it names a UDIM texture
+    /// set: each point is looked up in the file whose name has the
+    /// token replaced by the tile number 1001 + u + 10*v, where u and v
+    /// are the integer parts of s and t (0 <= u < 10), using s and t
+    /// relative to that tile.  Points outside of any tile get the fill
+    /// value.
+    ///
     /// Return true if the file is found and could be opened by an
     /// available ImageIO plugin, otherwise return false.
     virtual bool texture (ustring filename, TextureOptions &options,
@@ -266,6 +305,16 @@ public:
                           VaryingRef<float> dsdy, VaryingRef<float> dtdy,
                           float *result) = 0;
 
+    /// Slightly faster version of multi-point 2D texture lookup that
+    /// takes a TextureHandle rather than a filename.
+    virtual bool texture (TextureHandle *texture_handle,
+                          TextureOptions &options,
+                          Runflag *runflags, int beginactive, int endactive,
+                          VaryingRef<float> s, VaryingRef<float> t,
+                          VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                          VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                          float *result) = 0;
+
     /// Retrieve a 3D texture lookup at a single point.
     ///
     /// Return true if the file is found and could be opened by an
@@ -336,6 +385,12 @@ public:
     virtual bool get_texture_info (ustring filename, ustring dataname,
                                    TypeDesc datatype, void *data) = 0;
 
+    /// Slightly faster version of get_texture_info that takes a
+    /// TextureHandle rather than a filename.
+    virtual bool get_texture_info (TextureHandle *texture_handle,
+                                   ustring dataname,
+                                   TypeDesc datatype, void *data) = 0;
+
     /// Get the ImageSpec associated with the named texture
     /// (specifically, the first MIP-map level).  If the file is found
     /// and is an image format that can be read, store a copy of its
@@ -377,6 +432,46 @@ public:
                              int ybegin, int yend, int zbegin, int zend,
                              TypeDesc format, void *result) = 0;
 
+    /// Slightly faster version of get_texels that takes a
+    /// TextureHandle rather than a filename.
+    virtual bool get_texels (TextureHandle *texture_handle,
+                             TextureOptions &options,
+                             int level, int xbegin, int xend,
+                             int ybegin, int yend, int zbegin, int zend,
+                             TypeDesc format, void *result) = 0;
+
+    /// Retrieve a scattered set of npoints raw unfiltered texels, the
+    /// i-th of which is at integer pixel coordinates (x[i],y[i]) of MIP
+    /// level level[i] (or of level 0 for all points, if level is
+    /// NULL).  The channels retrieved are given by options.firstchannel
+    /// and options.nchannels, and any requested channels not present
+    /// in the file get options.fill.  The values are converted to the
+    /// type specified by format and stored contiguously, point after
+    /// point, beginning at result, which must have room for
+    /// npoints*options.nchannels values.  Requested texels outside the
+    /// valid pixel data region will be filled in with 0 values.
+    ///
+    /// The file is found once, and the points are visited in tile
+    /// order so that each distinct tile is found only once per call,
+    /// which makes this far cheaper than calling get_texels() with a
+    /// 1x1 region for each point.
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, otherwise return false.
+    virtual bool get_texels_gather (ustring filename,
+                                    TextureOptions &options, int npoints,
+                                    const int *x, const int *y,
+                                    const int *level,
+                                    TypeDesc format, void *result) = 0;
+
+    /// Slightly faster version of get_texels_gather that takes a
+    /// TextureHandle rather than a filename.
+    virtual bool get_texels_gather (TextureHandle *texture_handle,
+                                    TextureOptions &options, int npoints,
+                                    const int *x, const int *y,
+                                    const int *level,
+                                    TypeDesc format, void *result) = 0;
+
     /// If any of the API routines returned false indicating an error,
     /// this routine will return the error string (and clear any error
     /// flags).  If no error has occurred since the last time geterror()
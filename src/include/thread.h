@@ -57,6 +57,7 @@
 
 #include <boost/thread.hpp>
 #include <boost/thread/tss.hpp>
+#include <boost/function.hpp>
 #include <boost/version.hpp>
 #if (BOOST_VERSION == 103500)
 #  include <boost/thread/shared_mutex.hpp>
@@ -92,6 +93,8 @@
 #  include <libkern/OSAtomic.h>
 #endif
 
+#include "export.h"
+
 
 #ifdef OPENIMAGEIO_NAMESPACE
 namespace OPENIMAGEIO_NAMESPACE {
@@ -538,6 +541,119 @@ typedef spin_mutex::lock_guard spin_lock;
 
 
 
+class task_set;
+
+/// A thread_pool is a set of worker threads that persist for the life
+/// of the pool, waiting for tasks (added through a task_set) to run.
+/// Reusing threads this way means that short-lived parallel operations
+/// don't pay thread creation costs every time.  Most code should just
+/// use the process-wide shared pool, default_pool(), so that all the
+/// libraries and tools in a process share one set of threads.
+///
+/// Pending tasks are kept in a single queue, oldest first.  A thread
+/// waiting for its own task_set to finish runs that set's pending tasks
+/// itself rather than blocking, so tasks may safely create and wait on
+/// task_sets of their own.
+class DLLPUBLIC thread_pool {
+public:
+    /// Create a pool with nthreads worker threads.  (More may be added
+    /// later with reserve().)
+    thread_pool (int nthreads = 0);
+
+    /// Destroy the pool, after waiting for any queued tasks to finish.
+    ~thread_pool ();
+
+    /// Return the process-wide shared pool.  It starts with no worker
+    /// threads and grows on demand, and is never destroyed.
+    static thread_pool *default_pool ();
+
+    /// Return the number of worker threads in the pool (not counting
+    /// threads that are waiting on a task_set).
+    int size () const;
+
+    /// Make sure the pool has at least nthreads worker threads.
+    ///
+    void reserve (int nthreads);
+
+    /// Return the number of hardware threads (cores) in the machine.
+    ///
+    static int hardware_threads ();
+
+private:
+    class Impl;
+    Impl *m_impl;
+    friend class task_set;
+
+    // Disallow copy construction and assignment
+    thread_pool (const thread_pool &);
+    const thread_pool & operator= (const thread_pool &);
+};
+
+
+
+/// A task_set is a group of tasks running on a thread_pool that may be
+/// waited on, or cancelled, together.  Cancelling a task_set discards
+/// its tasks that have not yet started; tasks that are already running
+/// may check cancelled() and return early if they wish.  To be able to
+/// cancel one task on its own, give it a task_set of its own.
+class DLLPUBLIC task_set {
+public:
+    typedef boost::function<void()> task;
+
+    /// Create a task_set whose tasks will run on the given pool (or the
+    /// default_pool(), if pool is NULL).
+    task_set (thread_pool *pool = NULL);
+
+    /// Destroying a task_set waits for its tasks to finish.
+    ///
+    ~task_set ();
+
+    /// Queue a task to be run by the next available thread of the pool.
+    ///
+    void push (const task &t);
+
+    /// Wait until every task pushed so far has finished (or been
+    /// discarded by cancel()), running pending tasks in the calling
+    /// thread rather than just blocking.
+    void wait ();
+
+    /// Discard all tasks not yet started, and ask running ones to stop.
+    ///
+    void cancel ();
+
+    /// Has cancel() been called?
+    ///
+    bool cancelled () const { return m_cancelled != 0; }
+
+    thread_pool *pool () const { return m_pool; }
+
+private:
+    thread_pool *m_pool;
+    int m_pending;              // Tasks queued or running (guarded by pool)
+    atomic_int m_cancelled;     // Nonzero once cancel() is called
+    friend class thread_pool::Impl;
+
+    // Disallow copy construction and assignment
+    task_set (const task_set &);
+    const task_set & operator= (const task_set &);
+};
+
+
+
+/// Call func(b,e) on disjoint subranges [b..e) that together exactly
+/// cover [begin..end), using up to nthreads threads at once (counting
+/// the calling thread; nthreads < 1 means one per core) of the default
+/// thread_pool.  Subranges will be chunksize long (except perhaps the
+/// last one); chunksize < 1 means to pick a size that gives each thread
+/// a few chunks, so that threads that finish early can pick up the
+/// slack.  Return only when all of func's calls have returned.  func
+/// must be safe to call concurrently on disjoint subranges.
+DLLPUBLIC void parallel_for (int begin, int end,
+                             const boost::function<void(int,int)> &func,
+                             int nthreads = 0, int chunksize = 0);
+
+
+
 #ifdef OPENIMAGEIO_NAMESPACE
 }; // end namespace OPENIMAGEIO_NAMESPACE
 using namespace OPENIMAGEIO_NAMESPACE;
@@ -75,6 +75,9 @@ static std::string outputname;
 static std::string crop_type;
 static int crop_xmin = 0, crop_xmax = 0, crop_ymin = 0, crop_ymax = 0;
 static bool do_add = false;
+static int resize_xres = 0, resize_yres = 0;
+static std::string filtername;
+static float filterwidth = 0.0f;
 static std::string colortransfer_to = "", colortransfer_from = "sRGB";
 static ImageBuf img;
 
@@ -106,6 +109,9 @@ getargs (int argc, char *argv[])
                 "--add", &do_add, "Add two images",
                 "--crop %s %d %d %d %d", &crop_type, &crop_xmin, &crop_xmax,
                     &crop_ymin, &crop_ymax, "Crop an image (type, xmin, xmax, ymin, ymax)\n\t\t\t\ttype = black|white|trans|window|cut",
+                "--resize %d %d", &resize_xres, &resize_yres, "Resize an image (xres, yres)",
+                "--filter %s", &filtername, "Filter for --resize: box, triangle, gaussian,\n\t\t\t\tcatmull-rom, blackman-harris, sinc, mitchell, b-spline",
+                "--filterwidth %f", &filterwidth, "Filter width for --resize (default: depends on filter)",
                 "<SEPARATOR>", "Output options:",
 //                "-d %s", &dataformatname, "Set the output data format to one of:\n"
 //                        "\t\t\tuint8, sint8, uint16, sint16, half, float, double",
@@ -237,6 +243,34 @@ main (int argc, char *argv[])
         out.save (outputname);
     }//do add
 
+    if (resize_xres > 0 && resize_yres > 0) {
+        if (filenames.size() != 1) {
+            std::cerr << "iprocess: --resize needs one input filename\n";
+            exit (EXIT_FAILURE);
+        }
+        std::cout << "Resizing " << filenames[0] << " to " << resize_xres
+                  << "x" << resize_yres << " as " << outputname << "\n";
+        ImageBuf in;
+        if (! read_input (filenames[0], in)) {
+            std::cerr << "iprocess: read error: " << in.geterror() << "\n";
+            return EXIT_FAILURE;
+        }
+        ImageSpec spec = in.spec();
+        spec.x = 0;
+        spec.y = 0;
+        spec.width = spec.full_width = resize_xres;
+        spec.height = spec.full_height = resize_yres;
+        spec.full_x = 0;
+        spec.full_y = 0;
+        ImageBuf out ("resized", spec);
+        if (! ImageBufAlgo::resize (out, in, filtername, filterwidth)) {
+            std::cerr << "iprocess: could not resize with filter \""
+                      << filtername << "\"\n";
+            return EXIT_FAILURE;
+        }
+        out.save (outputname);
+    }
+
     if (colortransfer_to != "") {
         if (filenames.size() != 1) {
             std::cerr << "iprocess: --transfer needs one input filename\n";
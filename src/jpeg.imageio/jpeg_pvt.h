@@ -42,6 +42,9 @@ extern "C" {
 #include "jpeglib.h"
 }
 
+#include "filesystem.h"
+#include "stripreader.h"
+
 
 #ifndef _TIFF_
 struct TIFFDirEntry;
@@ -50,35 +53,68 @@ struct TIFFDirEntry;
 
 class JpgInput : public ImageInput {
  public:
-    JpgInput () { init(); }
+    JpgInput () : m_io_user(NULL) { init(); }
     virtual ~JpgInput () { close(); }
     virtual const char * format_name (void) const { return "jpeg"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool open (const std::string &name, ImageSpec &spec,
                        const ImageSpec &config);
-    virtual bool seek_subimage (int index, ImageSpec &newspec) {
-        return (index == 0);   // JPEG has only one subimage
-    }
+    virtual int current_subimage (void) const { return m_subimage; }
+    virtual bool seek_subimage (int index, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    using ImageInput::read_native_scanlines;  // Keep the channel subset one
     virtual bool close ();
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
     std::string filename () const { return m_filename; }
     void * coeffs () const { return m_coeffs; }
 
  private:
-    FILE *m_fd;
+    // Everything needed to decode the image at one scale.  Each subimage
+    // gets a libjpeg decompressor of its own, kept until close(), so
+    // that moving between subimages never starts a decode over.
+    struct Decoder : public StripReader {
+        JpgInput *in;
+        int subimage;
+        struct jpeg_decompress_struct cinfo;
+        struct jpeg_error_mgr jerr;
+        bool active;              // Has cinfo been created?
+        virtual bool decode (int n, unsigned char *data);
+        virtual bool restart () { return in->start_decoder (subimage); }
+    };
+
+    Filesystem::IOProxy *m_io;       // Where we read from
+    Filesystem::IOProxy *m_io_user;  // Proxy from set_ioproxy(), if any
     std::string m_filename;
-    int m_next_scanline;      // Which scanline is the next to read?
     bool m_raw;               // Read raw coefficients, not scanlines
-    struct jpeg_decompress_struct m_cinfo;
-    struct jpeg_error_mgr m_jerr;
+    bool m_reduced_subimages; // Present DCT-scaled decodes as subimages?
+    int m_subimage;           // Subimage n is decoded at 1/2^n scale
+    int m_nsubimages;         // 1, or up to 4 with "reduced_subimages"
+    ImageSpec m_fullspec;     // Spec of subimage 0
+    Decoder m_decoders[4];    // Decoder for each subimage
     jvirt_barray_ptr *m_coeffs;
 
     void init () {
-        m_fd = NULL;
+        m_io = NULL;
         m_raw = false;
+        m_reduced_subimages = false;
+        m_subimage = 0;
+        m_nsubimages = 1;
+        for (int i = 0;  i < 4;  ++i) {
+            m_decoders[i].in = this;
+            m_decoders[i].subimage = i;
+            m_decoders[i].active = false;
+        }
         m_coeffs = NULL;
     }
 
+    // (Re)start decoding the given subimage from its first scanline.
+    bool start_decoder (int subimage);
+
     // Rummage through the JPEG "APP1" marker pointed to by buf, decoding
     // IPTC (International Press Telecommunications Council) metadata
     // information and adding attributes to spec.  This assumes it's in
@@ -58,10 +58,111 @@ extern "C" {
     DLLEXPORT const char *jpeg_input_extensions[] = {
         "jpg", "jpe", "jpeg", NULL
     };
+    DLLEXPORT bool jpeg_input_signature (const unsigned char *header,
+                                         int nbytes) {
+        // SOI marker followed by the start of another marker
+        return (nbytes >= 3 && header[0] == 0xFF && header[1] == 0xD8
+                && header[2] == 0xFF);
+    }
+};
+
+
+
+// libjpeg data source that reads through an IOProxy.  If the proxy
+// holds its contents in memory, libjpeg is pointed straight at them and
+// nothing is copied.  Each source keeps its own position, so several
+// decompressors (one per scale) can share the proxy.
+struct proxy_source_mgr {
+    struct jpeg_source_mgr pub;
+    Filesystem::IOProxy *io;
+    int64_t pos;            // Where in io the next read starts
+    JOCTET buffer[4096];
 };
 
 
 
+static void
+proxy_init_source (j_decompress_ptr cinfo)
+{
+}
+
+
+
+static boolean
+proxy_fill_input_buffer (j_decompress_ptr cinfo)
+{
+    proxy_source_mgr *src = (proxy_source_mgr *) cinfo->src;
+    if (src->io->tell() != src->pos)
+        src->io->seek (src->pos);
+    size_t n = src->io->read (src->buffer, sizeof(src->buffer));
+    src->pos += n;
+    if (n == 0) {
+        // Premature end of data -- insert a fake EOI marker, just as
+        // libjpeg's own stdio source does.
+        src->buffer[0] = (JOCTET) 0xFF;
+        src->buffer[1] = (JOCTET) JPEG_EOI;
+        n = 2;
+    }
+    src->pub.next_input_byte = src->buffer;
+    src->pub.bytes_in_buffer = n;
+    return TRUE;
+}
+
+
+
+static void
+proxy_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+    proxy_source_mgr *src = (proxy_source_mgr *) cinfo->src;
+    if (num_bytes <= 0)
+        return;
+    if ((size_t) num_bytes <= src->pub.bytes_in_buffer) {
+        src->pub.next_input_byte += num_bytes;
+        src->pub.bytes_in_buffer -= num_bytes;
+    } else {
+        num_bytes -= (long) src->pub.bytes_in_buffer;
+        src->pos += num_bytes;
+        src->pub.bytes_in_buffer = 0;
+    }
+}
+
+
+
+static void
+proxy_term_source (j_decompress_ptr cinfo)
+{
+}
+
+
+
+// Read the JPEG stream from the start of io.
+static void
+jpeg_proxy_src (j_decompress_ptr cinfo, Filesystem::IOProxy *io)
+{
+    if (! cinfo->src)
+        cinfo->src = (struct jpeg_source_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+                                        sizeof(proxy_source_mgr));
+    proxy_source_mgr *src = (proxy_source_mgr *) cinfo->src;
+    src->pub.init_source = proxy_init_source;
+    src->pub.fill_input_buffer = proxy_fill_input_buffer;
+    src->pub.skip_input_data = proxy_skip_input_data;
+    src->pub.resync_to_restart = jpeg_resync_to_restart;
+    src->pub.term_source = proxy_term_source;
+    src->io = io;
+    src->pos = 0;
+    src->pub.next_input_byte = NULL;
+    src->pub.bytes_in_buffer = 0;
+    const JOCTET *mem = (const JOCTET *) io->memory ();
+    if (mem && io->size() > 0) {
+        src->pub.next_input_byte = mem;
+        src->pub.bytes_in_buffer = (size_t) io->size();
+        src->pos = io->size();
+    }
+}
+
+
+
 bool
 JpgInput::open (const std::string &name, ImageSpec &newspec,
                 const ImageSpec &config)
@@ -69,6 +170,8 @@ JpgInput::open (const std::string &name, ImageSpec &newspec,
     const ImageIOParameter *p = config.find_attribute ("_jpeg:raw",
                                                        TypeDesc::TypeInt);
     m_raw = p && *(int *)p->data();
+    p = config.find_attribute ("reduced_subimages", TypeDesc::TypeInt);
+    m_reduced_subimages = p && *(int *)p->data();
     return open (name, newspec);
 }
 
@@ -79,46 +182,41 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
 {
     // Check that file exists and can be opened
     m_filename = name;
-    m_fd = fopen (name.c_str(), "rb");
-    if (m_fd == NULL) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
+    if (m_io_user) {
+        m_io = m_io_user;
+        m_io->seek (0);
+    } else {
+        m_io = new Filesystem::IOFile (name, Filesystem::IOProxy::Read);
+        if (! m_io->opened ()) {
+            delete m_io;
+            m_io = NULL;
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     // Check magic number to assure this is a JPEG file
     int magic = 0;
-    fread (&magic, 4, 1, m_fd);
-    rewind (m_fd);
+    m_io->read (&magic, 4);
+    m_io->seek (0);
     const int JPEG_MAGIC = 0xffd8ffe0, JPEG_MAGIC_OTHER_ENDIAN =  0xe0ffd8ff;
     const int JPEG_MAGIC2 = 0xffd8ffe1, JPEG_MAGIC2_OTHER_ENDIAN =  0xe1ffd8ff;
     if (magic != JPEG_MAGIC && magic != JPEG_MAGIC_OTHER_ENDIAN &&
         magic != JPEG_MAGIC2 && magic != JPEG_MAGIC2_OTHER_ENDIAN) {
-        fclose (m_fd);
-        m_fd = NULL;
+        if (m_io != m_io_user)
+            delete m_io;
+        m_io = NULL;
         error ("\"%s\" is a JPEG file, magic number doesn't match", name.c_str());
         return false;
     }
 
-    m_cinfo.err = jpeg_std_error (&m_jerr);
-    jpeg_create_decompress (&m_cinfo);          // initialize decompressor
-    jpeg_stdio_src (&m_cinfo, m_fd);            // specify the data source
-
-    // Request saving of EXIF and other special tags for later spelunking
-    for (int mark = 0;  mark < 16;  ++mark)
-        jpeg_save_markers (&m_cinfo, JPEG_APP0+mark, 0xffff);
-    jpeg_save_markers (&m_cinfo, JPEG_COM, 0xffff);     // comment marker
-
-    jpeg_read_header (&m_cinfo, FALSE);         // read the file parameters
-    if (m_raw)
-        m_coeffs = jpeg_read_coefficients (&m_cinfo);
-    else
-        jpeg_start_decompress (&m_cinfo);       // start working
-    m_next_scanline = 0;                        // next scanline we'll read
-
-    m_spec = ImageSpec (m_cinfo.output_width, m_cinfo.output_height,
-                        m_cinfo.output_components, TypeDesc::UINT8);
+    if (! start_decoder (0))
+        return false;
+    struct jpeg_decompress_struct &cinfo (m_decoders[0].cinfo);
+    m_spec = ImageSpec (cinfo.output_width, cinfo.output_height,
+                        cinfo.output_components, TypeDesc::UINT8);
 
-    for (jpeg_saved_marker_ptr m = m_cinfo.marker_list;  m;  m = m->next) {
+    for (jpeg_saved_marker_ptr m = cinfo.marker_list;  m;  m = m->next) {
         if (m->marker == (JPEG_APP0+1) &&
                 ! strcmp ((const char *)m->data, "Exif"))
             decode_exif ((unsigned char *)m->data, m->data_length, m_spec);
@@ -140,6 +238,18 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
         }
     }
 
+    // Without the "reduced_subimages" hint, JPEG has only one subimage.
+    // With it, subimages 1-3 are decodes at 1/2, 1/4 and 1/8 scale,
+    // stopping once a level has shrunk to a single pixel.  Progressive
+    // files are left alone: each of their decoders would hold the whole
+    // image's coefficients, and scaling saves little of their decode.
+    m_nsubimages = 1;
+    if (m_reduced_subimages && ! m_raw && ! cinfo.progressive_mode)
+        while (m_nsubimages < 4 &&
+               std::max (m_spec.width, m_spec.height) >> (m_nsubimages-1) > 1)
+            ++m_nsubimages;
+    m_fullspec = m_spec;
+
     newspec = m_spec;
     return true;
 }
@@ -147,53 +257,130 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
 
 
 bool
-JpgInput::read_native_scanline (int y, int z, void *data)
+JpgInput::seek_subimage (int index, ImageSpec &newspec)
 {
-    if (m_raw)
-        return false;
-    if (y < 0 || y >= (int)m_cinfo.output_height)   // out of range scanline
+    if (index == m_subimage) {
+        newspec = m_spec;
+        return true;
+    }
+    if (index < 0 || index >= m_nsubimages)
         return false;
-    if (m_next_scanline > y) {
-        // User is trying to read an earlier scanline than the one we're
-        // up to.  Easy fix: close the file and re-open.
-        ImageSpec dummyspec;
-        int subimage = current_subimage();
-        if (! close ()  ||
-            ! open (m_filename, dummyspec)  ||
-            ! seek_subimage (subimage, dummyspec))
-            return false;    // Somehow, the re-open failed
-        assert (m_next_scanline == 0 && current_subimage() == subimage);
+    // Nothing is decoded until the subimage is read.  Its size halves
+    // and rounds down at each level, as automip's levels do; libjpeg
+    // rounds up, so the decode may carry a row or column more, which we
+    // never hand out.
+    m_subimage = index;
+    m_spec = m_fullspec;
+    if (index > 0) {
+        m_spec.width = m_spec.full_width = std::max (1, m_fullspec.width >> index);
+        m_spec.height = m_spec.full_height = std::max (1, m_fullspec.height >> index);
+        m_spec.attribute ("reduction", 1 << index);
     }
-    while (m_next_scanline <= y) {
-        // Keep reading until we're read the scanline we really need
-        jpeg_read_scanlines (&m_cinfo, (JSAMPLE **)&data, 1); // read one scanline
-        ++m_next_scanline;
+    newspec = m_spec;
+    return true;
+}
+
+
+
+bool
+JpgInput::start_decoder (int subimage)
+{
+    Decoder &d (m_decoders[subimage]);
+    if (d.active)
+        jpeg_destroy_decompress (&d.cinfo);
+    d.cinfo.err = jpeg_std_error (&d.jerr);
+    jpeg_create_decompress (&d.cinfo);          // initialize decompressor
+    jpeg_proxy_src (&d.cinfo, m_io);            // specify the data source
+    d.active = true;
+
+    if (subimage == 0) {
+        // Request saving of EXIF and other special tags for later spelunking
+        for (int mark = 0;  mark < 16;  ++mark)
+            jpeg_save_markers (&d.cinfo, JPEG_APP0+mark, 0xffff);
+        jpeg_save_markers (&d.cinfo, JPEG_COM, 0xffff);     // comment marker
     }
+
+    jpeg_read_header (&d.cinfo, FALSE);         // read the file parameters
+    if (m_raw)
+        m_coeffs = jpeg_read_coefficients (&d.cinfo);
+    else {
+        // Reduced-resolution subimages are decoded by libjpeg's DCT
+        // scaling, which skips most of the work of a full decode.
+        d.cinfo.scale_num = 1;
+        d.cinfo.scale_denom = 1 << subimage;
+        jpeg_start_decompress (&d.cinfo);       // start working
+    }
+    d.start (d.cinfo.output_height,
+             d.cinfo.output_width * d.cinfo.output_components);
     return true;
 }
 
 
 
 bool
-JpgInput::close ()
+JpgInput::Decoder::decode (int n, unsigned char *data)
 {
-    if (m_fd != NULL) {
-        // N.B. don't call finish_decompress if we never read anything
-        if (m_next_scanline > 0) {
-            // But if we've only read some scanlines, read the rest to avoid
-            // errors
-            std::vector<char> buf (spec().scanline_bytes());
-            char *data = &buf[0];
-            while (m_next_scanline < spec().height) {
-                jpeg_read_scanlines (&m_cinfo, (JSAMPLE **)&data, 1);
-                ++m_next_scanline;
+    // libjpeg hands back only a few rows per call no matter how many
+    // we ask for
+    JSAMPROW rows[64];
+    while (n > 0) {
+        int nrows = std::min (n, 64);
+        for (int i = 0;  i < nrows;  ++i)
+            rows[i] = (JSAMPROW) (data + i * rowbytes());
+        for (int i = 0;  i < nrows;  ) {
+            int nread = jpeg_read_scanlines (&cinfo, rows+i, nrows-i);
+            if (nread <= 0) {
+                in->error ("JPEG decode failed at scanline %d",
+                           next_scanline() + i);
+                return false;
             }
+            i += nread;
         }
-        if (m_next_scanline > 0 || m_raw)
-            jpeg_finish_decompress (&m_cinfo);
-        jpeg_destroy_decompress (&m_cinfo);
-        fclose (m_fd);
-        m_fd = NULL;
+        n -= nrows;
+        data += nrows * rowbytes();
+    }
+    return true;
+}
+
+
+
+bool
+JpgInput::read_native_scanline (int y, int z, void *data)
+{
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+JpgInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    if (m_raw)
+        return false;
+    if (ybegin < 0 || yend > m_spec.height)   // out of range
+        return false;
+    Decoder &dec (m_decoders[m_subimage]);
+    if (! dec.active && ! start_decoder (m_subimage))
+        return false;
+    // A reduced decode may be a column wider than the subimage
+    return dec.read (ybegin, yend, m_spec.scanline_bytes(),
+                     (unsigned char *)data);
+}
+
+
+
+bool
+JpgInput::close ()
+{
+    if (m_io != NULL) {
+        // Every decoder can be destroyed where it stands; libjpeg
+        // doesn't need the rest of the image read first.
+        for (int i = 0;  i < 4;  ++i)
+            if (m_decoders[i].active)
+                jpeg_destroy_decompress (&m_decoders[i].cinfo);
+        if (m_io != m_io_user)
+            delete m_io;
+        m_io = NULL;
     }
     init ();   // Reset to initial state
     return true;
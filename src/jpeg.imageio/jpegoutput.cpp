@@ -36,6 +36,7 @@
 
 extern "C" {
 #include "jpeglib.h"
+#include "jerror.h"
 }
 
 #include "imageio.h"
@@ -53,10 +54,16 @@ using namespace Jpeg_imageio_pvt;
 
 class JpgOutput : public ImageOutput {
  public:
-    JpgOutput () { init(); }
+    JpgOutput () : m_io_user(NULL) { init(); }
     virtual ~JpgOutput () { close(); }
     virtual const char * format_name (void) const { return "jpeg"; }
-    virtual bool supports (const std::string &property) const { return false; }
+    virtual bool supports (const std::string &property) const {
+        return (property == "ioproxy");
+    }
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        bool append=false);
     virtual bool write_scanline (int y, int z, TypeDesc format,
@@ -65,7 +72,8 @@ class JpgOutput : public ImageOutput {
     virtual bool copy_image (ImageInput *in);
 
  private:
-    FILE *m_fd;
+    Filesystem::IOProxy *m_io;       // Where we write to
+    Filesystem::IOProxy *m_io_user;  // Proxy from set_ioproxy(), if any
     std::string m_filename;
     int m_next_scanline;             // Which scanline is the next to write?
     std::vector<unsigned char> m_scratch;
@@ -75,7 +83,7 @@ class JpgOutput : public ImageOutput {
     struct jpeg_decompress_struct *m_copy_decompressor;
 
     void init (void) {
-        m_fd = NULL;
+        m_io = NULL;
         m_copy_coeffs = NULL;
         m_copy_decompressor = NULL;
     }
@@ -95,6 +103,67 @@ extern "C" {
 
 
 
+// libjpeg data destination that writes through an IOProxy.
+struct proxy_destination_mgr {
+    struct jpeg_destination_mgr pub;
+    Filesystem::IOProxy *io;
+    JOCTET buffer[4096];
+};
+
+
+
+static void
+proxy_init_destination (j_compress_ptr cinfo)
+{
+    proxy_destination_mgr *dest = (proxy_destination_mgr *) cinfo->dest;
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = sizeof(dest->buffer);
+}
+
+
+
+static boolean
+proxy_empty_output_buffer (j_compress_ptr cinfo)
+{
+    proxy_destination_mgr *dest = (proxy_destination_mgr *) cinfo->dest;
+    if (dest->io->write (dest->buffer, sizeof(dest->buffer))
+            != sizeof(dest->buffer))
+        ERREXIT (cinfo, JERR_FILE_WRITE);
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = sizeof(dest->buffer);
+    return TRUE;
+}
+
+
+
+static void
+proxy_term_destination (j_compress_ptr cinfo)
+{
+    proxy_destination_mgr *dest = (proxy_destination_mgr *) cinfo->dest;
+    size_t n = sizeof(dest->buffer) - dest->pub.free_in_buffer;
+    if (n > 0 && dest->io->write (dest->buffer, n) != n)
+        ERREXIT (cinfo, JERR_FILE_WRITE);
+    dest->io->flush ();
+}
+
+
+
+static void
+jpeg_proxy_dest (j_compress_ptr cinfo, Filesystem::IOProxy *io)
+{
+    if (! cinfo->dest)
+        cinfo->dest = (struct jpeg_destination_mgr *)
+            (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_PERMANENT,
+                                        sizeof(proxy_destination_mgr));
+    proxy_destination_mgr *dest = (proxy_destination_mgr *) cinfo->dest;
+    dest->pub.init_destination = proxy_init_destination;
+    dest->pub.empty_output_buffer = proxy_empty_output_buffer;
+    dest->pub.term_destination = proxy_term_destination;
+    dest->io = io;
+}
+
+
+
 bool
 JpgOutput::open (const std::string &name, const ImageSpec &newspec,
                  bool append)
@@ -121,10 +190,16 @@ JpgOutput::open (const std::string &name, const ImageSpec &newspec,
         return false;
     }
 
-    m_fd = fopen (name.c_str(), "wb");
-    if (m_fd == NULL) {
-        error ("Unable to open file \"%s\"", name.c_str());
-        return false;
+    if (m_io_user) {
+        m_io = m_io_user;
+    } else {
+        m_io = new Filesystem::IOFile (name, Filesystem::IOProxy::Write);
+        if (! m_io->opened ()) {
+            delete m_io;
+            m_io = NULL;
+            error ("Unable to open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     int quality = 98;
@@ -135,7 +210,7 @@ JpgOutput::open (const std::string &name, const ImageSpec &newspec,
 
     m_cinfo.err = jpeg_std_error (&c_jerr);             // set error handler
     jpeg_create_compress (&m_cinfo);                    // create compressor
-    jpeg_stdio_dest (&m_cinfo, m_fd);                   // set output stream
+    jpeg_proxy_dest (&m_cinfo, m_io);                   // set output stream
 
     // Set image and compression parameters
     m_cinfo.image_width = m_spec.width;
@@ -254,7 +329,7 @@ JpgOutput::write_scanline (int y, int z, TypeDesc format,
 bool
 JpgOutput::close ()
 {
-    if (! m_fd)          // Already closed
+    if (! m_io)          // Already closed
         return true;
 
     if (m_next_scanline < spec().height && m_copy_coeffs == NULL) {
@@ -280,8 +355,9 @@ JpgOutput::close ()
     }
     DBG std::cout << "out close: about to destroy_compress\n";
     jpeg_destroy_compress (&m_cinfo);
-    fclose (m_fd);
-    m_fd = NULL;
+    if (m_io != m_io_user)
+        delete m_io;
+    m_io = NULL;
     init();
     
     return true;
@@ -292,7 +368,9 @@ JpgOutput::close ()
 bool
 JpgOutput::copy_image (ImageInput *in)
 {
-    if (in && !strcmp(in->format_name(), "jpeg")) {
+    // The lossless copy re-opens the output, which only works for a
+    // file we created ourselves, not for a caller's proxy.
+    if (in && !strcmp(in->format_name(), "jpeg") && ! m_io_user) {
         JpgInput *jpg_in = dynamic_cast<JpgInput *> (in);
         std::string in_name = jpg_in->filename ();
         DBG std::cout << "JPG copy_image from " << in_name << "\n";
@@ -315,7 +393,7 @@ JpgOutput::copy_image (ImageInput *in)
         ImageSpec orig_out_spec = spec();
         close ();
         m_copy_coeffs = (jvirt_barray_ptr *)jpg_in->coeffs();
-        m_copy_decompressor = &jpg_in->m_cinfo;
+        m_copy_decompressor = &jpg_in->m_decoders[0].cinfo;
         open (out_name, orig_out_spec);
 
         // Strangeness -- the write_coefficients somehow sets things up
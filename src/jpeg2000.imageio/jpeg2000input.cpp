@@ -28,6 +28,8 @@
   (This is the Modified BSD License)
 */
 
+#include <cstring>
+
 #include "imageio.h"
 using namespace OpenImageIO;
 #include "jpeg2000_pvt.h"
@@ -42,6 +44,16 @@ extern "C" {
     DLLEXPORT const char *jpeg2000_input_extensions[] = {
         "jp2", "j2k", NULL
     };
+    DLLEXPORT bool jpeg2000_input_signature (const unsigned char *header,
+                                             int nbytes) {
+        // Either a JP2 signature box or a raw J2K codestream
+        static const unsigned char jp2[12] = { 0x00, 0x00, 0x00, 0x0C,
+                                               'j', 'P', ' ', ' ',
+                                               0x0D, 0x0A, 0x87, 0x0A };
+        static const unsigned char j2k[4] = { 0xFF, 0x4F, 0xFF, 0x51 };
+        return (nbytes >= 12 && ! memcmp (header, jp2, 12))
+            || (nbytes >= 4 && ! memcmp (header, j2k, 4));
+    }
 }
 
 
@@ -0,0 +1,149 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// Benchmark the throughput of pixel data format conversion through
+/// convert_types, compared to the plain scalar convert_type templates.
+
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <OpenEXR/half.h>
+
+#include "argparse.h"
+#include "fmath.h"
+#include "imageio.h"
+#include "strutil.h"
+#include "timer.h"
+
+using namespace OpenImageIO;
+
+
+static int nvalues = 4096*4096;
+static int iterations = 10;
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("Usage:  convert_bench [options]",
+                "--help", &help, "Print help message",
+                "--values %d", &nvalues, "Number of values to convert",
+                "--iters %d", &iterations, "Iterations of each conversion",
+                NULL);
+    if (ap.parse (argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+}
+
+
+
+// Time converting S to D both ways, and report Mvalues/sec.
+template<typename S, typename D>
+static void
+benchmark (const char *name, TypeDesc stype, TypeDesc dtype,
+           const std::vector<S> &src)
+{
+    std::vector<D> dst (src.size()), check (src.size());
+
+    Timer timer;
+    for (int i = 0;  i < iterations;  ++i)
+        convert_type (&src[0], &check[0], src.size());
+    double tscalar = timer() / iterations;
+
+    convert_types (stype, &src[0], dtype, &dst[0], (int)src.size());
+    timer.reset ();
+    timer.start ();
+    for (int i = 0;  i < iterations;  ++i)
+        convert_types (stype, &src[0], dtype, &dst[0], (int)src.size());
+    double t = timer() / iterations;
+
+    int mismatches = 0;
+    for (size_t i = 0;  i < src.size();  ++i)
+        if (memcmp (&dst[i], &check[i], sizeof(D)))
+            ++mismatches;
+
+    std::cout << Strutil::format ("  %-16s %8.1f Mvals/s  (scalar %8.1f, speedup %.2fx)",
+                                  name, src.size() / t * 1.0e-6,
+                                  src.size() / tscalar * 1.0e-6,
+                                  t > 0 ? tscalar / t : 0.0);
+    if (mismatches)
+        std::cout << "  " << mismatches << " MISMATCHES";
+    std::cout << "\n";
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+    getargs (argc, argv);
+
+    std::vector<float> f (nvalues);
+    std::vector<unsigned char> u8 (nvalues);
+    std::vector<unsigned short> u16 (nvalues);
+    std::vector<half> h (nvalues);
+    for (int i = 0;  i < nvalues;  ++i) {
+        // Mostly [0,1], with some values out of range to clamp
+        f[i] = (float)(i % 10007) / 10007.0f * 1.2f - 0.1f;
+        u8[i] = (unsigned char) i;
+        u16[i] = (unsigned short) (i * 7);
+        h[i] = f[i];
+    }
+
+    std::cout << "Converting " << nvalues << " values, " << iterations
+              << " iterations each\n";
+    benchmark<unsigned char,float> ("uint8 -> float", TypeDesc::UINT8,
+                                    TypeDesc::FLOAT, u8);
+    benchmark<float,unsigned char> ("float -> uint8", TypeDesc::FLOAT,
+                                    TypeDesc::UINT8, f);
+    benchmark<unsigned short,float> ("uint16 -> float", TypeDesc::UINT16,
+                                     TypeDesc::FLOAT, u16);
+    benchmark<float,unsigned short> ("float -> uint16", TypeDesc::FLOAT,
+                                     TypeDesc::UINT16, f);
+    benchmark<half,float> ("half -> float", TypeDesc::HALF,
+                           TypeDesc::FLOAT, h);
+    benchmark<float,half> ("float -> half", TypeDesc::FLOAT,
+                           TypeDesc::HALF, f);
+    return 0;
+}
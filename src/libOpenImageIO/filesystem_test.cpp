@@ -0,0 +1,215 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "filesystem.h"
+
+#define BOOST_TEST_SOURCE
+#define BOOST_TEST_MAIN
+#include <boost/test/included/unit_test.hpp>
+
+
+// Write into a growable memory buffer, then read it back with no copy.
+BOOST_AUTO_TEST_CASE (test_iovecoutput_iomemreader)
+{
+    std::vector<unsigned char> buf;
+    Filesystem::IOVecOutput out (buf);
+    BOOST_CHECK (out.opened ());
+    BOOST_CHECK_EQUAL (out.write ("hello, ", 7), 7u);
+    BOOST_CHECK_EQUAL (out.write ("world", 5), 5u);
+    BOOST_CHECK_EQUAL (buf.size(), 12u);
+    BOOST_CHECK_EQUAL (out.tell(), 12);
+
+    // Writing past the end after a seek grows the buffer
+    out.seek (20);
+    out.write ("!", 1);
+    BOOST_CHECK_EQUAL (buf.size(), 21u);
+    // Overwriting in the middle does not
+    out.seek (0);
+    out.write ("H", 1);
+    BOOST_CHECK_EQUAL (buf.size(), 21u);
+
+    Filesystem::IOMemReader in (&buf[0], buf.size());
+    BOOST_CHECK (in.memory() == &buf[0]);
+    BOOST_CHECK_EQUAL (in.size(), (int64_t) 21);
+    char s[32];
+    BOOST_CHECK_EQUAL (in.read (s, 12), 12u);
+    BOOST_CHECK (! memcmp (s, "Hello, world", 12));
+    in.seek (20);
+    BOOST_CHECK_EQUAL (in.read (s, sizeof(s)), 1u);   // short read at end
+    BOOST_CHECK_EQUAL (s[0], '!');
+    BOOST_CHECK_EQUAL (in.read (s, sizeof(s)), 0u);
+    BOOST_CHECK (! in.seek (-1));
+}
+
+
+
+BOOST_AUTO_TEST_CASE (test_iofile)
+{
+    const char *filename = "filesystem_test.tmp";
+    {
+        Filesystem::IOFile out (filename, Filesystem::IOProxy::Write);
+        BOOST_CHECK (out.opened ());
+        BOOST_CHECK_EQUAL (out.write ("0123456789", 10), 10u);
+    }
+    Filesystem::IOFile in (filename, Filesystem::IOProxy::Read);
+    BOOST_CHECK (in.opened ());
+    BOOST_CHECK_EQUAL (in.size(), (int64_t) 10);
+    BOOST_CHECK (in.memory() == NULL);
+    char s[16];
+    in.seek (4);
+    BOOST_CHECK_EQUAL (in.read (s, sizeof(s)), 6u);
+    BOOST_CHECK (! memcmp (s, "456789", 6));
+    BOOST_CHECK_EQUAL (in.tell(), 10);
+    in.close ();
+    BOOST_CHECK (! in.opened ());
+    remove (filename);
+
+    Filesystem::IOFile missing ("no_such_file.tmp", Filesystem::IOProxy::Read);
+    BOOST_CHECK (! missing.opened ());
+}
+
+
+
+// Check BufferedReader against the bytes it should be reading, across
+// buffer refills, seeks, big direct reads and the end of the file, both
+// reading through stdio and from a memory mapping.
+BOOST_AUTO_TEST_CASE (test_bufferedreader)
+{
+    const char *filename = "filesystem_test.tmp";
+    std::vector<unsigned char> data (100000);
+    for (size_t i = 0;  i < data.size();  ++i)
+        data[i] = (unsigned char) (i * 7 + i / 256);
+    data[50000] = '\n';
+    {
+        Filesystem::IOFile out (filename, Filesystem::IOProxy::Write);
+        out.write (&data[0], data.size());
+    }
+
+    for (int mmap = 0;  mmap < 2;  ++mmap) {
+        Filesystem::BufferedReader in (4096);
+        BOOST_CHECK (in.open (filename, mmap != 0));
+        BOOST_CHECK_EQUAL (in.size(), (int64_t) data.size());
+        BOOST_CHECK_EQUAL (in.memory() != NULL, mmap != 0);
+
+        // Small reads that straddle refills
+        std::vector<unsigned char> buf (data.size());
+        for (size_t pos = 0;  pos < 10000;  pos += 7)
+            BOOST_CHECK_EQUAL (in.read (&buf[pos], 7), 7u);
+        BOOST_CHECK (! memcmp (&buf[0], &data[0], 10000));
+
+        // A big read, partly buffered and partly not
+        in.seek (9990);
+        BOOST_CHECK_EQUAL (in.read (&buf[0], 30000), 30000u);
+        BOOST_CHECK (! memcmp (&buf[0], &data[9990], 30000));
+
+        // next() and seeking backwards
+        in.seek (123);
+        const unsigned char *p = in.next (5000);
+        BOOST_CHECK (p && ! memcmp (p, &data[123], 5000));
+        BOOST_CHECK_EQUAL (in.tell(), 5123);
+        BOOST_CHECK_EQUAL (in.getc(), data[5123]);
+
+        // Stepping back a row at a time, as bottom-up images are read
+        bool same = true;
+        for (size_t pos = 90000;  pos >= 60000;  pos -= 1000) {
+            in.seek (pos);
+            p = in.next (1000);
+            same = same && p && ! memcmp (p, &data[pos], 1000);
+        }
+        BOOST_CHECK (same);
+
+        // Endian-aware fields
+        uint16_t be, le;
+        in.seek (10);
+        BOOST_CHECK (in.read_be (&be));
+        BOOST_CHECK (in.read_le (&le));
+        BOOST_CHECK_EQUAL (be, (data[10] << 8) | data[11]);
+        BOOST_CHECK_EQUAL (le, data[12] | (data[13] << 8));
+
+        // Lines
+        std::string line;
+        in.seek (49990);
+        BOOST_CHECK (in.getline (line));
+        BOOST_CHECK_EQUAL (line.size(), 10u);
+        BOOST_CHECK_EQUAL (in.tell(), 50001);
+
+        // The end of the file
+        in.seek (data.size() - 3);
+        BOOST_CHECK (in.next (4) == NULL);
+        BOOST_CHECK_EQUAL (in.tell(), (int64_t) data.size() - 3);
+        BOOST_CHECK_EQUAL (in.read (&buf[0], 10), 3u);
+        BOOST_CHECK_EQUAL (in.getc(), -1);
+        BOOST_CHECK (! in.getline (line));
+    }
+    remove (filename);
+}
+
+
+
+// A caller's proxy that, like IOProxy itself, doesn't know its size.
+class UnsizedProxy : public Filesystem::IOProxy {
+public:
+    UnsizedProxy (const std::vector<unsigned char> &data)
+        : IOProxy ("", Read), m_data(data) { }
+    virtual const char *proxytype () const { return "unsized"; }
+    virtual size_t read (void *buf, size_t size) {
+        size_t n = m_pos < (int64_t) m_data.size()
+                 ? std::min (size, m_data.size() - (size_t) m_pos) : 0;
+        if (n)
+            memcpy (buf, &m_data[m_pos], n);
+        m_pos += n;
+        return n;
+    }
+private:
+    const std::vector<unsigned char> &m_data;
+};
+
+
+
+BOOST_AUTO_TEST_CASE (test_bufferedreader_unsized)
+{
+    std::vector<unsigned char> data (10000);
+    for (size_t i = 0;  i < data.size();  ++i)
+        data[i] = (unsigned char) (i * 13);
+    UnsizedProxy io (data);
+    Filesystem::BufferedReader in (4096);
+    BOOST_CHECK (in.open (&io));
+    BOOST_CHECK_EQUAL (in.size(), (int64_t) data.size());
+    in.seek (9000);
+    const unsigned char *p = in.next (1000);
+    BOOST_CHECK (p && ! memcmp (p, &data[9000], 1000));
+    BOOST_CHECK_EQUAL (in.getc(), -1);
+}
@@ -31,18 +31,203 @@
 /// \file
 /// Implementation of ImageBuf class.
 
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
 
 #include "imagebuf.h"
 using namespace OpenImageIO;
 using namespace ImageBufAlgo;
 
 #include "dassert.h"
+#include "filter.h"
+#include "sysutil.h"
+#include "thread.h"
+
+
+
+namespace {
+
+static int default_nthreads = 0;   // 0 means one per core
+
+// Don't bother splitting regions with fewer pixels than this among
+// threads -- the hand-off costs more than it saves.
+static const int min_parallel_pixels = 16384;
+
+
+
+// Run func on a range of the bands given by ybounds.
+static void
+run_bands (const RegionFunc *func, int xbegin, int xend,
+           const std::vector<int> *ybounds, int bandbegin, int bandend)
+{
+    for (int band = bandbegin;  band < bandend;  ++band)
+        (*func) (xbegin, xend, (*ybounds)[band], (*ybounds)[band+1]);
+}
+
+};  // end anonymous namespace
+
+
+
+void
+ImageBufAlgo::set_default_threads (int nthreads)
+{
+    default_nthreads = std::max (0, nthreads);
+}
+
+
+
+int
+ImageBufAlgo::default_threads ()
+{
+    return default_nthreads;
+}
+
+
+
+void
+ImageBufAlgo::parallel_image (const RegionFunc &func,
+                              int xbegin, int xend, int ybegin, int yend,
+                              int nthreads, int yalign)
+{
+    if (xend <= xbegin || yend <= ybegin)
+        return;
+    if (nthreads < 1)
+        nthreads = default_nthreads;
+    if (nthreads < 1)
+        nthreads = thread_pool::hardware_threads ();
+    yalign = std::max (1, yalign);
+    int width = xend - xbegin, height = yend - ybegin;
+    if ((imagesize_t)width * height < min_parallel_pixels)
+        nthreads = 1;
+    // Split into a few bands per thread, so threads that finish early
+    // (or start late) can pick up the slack, but keep band boundaries
+    // on multiples of yalign.
+    int maxbands = (height + yalign - 1) / yalign;
+    int nbands = std::min (nthreads * 4, maxbands);
+    if (nthreads < 2 || nbands < 2) {
+        func (xbegin, xend, ybegin, yend);
+        return;
+    }
+
+    std::vector<int> ybounds;
+    int bandheight = ((maxbands + nbands - 1) / nbands) * yalign;
+    for (int y = ybegin;  y < yend;  y += bandheight)
+        ybounds.push_back (y);
+    ybounds.push_back (yend);
+    parallel_for (0, (int)ybounds.size()-1,
+                  boost::bind (run_bands, &func, xbegin, xend, &ybounds, _1, _2),
+                  nthreads, 1);
+}
+
+
+
+namespace {
+
+// Copy the pixels of src in [xbegin..xend) X [ybegin..yend) to dst,
+// offset by (-xoffset,-yoffset).
+static void
+crop_block (ImageBuf *dst, const ImageBuf *src, int xoffset, int yoffset,
+            int xbegin, int xend, int ybegin, int yend)
+{
+    if (src->spec().format == dst->spec().format &&
+        src->nchannels() == dst->nchannels() && dst->localpixels() &&
+        xbegin >= src->xbegin() && xend <= src->xend() &&
+        ybegin >= src->ybegin() && yend <= src->yend() &&
+        xbegin-xoffset >= dst->xbegin() && xend-xoffset <= dst->xend() &&
+        ybegin-yoffset >= dst->ybegin() && yend-yoffset <= dst->yend()) {
+        // Same pixel layout and the whole region lies inside src and
+        // lands inside dst, so the two iterators stay in step and we
+        // can just copy the raw bytes a contiguous span at a time.
+        size_t pixelbytes = src->spec().pixel_bytes();
+        ImageBuf::ConstIterator<unsigned char,unsigned char> s (*src,
+                                             xbegin, xend, ybegin, yend);
+        ImageBuf::Iterator<unsigned char,unsigned char> d (*dst,
+                           xbegin-xoffset, ybegin-yoffset,
+                           xend-xoffset, yend-yoffset);
+        while (s.valid()) {
+            int n = std::min (s.span(), d.span());
+            memcpy (d.rawptr(), s.rawptr(), n * pixelbytes);
+            s.advance (n);
+            d.advance (n);
+        }
+        return;
+    }
+
+    float *pixel = ALLOCA (float, src->nchannels());
+    for (int j = ybegin;  j < yend;  ++j)
+        for (int i = xbegin;  i < xend;  ++i) {
+            src->getpixel (i, j, pixel);
+            dst->setpixel (i-xoffset, j-yoffset, pixel);
+        }
+}
+
+
+
+static void
+fill_block (ImageBuf *dst, const float *pixel,
+            int xbegin, int xend, int ybegin, int yend)
+{
+    dst->fill (pixel, xbegin, xend, ybegin, yend);
+}
+
+
+
+static void
+add_block (ImageBuf *dst, const ImageBuf *A, const ImageBuf *B, int options,
+           int xbegin, int xend, int ybegin, int yend)
+{
+    ImageBuf::ConstIterator<float,float> a (*A, xbegin, xend, ybegin, yend);
+    ImageBuf::ConstIterator<float,float> b (*B);
+    ImageBuf::Iterator<float> d (*dst);
+    int nchannels = A->nchannels();
+    // Offset from A's pixel coordinates to B's
+    int bxoffset = 0, byoffset = 0;
+    if (! (options & ADD_RETAIN_WINDOWS)) {
+        // ADD_ALIGN_WINDOWS: make B line up with A
+        bxoffset = B->xbegin() - A->xbegin();
+        byoffset = B->ybegin() - A->ybegin();
+    }
+    // Loop over all pixels in A, a contiguous span at a time
+    while (a.valid()) {
+        // Point the iterators for B and dst to the corresponding pixel
+        b.pos (a.x()+bxoffset, a.y()+byoffset);
+        d.pos (a.x(), a.y());
+        if (! b.valid() || ! d.valid()) {
+            a.advance (1);  // Skip pixels that don't align
+            continue;
+        }
+
+        // Add as many pixels as are contiguous in all three images
+        int n = std::min (a.span(), std::min (b.span(), d.span()));
+        const float *ap = (const float *) a.rawptr();
+        const float *bp = (const float *) b.rawptr();
+        float *dp = (float *) d.rawptr();
+        for (int i = 0, e = n*nchannels;  i < e;  ++i)
+            dp[i] = ap[i] + bp[i];
+        a.advance (n);
+    }
+}
+
+
+
+static void
+colortransfer_block (ImageBuf *buf, ColorTransfer *tfunc,
+                     int xbegin, int xend, int ybegin, int yend)
+{
+    buf->transfer_pixels (tfunc, xbegin, xend, ybegin, yend);
+}
+
+};  // end anonymous namespace
 
 
 bool 
 ImageBufAlgo::crop (ImageBuf &dst, const ImageBuf &src,
-                    int xbegin, int xend, int ybegin, int yend, int options) 
+                    int xbegin, int xend, int ybegin, int yend, int options,
+                    int nthreads)
 {
     const ImageSpec &src_spec (src.spec());
     
@@ -112,7 +297,9 @@ ImageBufAlgo::crop (ImageBuf &dst, const ImageBuf &src,
                 pixel[k]=0;
 	    break;
         }
-        dst.fill(pixel);
+        parallel_image (boost::bind (fill_block, &dst, pixel, _1, _2, _3, _4),
+                        dst.xbegin(), dst.xend(), dst.ybegin(), dst.yend(),
+                        nthreads);
     }
     //copy the cropping area pixel
     switch(options)
@@ -122,18 +309,14 @@ ImageBufAlgo::crop (ImageBuf &dst, const ImageBuf &src,
     case CROP_WHITE:
     case CROP_TRANS:
 	//all the data is copied
-	for (int j=ybegin; j<yend; j++)
-            for (int i=xbegin; i<xend; i++) {
-                src.getpixel (i, j, pixel);
-                dst.setpixel (i, j, pixel);
-	    }
+        parallel_image (boost::bind (crop_block, &dst, &src, 0, 0,
+                                     _1, _2, _3, _4),
+                        xbegin, xend, ybegin, yend, nthreads);
 	break;
     case CROP_CUT:
-	for (int j=ybegin; j<yend; j++)
-            for (int i=xbegin; i<xend; i++) {
-                src.getpixel (i, j, pixel);
-                dst.setpixel (i-xbegin, j-ybegin, pixel);
-	    }
+        parallel_image (boost::bind (crop_block, &dst, &src, xbegin, ybegin,
+                                     _1, _2, _3, _4),
+                        xbegin, xend, ybegin, yend, nthreads);
 	break;
     }
     return true;
@@ -144,7 +327,7 @@ ImageBufAlgo::crop (ImageBuf &dst, const ImageBuf &src,
     
 bool
 ImageBufAlgo::add (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
-                   int options)
+                   int options, int nthreads)
 {
     // Sanity checks
     
@@ -175,28 +358,10 @@ ImageBufAlgo::add (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
             B.spec().format == TypeDesc::FLOAT &&
             dst.spec().format == TypeDesc::FLOAT);
     
-    ImageBuf::ConstIterator<float,float> a (A);
-    ImageBuf::ConstIterator<float,float> b (B);
-    ImageBuf::Iterator<float> d (dst);
-    int nchannels = A.nchannels();
-    // Loop over all pixels in A
-    for ( ; a.valid();  ++a) {  
-        // Point the iterators for B and dst to the corresponding pixel
-        if (options & ADD_RETAIN_WINDOWS) {
-            b.pos (a.x(), a.y());
-        } else {
-            // ADD_ALIGN_WINDOWS: make B line up with A
-            b.pos (a.x()-A.xbegin()+B.xbegin(), a.y()-A.ybegin()+B.ybegin());
-        }
-        d.pos (a.x(), b.y());
-        
-        if (! b.valid() || ! d.valid())
-            continue;   // Skip pixels that don't align
-        
-        // Add the pixel
-        for (int c = 0;  c < nchannels;  ++c)
-              d[c] = a[c] + b[c];
-    }
+    // Loop over all pixels in A, split among threads
+    parallel_image (boost::bind (add_block, &dst, &A, &B, options,
+                                 _1, _2, _3, _4),
+                    A.xbegin(), A.xend(), A.ybegin(), A.yend(), nthreads);
     
     return true;
 }
@@ -205,7 +370,7 @@ ImageBufAlgo::add (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
 
 bool
 ImageBufAlgo::colortransfer (ImageBuf &output, const ImageBuf &input,
-                             ColorTransfer *tfunc)
+                             ColorTransfer *tfunc, int nthreads)
 {
     // copy input ImageBuf to output ImageBuf if they aren't the same.
     if (&output != &input)
@@ -216,7 +381,190 @@ ImageBufAlgo::colortransfer (ImageBuf &output, const ImageBuf &input,
         return true;
 
     // run the transfer function over the output ImageBuf
-    output.transfer_pixels (tfunc);
+    parallel_image (boost::bind (colortransfer_block, &output, tfunc,
+                                 _1, _2, _3, _4),
+                    output.xbegin(), output.xend(),
+                    output.ybegin(), output.yend(), nthreads);
     
     return true;
 }
+
+
+
+namespace {
+
+// Filter weights for resampling one axis: dst pixel i is the sum of
+// count[i] src pixels starting at first[i], weighted by the values
+// beginning at weights[i*maxtaps].
+struct ResizeAxis {
+    std::vector<int> first, count;
+    std::vector<float> weights;
+    int maxtaps;
+};
+
+
+
+// Fill in the weights for resampling the src pixel range
+// [srcbegin..srcend) onto the dst range [dstbegin..dstend).  Taps that
+// fall off the edge of src are clamped to the edge pixel.
+static void
+make_resize_axis (ResizeAxis &axis, const Filter1D &filter,
+                  int srcbegin, int srcend, int dstbegin, int dstend)
+{
+    int n = dstend - dstbegin;
+    float scale = (float)(srcend - srcbegin) / (float)n;
+    // When shrinking, stretch the filter to cover a dst pixel's worth
+    // of src pixels.
+    float fscale = std::max (1.0f, scale);
+    float radius = 0.5f * filter.width() * fscale;
+    axis.maxtaps = (int) ceilf (2.0f * radius) + 1;
+    axis.first.resize (n);
+    axis.count.resize (n);
+    axis.weights.assign (n * axis.maxtaps, 0.0f);
+    for (int i = 0;  i < n;  ++i) {
+        // Center of dst pixel i, in src pixel coordinates (src pixel j
+        // spans [j..j+1)).
+        float center = srcbegin + (i + 0.5f) * scale;
+        int a = (int) ceilf (center - radius - 0.5f);
+        int b = std::min ((int) floorf (center + radius - 0.5f),
+                          a + axis.maxtaps - 1);
+        int first = clamp (a, srcbegin, srcend-1);
+        float *w = &axis.weights[i * axis.maxtaps];
+        float total = 0.0f;
+        for (int j = a;  j <= b;  ++j) {
+            float wj = filter ((j + 0.5f - center) / fscale);
+            w[clamp (j, srcbegin, srcend-1) - first] += wj;
+            total += wj;
+        }
+        axis.first[i] = first;
+        axis.count[i] = clamp (b, srcbegin, srcend-1) - first + 1;
+        if (total != 0.0f) {
+            for (int j = 0;  j < axis.count[i];  ++j)
+                w[j] /= total;
+        } else {
+            // Filter too narrow to touch any src pixel center: just
+            // take the nearest one.
+            axis.first[i] = clamp ((int) floorf (center), srcbegin, srcend-1);
+            axis.count[i] = 1;
+            w[0] = 1.0f;
+        }
+    }
+}
+
+
+
+// Resize the [xbegin..xend) X [ybegin..yend) region of dst.  The src
+// scanlines contributing to the region are first filtered horizontally
+// into a float buffer, which is then filtered vertically to make each
+// dst scanline.  Every inner loop runs over contiguous floats.
+static void
+resize_block (ImageBuf *dst, const ImageBuf *src,
+              const ResizeAxis *xaxis, const ResizeAxis *yaxis,
+              int xbegin, int xend, int ybegin, int yend)
+{
+    int nchannels = src->nchannels();
+    int dx0 = xbegin - dst->xbegin(), dx1 = xend - dst->xbegin();
+    int dy0 = ybegin - dst->ybegin(), dy1 = yend - dst->ybegin();
+
+    // Range of src pixels needed for this region
+    int srcxbegin = xaxis->first[dx0], srcxend = srcxbegin;
+    for (int dx = dx0;  dx < dx1;  ++dx) {
+        srcxbegin = std::min (srcxbegin, xaxis->first[dx]);
+        srcxend = std::max (srcxend, xaxis->first[dx] + xaxis->count[dx]);
+    }
+    int srcybegin = yaxis->first[dy0], srcyend = srcybegin;
+    for (int dy = dy0;  dy < dy1;  ++dy) {
+        srcybegin = std::min (srcybegin, yaxis->first[dy]);
+        srcyend = std::max (srcyend, yaxis->first[dy] + yaxis->count[dy]);
+    }
+
+    // Horizontal pass: tmp holds, for each needed src scanline, the
+    // region's dst columns.
+    int rowvals = (xend - xbegin) * nchannels;
+    std::vector<float> srcrow ((srcxend - srcxbegin) * nchannels);
+    std::vector<float> tmp ((srcyend - srcybegin) * rowvals, 0.0f);
+    for (int sy = srcybegin;  sy < srcyend;  ++sy) {
+        src->copy_pixels (srcxbegin, srcxend, sy, sy+1,
+                          TypeDesc::FLOAT, &srcrow[0]);
+        float *out = &tmp[(sy - srcybegin) * rowvals];
+        for (int dx = dx0;  dx < dx1;  ++dx, out += nchannels) {
+            const float *w = &xaxis->weights[dx * xaxis->maxtaps];
+            const float *in = &srcrow[(xaxis->first[dx] - srcxbegin) * nchannels];
+            for (int t = 0, ntaps = xaxis->count[dx];  t < ntaps;  ++t)
+                for (int c = 0;  c < nchannels;  ++c)
+                    out[c] += w[t] * (*in++);
+        }
+    }
+
+    // Vertical pass, one dst scanline at a time
+    bool direct = (dst->localpixels() &&
+                   dst->spec().format == TypeDesc::FLOAT);
+    std::vector<float> row (rowvals);
+    for (int dy = dy0;  dy < dy1;  ++dy) {
+        int y = dy + dst->ybegin();
+        float *out = &row[0];
+        if (direct) {
+            // Sum straight into dst's own scanline
+            ImageBuf::Iterator<float> d (*dst, xbegin, y, xend, y+1);
+            out = (float *) d.rawptr();
+        }
+        std::fill (out, out + rowvals, 0.0f);
+        const float *w = &yaxis->weights[dy * yaxis->maxtaps];
+        for (int t = 0, ntaps = yaxis->count[dy];  t < ntaps;  ++t) {
+            const float *in = &tmp[(yaxis->first[dy] + t - srcybegin) * rowvals];
+            float wt = w[t];
+            for (int i = 0;  i < rowvals;  ++i)
+                out[i] += wt * in[i];
+        }
+        if (! direct)
+            for (int x = xbegin;  x < xend;  ++x)
+                dst->setpixel (x, y, &row[(x - xbegin) * nchannels]);
+    }
+}
+
+};  // end anonymous namespace
+
+
+
+bool
+ImageBufAlgo::resize (ImageBuf &dst, const ImageBuf &src,
+                      const std::string &filtername, float filterwidth,
+                      int nthreads)
+{
+    if (! dst.localpixels() || dst.nchannels() != src.nchannels() ||
+        (const void *)&src == (const void *)&dst)
+        return false;
+    if (dst.spec().width < 1 || dst.spec().height < 1 ||
+        src.spec().width < 1 || src.spec().height < 1)
+        return false;
+
+    // Full widths at which each filter looks its best, in dst pixels
+    static const struct { const char *name; float width; } filterwidths[] = {
+        { "box", 1 }, { "triangle", 2 }, { "gaussian", 2 },
+        { "catmull-rom", 4 }, { "blackman-harris", 3 }, { "sinc", 4 },
+        { "mitchell", 4 }, { "b-spline", 4 }, { NULL, 0 }
+    };
+    std::string name = filtername.empty() ? std::string("triangle") : filtername;
+    if (filterwidth <= 0.0f) {
+        filterwidth = 1.0f;
+        for (int i = 0;  filterwidths[i].name;  ++i)
+            if (name == filterwidths[i].name)
+                filterwidth = filterwidths[i].width;
+    }
+    Filter1D *filter = Filter1D::create (name, filterwidth);
+    if (! filter)
+        return false;
+
+    ResizeAxis xaxis, yaxis;
+    make_resize_axis (xaxis, *filter, src.xbegin(), src.xend(),
+                      dst.xbegin(), dst.xend());
+    make_resize_axis (yaxis, *filter, src.ybegin(), src.yend(),
+                      dst.ybegin(), dst.yend());
+    delete filter;
+
+    parallel_image (boost::bind (resize_block, &dst, &src, &xaxis, &yaxis,
+                                 _1, _2, _3, _4),
+                    dst.xbegin(), dst.xend(), dst.ybegin(), dst.yend(),
+                    nthreads);
+    return true;
+}
@@ -0,0 +1,205 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// Benchmark the ImageBufAlgo operations at a range of thread counts.
+/// For example, "imagebufalgo_bench --res 8192 8192" for 8K images.
+
+
+#include <iostream>
+#include <cstdlib>
+
+#include <boost/bind.hpp>
+
+#include "argparse.h"
+#include "imageio.h"
+#include "imagebuf.h"
+#include "strutil.h"
+#include "thread.h"
+#include "timer.h"
+
+using namespace OpenImageIO;
+
+
+static int xres = 2048, yres = 2048;
+static int nchannels = 4;
+static int iterations = 5;
+static int maxthreads = 0;
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("Usage:  imagebufalgo_bench [options]",
+                "--help", &help, "Print help message",
+                "--res %d %d", &xres, &yres, "Resolution of the test images",
+                "--iters %d", &iterations, "Iterations of each operation",
+                "--threads %d", &maxthreads,
+                    "Maximum number of threads to try (default: one per core)",
+                NULL);
+    if (ap.parse (argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+}
+
+
+
+// Run the operation the given number of times, return the average
+// time per iteration, in seconds.
+template<class FUNC>
+static double
+time_op (FUNC func, int nthreads)
+{
+    func (nthreads);   // warm up, so allocation isn't part of the timing
+    Timer timer;
+    for (int i = 0;  i < iterations;  ++i)
+        func (nthreads);
+    return timer() / iterations;
+}
+
+
+
+static ImageBuf A, B, Dst;
+static ColorTransfer *tfunc = NULL;
+
+static void do_add (int nthreads)
+{
+    ImageBufAlgo::add (Dst, A, B, ImageBufAlgo::ADD_DEFAULT, nthreads);
+}
+
+static void do_crop (int nthreads)
+{
+    ImageBuf dst;
+    ImageBufAlgo::crop (dst, A, xres/4, xres-xres/4, yres/4, yres-yres/4,
+                        ImageBufAlgo::CROP_BLACK, nthreads);
+}
+
+static void do_colortransfer (int nthreads)
+{
+    ImageBufAlgo::colortransfer (Dst, A, tfunc, nthreads);
+}
+
+// Sum the pixels of A in the region, one pixel at a time through the
+// iterator, or a contiguous span at a time.
+static void sum_block (bool spans, int xbegin, int xend, int ybegin, int yend)
+{
+    float sum = 0.0f;
+    ImageBuf::ConstIterator<float> a (A, xbegin, xend, ybegin, yend);
+    if (spans) {
+        int n;
+        for (  ;  a.valid();  a.advance (n)) {
+            n = a.span();
+            const float *p = (const float *) a.rawptr();
+            for (int i = 0;  i < n*nchannels;  ++i)
+                sum += p[i];
+        }
+    } else {
+        for (  ;  a.valid();  ++a)
+            for (int c = 0;  c < nchannels;  ++c)
+                sum += a[c];
+    }
+    volatile float result = sum;  // keep the loop from being optimized away
+    (void) result;
+}
+
+static void do_iterate (int nthreads)
+{
+    ImageBufAlgo::parallel_image (boost::bind (sum_block, false,
+                                               _1, _2, _3, _4),
+                                  0, xres, 0, yres, nthreads);
+}
+
+static void do_iterate_spans (int nthreads)
+{
+    ImageBufAlgo::parallel_image (boost::bind (sum_block, true,
+                                               _1, _2, _3, _4),
+                                  0, xres, 0, yres, nthreads);
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+    getargs (argc, argv);
+    if (maxthreads < 1) {
+#if (BOOST_VERSION >= 103500)
+        maxthreads = boost::thread::hardware_concurrency();
+#else
+        maxthreads = 1;
+#endif
+    }
+
+    ImageSpec spec (xres, yres, nchannels, TypeDesc::FLOAT);
+    spec.alpha_channel = 3;
+    A.reset ("A", spec);
+    B.reset ("B", spec);
+    Dst.reset ("Dst", spec);
+    float pixel[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+    A.fill (pixel);
+    B.fill (pixel);
+    tfunc = ColorTransfer::create ("linear_to_sRGB");
+
+    std::cout << "ImageBufAlgo on " << xres << "x" << yres << "x"
+              << nchannels << " float images, " << iterations
+              << " iterations each\n";
+    struct { const char *name; void (*func)(int); } ops[] = {
+        { "add", do_add },
+        { "crop", do_crop },
+        { "colortransfer", do_colortransfer },
+        { "iterate", do_iterate },
+        { "iterate spans", do_iterate_spans }
+    };
+    for (size_t op = 0;  op < sizeof(ops)/sizeof(ops[0]);  ++op) {
+        double t1 = 0;
+        for (int nthreads = 1;  nthreads <= maxthreads;  nthreads *= 2) {
+            double t = time_op (ops[op].func, nthreads);
+            if (nthreads == 1)
+                t1 = t;
+            std::cout << Strutil::format ("  %-14s %2d threads: %8.2f ms  (speedup %.2fx)\n",
+                                          ops[op].name, nthreads, t * 1000.0,
+                                          t > 0 ? t1 / t : 0.0);
+            if (nthreads < maxthreads && nthreads*2 > maxthreads)
+                nthreads = maxthreads / 2;  // make sure we try maxthreads
+        }
+    }
+
+    delete tfunc;
+    return 0;
+}
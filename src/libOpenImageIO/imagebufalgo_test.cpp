@@ -209,6 +209,40 @@ TEST_F (CropTest, crop_cut)
 }
 
 
+// Test a CUT crop whose region extends past the source's data window
+TEST_F (CropTest, crop_cut_past_data_window)
+{
+    // Source whose data window covers only x = [3,8) of the full image,
+    // with each pixel's value being its x coordinate
+    ImageSpec spec (5, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    spec.x = 3;
+    spec.full_x = 0;
+    spec.full_width = WIDTH;
+    spec.alpha_channel = 3;
+    ImageBuf S ("S", spec);
+    float *pixel = ALLOCA(float, CHANNELS);
+    for (int j = 0;  j < HEIGHT;  ++j)
+        for (int i = spec.x;  i < spec.x+spec.width;  ++i) {
+            for (int c = 0;  c < CHANNELS;  ++c)
+                pixel[c] = (float) i;
+            S.setpixel (i, j, pixel);
+        }
+
+    ImageBufAlgo::crop (B, S, 0, 6, 0, 4, ImageBufAlgo::CROP_CUT);
+    ASSERT_EQ (B.spec().width, 6);
+    ASSERT_EQ (B.spec().height, 4);
+    for (int j = 0;  j < B.spec().height;  ++j) {
+        for (int i = 0;  i < B.spec().width;  ++i) {
+            B.getpixel (i, j, pixel);
+            // Pixels the source has keep their place; the rest are empty
+            float expected = (i >= spec.x) ? (float) i : 0.0f;
+            for (int c = 0;  c < CHANNELS;  ++c)
+                EXPECT_EQ (pixel[c], expected) << "bad ImageBuf::crop CUT at " << i;
+        }
+    }
+}
+
+
 TEST_F (CropTest, crop_window)
 {
     // Test WINDOW crop
@@ -269,6 +303,48 @@ TEST_F (CropTest, crop_black)
 }
 
 
+// Test a BLACK crop of an image whose data window is offset from, and
+// bigger than, the display window (overscan)
+TEST_F (CropTest, crop_black_overscan)
+{
+    ImageSpec spec (WIDTH+4, HEIGHT+2, CHANNELS, TypeDesc::FLOAT);
+    spec.x = -2;
+    spec.y = -1;
+    spec.full_x = 0;
+    spec.full_y = 0;
+    spec.full_width = WIDTH;
+    spec.full_height = HEIGHT;
+    spec.alpha_channel = 3;
+    ImageBuf S ("S", spec);
+    S.fill (arbitrary1, S.xbegin(), S.xend(), S.ybegin(), S.yend());
+
+    ImageBufAlgo::crop (B, S, xbegin, xend, ybegin, yend,
+                        ImageBufAlgo::CROP_BLACK);
+    // Should keep the source's windows
+    ASSERT_EQ (B.spec().x, spec.x);
+    ASSERT_EQ (B.spec().width, spec.width);
+    ASSERT_EQ (B.spec().y, spec.y);
+    ASSERT_EQ (B.spec().height, spec.height);
+    float *pixel = ALLOCA(float, CHANNELS);
+    for (int j = B.ybegin();  j < B.yend();  ++j) {
+        for (int i = B.xbegin();  i < B.xend();  ++i) {
+            B.getpixel (i, j, pixel);
+            if (j >= ybegin && j < yend && i >= xbegin && i < xend) {
+                for (int c = 0;  c < CHANNELS;  ++c)
+                    EXPECT_EQ (pixel[c], arbitrary1[c]) << "bad ImageBuf::crop BLACK at " << i << "," << j;
+            } else {
+                // Everything else in the data window, including the
+                // overscan, should be black
+                EXPECT_EQ (pixel[0], 0) << "bad ImageBuf::crop BLACK at " << i << "," << j;
+                EXPECT_EQ (pixel[1], 0) << "bad ImageBuf::crop BLACK at " << i << "," << j;
+                EXPECT_EQ (pixel[2], 0) << "bad ImageBuf::crop BLACK at " << i << "," << j;
+                EXPECT_EQ (pixel[3], 1) << "bad ImageBuf::crop BLACK at " << i << "," << j;
+            }
+        }
+    }
+}
+
+
 TEST_F (CropTest, crop_white)
 {
     // Test WHITE crop
@@ -370,6 +446,125 @@ TEST_F (ImageBufTest, ImageBuf_add)
 
 
 
+// Tests ImageBufAlgo::add split among threads, on an image big enough
+// that parallel_image really does split it.
+TEST_F (ImageBufTest, ImageBuf_add_threads)
+{
+    const int WIDTH = 256;
+    const int HEIGHT = 256;
+    const int CHANNELS = 4;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    spec.alpha_channel = 3;
+
+    ImageBuf A ("A", spec);
+    ImageBuf B ("B", spec);
+    for (int j = 0;  j < HEIGHT;  ++j) {
+        for (int i = 0;  i < WIDTH;  ++i) {
+            float a[CHANNELS] = { (float)i, (float)j, 0.5f, 1.0f };
+            float b[CHANNELS] = { (float)j, 0.25f, (float)i, 0.0f };
+            A.setpixel (i, j, a);
+            B.setpixel (i, j, b);
+        }
+    }
+
+    ImageBuf C ("C", spec);
+    ImageBufAlgo::add (C, A, B, ImageBufAlgo::ADD_DEFAULT, 4);
+
+    for (int j = 0;  j < HEIGHT;  ++j) {
+        for (int i = 0;  i < WIDTH;  ++i) {
+            float pixel[CHANNELS];
+            C.getpixel (i, j, pixel);
+            EXPECT_EQ (pixel[0], (float)(i+j)) << "bad threaded ImageBufAlgo::add";
+            EXPECT_EQ (pixel[1], j+0.25f) << "bad threaded ImageBufAlgo::add";
+            EXPECT_EQ (pixel[2], i+0.5f) << "bad threaded ImageBufAlgo::add";
+            EXPECT_EQ (pixel[3], 1.0f) << "bad threaded ImageBufAlgo::add";
+        }
+    }
+}
+
+
+
+// Tests that iterating a span at a time visits exactly the pixels of
+// the region, in order, at the same addresses as pixel-at-a-time.
+TEST_F (ImageBufTest, ImageBuf_iterator_spans)
+{
+    const int WIDTH = 16;
+    const int HEIGHT = 8;
+    const int CHANNELS = 3;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf A ("A", spec);
+    for (int j = 0;  j < HEIGHT;  ++j) {
+        for (int i = 0;  i < WIDTH;  ++i) {
+            float pixel[CHANNELS] = { (float)i, (float)j, 0.0f };
+            A.setpixel (i, j, pixel);
+        }
+    }
+
+    ImageBuf::ConstIterator<float> pixel (A, 3, 11, 2, 6);
+    ImageBuf::ConstIterator<float> span (A, 3, 11, 2, 6);
+    int n, npixels = 0;
+    for (  ;  span.valid();  span.advance (n)) {
+        n = span.span();
+        EXPECT_EQ (n, 8) << "span should cover the rest of the region's row";
+        const float *p = (const float *) span.rawptr();
+        for (int i = 0;  i < n;  ++i, ++pixel, ++npixels) {
+            EXPECT_TRUE (pixel.rawptr() == (const void *)(p + i*CHANNELS));
+            EXPECT_EQ (p[i*CHANNELS+0], (float)pixel.x());
+            EXPECT_EQ (p[i*CHANNELS+1], (float)pixel.y());
+        }
+    }
+    EXPECT_EQ (npixels, 8*4);
+    EXPECT_FALSE (pixel.valid());
+}
+
+
+
+// Tests ImageBufAlgo::resize
+TEST_F (ImageBufTest, ImageBuf_resize)
+{
+    const int WIDTH = 16;
+    const int HEIGHT = 8;
+    const int CHANNELS = 2;
+    ImageSpec spec (WIDTH, HEIGHT, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf A ("A", spec);
+    for (int j = 0;  j < HEIGHT;  ++j) {
+        for (int i = 0;  i < WIDTH;  ++i) {
+            float pixel[CHANNELS] = { (float)i, 0.5f };
+            A.setpixel (i, j, pixel);
+        }
+    }
+
+    // Halving with a box filter averages pairs of pixels
+    ImageSpec halfspec (WIDTH/2, HEIGHT/2, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf B ("B", halfspec);
+    EXPECT_TRUE (ImageBufAlgo::resize (B, A, "box"));
+    for (int j = 0;  j < HEIGHT/2;  ++j) {
+        for (int i = 0;  i < WIDTH/2;  ++i) {
+            float pixel[CHANNELS];
+            B.getpixel (i, j, pixel);
+            EXPECT_FLOAT_EQ (pixel[0], 2*i+0.5f) << "bad box resize";
+            EXPECT_FLOAT_EQ (pixel[1], 0.5f) << "bad box resize";
+        }
+    }
+
+    // Any (normalized) filter at any scale leaves a constant channel
+    // unchanged.
+    ImageSpec oddspec (23, 5, CHANNELS, TypeDesc::FLOAT);
+    ImageBuf C ("C", oddspec);
+    EXPECT_TRUE (ImageBufAlgo::resize (C, A, "mitchell"));
+    for (int j = 0;  j < 5;  ++j) {
+        for (int i = 0;  i < 23;  ++i) {
+            float pixel[CHANNELS];
+            C.getpixel (i, j, pixel);
+            EXPECT_NEAR (pixel[1], 0.5f, 1.0e-6) << "bad mitchell resize";
+        }
+    }
+
+    EXPECT_FALSE (ImageBufAlgo::resize (C, A, "no-such-filter"));
+}
+
+
+
 // luminance ramp from -0.1 -> 14.0 used in color transfer tests
 static float LUMINANCE_LINEAR[142] = {
 -0.100000,  0.000000,  0.100000,  0.200000,  0.300000,  0.400000,  0.500000, 
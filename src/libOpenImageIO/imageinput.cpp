@@ -31,8 +31,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
-
-#include <boost/scoped_array.hpp>
+#include <vector>
+#include <algorithm>
 
 #include "dassert.h"
 #include "typedesc.h"
@@ -45,6 +45,14 @@ using namespace OpenImageIO;
 using namespace OpenImageIO::pvt;
 
 
+// How many scanlines read_scanlines and read_image ask the plugin for at
+// once.  It's a multiple of the block sizes of the common block-based
+// codecs (e.g. 16 or 32 lines for OpenEXR), big enough that a plugin
+// decoding blocks in parallel has enough of them to keep several threads
+// busy, and bounds the size of the scratch buffer needed when converting.
+static const int scanline_chunk = 256;
+
+
 
 bool 
 ImageInput::read_scanline (int y, int z, TypeDesc format, void *data,
@@ -55,9 +63,13 @@ ImageInput::read_scanline (int y, int z, TypeDesc format, void *data,
     if (contiguous && m_spec.format == format)  // Simple case
         return read_native_scanline (y, z, data);
 
-    // Complex case -- either changing data type or stride
+    // Complex case -- either changing data type or stride.  Read the
+    // native pixels into our scratch buffer, which is kept from call to
+    // call so that we don't allocate every time.
     int scanline_values = m_spec.width * m_spec.nchannels;
-    unsigned char *buf = (unsigned char *) alloca (m_spec.scanline_bytes());
+    if (m_scratch.size() < m_spec.scanline_bytes())
+        m_scratch.resize (m_spec.scanline_bytes());
+    unsigned char *buf = &m_scratch[0];
     bool ok = read_native_scanline (y, z, buf);
     if (! ok)
         return false;
@@ -74,32 +86,101 @@ ImageInput::read_scanline (int y, int z, TypeDesc format, void *data,
 
 
 
+bool
+ImageInput::read_scanlines (int ybegin, int yend, int z,
+                            TypeDesc format, void *data,
+                            stride_t xstride, stride_t ystride)
+{
+    return read_scanlines (ybegin, yend, z, 0, m_spec.nchannels,
+                           format, data, xstride, ystride);
+}
+
+
+
+bool
+ImageInput::read_scanlines (int ybegin, int yend, int z,
+                            int chbegin, int chend,
+                            TypeDesc format, void *data,
+                            stride_t xstride, stride_t ystride)
+{
+    int nchans = chend - chbegin;
+    stride_t zstride = AutoStride;
+    m_spec.auto_stride (xstride, ystride, zstride, format, nchans,
+                        m_spec.width, m_spec.height);
+    stride_t native_pixel_bytes = (stride_t) m_spec.format.size() * nchans;
+    stride_t native_scanline_bytes = native_pixel_bytes * m_spec.width;
+    if (format == m_spec.format && xstride == native_pixel_bytes &&
+          ystride == native_scanline_bytes)   // Simple case
+        return read_native_scanlines (ybegin, yend, z, chbegin, chend, data);
+
+    // Complex case -- either changing data type or stride.  Read the
+    // native pixels a chunk of scanlines at a time into our scratch
+    // buffer, and convert them into place.
+    int chunk = std::min (scanline_chunk, yend-ybegin);
+    if (chunk < 1)
+        return true;
+    if (m_scratch.size() < (size_t)(chunk * native_scanline_bytes))
+        m_scratch.resize ((size_t)(chunk * native_scanline_bytes));
+    unsigned char *buf = &m_scratch[0];
+    for (int y = ybegin;  y < yend;  y += chunk) {
+        int n = std::min (chunk, yend-y);
+        if (! read_native_scanlines (y, y+n, z, chbegin, chend, buf))
+            return false;
+        if (! convert_image (nchans, m_spec.width, n, 1,
+                             buf, m_spec.format, native_pixel_bytes,
+                             native_scanline_bytes, n*native_scanline_bytes,
+                             (char *)data + (y-ybegin)*ystride, format,
+                             xstride, ystride, AutoStride)) {
+            error ("ImageInput::read_scanlines : no support for format %s",
+                   m_spec.format.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
 bool 
 ImageInput::read_tile (int x, int y, int z, TypeDesc format, void *data,
                        stride_t xstride, stride_t ystride, stride_t zstride)
 {
+    return read_tile (x, y, z, 0, m_spec.nchannels, format, data,
+                      xstride, ystride, zstride);
+}
+
+
+
+bool 
+ImageInput::read_tile (int x, int y, int z, int chbegin, int chend,
+                       TypeDesc format, void *data,
+                       stride_t xstride, stride_t ystride, stride_t zstride)
+{
+    int nchans = chend - chbegin;
     m_spec.auto_stride (xstride, ystride, zstride, format,
-                        m_spec.nchannels, m_spec.tile_width, m_spec.tile_height);
-    bool contiguous = (xstride == m_spec.nchannels*(int)format.size() &&
+                        nchans, m_spec.tile_width, m_spec.tile_height);
+    bool contiguous = (xstride == nchans*(int)format.size() &&
                        ystride == xstride*m_spec.tile_width &&
                        (zstride == ystride*m_spec.tile_height || zstride == 0));
     if (contiguous && m_spec.format == format)  // Simple case
-        return read_native_tile (x, y, z, data);
+        return read_native_tile (x, y, z, chbegin, chend, data);
 
     // Complex case -- either changing data type or stride
     int tile_values = m_spec.tile_width * m_spec.tile_height * 
-                      std::max(1,m_spec.tile_depth) * m_spec.nchannels;
+                      std::max(1,m_spec.tile_depth) * nchans;
 
-    boost::scoped_array<char> buf (new char [m_spec.tile_bytes()]);
-    bool ok = read_native_tile (x, y, z, &buf[0]);
+    if (m_scratch.size() < tile_values * m_spec.format.size())
+        m_scratch.resize (tile_values * m_spec.format.size());
+    unsigned char *buf = &m_scratch[0];
+    bool ok = read_native_tile (x, y, z, chbegin, chend, buf);
     if (! ok)
         return false;
     // FIXME -- what happens when the last tile of a row or column extends
     // beyond the borders of the image buffer???
     ok = contiguous 
-        ? convert_types (m_spec.format, &buf[0], format, data, tile_values)
-        : convert_image (m_spec.nchannels, m_spec.tile_width, m_spec.tile_height, m_spec.tile_depth, 
-                         &buf[0], m_spec.format, AutoStride, AutoStride, AutoStride,
+        ? convert_types (m_spec.format, buf, format, data, tile_values)
+        : convert_image (nchans, m_spec.tile_width, m_spec.tile_height, m_spec.tile_depth, 
+                         buf, m_spec.format, AutoStride, AutoStride, AutoStride,
                          data, format, xstride, ystride, zstride);
     if (! ok)
         error ("ImageInput::read_tile : no support for format %s",
@@ -124,52 +205,57 @@ ImageInput::read_image (TypeDesc format, void *data,
     if (m_spec.tile_width) {
         // Tiled image
 
-        // Locally allocate a single tile to gracefully deal with image
-        // dimensions smaller than a tile, or if one of the tiles runs
-        // past the right or bottom edge.  Then we copy from our tile to
-        // the user data, only copying valid pixel ranges.
-        size_t tilexstride = m_spec.nchannels * format.size();
-        size_t tileystride = tilexstride * m_spec.tile_width;
-        size_t tilezstride = tileystride * m_spec.tile_height;
-        size_t tile_values = (size_t)m_spec.tile_width * (size_t)m_spec.tile_height *
-            (size_t)std::max(1,m_spec.tile_depth) * m_spec.nchannels;
-        boost::scoped_array<char> pels (new char [tile_values * format.size()]);
-        for (int z = 0;  z < m_spec.depth;  z += m_spec.tile_depth)
-            for (int y = 0;  y < m_spec.height;  y += m_spec.tile_height) {
-                for (int x = 0;  x < m_spec.width && ok;  x += m_spec.tile_width) {
-#if 0
-                    ok &= read_tile (x+m_spec.x, y+m_spec.y, z+m_spec.z, format,
-                                     (char *)data + z*zstride + y*ystride + x*xstride,
-                                     xstride, ystride, zstride);
-#endif
-                    ok &= read_tile (x+m_spec.x, y+m_spec.y, z+m_spec.z,
-                                     format, &pels[0]);
-                    // Now copy out the scanlines
-                    int ntz = std::min (z+m_spec.tile_depth, m_spec.depth) - z;
-                    int nty = std::min (y+m_spec.tile_height, m_spec.height) - y;
-                    int ntx = std::min (x+m_spec.tile_width, m_spec.width) - x;
-                    for (int tz = 0;  tz < ntz;  ++tz) {
-                        for (int ty = 0;  ty < nty;  ++ty) {
-                            // FIXME -- doesn't work for non-contiguous scanlines
-                            memcpy ((char *)data + x*xstride + (y+ty)*ystride + (z+tz)*zstride,
-                                    &pels[ty*tileystride+tz*tilezstride],
-                                    ntx*tilexstride);
-                        }
-                    }
-//                    return ok; // DEBUG -- just try very first tile
+        // Read a whole row of tiles at a time, so that plugins able to
+        // decode many tiles at once can do so.  When the caller wants
+        // the native format with contiguous pixels and scanlines, the
+        // tiles are read straight into the user's buffer; otherwise
+        // they're read into our scratch buffer and converted into place
+        // with the caller's strides.
+        stride_t native_pixel_bytes = (stride_t) m_spec.pixel_bytes();
+        stride_t native_scanline_bytes = (stride_t) m_spec.scanline_bytes();
+        bool native = (format == m_spec.format &&
+                       xstride == native_pixel_bytes &&
+                       ystride == native_scanline_bytes);
+        int tile_depth = std::max (1, m_spec.tile_depth);
+        for (int z = 0;  z < m_spec.depth && ok;  z += tile_depth)
+            for (int y = 0;  y < m_spec.height && ok;  y += m_spec.tile_height) {
+                int ntz = std::min (z+tile_depth, m_spec.depth) - z;
+                int nty = std::min (y+m_spec.tile_height, m_spec.height) - y;
+                char *dst = (char *)data + z*zstride + y*ystride;
+                bool direct = native && (ntz == 1 ||
+                               zstride == native_scanline_bytes*nty);
+                void *buf = dst;
+                if (! direct) {
+                    size_t size = native_scanline_bytes * nty * ntz;
+                    if (m_scratch.size() < size)
+                        m_scratch.resize (size);
+                    buf = &m_scratch[0];
                 }
+                ok &= read_native_tiles (m_spec.x, m_spec.x+m_spec.width,
+                                         y+m_spec.y, y+nty+m_spec.y,
+                                         z+m_spec.z, z+ntz+m_spec.z, buf);
+                if (ok && ! direct)
+                    ok &= convert_image (m_spec.nchannels, m_spec.width,
+                                         nty, ntz, buf, m_spec.format,
+                                         native_pixel_bytes,
+                                         native_scanline_bytes,
+                                         native_scanline_bytes*nty,
+                                         dst, format,
+                                         xstride, ystride, zstride);
                 if (progress_callback)
                     if (progress_callback (progress_callback_data, (float)y/m_spec.height))
                         return ok;
             }
     } else {
-        // Scanline image
+        // Scanline image -- read a chunk of scanlines at a time
         for (int z = 0;  z < m_spec.depth;  ++z)
-            for (int y = 0;  y < m_spec.height && ok;  ++y) {
-                ok &= read_scanline (y+m_spec.y, z+m_spec.z, format,
-                                     (char *)data + z*zstride + y*ystride,
-                                     xstride);
-                if (progress_callback && !(y & 0x0f))
+            for (int y = 0;  y < m_spec.height && ok;  y += scanline_chunk) {
+                int yend = std::min (y+scanline_chunk, m_spec.height);
+                ok &= read_scanlines (y+m_spec.y, yend+m_spec.y, z+m_spec.z,
+                                      format,
+                                      (char *)data + z*zstride + y*ystride,
+                                      xstride, ystride);
+                if (progress_callback)
                     if (progress_callback (progress_callback_data, (float)y/m_spec.height))
                         return ok;
             }
@@ -181,6 +267,129 @@ ImageInput::read_image (TypeDesc format, void *data,
 
 
 
+bool
+ImageInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    size_t scanline_bytes = m_spec.scanline_bytes();
+    for (int y = ybegin;  y < yend;  ++y)
+        if (! read_native_scanline (y, z,
+                                    (char *)data + (y-ybegin)*scanline_bytes))
+            return false;
+    return true;
+}
+
+
+
+bool
+ImageInput::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                               int zbegin, int zend, void *data)
+{
+    // Read each tile into a temporary buffer, then copy the part of it
+    // that lies within the requested region into its place in the block.
+    stride_t pixel_bytes = (stride_t) m_spec.pixel_bytes();
+    stride_t tile_ystride = pixel_bytes * m_spec.tile_width;
+    stride_t tile_zstride = tile_ystride * m_spec.tile_height;
+    stride_t ystride = pixel_bytes * (xend-xbegin);
+    stride_t zstride = ystride * (yend-ybegin);
+    int tile_depth = std::max (1, m_spec.tile_depth);
+    if (m_native_scratch.size() < m_spec.tile_bytes())
+        m_native_scratch.resize (m_spec.tile_bytes());
+    unsigned char *pels = &m_native_scratch[0];
+    for (int z = zbegin;  z < zend;  z += tile_depth)
+        for (int y = ybegin;  y < yend;  y += m_spec.tile_height)
+            for (int x = xbegin;  x < xend;  x += m_spec.tile_width) {
+                if (! read_native_tile (x, y, z, pels))
+                    return false;
+                int ntz = std::min (z+tile_depth, zend) - z;
+                int nty = std::min (y+m_spec.tile_height, yend) - y;
+                int ntx = std::min (x+m_spec.tile_width, xend) - x;
+                if (! convert_image (m_spec.nchannels, ntx, nty, ntz,
+                               pels, m_spec.format, pixel_bytes,
+                               tile_ystride, tile_zstride,
+                               (char *)data + (z-zbegin)*zstride
+                                   + (y-ybegin)*ystride + (x-xbegin)*pixel_bytes,
+                               m_spec.format, pixel_bytes, ystride, zstride)) {
+                    error ("ImageInput::read_native_tiles : no support for format %s",
+                           m_spec.format.c_str());
+                    return false;
+                }
+            }
+    return true;
+}
+
+
+
+bool
+ImageInput::read_native_scanlines (int ybegin, int yend, int z,
+                                   int chbegin, int chend, void *data)
+{
+    if (chbegin == 0 && chend == m_spec.nchannels)
+        return read_native_scanlines (ybegin, yend, z, data);
+
+    // Read all the channels, a chunk of scanlines at a time, and copy
+    // out just the ones asked for.
+    int chunk = std::min (scanline_chunk, yend-ybegin);
+    if (chunk < 1)
+        return true;
+    stride_t pixel_bytes = (stride_t) m_spec.pixel_bytes();
+    stride_t scanline_bytes = (stride_t) m_spec.scanline_bytes();
+    stride_t chan_pixel_bytes = (stride_t) m_spec.format.size() * (chend-chbegin);
+    stride_t chan_scanline_bytes = chan_pixel_bytes * m_spec.width;
+    if (m_native_scratch.size() < (size_t)(chunk * scanline_bytes))
+        m_native_scratch.resize ((size_t)(chunk * scanline_bytes));
+    unsigned char *pels = &m_native_scratch[0];
+    for (int y = ybegin;  y < yend;  y += chunk) {
+        int n = std::min (chunk, yend-y);
+        if (! read_native_scanlines (y, y+n, z, pels))
+            return false;
+        if (! convert_image (chend-chbegin, m_spec.width, n, 1,
+                       pels + chbegin * m_spec.format.size(), m_spec.format,
+                       pixel_bytes, scanline_bytes, n*scanline_bytes,
+                       (char *)data + (y-ybegin)*chan_scanline_bytes,
+                       m_spec.format, chan_pixel_bytes, chan_scanline_bytes,
+                       n*chan_scanline_bytes)) {
+            error ("ImageInput::read_native_scanlines : no support for format %s",
+                   m_spec.format.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageInput::read_native_tile (int x, int y, int z,
+                              int chbegin, int chend, void *data)
+{
+    if (chbegin == 0 && chend == m_spec.nchannels)
+        return read_native_tile (x, y, z, data);
+
+    // Read the whole tile and copy out just the channels asked for
+    if (m_native_scratch.size() < m_spec.tile_bytes())
+        m_native_scratch.resize (m_spec.tile_bytes());
+    unsigned char *pels = &m_native_scratch[0];
+    if (! read_native_tile (x, y, z, pels))
+        return false;
+    stride_t pixel_bytes = (stride_t) m_spec.pixel_bytes();
+    stride_t chan_pixel_bytes = (stride_t) m_spec.format.size() * (chend-chbegin);
+    if (! convert_image (chend-chbegin, m_spec.tile_width,
+                         m_spec.tile_height, std::max (1, m_spec.tile_depth),
+                         pels + chbegin * m_spec.format.size(), m_spec.format,
+                         pixel_bytes, pixel_bytes * m_spec.tile_width,
+                         pixel_bytes * m_spec.tile_width * m_spec.tile_height,
+                         data, m_spec.format, chan_pixel_bytes,
+                         chan_pixel_bytes * m_spec.tile_width,
+                         chan_pixel_bytes * m_spec.tile_width * m_spec.tile_height)) {
+        error ("ImageInput::read_native_tile : no support for format %s",
+               m_spec.format.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+
 int 
 ImageInput::send_to_input (const char *format, ...)
 {
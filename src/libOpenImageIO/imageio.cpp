@@ -34,8 +34,6 @@
 #include <OpenEXR/half.h>
 #include <OpenEXR/ImathFun.h>
 
-#include <boost/scoped_array.hpp>
-
 #include "dassert.h"
 #include "typedesc.h"
 #include "strutil.h"
@@ -50,6 +48,7 @@ using namespace OpenImageIO::pvt;
 
 
 static std::string create_error_msg;
+static atomic_int exr_threads;   // 0 = no threading, as OpenEXR defaults
 
 recursive_mutex OpenImageIO::pvt::imageio_mutex;
 
@@ -88,6 +87,34 @@ OpenImageIO::geterror ()
 
 
 
+bool
+OpenImageIO::attribute (const std::string &name, TypeDesc type,
+                        const void *val)
+{
+    // exr_threads is atomic, so it may be set and read (as it is on
+    // every OpenEXR open) without taking imageio_mutex.
+    if (name == "exr_threads" && type == TypeDesc::INT) {
+        exr_threads = *(const int *)val;
+        return true;
+    }
+    return false;
+}
+
+
+
+bool
+OpenImageIO::getattribute (const std::string &name, TypeDesc type,
+                           void *val)
+{
+    if (name == "exr_threads" && type == TypeDesc::INT) {
+        *(int *)val = exr_threads;
+        return true;
+    }
+    return false;
+}
+
+
+
 int
 OpenImageIO::quantize (float value, int quant_black, int quant_white,
                        int quant_min, int quant_max, float quant_dither)
@@ -182,10 +209,286 @@ OpenImageIO::pvt::contiguize (const void *src, int nchannels,
 
 
 
+// Vectorized kernels for the most common format conversions (8 and 16
+// bit unsigned ints and half, to and from float).  Each gives exactly
+// the same results as the scalar code it replaces.  SSE2 is part of
+// every x86-64 CPU so it's chosen at compile time; the half conversions
+// need F16C, so we check for it at runtime.
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(_MSC_VER))
+#  define CONVERT_SSE2 1
+#  include <emmintrin.h>
+#endif
+#if defined(CONVERT_SSE2) && defined(__GNUC__) && !defined(__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#  define CONVERT_F16C 1
+#  include <immintrin.h>
+#  include <cpuid.h>
+#endif
+
+
+namespace {
+
+#ifdef CONVERT_SSE2
+
+// Load 4 values as 32 bit ints
+inline __m128i
+load4 (const unsigned char *src)
+{
+    int bits;
+    memcpy (&bits, src, sizeof(int));
+    __m128i v = _mm_unpacklo_epi8 (_mm_cvtsi32_si128 (bits),
+                                   _mm_setzero_si128());
+    return _mm_unpacklo_epi16 (v, _mm_setzero_si128());
+}
+
+inline __m128i
+load4 (const unsigned short *src)
+{
+    __m128i v = _mm_loadl_epi64 ((const __m128i *)src);
+    return _mm_unpacklo_epi16 (v, _mm_setzero_si128());
+}
+
+
+// Store 4 ints, already known to be in range, as the narrower type
+inline void
+store4 (__m128i v, unsigned char *dst)
+{
+    v = _mm_packs_epi32 (v, v);
+    v = _mm_packus_epi16 (v, v);
+    int bits = _mm_cvtsi128_si32 (v);
+    memcpy (dst, &bits, sizeof(int));
+}
+
+inline void
+store4 (__m128i v, unsigned short *dst)
+{
+    // There's no unsigned 32->16 bit pack in SSE2, so shift to signed
+    // range, pack, and shift back.
+    v = _mm_packs_epi32 (_mm_sub_epi32 (v, _mm_set1_epi32 (32768)),
+                         _mm_setzero_si128());
+    v = _mm_xor_si128 (v, _mm_set1_epi16 ((short)0x8000));
+    _mm_storel_epi64 ((__m128i *)dst, v);
+}
+
+
+// Same as convert_type<T,float>, which does the scaling in double.
+template<typename T>
+void
+to_float_sse2 (const T *src, float *dst, size_t n)
+{
+    const __m128d scale = _mm_set1_pd (1.0 / std::numeric_limits<T>::max());
+    size_t i = 0;
+    for ( ;  i + 4 <= n;  i += 4) {
+        __m128i v = load4 (src + i);
+        __m128d lo = _mm_mul_pd (_mm_cvtepi32_pd (v), scale);
+        __m128d hi = _mm_mul_pd (_mm_cvtepi32_pd (_mm_srli_si128 (v, 8)),
+                                 scale);
+        _mm_storeu_ps (dst + i, _mm_movelh_ps (_mm_cvtpd_ps (lo),
+                                               _mm_cvtpd_ps (hi)));
+    }
+    if (i < n)
+        convert_type (src + i, dst + i, n - i);
+}
+
+
+// Same as convert_type<float,T>: scale, clamp (NaN goes to 0), and
+// truncate, in double.
+template<typename T>
+void
+from_float_sse2 (const float *src, T *dst, size_t n)
+{
+    const __m128d tmax = _mm_set1_pd ((double) std::numeric_limits<T>::max());
+    const __m128d zero = _mm_setzero_pd ();
+    size_t i = 0;
+    for ( ;  i + 4 <= n;  i += 4) {
+        __m128 f = _mm_loadu_ps (src + i);
+        __m128d lo = _mm_mul_pd (_mm_cvtps_pd (f), tmax);
+        __m128d hi = _mm_mul_pd (_mm_cvtps_pd (_mm_movehl_ps (f, f)), tmax);
+        lo = _mm_min_pd (_mm_max_pd (lo, zero), tmax);
+        hi = _mm_min_pd (_mm_max_pd (hi, zero), tmax);
+        store4 (_mm_unpacklo_epi64 (_mm_cvttpd_epi32 (lo),
+                                    _mm_cvttpd_epi32 (hi)), dst + i);
+    }
+    if (i < n)
+        convert_type (src + i, dst + i, n - i);
+}
+
+
+// Same as quantize() of each value: lerp between black and white in
+// float, then truncate and clamp to [qmin,qmax] (NaN goes to qmin).
+template<typename T>
+void
+quantize_sse2 (const float *src, T *dst, size_t n,
+               int black, int white, int qmin, int qmax)
+{
+    const __m128 one = _mm_set1_ps (1.0f);
+    const __m128 b = _mm_set1_ps ((float)black);
+    const __m128 w = _mm_set1_ps ((float)white);
+    const __m128 lo = _mm_set1_ps ((float)qmin);
+    const __m128 hi = _mm_set1_ps ((float)qmax);
+    size_t i = 0;
+    for ( ;  i + 4 <= n;  i += 4) {
+        __m128 t = _mm_loadu_ps (src + i);
+        __m128 v = _mm_add_ps (_mm_mul_ps (b, _mm_sub_ps (one, t)),
+                               _mm_mul_ps (w, t));
+        v = _mm_min_ps (_mm_max_ps (v, lo), hi);
+        store4 (_mm_cvttps_epi32 (v), dst + i);
+    }
+    for ( ;  i < n;  ++i)
+        dst[i] = (T) quantize (src[i], black, white, qmin, qmax, 0.0f);
+}
+
+#endif /* CONVERT_SSE2 */
+
+
+#ifdef CONVERT_F16C
+
+// Does the CPU (and OS) support the F16C half conversion instructions?
+bool
+cpu_has_f16c ()
+{
+    unsigned int a, b, c, d;
+    if (! __get_cpuid (1, &a, &b, &c, &d))
+        return false;
+    // F16C instructions are VEX encoded, so the OS must also be saving
+    // the AVX register state.
+    if (! (c & bit_F16C) || ! (c & bit_AVX) || ! (c & bit_OSXSAVE))
+        return false;
+    unsigned int xcr0, xcr0hi;
+    __asm__ ("xgetbv" : "=a" (xcr0), "=d" (xcr0hi) : "c" (0));
+    return (xcr0 & 6) == 6;
+}
+
+const bool has_f16c = cpu_has_f16c ();
+
+
+__attribute__ ((target ("avx,f16c")))
+void
+half_to_float_f16c (const half *src, float *dst, size_t n)
+{
+    size_t i = 0;
+    for ( ;  i + 8 <= n;  i += 8)
+        _mm256_storeu_ps (dst + i,
+                   _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *)(src + i))));
+    for ( ;  i < n;  ++i)
+        dst[i] = src[i];
+}
+
+
+// Rounds to nearest even, like half(float).
+__attribute__ ((target ("avx,f16c")))
+void
+float_to_half_f16c (const float *src, half *dst, size_t n)
+{
+    size_t i = 0;
+    for ( ;  i + 8 <= n;  i += 8)
+        _mm_storeu_si128 ((__m128i *)(dst + i),
+                          _mm256_cvtps_ph (_mm256_loadu_ps (src + i), 0));
+    for ( ;  i < n;  ++i)
+        dst[i] = src[i];
+}
+
+#endif /* CONVERT_F16C */
+
+
+
+// Convert n values of the given format to float with the vectorized
+// kernels, if there are any for that format.  Return false, having
+// done nothing, if there aren't.
+bool
+simd_to_float (const void *src, float *dst, size_t n, TypeDesc format)
+{
+    switch (format.basetype) {
+#ifdef CONVERT_SSE2
+    case TypeDesc::UINT8 :
+        to_float_sse2 ((const unsigned char *)src, dst, n);
+        return true;
+    case TypeDesc::UINT16 :
+        to_float_sse2 ((const unsigned short *)src, dst, n);
+        return true;
+#endif
+#ifdef CONVERT_F16C
+    case TypeDesc::HALF :
+        if (! has_f16c)
+            return false;
+        half_to_float_f16c ((const half *)src, dst, n);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+
+
+// Convert n floats to the given format, with the same results as
+// convert_type, using the vectorized kernels if there are any for that
+// format.  Return false, having done nothing, if there aren't.
+bool
+simd_from_float (const float *src, void *dst, size_t n, TypeDesc format)
+{
+    switch (format.basetype) {
+#ifdef CONVERT_SSE2
+    case TypeDesc::UINT8 :
+        from_float_sse2 (src, (unsigned char *)dst, n);
+        return true;
+    case TypeDesc::UINT16 :
+        from_float_sse2 (src, (unsigned short *)dst, n);
+        return true;
+#endif
+#ifdef CONVERT_F16C
+    case TypeDesc::HALF :
+        if (! has_f16c)
+            return false;
+        float_to_half_f16c (src, (half *)dst, n);
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+
+
+// Quantize n floats to the given format, with the same results as
+// convert_from_float, using the vectorized kernels if there are any for
+// that format and the quantization range fits it.  Return false,
+// having done nothing, if not.
+bool
+simd_quantize (const float *src, void *dst, size_t n, TypeDesc format,
+               int black, int white, int qmin, int qmax)
+{
+    switch (format.basetype) {
+#ifdef CONVERT_SSE2
+    case TypeDesc::UINT8 :
+        if (qmin < 0 || qmax > 255)
+            return false;
+        quantize_sse2 (src, (unsigned char *)dst, n, black, white, qmin, qmax);
+        return true;
+    case TypeDesc::UINT16 :
+        if (qmin < 0 || qmax > 65535)
+            return false;
+        quantize_sse2 (src, (unsigned short *)dst, n, black, white, qmin, qmax);
+        return true;
+#endif
+    case TypeDesc::HALF :
+        // Half isn't quantized, just converted
+        return simd_from_float (src, dst, n, format);
+    default:
+        return false;
+    }
+}
+
+};  // end anonymous namespace
+
+
+
 const float *
 OpenImageIO::pvt::convert_to_float (const void *src, float *dst, int nvals,
                                     TypeDesc format)
 {
+    if (simd_to_float (src, dst, nvals, format))
+        return dst;
     switch (format.basetype) {
     case TypeDesc::FLOAT :
         return (float *)src;
@@ -270,6 +573,9 @@ OpenImageIO::pvt::convert_from_float (const float *src, void *dst, size_t nvals,
                                       int quant_min, int quant_max, float quant_dither, 
                                       TypeDesc format)
 {
+    if (src && simd_quantize (src, dst, nvals, format, quant_black,
+                              quant_white, quant_min, quant_max))
+        return dst;
     switch (format.basetype) {
     case TypeDesc::FLOAT :
         return src;
@@ -322,56 +628,41 @@ OpenImageIO::pvt::convert_from_float (const float *src, void *dst, size_t nvals,
 
 
 
+namespace {
+
+// Convert n values of src_type to float.  Return false if src_type is
+// not a known format.
 bool
-OpenImageIO::convert_types (TypeDesc src_type, const void *src, 
-                            TypeDesc dst_type, void *dst, int n,
-                            ColorTransfer *tfunc,
-                            int alpha_channel, int z_channel)
+types_to_float (TypeDesc src_type, const void *src, float *buf, int n)
 {
-    // If no conversion is necessary, just memcpy
-    if (src_type == dst_type && tfunc == NULL) {
-        memcpy (dst, src, n * src_type.size());
+    if (simd_to_float (src, buf, n, src_type))
         return true;
+    switch (src_type.basetype) {
+    case TypeDesc::UINT8 : convert_type ((const unsigned char *)src, buf, n); break;
+    case TypeDesc::UINT16 : convert_type ((const unsigned short *)src, buf, n); break;
+    case TypeDesc::FLOAT : convert_type ((const float *)src, buf, n); break;
+    case TypeDesc::HALF :  convert_type ((const half *)src, buf, n); break;
+    case TypeDesc::DOUBLE : convert_type ((const double *)src, buf, n); break;
+    case TypeDesc::INT8 :  convert_type ((const char *)src, buf, n);  break;
+    case TypeDesc::INT16 : convert_type ((const short *)src, buf, n); break;
+    case TypeDesc::INT :   convert_type ((const int *)src, buf, n); break;
+    case TypeDesc::UINT :  convert_type ((const unsigned int *)src, buf, n);  break;
+    case TypeDesc::INT64 : convert_type ((const long long *)src, buf, n); break;
+    case TypeDesc::UINT64 : convert_type ((const unsigned long long *)src, buf, n);  break;
+    default:         return false;  // unknown format
     }
+    return true;
+}
 
-    // Conversions are via a temporary float array
-    bool use_tmp = false;
-    boost::scoped_array<float> tmp;
-    float *buf;
-    if (src_type == TypeDesc::FLOAT && tfunc == NULL) {
-        buf = (float *) src;
-    } else {
-        tmp.reset (new float[n]);  // Will be freed when tmp exists its scope
-        buf = tmp.get();
-        use_tmp = true;
-    }
-
-    if (use_tmp) {
-        // Convert from 'src_type' to float (or nothing, if already float)
-        switch (src_type.basetype) {
-        case TypeDesc::UINT8 : convert_type ((const unsigned char *)src, buf, n); break;
-        case TypeDesc::UINT16 : convert_type ((const unsigned short *)src, buf, n); break;
-        case TypeDesc::FLOAT : convert_type ((const float *)src, buf, n); break;
-        case TypeDesc::HALF :  convert_type ((const half *)src, buf, n); break;
-        case TypeDesc::DOUBLE : convert_type ((const double *)src, buf, n); break;
-        case TypeDesc::INT8 :  convert_type ((const char *)src, buf, n);  break;
-        case TypeDesc::INT16 : convert_type ((const short *)src, buf, n); break;
-        case TypeDesc::INT :   convert_type ((const int *)src, buf, n); break;
-        case TypeDesc::UINT :  convert_type ((const unsigned int *)src, buf, n);  break;
-        case TypeDesc::INT64 : convert_type ((const long long *)src, buf, n); break;
-        case TypeDesc::UINT64 : convert_type ((const unsigned long long *)src, buf, n);  break;
-        default:         return false;  // unknown format
-        }
 
-        // use a transfer function to encode or decode the image signal
-        if (tfunc) {
-            for (int i = 0;  i < n;  ++i)
-                if (i != alpha_channel && i != z_channel)
-                    buf[i] = (*tfunc) (buf[i]);
-        }
-    }
 
-    // Convert float to 'dst_type' (just a copy if dst is float)
+// Convert n floats to dst_type (just a copy if dst is float).  Return
+// false if dst_type is not a known format.
+bool
+types_from_float (const float *buf, TypeDesc dst_type, void *dst, int n)
+{
+    if (simd_from_float (buf, dst, n, dst_type))
+        return true;
     switch (dst_type.basetype) {
     case TypeDesc::FLOAT :  memcpy (dst, buf, n * sizeof(float));       break;
     case TypeDesc::UINT8 :  convert_type (buf, (unsigned char *)dst, n);  break;
@@ -386,7 +677,54 @@ OpenImageIO::convert_types (TypeDesc src_type, const void *src,
     case TypeDesc::DOUBLE : convert_type (buf, (double *)dst, n); break;
     default:         return false;  // unknown format
     }
+    return true;
+}
+
+};  // end anonymous namespace
 
+
+
+bool
+OpenImageIO::convert_types (TypeDesc src_type, const void *src, 
+                            TypeDesc dst_type, void *dst, int n,
+                            ColorTransfer *tfunc,
+                            int alpha_channel, int z_channel)
+{
+    // If no conversion is necessary, just memcpy
+    if (src_type == dst_type && tfunc == NULL) {
+        memcpy (dst, src, n * src_type.size());
+        return true;
+    }
+
+    // Float source with nothing else to do: convert directly
+    if (src_type == TypeDesc::FLOAT && tfunc == NULL)
+        return types_from_float ((const float *)src, dst_type, dst, n);
+
+    // Other conversions are via float -- straight into dst if that's
+    // float, otherwise a chunk at a time through a small buffer on the
+    // stack, so that we never need to allocate memory here.
+    const int chunksize = 1024;
+    float chunk[chunksize];
+    size_t srcsize = src_type.size(), dstsize = dst_type.size();
+    for (int start = 0;  start < n;  start += chunksize) {
+        int nc = std::min (chunksize, n - start);
+        float *buf = (dst_type == TypeDesc::FLOAT) ? (float *)dst + start
+                                                   : chunk;
+        if (! types_to_float (src_type, (const char *)src + start*srcsize,
+                              buf, nc))
+            return false;
+
+        // use a transfer function to encode or decode the image signal
+        if (tfunc) {
+            for (int i = 0;  i < nc;  ++i)
+                if (start+i != alpha_channel && start+i != z_channel)
+                    buf[i] = (*tfunc) (buf[i]);
+        }
+
+        if (buf == chunk &&
+            ! types_from_float (buf, dst_type, (char *)dst + start*dstsize, nc))
+            return false;
+    }
     return true;
 }
 
@@ -417,7 +755,12 @@ OpenImageIO::convert_image (int nchannels, int width, int height, int depth,
     ImageSpec::auto_stride (dst_xstride, dst_ystride, dst_zstride,
                             dst_type, nchannels, width, height);
     bool result = true;
-    bool contig = (src_xstride == dst_xstride && src_xstride == nchannels);
+    // A transfer function that must skip the alpha or z channel forces
+    // the pixel-at-a-time path, since convert_types can only find those
+    // channels within a single pixel.
+    bool contig = (src_xstride == (stride_t)(nchannels * src_type.size()) &&
+                   dst_xstride == (stride_t)(nchannels * dst_type.size()) &&
+                   (! tfunc || (alpha_channel < 0 && z_channel < 0)));
     for (int z = 0;  z < depth;  ++z) {
         for (int y = 0;  y < height;  ++y) {
             const char *f = (const char *)src + (z*src_zstride + y*src_ystride);
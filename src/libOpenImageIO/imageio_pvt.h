@@ -52,6 +52,10 @@ namespace pvt {
 ///
 typedef void* (*create_prototype)();
 
+/// Prototype for a plugin's cheap check of whether the first nbytes of
+/// a file look like its format.
+typedef bool (*signature_prototype)(const unsigned char *header, int nbytes);
+
 /// Mutex allowing thread safety of ImageOutput internals
 ///
 extern recursive_mutex imageio_mutex;
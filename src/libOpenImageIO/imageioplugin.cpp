@@ -31,6 +31,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -42,6 +43,7 @@
 #include "plugin.h"
 #include "strutil.h"
 #include "filesystem.h"
+#include "refcnt.h"
 
 #include "imageio.h"
 #include "imageio_pvt.h"
@@ -64,6 +66,9 @@ static PluginMap output_extensions;
 static std::map <std::string, Plugin::Handle> plugin_handles;
 // Map format name to full path
 static std::map <std::string, std::string> plugin_filepaths;
+// Map ImageInput creation to its signature check
+typedef std::map <create_prototype, signature_prototype> SignatureMap;
+static SignatureMap input_signatures;
 
 // FIXME -- do we use the extensions above?
 
@@ -71,12 +76,91 @@ static std::map <std::string, std::string> plugin_filepaths;
 static std::string pattern = Strutil::format (".imageio.%s",
                                               Plugin::plugin_extension());
 
+// How many bytes at the start of a file ImageInput::create reads to
+// hand to the plugins' signature checks.
+static const int signature_bytes = 64;
+
+
+
+/// Read-only copy of what ImageInput::create and ImageOutput::create
+/// need from the tables above.  A new one is published every time the
+/// tables change, and each thread keeps a reference to the one it last
+/// saw, so that looking up a plugin doesn't need to lock imageio_mutex.
+struct PluginCatalog {
+    PluginMap input_formats;    ///< Format name or extension -> creator
+    PluginMap output_formats;   ///< Format name or extension -> creator
+    /// Input creators and signature checks, one per format.  Formats
+    /// whose plugin has no signature check have a NULL check.
+    std::vector<std::pair<create_prototype,signature_prototype> > input_plugins;
+    /// Search paths that have already been scanned for plugins, so a
+    /// format that isn't in the tables doesn't send us back to the
+    /// disk every time it's asked for.
+    std::set<std::string> searchpaths;
+};
+
+struct PluginCatalogRef {
+    int generation;
+    shared_ptr<PluginCatalog> catalog;
+};
+
+static shared_ptr<PluginCatalog> plugin_catalog (new PluginCatalog);
+static atomic_int plugin_catalog_generation;
+static thread_specific_ptr<PluginCatalogRef> plugin_catalog_ref;
+
+
+
+/// Publish a new PluginCatalog reflecting the tables above, having
+/// scanned the given searchpaths.  Must be called while holding
+/// imageio_mutex.
+static void
+publish_plugin_catalog (const std::set<std::string> &searchpaths)
+{
+    shared_ptr<PluginCatalog> cat (new PluginCatalog);
+    cat->input_formats = input_formats;
+    cat->output_formats = output_formats;
+    std::set<create_prototype> seen;
+    for (PluginMap::const_iterator f = input_formats.begin();
+         f != input_formats.end();  ++f) {
+        if (seen.insert (f->second).second) {
+            SignatureMap::const_iterator sig = input_signatures.find (f->second);
+            cat->input_plugins.push_back (std::make_pair (f->second,
+                    sig == input_signatures.end() ? NULL : sig->second));
+        }
+    }
+    cat->searchpaths = searchpaths;
+    plugin_catalog = cat;
+    ++plugin_catalog_generation;
+}
+
+
+
+/// Return the most recently published PluginCatalog, taking the lock
+/// only if it has changed since this thread last asked.
+static shared_ptr<PluginCatalog>
+current_plugin_catalog ()
+{
+    PluginCatalogRef *ref = plugin_catalog_ref.get ();
+    if (! ref) {
+        ref = new PluginCatalogRef;
+        ref->generation = -1;
+        plugin_catalog_ref.reset (ref);
+    }
+    if (ref->generation != plugin_catalog_generation) {
+        recursive_lock_guard lock (imageio_mutex);
+        ref->catalog = plugin_catalog;
+        ref->generation = plugin_catalog_generation;
+    }
+    return ref->catalog;
+}
+
+
 
 /// Register the input and output 'create' routine and list of file
 /// extensions for a particular format.
 static void
 declare_plugin (const std::string &format_name,
                 create_prototype input_creator, const char **input_extensions,
+                signature_prototype input_signature,
                 create_prototype output_creator, const char **output_extensions)
 {
 //    std::cerr << "declaring plugin for " << format_name << "\n";
@@ -93,6 +177,8 @@ declare_plugin (const std::string &format_name,
             if (input_formats.find(ext) == input_formats.end())
                 input_formats[ext] = input_creator;
         }
+        if (input_signature)
+            input_signatures[input_creator] = input_signature;
     }
 
     // Look for output creator and list of supported extensions
@@ -160,6 +246,8 @@ catalog_plugin (const std::string &format_name,
         (create_prototype) Plugin::getsym (handle, format_name+"_input_imageio_create");
     const char **input_extensions =
         (const char **) Plugin::getsym (handle, format_name+"_input_extensions");
+    signature_prototype input_signature =
+        (signature_prototype) Plugin::getsym (handle, format_name+"_input_signature");
     create_prototype output_creator =
         (create_prototype) Plugin::getsym (handle, format_name+"_output_imageio_create");
     const char **output_extensions =
@@ -167,7 +255,7 @@ catalog_plugin (const std::string &format_name,
 
     if (input_creator || output_creator)
         declare_plugin (format_name, input_creator, input_extensions,
-                        output_creator, output_extensions);
+                        input_signature, output_creator, output_extensions);
     else
         Plugin::close (handle);   // not useful
 }
@@ -178,11 +266,12 @@ catalog_plugin (const std::string &format_name,
 // list of file extensions, for the standard plugins that come with OIIO.
 // These won't be used unless EMBED_PLUGINS is defined.  Use the PLUGENTRY
 // macro to make the declaration compact and easy to read.
-#define PLUGENTRY(name)                                        \
-    extern ImageInput *name ## _input_imageio_create ();       \
-    extern ImageOutput *name ## _output_imageio_create ();     \
-    extern const char *name ## _output_extensions[];           \
-    extern const char *name ## _input_extensions[];
+#define PLUGENTRY(name)                                                 \
+    extern ImageInput *name ## _input_imageio_create ();                \
+    extern ImageOutput *name ## _output_imageio_create ();              \
+    extern const char *name ## _output_extensions[];                    \
+    extern const char *name ## _input_extensions[];                     \
+    extern bool name ## _input_signature (const unsigned char *, int);
 
 extern "C" {
     PLUGENTRY (bmp);
@@ -216,6 +305,7 @@ catalog_builtin_plugins ()
     declare_plugin (#name,                                              \
                     (create_prototype) name ## _input_imageio_create,   \
                     name ## _input_extensions,                          \
+                    name ## _input_signature,                           \
                     (create_prototype) name ## _output_imageio_create,  \
                     name ## _output_extensions)
 
@@ -241,11 +331,15 @@ catalog_builtin_plugins ()
 
 
 /// Look at ALL imageio plugins in the searchpath and add them to the
-/// catalog.  This routine is not reentrant and should only be called
-/// by a routine that is holding a lock on imageio_mutex.
+/// catalog, then publish the new PluginCatalog.  This routine is not
+/// reentrant and should only be called by a routine that is holding a
+/// lock on imageio_mutex.
 static void
 catalog_all_plugins (std::string searchpath)
 {
+    std::set<std::string> searchpaths = plugin_catalog->searchpaths;
+    searchpaths.insert (searchpath);
+
     catalog_builtin_plugins ();
 
     const char *imageio_library_path = getenv ("IMAGEIO_LIBRARY_PATH");
@@ -281,11 +375,49 @@ catalog_all_plugins (std::string searchpath)
             }
         }
     }
+    publish_plugin_catalog (searchpaths);
 //    std::cerr << "done catalog_all\n";
 }
 
 
 
+/// Return the current PluginCatalog, first scanning searchpath for
+/// plugins if there's no input (or output) plugin for format and we
+/// haven't looked there before.
+static shared_ptr<PluginCatalog>
+find_plugins (const std::string &format, const std::string &searchpath,
+              bool input)
+{
+    shared_ptr<PluginCatalog> catalog = current_plugin_catalog ();
+    const PluginMap &formats (input ? catalog->input_formats
+                                    : catalog->output_formats);
+    if (formats.find (format) == formats.end() &&
+        catalog->searchpaths.find (searchpath) == catalog->searchpaths.end()) {
+        recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
+        // Another thread may have scanned it while we waited for the lock
+        if (plugin_catalog->searchpaths.find (searchpath) ==
+                plugin_catalog->searchpaths.end())
+            catalog_all_plugins (searchpath);
+        catalog = plugin_catalog;
+    }
+    return catalog;
+}
+
+
+
+void
+OpenImageIO::refresh_plugins (const std::string &plugin_searchpath)
+{
+    recursive_lock_guard lock (imageio_mutex);
+    // Forget which paths we've already scanned, so that formats we
+    // still can't find will be looked for again, and rescan this one
+    // right now.
+    publish_plugin_catalog (std::set<std::string>());
+    catalog_all_plugins (plugin_searchpath);
+}
+
+
+
 ImageOutput *
 ImageOutput::create (const std::string &filename, const std::string &plugin_searchpath)
 {
@@ -306,16 +438,15 @@ ImageOutput::create (const std::string &filename, const std::string &plugin_sear
         // std::cerr << "extension of '" << filename << "' is '" << format << "'\n";
     }
 
-    recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
-
     // See if it's already in the table.  If not, scan all plugins we can
     // find to populate the table.
     boost::algorithm::to_lower (format);
-    if (output_formats.find (format) == output_formats.end())
-        catalog_all_plugins (plugin_searchpath);
+    shared_ptr<PluginCatalog> catalog = find_plugins (format, plugin_searchpath,
+                                                      false);
 
-    if (output_formats.find (format) == output_formats.end()) {
-        if (input_formats.empty()) {
+    PluginMap::const_iterator found = catalog->output_formats.find (format);
+    if (found == catalog->output_formats.end()) {
+        if (catalog->input_formats.empty()) {
             // This error is so fundamental, we echo it to stderr in
             // case the app is too dumb to do so.
             const char *msg = "ImageOutput::create() could not find any ImageOutput plugins!\n"
@@ -329,15 +460,35 @@ ImageOutput::create (const std::string &filename, const std::string &plugin_sear
         return NULL;
     }
 
-    create_prototype create_function = output_formats[format];
+    create_prototype create_function = found->second;
     ASSERT (create_function != NULL);
     return (ImageOutput *) create_function();
 }
 
 
 
-ImageInput *
-ImageInput::create (const std::string &filename, const std::string &plugin_searchpath)
+/// Read up to signature_bytes from the start of the file into header,
+/// returning how many we got (0 if the file can't be read).
+static int
+read_header (const std::string &filename, unsigned char *header)
+{
+    FILE *f = fopen (filename.c_str(), "rb");
+    if (! f)
+        return 0;
+    int nbytes = (int) fread (header, 1, signature_bytes, f);
+    fclose (f);
+    return nbytes;
+}
+
+
+
+/// Create the ImageInput for filename.  If by_extension is true and a
+/// plugin claims the file's extension, that plugin is used without
+/// touching the file.  Otherwise the start of the file is read once and
+/// the plugins' signature checks pick which one gets it.
+static ImageInput *
+create_input (const std::string &filename, const std::string &plugin_searchpath,
+              bool by_extension)
 {
     if (filename.empty()) { // Can't even guess if no filename given
         OpenImageIO::pvt::error ("ImageInput::create() called with no filename");
@@ -356,39 +507,52 @@ ImageInput::create (const std::string &filename, const std::string &plugin_searc
         // std::cerr << "extension of '" << filename << "' is '" << format << "'\n";
     }
 
-    recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
-
     // See if it's already in the table.  If not, scan all plugins we can
     // find to populate the table.
     boost::algorithm::to_lower (format);
-    if (input_formats.find (format) == input_formats.end())
-        catalog_all_plugins (plugin_searchpath);
+    shared_ptr<PluginCatalog> catalog = find_plugins (format, plugin_searchpath,
+                                                      true);
 
     create_prototype create_function = NULL; 
-    if (input_formats.find (format) != input_formats.end()) {
-        create_function = input_formats[format];
-    } else {
-        // If a plugin can't be found that was explicitly designated
-        // for this extension, then just try every one we find and see if
-        // any will open the file.
-        for (PluginMap::const_iterator plugin = input_formats.begin();
-             plugin != input_formats.end(); ++plugin)
-        {
+    if (by_extension) {
+        PluginMap::const_iterator found = catalog->input_formats.find (format);
+        if (found != catalog->input_formats.end())
+            return (ImageInput *) found->second();
+    }
+
+    // Read the start of the file once and let the plugins' signature
+    // checks pick which one gets it.
+    unsigned char header[signature_bytes];
+    int nbytes = read_header (filename, header);
+    for (size_t i = 0;  nbytes > 0 && i < catalog->input_plugins.size();  ++i) {
+        signature_prototype sig = catalog->input_plugins[i].second;
+        if (sig && sig (header, nbytes)) {
+            create_function = catalog->input_plugins[i].first;
+            break;
+        }
+    }
+
+    if (create_function == NULL) {
+        // If no plugin claims this file, try the ones that can't tell
+        // from the header alone and see if any will open the file.
+        for (size_t i = 0;  i < catalog->input_plugins.size();  ++i) {
+            if (catalog->input_plugins[i].second)
+                continue;
             ImageSpec test_spec;
-            ImageInput *test_plugin = (ImageInput*) plugin->second();
+            ImageInput *test_plugin = (ImageInput*) catalog->input_plugins[i].first();
             bool ok = test_plugin->open(filename, test_spec);
             if (ok)
                 test_plugin->close ();
             delete test_plugin;
             if (ok) {
-                create_function = plugin->second;
+                create_function = catalog->input_plugins[i].first;
                 break;
             }
         }
     }
 
     if (create_function == NULL) {
-        if (input_formats.empty()) {
+        if (catalog->input_formats.empty()) {
             // This error is so fundamental, we echo it to stderr in
             // case the app is too dumb to do so.
             const char *msg = "ImageInput::create() could not find any ImageInput plugins!\n"
@@ -407,3 +571,20 @@ ImageInput::create (const std::string &filename, const std::string &plugin_searc
 
     return (ImageInput *) create_function();
 }
+
+
+
+ImageInput *
+ImageInput::create (const std::string &filename, const std::string &plugin_searchpath)
+{
+    return create_input (filename, plugin_searchpath, true);
+}
+
+
+
+ImageInput *
+ImageInput::create_by_contents (const std::string &filename,
+                                const std::string &plugin_searchpath)
+{
+    return create_input (filename, plugin_searchpath, false);
+}
@@ -49,6 +49,13 @@ using namespace OpenImageIO;
 using namespace OpenImageIO::pvt;
 
 
+// How many scanlines write_image hands to write_scanlines at once.  It
+// is a multiple of the usual strip and block heights, and big enough
+// that plugins which compress strips or blocks in parallel have enough
+// of them to keep several threads busy.
+static const int scanline_chunk = 256;
+
+
 
 int
 ImageOutput::send_to_output (const char *format, ...)
@@ -182,6 +189,73 @@ ImageOutput::to_native_rectangle (int xmin, int xmax, int ymin, int ymax,
 
 
 
+bool
+ImageOutput::write_scanlines (int ybegin, int yend, int z,
+                              TypeDesc format, const void *data,
+                              stride_t xstride, stride_t ystride)
+{
+    stride_t zstride = AutoStride;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        m_spec.width, yend-ybegin);
+    bool ok = true;
+    for (int y = ybegin;  y < yend && ok;  ++y)
+        ok &= write_scanline (y, z, format,
+                              (const char *)data + (y-ybegin)*ystride, xstride);
+    return ok;
+}
+
+
+
+bool
+ImageOutput::write_tiles (int xbegin, int xend, int ybegin, int yend,
+                          int zbegin, int zend, TypeDesc format,
+                          const void *data, stride_t xstride,
+                          stride_t ystride, stride_t zstride)
+{
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        xend-xbegin, yend-ybegin);
+
+    // Tiles that lie entirely within the region are passed to
+    // write_tile straight from the caller's buffer, with the caller's
+    // strides.  Those that run past the right or bottom edge (or
+    // regions smaller than a tile) are first copied into a zero-padded
+    // full-size tile, so that write_tile never reads past the data.
+    stride_t tilexstride = m_spec.nchannels * format.size();
+    stride_t tileystride = tilexstride * m_spec.tile_width;
+    stride_t tilezstride = tileystride * m_spec.tile_height;
+    int tile_depth = std::max (1, m_spec.tile_depth);
+    std::vector<char> pels;
+    bool ok = true;
+    for (int z = zbegin;  z < zend && ok;  z += tile_depth)
+        for (int y = ybegin;  y < yend && ok;  y += m_spec.tile_height)
+            for (int x = xbegin;  x < xend && ok;  x += m_spec.tile_width) {
+                const char *tiledata = (const char *)data + (z-zbegin)*zstride
+                                     + (y-ybegin)*ystride + (x-xbegin)*xstride;
+                int ntz = std::min (z+tile_depth, zend) - z;
+                int nty = std::min (y+m_spec.tile_height, yend) - y;
+                int ntx = std::min (x+m_spec.tile_width, xend) - x;
+                if (ntx == m_spec.tile_width && nty == m_spec.tile_height &&
+                    ntz == tile_depth) {
+                    ok &= write_tile (x, y, z, format, tiledata,
+                                      xstride, ystride, zstride);
+                } else {
+                    pels.assign (tilezstride * tile_depth, 0);
+                    if (! convert_image (m_spec.nchannels, ntx, nty, ntz,
+                                   tiledata, format, xstride, ystride, zstride,
+                                   &pels[0], format,
+                                   tilexstride, tileystride, tilezstride)) {
+                        error ("ImageOutput::write_tiles : no support for format %s",
+                               format.c_str());
+                        return false;
+                    }
+                    ok &= write_tile (x, y, z, format, &pels[0]);
+                }
+            }
+    return ok;
+}
+
+
+
 bool
 ImageOutput::write_image (TypeDesc format, const void *data,
                           stride_t xstride, stride_t ystride, stride_t zstride,
@@ -201,59 +275,31 @@ ImageOutput::write_image (TypeDesc format, const void *data,
         if (progress_callback (progress_callback_data, 0.0f))
             return ok;
     if (m_spec.tile_width && supports ("tiles")) {
-        // Tiled image
-
-        // FIXME: what happens if the image dimensions are smaller than
-        // the tile dimensions?  Or if one of the tiles runs past the
-        // right or bottom edge?  Do we need to allocate a full tile and
-        // copy into it before calling write_tile?  That's probably the
-        // safe thing to do.  Or should that handling be pushed all the
-        // way into write_tile itself?
-
-        // Locally allocate a single tile to gracefully deal with image
-        // dimensions smaller than a tile, or if one of the tiles runs
-        // past the right or bottom edge.  Then we copy from our tile to
-        // the user data, only copying valid pixel ranges.
-        size_t tilexstride = m_spec.nchannels * format.size();
-        size_t tileystride = tilexstride * m_spec.tile_width;
-        size_t tilezstride = tileystride * m_spec.tile_height;
-        size_t tile_values = (size_t)m_spec.tile_width * (size_t)m_spec.tile_height *
-            (size_t)std::max(1,m_spec.tile_depth) * m_spec.nchannels;
-        std::vector<char> pels (tile_values * format.size());
-
-        for (int z = 0;  z < m_spec.depth;  z += m_spec.tile_depth)
-            for (int y = 0;  y < m_spec.height;  y += m_spec.tile_height) {
-                for (int x = 0;  x < m_spec.width && ok;  x += m_spec.tile_width) {
-                    // Now copy out the scanlines
-                    // FIXME -- can we do less work for the tiles that
-                    // don't overlap image boundaries?
-                    int ntz = std::min (z+m_spec.tile_depth, m_spec.depth) - z;
-                    int nty = std::min (y+m_spec.tile_height, m_spec.height) - y;
-                    int ntx = std::min (x+m_spec.tile_width, m_spec.width) - x;
-                    for (int tz = 0;  tz < ntz;  ++tz) {
-                        for (int ty = 0;  ty < nty;  ++ty) {
-                            // FIXME -- doesn't work for non-contiguous scanlines
-                            memcpy (&pels[ty*tileystride+tz*tilezstride],
-                                    (char *)data + x*xstride + (y+ty)*ystride + (z+tz)*zstride,
-                                    ntx*tilexstride);
-                        }
-                    }
-
-                    ok &= write_tile (x+m_spec.x, y+m_spec.y, z+m_spec.z,
-                                      format, &pels[0]);
-                }
+        // Tiled image -- hand the plugin a whole row of tiles at a time
+        int tile_depth = std::max (1, m_spec.tile_depth);
+        for (int z = 0;  z < m_spec.depth && ok;  z += tile_depth)
+            for (int y = 0;  y < m_spec.height && ok;  y += m_spec.tile_height) {
+                int ntz = std::min (z+tile_depth, m_spec.depth) - z;
+                int nty = std::min (y+m_spec.tile_height, m_spec.height) - y;
+                ok &= write_tiles (m_spec.x, m_spec.x+m_spec.width,
+                                   y+m_spec.y, y+nty+m_spec.y,
+                                   z+m_spec.z, z+ntz+m_spec.z, format,
+                                   (const char *)data + z*zstride + y*ystride,
+                                   xstride, ystride, zstride);
                 if (progress_callback)
                     if (progress_callback (progress_callback_data, (float)y/m_spec.height))
                         return ok;
             }
     } else {
-        // Scanline image
+        // Scanline image -- hand the plugin a chunk of scanlines at a time
         for (int z = 0;  z < m_spec.depth;  ++z)
-            for (int y = 0;  y < m_spec.height && ok;  ++y) {
-                ok &= write_scanline (y+m_spec.y, z+m_spec.z, format,
-                                      (const char *)data + z*zstride + y*ystride,
-                                      xstride);
-                if (progress_callback && !(y & 0x0f))
+            for (int y = 0;  y < m_spec.height && ok;  y += scanline_chunk) {
+                int yend = std::min (y+scanline_chunk, m_spec.height);
+                ok &= write_scanlines (y+m_spec.y, yend+m_spec.y, z+m_spec.z,
+                                       format,
+                                       (const char *)data + z*zstride + y*ystride,
+                                       xstride, ystride);
+                if (progress_callback)
                     if (progress_callback (progress_callback_data, (float)y/m_spec.height))
                         return ok;
             }
@@ -0,0 +1,170 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// Benchmark how fast images can be read from disk: open each file and
+/// read all its pixels several times, reading either through the usual
+/// file I/O or through a memory-mapped Filesystem::IOMappedFile.
+
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "argparse.h"
+#include "filesystem.h"
+#include "imageio.h"
+#include "strutil.h"
+#include "timer.h"
+
+using namespace OpenImageIO;
+
+
+static std::vector<std::string> filenames;
+static int iterations = 10;
+static bool use_mmap = false;
+
+
+
+static int
+parse_files (int argc, const char *argv[])
+{
+    for (int i = 0;  i < argc;  i++)
+        filenames.push_back (argv[i]);
+    return 0;
+}
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("Usage:  ingest_bench [options] filename...",
+                "%*", parse_files, "",
+                "--help", &help, "Print help message",
+                "--iters %d", &iterations, "Iterations of each read",
+                "--mmap", &use_mmap, "Also time reading through a memory-mapped file",
+                NULL);
+    if (ap.parse (argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help || filenames.empty()) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+}
+
+
+
+// Open the file and read all of its pixels, through the proxy if one is
+// given.  Return the number of pixel bytes read, or 0 on failure.
+static imagesize_t
+read_file (const std::string &filename, Filesystem::IOProxy *io,
+           std::vector<char> &pixels)
+{
+    ImageInput *in = ImageInput::create (filename);
+    if (! in) {
+        std::cerr << "ingest_bench: " << geterror() << "\n";
+        return 0;
+    }
+    if (io && ! in->set_ioproxy (io)) {
+        std::cerr << "ingest_bench: " << in->format_name()
+                  << " can't read through a proxy\n";
+        delete in;
+        return 0;
+    }
+    ImageSpec spec;
+    imagesize_t bytes = 0;
+    if (in->open (filename, spec)) {
+        bytes = spec.image_bytes ();
+        pixels.resize (bytes);
+        if (! in->read_image (spec.format, &pixels[0])) {
+            std::cerr << "ingest_bench: " << in->geterror() << "\n";
+            bytes = 0;
+        }
+        in->close ();
+    } else {
+        std::cerr << "ingest_bench: " << in->geterror() << "\n";
+    }
+    delete in;
+    return bytes;
+}
+
+
+
+// Time reading the file, and report the rate of the pixels read.
+static void
+benchmark (const std::string &filename, bool mmap)
+{
+    std::vector<char> pixels;
+    Filesystem::IOMappedFile *io = NULL;
+    if (mmap) {
+        io = new Filesystem::IOMappedFile (filename);
+        if (! io->opened ()) {
+            std::cerr << "ingest_bench: could not map " << filename << "\n";
+            delete io;
+            return;
+        }
+    }
+
+    // One read up front so that the file is in the cache for all of them
+    imagesize_t bytes = read_file (filename, io, pixels);
+    if (bytes) {
+        Timer timer;
+        for (int i = 0;  i < iterations;  ++i)
+            read_file (filename, io, pixels);
+        double t = timer() / iterations;
+        std::cout << Strutil::format ("  %-32s %-6s %8.2f ms  %8.1f MB/s\n",
+                                      filename.c_str(), mmap ? "mmap" : "file",
+                                      t * 1.0e3, bytes / t * 1.0e-6);
+    }
+    delete io;
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+    getargs (argc, argv);
+
+    std::cout << "Reading each image " << iterations << " times\n";
+    for (size_t i = 0;  i < filenames.size();  ++i) {
+        benchmark (filenames[i], false);
+        if (use_mmap)
+            benchmark (filenames[i], true);
+    }
+    return 0;
+}
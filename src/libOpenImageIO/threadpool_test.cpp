@@ -0,0 +1,119 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <iostream>
+
+#include "thread.h"
+
+#define BOOST_TEST_SOURCE
+#define BOOST_TEST_MAIN
+#include <boost/test/included/unit_test.hpp>
+
+
+// Test the thread pool by having parallel_for and a task_set each
+// increment an atomic accumulator once per item.  If, at the end, the
+// accumulated value equals the number of items, every item ran exactly
+// once.
+
+const int nitems = 100000;
+
+atomic_int accum;
+
+
+
+static void
+add_range (int begin, int end)
+{
+    accum += (end - begin);
+}
+
+
+
+static void
+add_one ()
+{
+    ++accum;
+}
+
+
+
+static void
+nested_range (int begin, int end)
+{
+    // Nested parallel_for must not deadlock even if every pool thread
+    // is busy running the outer loop.
+    for (int i = begin;  i < end;  ++i)
+        parallel_for (0, 100, add_range, 4, 10);
+}
+
+
+
+BOOST_AUTO_TEST_CASE (test_parallel_for)
+{
+    std::cout << "hw threads = " << thread_pool::hardware_threads() << "\n";
+    std::cout << "pool size = " << thread_pool::default_pool()->size() << "\n";
+
+    accum = 0;
+    parallel_for (0, nitems, add_range, 16, 7);
+    BOOST_CHECK_EQUAL ((int)accum, nitems);
+
+    accum = 0;
+    parallel_for (0, 64, nested_range, 8, 1);
+    BOOST_CHECK_EQUAL ((int)accum, 64*100);
+}
+
+
+
+BOOST_AUTO_TEST_CASE (test_task_set)
+{
+    accum = 0;
+    {
+        task_set tasks;
+        for (int i = 0;  i < 1000;  ++i)
+            tasks.push (add_one);
+        tasks.wait ();
+        BOOST_CHECK_EQUAL ((int)accum, 1000);
+        BOOST_CHECK (! tasks.cancelled());
+    }
+
+    // A cancelled task_set still returns from wait(), and no more tasks
+    // run than were pushed.
+    accum = 0;
+    {
+        task_set tasks;
+        for (int i = 0;  i < 1000;  ++i)
+            tasks.push (add_one);
+        tasks.cancel ();
+        tasks.wait ();
+        BOOST_CHECK (tasks.cancelled());
+        BOOST_CHECK ((int)accum <= 1000);
+    }
+}
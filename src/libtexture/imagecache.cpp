@@ -32,6 +32,7 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <algorithm>
 #include <boost/foreach.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/tr1/memory.hpp>
@@ -170,6 +171,22 @@ void safe_insert (HashMapT& map, const typename HashMapT::key_type& key,
 #endif
 
 
+
+// One point of a get_pixels_gather() request, keyed by the tile it
+// falls in, so that a request can be sorted into tile order.
+struct GatherPoint {
+    int subimage, ty, tx;   // Tile origin
+    int index;              // Which point of the request
+    bool operator< (const GatherPoint &b) const {
+        if (subimage != b.subimage)
+            return subimage < b.subimage;
+        if (ty != b.ty)
+            return ty < b.ty;
+        return tx < b.tx;
+    }
+};
+
+
 };  // end anonymous namespace
 
 
@@ -279,6 +296,10 @@ ImageCacheFile::LevelInfo::LevelInfo (const ImageSpec &spec)
                         spec.height == spec.full_height &&
                         spec.depth == spec.full_depth);
     zero_origin = (spec.x == 0 && spec.y == 0 && spec.z == 0);
+    full_width = spec.full_width;
+    full_height = spec.full_height;
+    tilewidthmask = spec.tile_width - 1;
+    tileheightmask = spec.tile_height - 1;
 }
 
 
@@ -287,7 +308,7 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
                                 ImageCachePerThreadInfo *thread_info,
                                 ustring filename)
     : m_filename(filename), m_used(true), m_broken(false),
-      m_untiled(false), m_unmipped(false),
+      m_untiled(false), m_unmipped(false), m_filesubimages(0),
       m_texformat(TexFormatTexture),
       m_swrap(TextureOptions::WrapBlack), m_twrap(TextureOptions::WrapBlack),
       m_cubelayout(CubeUnknown), m_y_up(false),
@@ -342,11 +363,17 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         return false;
     }
 
+    // When automipping, let readers that can cheaply decode coarser
+    // versions of the image supply them as the first few MIP levels.
+    ImageSpec config;
+    if (imagecache().automip())
+        config.attribute ("reduced_subimages", 1);
+
     ImageSpec tempspec;
     m_broken = false;
     bool ok = true;
     for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
-        ok = m_input->open (m_filename.c_str(), tempspec);
+        ok = m_input->open (m_filename.c_str(), tempspec, config);
         if (ok) {
             if (tries)   // succeeded, but only after a failure!
                 ++thread_info->m_stats.file_retry_success;
@@ -356,6 +383,20 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         // We failed.  Wait a bit and try again.
         Sysutil::usleep (1000 * 100);  // 100 ms
     }
+    if (! ok) {
+        // The extension may have picked the wrong reader; see if the
+        // start of the file says it's really something else.
+        ImageInput *in = ImageInput::create_by_contents (m_filename.c_str(),
+                                          m_imagecache.searchpath().c_str());
+        (void) OpenImageIO::geterror ();  // Eat the errors
+        if (in && strcmp (in->format_name(), m_input->format_name()) &&
+                in->open (m_filename.c_str(), tempspec, config)) {
+            m_input.reset (in);
+            ok = true;
+        } else {
+            delete in;
+        }
+    }
     if (! ok) {
         imagecache().error ("%s", m_input->geterror().c_str());
         m_broken = true;
@@ -381,6 +422,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     m_validspec = true;
     m_spec.clear ();
     m_spec.reserve (16);
+    m_levels.clear ();
     int nsubimages = 0;
     do {
         if (nsubimages > 1 && tempspec.nchannels != m_spec[0].nchannels) {
@@ -412,17 +454,21 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         thread_info->m_stats.files_totalsize += tempspec.image_bytes();
     } while (m_input->seek_subimage (nsubimages, tempspec));
     ASSERT ((size_t)nsubimages == m_spec.size());
+    m_filesubimages = nsubimages;
 
     // Special work for non-MIPmapped images -- but only if "automip" is
     // on, it's a non-mipmapped image, and it doesn't have a "textureformat"
     // attribute (because that would indicate somebody constructed it as
-    // texture and specifically wants it un-mipmapped).
-    if (nsubimages == 1)
+    // texture and specifically wants it un-mipmapped).  Reduced-resolution
+    // decodes supplied by the reader don't make it MIP-mapped; we just
+    // carry on from the coarsest of them.
+    if (nsubimages == 1 ||
+            m_spec[1].find_attribute ("reduction", TypeDesc::TypeInt))
         m_unmipped = true;
     if (m_untiled && m_unmipped && imagecache().automip() &&
             ! spec().find_attribute ("textureformat", TypeDesc::TypeString)) {
-        int w = spec().full_width;
-        int h = spec().full_height;
+        int w = m_spec.back().full_width;
+        int h = m_spec.back().full_height;
         while (w > 1 || h > 1) {
             w = std::max (1, w/2);
             h = std::max (1, h/2);
@@ -520,8 +566,12 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     m_datatype = TypeDesc::FLOAT;
     if (! m_imagecache.forcefloat()) {
         // If we aren't forcing everything to be float internally, then 
-        // there are a few other types we allow.
-        if (spec.format == TypeDesc::UINT8)
+        // there are a few other types we allow.  Keeping 16 bit (uint16
+        // and half) data in its native form halves the cache footprint
+        // compared to float; the texture filters convert on the fly.
+        if (spec.format == TypeDesc::UINT8 ||
+            spec.format == TypeDesc::UINT16 ||
+            spec.format == TypeDesc::HALF)
             m_datatype = spec.format;
     }
 
@@ -539,6 +589,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
 bool
 ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
                            int subimage, int x, int y, int z,
+                           int chbegin, int chend,
                            TypeDesc format, void *data)
 {
     recursive_lock_guard guard (m_input_mutex);
@@ -567,7 +618,7 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         m_mipused = true;
 
     // Special case for un-MIP-mapped
-    if (m_unmipped && subimage != 0) {
+    if (m_unmipped && subimage >= m_filesubimages) {
         // For unmipped, non-zero subimage, release the mutex on the
         // ImageInput since upper levels don't need to directly perform
         // I/O.  This prevents the deadlock that could occur if another
@@ -575,7 +626,8 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         // the mutex (it's waiting for our mutex, we're waiting on its
         // tile to get filled with pixels).
         unlock_input_mutex ();
-        bool ok = read_unmipped (thread_info, subimage, x, y, z, format, data);
+        bool ok = read_unmipped (thread_info, subimage, x, y, z,
+                                 chbegin, chend, format, data);
         // The lock_guard at the very top will try to unlock upon
         // destruction, to to make things right, we need to re-lock.
         lock_input_mutex ();
@@ -584,7 +636,8 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
 
     // Special case for untiled
     if (m_untiled)
-        return read_untiled (thread_info, subimage, x, y, z, format, data);
+        return read_untiled (thread_info, subimage, x, y, z,
+                             chbegin, chend, format, data);
 
     // Ordinary tiled
     ImageSpec tmp;
@@ -592,7 +645,7 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         ok = m_input->seek_subimage (subimage, tmp);
     if (ok) {
         for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
-            ok = m_input->read_tile (x, y, z, format, data);
+            ok = m_input->read_tile (x, y, z, chbegin, chend, format, data);
             if (ok) {
                 if (tries)   // succeeded, but only after a failure!
                     ++thread_info->m_stats.tile_retry_success;
@@ -607,7 +660,8 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
             imagecache().error ("%s", m_input->error_message().c_str());
     }
     if (ok) {
-        size_t b = spec(subimage).tile_bytes();
+        size_t b = spec(subimage).tile_pixels() * (chend-chbegin)
+                       * spec(subimage).channel_bytes();
         thread_info->m_stats.bytes_read += b;
         m_bytesread += b;
         ++m_tilesread;
@@ -620,6 +674,7 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
 bool
 ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
                                int subimage, int x, int y, int z,
+                               int chbegin, int chend,
                                TypeDesc format, void *data)
 {
     // We need a tile from an unmipmapped file, and it doesn't really
@@ -638,9 +693,10 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
     const ImageSpec &spec (this->spec(subimage));
     int tw = spec.tile_width;
     int th = spec.tile_height;
+    int nchans = chend - chbegin;
     stride_t xstride=AutoStride, ystride=AutoStride, zstride=AutoStride;
-    spec.auto_stride(xstride, ystride, zstride, format, spec.nchannels, tw, th);
-    ImageSpec lospec (tw, th, spec.nchannels, TypeDesc::FLOAT);
+    spec.auto_stride(xstride, ystride, zstride, format, nchans, tw, th);
+    ImageSpec lospec (tw, th, nchans, TypeDesc::FLOAT);
     ImageBuf lores ("tmp", lospec);
 
     // Figure out the range of texels we need for this tile
@@ -674,8 +730,8 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
     // Texel by texel, generate the values by interpolating filtered
     // lookups form the next finer subimage.
     const ImageSpec &upspec (this->spec(subimage-1));  // next higher subimage
-    float *bilerppels = (float *) alloca (4 * spec.nchannels * sizeof(float));
-    float *resultpel = (float *) alloca (spec.nchannels * sizeof(float));
+    float *bilerppels = (float *) alloca (4 * nchans * sizeof(float));
+    float *resultpel = (float *) alloca (nchans * sizeof(float));
     bool ok = true;
     for (int j = y0;  j <= y1;  ++j) {
         float yf = (j+0.5f) / spec.full_height;
@@ -687,10 +743,11 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
             float xfrac = floorfrac (xf * upspec.full_width - 0.5, &xlow);
             ok &= imagecache().get_pixels (this, thread_info, subimage-1,
                                            xlow, xlow+2, ylow, ylow+2,
-                                           0, 1, TypeDesc::FLOAT, bilerppels);
-            bilerp (bilerppels+0, bilerppels+spec.nchannels,
-                    bilerppels+2*spec.nchannels, bilerppels+3*spec.nchannels,
-                    xfrac, yfrac, spec.nchannels, resultpel);
+                                           0, 1, chbegin, chend,
+                                           TypeDesc::FLOAT, bilerppels);
+            bilerp (bilerppels+0, bilerppels+nchans,
+                    bilerppels+2*nchans, bilerppels+3*nchans,
+                    xfrac, yfrac, nchans, resultpel);
             lores.setpixel (i-x0, j-y0, resultpel);
         }
     }
@@ -712,6 +769,7 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
 bool
 ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
                               int subimage, int x, int y, int z,
+                              int chbegin, int chend,
                               TypeDesc format, void *data)
 {
     // N.B. No need to lock the input mutex, since this is only called
@@ -730,9 +788,10 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
     // Strides for a single tile
     int tw = spec(subimage).tile_width;
     int th = spec(subimage).tile_height;
+    int nchans = chend - chbegin;
     stride_t xstride=AutoStride, ystride=AutoStride, zstride=AutoStride;
     spec(subimage).auto_stride (xstride, ystride, zstride, format,
-                                spec(subimage).nchannels, tw, th);
+                                nchans, tw, th);
 
     bool ok = true;
     if (imagecache().autotile()) {
@@ -743,25 +802,30 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
         // if not already present, on the assumption that it's highly
         // likely that they will also soon be requested.
         // FIXME -- I don't think this works properly for 3D images
-        int pixelsize = spec(subimage).nchannels * format.size();
+        int pixelsize = nchans * format.size();
         // Because of the way we copy below, we need to allocate the
         // buffer to be an even multiple of the tile width, so round up.
         stride_t scanlinesize = tw * ((spec(subimage).width+tw-1)/tw);
         scanlinesize *= pixelsize;
-        std::vector<char> buf (scanlinesize * th); // a whole tile-row size
+        // Use this thread's scratch buffer, so we don't allocate anew
+        // for every tile-row.
+        std::vector<char> &buf (thread_info->scratch); // a whole tile-row size
+        if (buf.size() < (size_t)(scanlinesize * th))
+            buf.resize (scanlinesize * th);
         int yy = y - spec(subimage).y;   // counting from top scanline
         // [y0,y1] is the range of scanlines to read for a tile-row
         int y0 = yy - (yy % th);
         int y1 = std::min (y0 + th - 1, spec(subimage).height - 1);
         y0 += spec(subimage).y;
         y1 += spec(subimage).y;
-        // Read the whole tile-row worth of scanlines
-        for (int scanline = y0, i = 0; scanline <= y1 && ok; ++scanline, ++i) {
-            ok = m_input->read_scanline (scanline, z, format, (void *)&buf[scanlinesize*i]);
-            if (! ok)
-                imagecache().error ("%s", m_input->error_message().c_str());
-        }
-        size_t b = (y1-y0+1) * spec(subimage).scanline_bytes();
+        // Read the whole tile-row worth of scanlines in one call, so the
+        // plugin may decode them in blocks rather than line by line.
+        ok = m_input->read_scanlines (y0, y1+1, z, chbegin, chend, format,
+                                      (void *)&buf[0], pixelsize, scanlinesize);
+        if (! ok)
+            imagecache().error ("%s", m_input->error_message().c_str());
+        size_t b = (y1-y0+1) * spec(subimage).width * nchans
+                       * spec(subimage).channel_bytes();
         thread_info->m_stats.bytes_read += b;
         m_bytesread += b;
         ++m_tilesread;
@@ -780,7 +844,7 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
         for (int i = 0;  i < spec(subimage).width;  i += tw) {
             if (i == xx) {
                 // This is the tile we've been asked for
-                convert_image (spec(subimage).nchannels, tw, th, 1,
+                convert_image (nchans, tw, th, 1,
                                &buf[x0 * pixelsize], format, pixelsize,
                                scanlinesize, scanlinesize*th, data, format,
                                xstride, ystride, zstride);
@@ -788,7 +852,8 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
                 // Not the tile we asked for, but it's in the same
                 // tile-row, so let's put it in the cache anyway so
                 // it'll be there when asked for.
-                TileID id (*this, subimage, i+spec(subimage).x, y0, z);
+                TileID id (*this, subimage, i+spec(subimage).x, y0, z,
+                           chbegin, chend);
                 if (! imagecache().tile_in_cache (id, thread_info,
                                                   true /*lock*/)) {
                     ImageCacheTileRef tile;
@@ -806,10 +871,15 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
         lock_input_mutex ();
     } else {
         // No auto-tile -- the tile is the whole image
-        ok = m_input->read_image (format, data, xstride, ystride, zstride);
+        const ImageSpec &s (spec(subimage));
+        for (int zz = 0;  ok && zz < std::max (1, s.depth);  ++zz)
+            ok = m_input->read_scanlines (s.y, s.y+s.height, s.z+zz,
+                                          chbegin, chend, format,
+                                          (char *)data + zz*zstride,
+                                          xstride, ystride);
         if (! ok)
             imagecache().error ("%s", m_input->error_message().c_str());
-        size_t b = spec(subimage).image_bytes();
+        size_t b = s.image_pixels() * nchans * s.channel_bytes();
         thread_info->m_stats.bytes_read += b;
         m_bytesread += b;
         ++m_tilesread;
@@ -1085,8 +1155,8 @@ ImageCacheTile::ImageCacheTile (const TileID &id, void *pels, TypeDesc format,
     size_t size = memsize_needed ();
     ASSERT (size > 0 && memsize() == 0);
     m_pixels.resize (size);
-    size_t dst_pelsize = spec.nchannels * file.datatype().size();
-    m_valid = convert_image (spec.nchannels, spec.tile_width, spec.tile_height,
+    size_t dst_pelsize = id.nchannels() * file.datatype().size();
+    m_valid = convert_image (id.nchannels(), spec.tile_width, spec.tile_height,
                              spec.tile_depth, pels, format, xstride, ystride,
                              zstride, &m_pixels[0], file.datatype(),
                              dst_pelsize, dst_pelsize * spec.tile_width,
@@ -1116,6 +1186,7 @@ ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
     ImageCacheFile &file (m_id.file());
     m_valid = file.read_tile (thread_info, m_id.subimage(),
                               m_id.x(), m_id.y(), m_id.z(),
+                              m_id.chbegin(), m_id.chend(),
                               file.datatype(), &m_pixels[0]);
     m_id.file().imagecache().incr_mem (size);
     if (! m_valid) {
@@ -1157,7 +1228,7 @@ ImageCacheTile::data (int x, int y, int z) const
     z -= m_id.z();
     if (x < 0 || x >= (int)w || y < 0 || y >= (int)h || z < 0 || z >= (int)d)
         return NULL;
-    size_t pixelsize = spec.nchannels * m_id.file().datatype().size();
+    size_t pixelsize = m_id.nchannels() * m_id.file().datatype().size();
     size_t offset = ((z * h + y) * w + x) * pixelsize;
     return (const void *)&m_pixels[offset];
 }
@@ -1185,6 +1256,7 @@ ImageCacheImpl::init ()
     m_accept_untiled = true;
     m_read_before_insert = false;
     m_failure_retries = 0;
+    m_max_tile_channels = 4;
     m_Mw2c.makeIdentity();
     m_mem_used = 0;
     m_statslevel = 0;
@@ -1536,6 +1608,9 @@ ImageCacheImpl::attribute (const std::string &name, TypeDesc type,
     }
     else if (name == "failure_retries" && type == TypeDesc::INT) {
         m_failure_retries = *(const int *)val;
+    }
+    else if (name == "max_tile_channels" && type == TypeDesc::INT) {
+        m_max_tile_channels = *(const int *)val;
     } else {
         // Otherwise, unknown name
         return false;
@@ -1596,6 +1671,10 @@ ImageCacheImpl::getattribute (const std::string &name, TypeDesc type,
         *(int *)val = (int)m_failure_retries;
         return true;
     }
+    if (name == "max_tile_channels" && type == TypeDesc::INT) {
+        *(int *)val = m_max_tile_channels;
+        return true;
+    }
     if (name == "worldtocommon" && (type == TypeDesc::PT_MATRIX ||
                                     type == TypeDesc(TypeDesc::FLOAT,16))) {
         *(Imath::M44f *)val = m_Mw2c;
@@ -1799,8 +1878,21 @@ ImageCacheImpl::get_image_info (ustring filename, ustring dataname,
         error ("Image file \"%s\" not found", filename.c_str());
         return false;
     }
+    return get_image_info (file, dataname, datatype, data);
+}
+
+
+
+bool
+ImageCacheImpl::get_image_info (ImageCacheFile *file, ustring dataname,
+                                TypeDesc datatype, void *data)
+{
+    if (! file) {
+        error ("Invalid image file handle");
+        return false;
+    }
     if (file->broken()) {
-        error ("Invalid image file \"%s\"", filename.c_str());
+        error ("Invalid image file \"%s\"", file->filename().c_str());
         return false;
     }
     if (dataname == s_exists && datatype == TypeDesc::TypeInt) {
@@ -1932,7 +2024,8 @@ ImageCacheImpl::get_pixels (ustring filename, int subimage,
     }
 
     return get_pixels (file, thread_info, subimage, xbegin, xend, 
-                       ybegin, yend, zbegin, zend, format, result);
+                       ybegin, yend, zbegin, zend,
+                       0, file->spec(subimage).nchannels, format, result);
 }
 
 
@@ -1942,7 +2035,7 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
                             ImageCachePerThreadInfo *thread_info,
                             int subimage,
                             int xbegin, int xend, int ybegin, int yend,
-                            int zbegin, int zend, 
+                            int zbegin, int zend, int chbegin, int chend,
                             TypeDesc format, void *result)
 {
     const ImageSpec &spec (file->spec());
@@ -1953,7 +2046,7 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
     // grab a whole tile at a time and memcpy it rapidly.  But no point
     // doing anything more complicated (not to mention bug-prone) until
     // somebody reports this routine as being a bottleneck.
-    int nc = file->spec().nchannels;
+    int nc = chend - chbegin;
     size_t formatpixelsize = nc * format.size();
     size_t scanlinesize = (xend-xbegin) * formatpixelsize;
     size_t zplanesize = (yend-ybegin) * scanlinesize;
@@ -1981,7 +2074,7 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
                     continue;
                 }
                 int tx = x - ((x - spec.x) % spec.tile_width);
-                TileID tileid (*file, subimage, tx, ty, tz);
+                TileID tileid (*file, subimage, tx, ty, tz, chbegin, chend);
                 ok &= find_tile (tileid, thread_info);
                 ImageCacheTileRef &tile (thread_info->tile);
                 const char *data;
@@ -2000,6 +2093,110 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
 
 
 
+bool
+ImageCacheImpl::get_pixels_gather (ustring filename, int npoints,
+                                   const int *x, const int *y,
+                                   const int *subimage,
+                                   int chbegin, int chend,
+                                   TypeDesc format, void *result)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info);
+    if (! file) {
+        error ("Image file \"%s\" not found", filename.c_str());
+        return false;
+    }
+    if (file->broken()) {
+        error ("Invalid image file \"%s\"", filename.c_str());
+        return false;
+    }
+    if (chbegin < 0 || chend < chbegin) {
+        error ("get_pixels_gather asked for invalid channel range [%d,%d)",
+               chbegin, chend);
+        return false;
+    }
+    return get_pixels_gather (file, thread_info, npoints, x, y, subimage,
+                              chbegin, chend, format, result,
+                              (chend-chbegin) * format.size());
+}
+
+
+
+bool
+ImageCacheImpl::get_pixels_gather (ImageCacheFile *file,
+                                   ImageCachePerThreadInfo *thread_info,
+                                   int npoints, const int *x, const int *y,
+                                   const int *subimage,
+                                   int chbegin, int chend,
+                                   TypeDesc format, void *result,
+                                   stride_t pixelstride)
+{
+    // Find the tile each point falls in, zeroing the points that don't
+    // fall in any, then sort the rest by tile so that each distinct
+    // tile is found just once no matter how the points are ordered.
+    size_t formatsize = format.size();
+    std::vector<GatherPoint> points;
+    points.reserve (npoints);
+    for (int i = 0;  i < npoints;  ++i) {
+        int sub = subimage ? subimage[i] : 0;
+        char *dst = (char *)result + i * pixelstride;
+        if (sub < 0 || sub >= file->subimages()) {
+            memset (dst, 0, (chend-chbegin) * formatsize);
+            continue;
+        }
+        const ImageSpec &spec (file->spec(sub));
+        if (x[i] < spec.x || x[i] >= spec.x+spec.width ||
+            y[i] < spec.y || y[i] >= spec.y+spec.height) {
+            memset (dst, 0, (chend-chbegin) * formatsize);
+            continue;
+        }
+        GatherPoint p;
+        p.subimage = sub;
+        p.tx = x[i] - ((x[i] - spec.x) % spec.tile_width);
+        p.ty = y[i] - ((y[i] - spec.y) % spec.tile_height);
+        p.index = i;
+        points.push_back (p);
+    }
+    std::sort (points.begin(), points.end());
+
+    bool ok = true;
+    for (size_t p = 0;  p < points.size();  ) {
+        // All the points from p up to pend share a tile
+        const GatherPoint &first (points[p]);
+        size_t pend = p+1;
+        while (pend < points.size() && ! (first < points[pend]))
+            ++pend;
+        const ImageSpec &spec (file->spec(first.subimage));
+        int nc = std::min (chend, spec.nchannels) - chbegin;
+        int tilechbegin = chbegin, tilechend = chbegin + nc;
+        tile_channels (spec, tilechbegin, tilechend);
+        TileID tileid (*file, first.subimage, first.tx, first.ty, spec.z,
+                       tilechbegin, tilechend);
+        ok &= find_tile (tileid, thread_info);
+        ImageCacheTileRef &tile (thread_info->tile);
+        size_t chanoffset = (chbegin - tilechbegin) * file->datatype().size();
+        for ( ;  p < pend;  ++p) {
+            int i = points[p].index;
+            char *dst = (char *)result + i * pixelstride;
+            const char *data;
+            if (nc > 0 && tile &&
+                  (data = (const char *)tile->data (x[i], y[i], spec.z))) {
+                convert_types (file->datatype(), data + chanoffset,
+                               format, dst, nc);
+                if (nc < chend-chbegin)
+                    memset (dst + nc*formatsize, 0,
+                            (chend-chbegin-nc) * formatsize);
+            } else {
+                memset (dst, 0, (chend-chbegin) * formatsize);
+            }
+        }
+    }
+
+    return ok;
+}
+
+
+
 ImageCache::Tile *
 ImageCacheImpl::get_tile (ustring filename, int subimage, int x, int y, int z)
 {
@@ -142,10 +142,11 @@ public:
     TypeDesc datatype () const { return m_datatype; }
     ImageCacheImpl &imagecache () const { return m_imagecache; }
 
-    /// Load new data tile
+    /// Load new data tile, holding channels [chbegin,chend)
     ///
     bool read_tile (ImageCachePerThreadInfo *thread_info,
                     int subimage, int x, int y, int z,
+                    int chbegin, int chend,
                     TypeDesc format, void *data);
 
     /// Mark the file as recently used.
@@ -181,6 +182,10 @@ public:
     struct LevelInfo {
         bool full_pixel_range;      ///< pixel data window matches image window
         bool zero_origin;           ///< pixel data origin is (0,0)
+        int full_width;             ///< full (display) width, from the spec
+        int full_height;            ///< full (display) height, from the spec
+        int tilewidthmask;          ///< tile_width-1 (tiles are pow2)
+        int tileheightmask;         ///< tile_height-1
         LevelInfo (const ImageSpec &spec);  ///< Initialize based on spec
     };
     const LevelInfo &levelinfo (int subimage) const { return m_levels[subimage]; }
@@ -191,6 +196,7 @@ private:
     bool m_broken;                  ///< has errors; can't be used properly
     bool m_untiled;                 ///< Not tiled
     bool m_unmipped;                ///< Not really MIP-mapped
+    int m_filesubimages;            ///< Subimages the ImageInput supplies
     shared_ptr<ImageInput> m_input; ///< Open ImageInput, NULL if closed
     std::vector<ImageSpec> m_spec;  ///< Format for each subimage
     std::vector<LevelInfo> m_levels;///< Extra per-level info for each subimage
@@ -204,7 +210,7 @@ private:
     TypeDesc m_datatype;            ///< Type of pixels we store internally
     CubeLayout m_cubelayout;        ///< cubemap: which layout?
     bool m_y_up;                    ///< latlong: is y "up"? (else z is up)
-    bool m_eightbit;                ///< Eight bit?  (or float)
+    bool m_eightbit;                ///< Is the file's native format UINT8?
     unsigned int m_channelsize;     ///< Channel size, in bytes
     unsigned int m_pixelsize;       ///< Channel size, in bytes
     ustring m_fileformat;           ///< File format name
@@ -235,6 +241,7 @@ private:
     /// a seek_subimage to the right subimage.
     bool read_untiled (ImageCachePerThreadInfo *thread_info,
                        int subimage, int x, int y, int z,
+                       int chbegin, int chend,
                        TypeDesc format, void *data);
 
     /// Load the requested tile, from a file that's not really MIPmapped.
@@ -242,6 +249,7 @@ private:
     /// a seek_subimage to the right subimage.
     bool read_unmipped (ImageCachePerThreadInfo *thread_info,
                         int subimage, int x, int y, int z,
+                        int chbegin, int chend,
                         TypeDesc format, void *data);
 
     void lock_input_mutex () {
@@ -290,9 +298,14 @@ public:
     TileID ();
 
     /// Initialize a TileID based on full elaboration of image file,
-    /// subimage, and tile x,y,z indices.
-    TileID (ImageCacheFile &file, int subimage, int x, int y, int z=0)
-        : m_x(x), m_y(y), m_z(z), m_subimage(subimage), m_file(file)
+    /// subimage, tile x,y,z indices, and the range of channels the tile
+    /// holds (chend < 0 means all the channels of the subimage).
+    TileID (ImageCacheFile &file, int subimage, int x, int y, int z=0,
+            int chbegin=0, int chend=-1)
+        : m_x(x), m_y(y), m_z(z), m_subimage(subimage),
+          m_chbegin(chbegin),
+          m_chend(chend >= 0 ? chend : file.spec(subimage).nchannels),
+          m_file(file)
     { }
 
     /// Destructor is trivial, because we don't hold any resources
@@ -304,6 +317,9 @@ public:
     int x (void) const { return m_x; }
     int y (void) const { return m_y; }
     int z (void) const { return m_z; }
+    int chbegin (void) const { return m_chbegin; }
+    int chend (void) const { return m_chend; }
+    int nchannels (void) const { return m_chend - m_chbegin; }
 
     void x (int v) { m_x = v; }
     void y (int v) { m_y = v; }
@@ -315,15 +331,17 @@ public:
         // Try to speed up by comparing field by field in order of most
         // probable rejection if they really are unequal.
         return (a.m_x == b.m_x && a.m_y == b.m_y && a.m_z == b.m_z &&
-                a.m_subimage == b.m_subimage && (&a.m_file == &b.m_file));
+                a.m_subimage == b.m_subimage && (&a.m_file == &b.m_file) &&
+                a.m_chbegin == b.m_chbegin && a.m_chend == b.m_chend);
     }
 
     /// Do the two ID's refer to the same tile, given that the
     /// caller *guarantees* that the two tiles point to the same
-    /// file and subimage (so it only has to compare xyz)?
+    /// file and subimage (so it only has to compare xyz and channels)?
     friend bool equal_same_subimage (const TileID &a, const TileID &b) {
         DASSERT ((&a.m_file == &b.m_file) && a.m_subimage == b.m_subimage);
-        return (a.m_x == b.m_x && a.m_y == b.m_y && a.m_z == b.m_z);
+        return (a.m_x == b.m_x && a.m_y == b.m_y && a.m_z == b.m_z &&
+                a.m_chbegin == b.m_chbegin && a.m_chend == b.m_chend);
     }
 
     /// Do the two ID's refer to the same tile?  
@@ -335,7 +353,8 @@ public:
     /// summing, so that collisions are unlikely.
     size_t hash () const {
         return m_x * 53 + m_y * 97 + m_z * 193 + 
-               m_subimage * 389 + m_file.filename().hash() * 769;
+               m_subimage * 389 + m_file.filename().hash() * 769 +
+               m_chbegin * 1543 + m_chend * 3079;
     }
 
     /// Functor that hashes a TileID
@@ -348,6 +367,7 @@ public:
 private:
     int m_x, m_y, m_z;        ///< x,y,z tile index within the subimage
     int m_subimage;           ///< subimage (usually MIP-map level)
+    int m_chbegin, m_chend;   ///< Range of channels the tile holds
     ImageCacheFile &m_file;   ///< Which ImageCacheFile we refer to
 };
 
@@ -405,7 +425,7 @@ public:
     ///
     size_t memsize_needed () const {
         const ImageSpec &spec (file().spec(m_id.subimage()));
-        return spec.tile_pixels() * spec.nchannels * file().datatype().size();
+        return spec.tile_pixels() * m_id.nchannels() * file().datatype().size();
     }
 
     /// Mark the tile as recently used.
@@ -461,6 +481,38 @@ typedef boost::unordered_map<TileID, ImageCacheTileRef, TileID::Hasher> TileCach
 typedef hash_map<TileID, ImageCacheTileRef, TileID::Hasher> TileCache;
 #endif
 
+/// A UDIM texture set, named by a filename pattern containing the token
+/// "<UDIM>" (for example, "color.<UDIM>.tx").  The token stands for the
+/// UDIM tile number 1001 + u + 10*v of the unit square of (s,t) space
+/// whose integer corner is (u,v), for 0 <= u < 10 and 0 <= v < 100.
+/// The filenames of all the tiles are made when the set is created and
+/// never change afterwards, so any thread may look them up without
+/// locking.  It lives here rather than with the rest of the
+/// TextureSystem internals so that ImageCachePerThreadInfo can hold a
+/// reference to one.
+class UdimSet : public RefCnt {
+public:
+    UdimSet (ustring pattern);
+
+    /// Return the filename of UDIM tile (u,v), or an empty ustring if
+    /// (u,v) is outside the range that UDIM numbers can express.
+    ustring tilename (int u, int v) const {
+        if (u < 0 || u >= 10 || v < 0 || v >= 100)
+            return ustring();
+        return m_tilenames[u + 10*v];
+    }
+
+    /// Does the filename look like a UDIM pattern?
+    static bool is_udim (ustring filename);
+
+private:
+    std::vector<ustring> m_tilenames;   ///< Filenames, by tile (udim-1001)
+};
+
+typedef intrusive_ptr<UdimSet> UdimSetRef;
+
+
+
 /// A very small amount of per-thread data that saves us from locking
 /// the mutex quite as often.  We store things here used by both
 /// ImageCache and TextureSystem, so they don't each need a costly
@@ -477,6 +529,10 @@ struct ImageCachePerThreadInfo {
     atomic_int purge;   // If set, tile ptrs need purging!
     ImageCacheStatistics m_stats;
     bool shared;   // Pointed to both by the IC and the thread_specific_ptr
+    std::vector<char> scratch;  // Reused for reading scanline tile-rows
+    // The last UDIM set the TextureSystem found, and its pattern
+    ustring last_udim_pattern;
+    UdimSetRef last_udim;
 
     ImageCachePerThreadInfo ()
         : next_last_file(0), shared(false)
@@ -572,6 +628,20 @@ public:
     bool forcefloat () const { return m_forcefloat; }
     bool accept_untiled () const { return m_accept_untiled; }
     int failure_retries () const { return m_failure_retries; }
+    int max_tile_channels () const { return m_max_tile_channels; }
+
+    /// Given a lookup of channels [chbegin,chend) of an image, adjust
+    /// them to the channel range of the tiles that should serve it: just
+    /// those channels if the image has more than max_tile_channels,
+    /// otherwise all of them, so that narrow images keep a single tile
+    /// per location no matter which channels are asked for.
+    void tile_channels (const ImageSpec &spec, int &chbegin, int &chend) const {
+        if (m_max_tile_channels <= 0 || spec.nchannels <= m_max_tile_channels ||
+                chend <= chbegin) {
+            chbegin = 0;
+            chend = spec.nchannels;
+        }
+    }
     void get_commontoworld (Imath::M44f &result) const {
         result = m_Mc2w;
     }
@@ -583,6 +653,11 @@ public:
     virtual bool get_image_info (ustring filename, ustring dataname,
                                  TypeDesc datatype, void *data);
 
+    /// Get information about the image in an already-found
+    /// ImageCacheFile.
+    bool get_image_info (ImageCacheFile *file, ustring dataname,
+                         TypeDesc datatype, void *data);
+
     /// Get the ImageSpec associated with the named image.  If the file
     /// is found and is an image format that can be read, store a copy
     /// of its specification in spec and return true.  Return false if
@@ -599,12 +674,30 @@ public:
                              int ybegin, int yend, int zbegin, int zend,
                              TypeDesc format, void *result);
 
-    /// Retrieve a rectangle of raw unfiltered pixels, from an open valid
-    /// ImageCacheFile.
+    /// Retrieve channels [chbegin,chend) of a rectangle of raw
+    /// unfiltered pixels, from an open valid ImageCacheFile, using (and
+    /// caching) tiles that hold just those channels.
     bool get_pixels (ImageCacheFile *file, ImageCachePerThreadInfo *thread_info,
                      int subimage, int xmin, int xmax,
                      int ymin, int ymax, int zmin, int zmax, 
-                     TypeDesc format, void *result);
+                     int chbegin, int chend, TypeDesc format, void *result);
+
+    // Retrieve a scattered set of raw unfiltered pixels.
+    virtual bool get_pixels_gather (ustring filename, int npoints,
+                                    const int *x, const int *y,
+                                    const int *subimage,
+                                    int chbegin, int chend,
+                                    TypeDesc format, void *result);
+
+    /// Retrieve a scattered set of raw unfiltered pixels from an open
+    /// valid ImageCacheFile, storing each point's channels
+    /// pixelstride bytes after the previous point's.
+    bool get_pixels_gather (ImageCacheFile *file,
+                            ImageCachePerThreadInfo *thread_info,
+                            int npoints, const int *x, const int *y,
+                            const int *subimage, int chbegin, int chend,
+                            TypeDesc format, void *result,
+                            stride_t pixelstride);
 
     /// Find the ImageCacheFile record for the named image, or NULL if
     /// no such file can be found.  This returns a plain old pointer,
@@ -815,6 +908,7 @@ private:
     bool m_accept_untiled;       ///< Accept untiled images?
     bool m_read_before_insert;   ///< Read tiles before adding to cache?
     int m_failure_retries;       ///< Times to re-try disk failures
+    int m_max_tile_channels;     ///< Wider images cache channel subsets
     Imath::M44f m_Mw2c;          ///< world-to-"common" matrix
     Imath::M44f m_Mc2w;          ///< common-to-world matrix
     FilenameMap m_files;         ///< Map file names to ImageCacheFile's
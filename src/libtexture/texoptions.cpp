@@ -83,7 +83,8 @@ TextureOptions::TextureOptions (bool)
       samples(default_samples),
       dresultds(NULL), dresultdt(NULL),
       zwrap(WrapDefault), zblur(default_blur), zwidth(default_width),
-      swrap_func(NULL), twrap_func(NULL)
+      swrap_func(NULL), twrap_func(NULL), texel_kernels(NULL),
+      tile_chbegin(0), tile_chend(0), random(NULL)
 {
 }
 
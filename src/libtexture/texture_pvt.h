@@ -59,6 +59,31 @@ class ImageCacheTileRef;
 
 
 
+/// The arithmetic inner loops of the accum_sample_* routines, compiled
+/// separately for each combination of cached texel data type and
+/// channel count.  TextureSystemImpl::texture() picks the right set
+/// once per batch (and stores it in the TextureOptions); the accum
+/// routines locate the texels and then hand them off to these.  Texel
+/// pointers are to the first channel to filter, in the file's cached
+/// data type.
+struct TexelKernels {
+    typedef void (*closest_kernel) (const unsigned char *texel, int nc,
+                                    float weight, float *accum);
+    typedef void (*bilinear_kernel) (const unsigned char *texel[2][2], int nc,
+                                     float sfrac, float tfrac, float weight,
+                                     float scalex, float scaley, float *accum,
+                                     float *daccumds, float *daccumdt);
+    typedef void (*bicubic_kernel) (const unsigned char *texel[4][4], int nc,
+                                    float sfrac, float tfrac, float weight,
+                                    float scalex, float scaley, float *accum,
+                                    float *daccumds, float *daccumdt);
+    closest_kernel closest;
+    bilinear_kernel bilinear;
+    bicubic_kernel bicubic;
+};
+
+
+
 /// Working implementation of the abstract TextureSystem class.
 ///
 class TextureSystemImpl : public TextureSystem {
@@ -120,6 +145,8 @@ public:
         result = m_Mc2w;
     }
 
+    virtual TextureHandle * get_texture_handle (ustring filename);
+
     /// Filtered 2D texture lookup for a single point, no runflags.
     ///
     virtual bool texture (ustring filename, TextureOptions &options,
@@ -131,6 +158,17 @@ public:
                         dsdx, dtdx, dsdy, dtdy, result);
     }
 
+    /// Filtered 2D texture lookup for a single point, no runflags,
+    /// by handle.
+    virtual bool texture (TextureHandle *texture_handle,
+                  TextureOptions &options, float s, float t,
+                  float dsdx, float dtdx, float dsdy, float dtdy,
+                  float *result) {
+        Runflag rf = RunFlagOn;
+        return texture (texture_handle, options, &rf, 0, 1, s, t,
+                        dsdx, dtdx, dsdy, dtdy, result);
+    }
+
     /// Retrieve a 2D texture lookup at many points at once.
     ///
     virtual bool texture (ustring filename, TextureOptions &options,
@@ -140,6 +178,21 @@ public:
                           VaryingRef<float> dsdy, VaryingRef<float> dtdy,
                           float *result);
 
+    /// Retrieve a 2D texture lookup at many points at once, by handle.
+    ///
+    virtual bool texture (TextureHandle *texture_handle,
+                          TextureOptions &options,
+                          Runflag *runflags, int beginactive, int endactive,
+                          VaryingRef<float> s, VaryingRef<float> t,
+                          VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                          VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                          float *result) {
+        return texture ((TextureFile *)texture_handle,
+                        m_imagecache->get_perthread_info (), options,
+                        runflags, beginactive, endactive,
+                        s, t, dsdx, dtdx, dsdy, dtdy, result);
+    }
+
     /// Retrieve a 3D texture lookup at a single point.
     ///
     virtual bool texture (ustring filename, TextureOptions &options,
@@ -212,6 +265,9 @@ public:
     ///
     virtual bool get_texture_info (ustring filename, ustring dataname,
                                    TypeDesc datatype, void *data);
+    virtual bool get_texture_info (TextureHandle *texture_handle,
+                                   ustring dataname,
+                                   TypeDesc datatype, void *data);
 
     /// Get the ImageSpec associated with the named texture
     /// (specifically, the first MIP-map level).  If the file is found
@@ -229,6 +285,21 @@ public:
                              int subimage, int xbegin, int xend,
                              int ybegin, int yend, int zbegin, int zend,
                              TypeDesc format, void *result);
+    virtual bool get_texels (TextureHandle *texture_handle,
+                             TextureOptions &options,
+                             int subimage, int xbegin, int xend,
+                             int ybegin, int yend, int zbegin, int zend,
+                             TypeDesc format, void *result);
+    virtual bool get_texels_gather (ustring filename,
+                                    TextureOptions &options, int npoints,
+                                    const int *x, const int *y,
+                                    const int *level,
+                                    TypeDesc format, void *result);
+    virtual bool get_texels_gather (TextureHandle *texture_handle,
+                                    TextureOptions &options, int npoints,
+                                    const int *x, const int *y,
+                                    const int *level,
+                                    TypeDesc format, void *result);
 
     virtual std::string geterror () const;
     virtual std::string getstats (int level=1, bool icstats=true) const;
@@ -254,6 +325,34 @@ private:
         return tf;
     }
 
+    /// Batched 2D texture lookup on an already-found file (which may be
+    /// NULL or broken, in which case the missing color or fill is used).
+    /// This does the real work for both texture() by name and by handle.
+    bool texture (TextureFile *texturefile, PerThreadInfo *thread_info,
+                  TextureOptions &options,
+                  Runflag *runflags, int beginactive, int endactive,
+                  VaryingRef<float> s, VaryingRef<float> t,
+                  VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                  VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                  float *result);
+
+    /// Find the UdimSet for the given filename pattern, creating it if
+    /// this is the first time we've seen it.  Return NULL if the
+    /// filename isn't a UDIM pattern at all.  The last set found is
+    /// remembered in the per-thread info, so that repeated batches on
+    /// the same pattern don't need to lock m_udims.
+    UdimSet *find_udim (ustring filename, PerThreadInfo *thread_info);
+
+    /// Texture lookups for a batch of points using a UDIM texture set:
+    /// resolve each point to its tile's file, then look up each group
+    /// of points that share a file with one call to texture().
+    bool texture_udim (UdimSet &udim, TextureOptions &options,
+                       Runflag *runflags, int beginactive, int endactive,
+                       VaryingRef<float> s, VaryingRef<float> t,
+                       VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                       VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                       float *result);
+
     /// Find the tile specified by id.  If found, return true and place
     /// the tile ref in thread_info->tile; if not found, return false.
     /// This is more efficient than find_tile_main_cache() because it
@@ -301,6 +400,13 @@ private:
                          VaryingRef<float> _dsdy, VaryingRef<float> _dtdy,
                          float *result);
     
+    /// Based on the filter width (in s,t units), figure out which two
+    /// MIP levels to blend, and their weights.  The two levels may be
+    /// the same, in which case levelweight[1] will be 0.
+    void compute_miplevels (TextureFile &texturefile,
+                            const TextureOptions &options, float filtwidth,
+                            int miplevel[2], float levelweight[2]);
+
     typedef bool (TextureSystemImpl::*accum_prototype)
                               (float s, float t, int level,
                                TextureFile &texturefile,
@@ -330,6 +436,10 @@ private:
                                float weight, float *accum,
                                float *daccumds, float *daccumdt);
 
+    /// Return the filtering kernels specialized for texels of the given
+    /// cached data type and number of channels to filter.
+    static const TexelKernels *texel_kernels (TypeDesc datatype, int nchannels);
+
     /// Internal error reporting routine, with printf-like arguments.
     ///
     void error (const char *message, ...) OPENIMAGEIO_PRINTF_ARGS(2,3);
@@ -344,6 +454,13 @@ private:
     mutable thread_specific_ptr< std::string > m_errormessage;
     Filter1D *hq_filter;         ///< Better filter for magnification
     int m_statslevel;
+#ifdef OIIO_HAVE_BOOST_UNORDERED_MAP
+    typedef boost::unordered_map<ustring,UdimSetRef,ustringHash> UdimMap;
+#else
+    typedef hash_map<ustring,UdimSetRef,ustringHash> UdimMap;
+#endif
+    UdimMap m_udims;             ///< UDIM patterns we've seen
+    spin_mutex m_udim_mutex;     ///< Guard m_udims
     friend class ImageCacheFile;
     friend class ImageCacheTile;
 };
@@ -37,12 +37,14 @@
 using namespace std::tr1;
 
 #include <OpenEXR/ImathMatrix.h>
+#include <OpenEXR/half.h>
 
 #include "dassert.h"
 #include "typedesc.h"
 #include "varyingref.h"
 #include "ustring.h"
 #include "strutil.h"
+#include "sysutil.h"
 #include "hash.h"
 #include "thread.h"
 #include "fmath.h"
@@ -360,6 +362,20 @@ TextureSystemImpl::get_texture_info (ustring filename, ustring dataname,
 
 
 
+bool
+TextureSystemImpl::get_texture_info (TextureHandle *texture_handle,
+                                     ustring dataname,
+                                     TypeDesc datatype, void *data)
+{
+    bool ok = m_imagecache->get_image_info ((TextureFile *)texture_handle,
+                                            dataname, datatype, data);
+    if (! ok)
+        error ("%s", m_imagecache->geterror().c_str());
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::get_imagespec (ustring filename, ImageSpec &spec)
 {
@@ -394,13 +410,33 @@ TextureSystemImpl::get_texels (ustring filename, TextureOptions &options,
         error ("Texture file \"%s\" not found", filename.c_str());
         return false;
     }
+    return get_texels ((TextureHandle *)texfile, options, subimage,
+                       xbegin, xend, ybegin, yend, zbegin, zend,
+                       format, result);
+}
+
+
+
+bool
+TextureSystemImpl::get_texels (TextureHandle *texture_handle,
+                               TextureOptions &options,
+                               int subimage, int xbegin, int xend,
+                               int ybegin, int yend, int zbegin, int zend,
+                               TypeDesc format, void *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = (TextureFile *) texture_handle;
+    if (! texfile) {
+        error ("Invalid texture handle");
+        return false;
+    }
     if (texfile->broken()) {
-        error ("Invalid texture file \"%s\"", filename.c_str());
+        error ("Invalid texture file \"%s\"", texfile->filename().c_str());
         return false;
     }
     if (subimage < 0 || subimage >= texfile->subimages()) {
         error ("get_texel asked for nonexistant subimage %d of \"%s\"",
-               subimage, filename.c_str());
+               subimage, texfile->filename().c_str());
         return false;
     }
     const ImageSpec &spec (texfile->spec());
@@ -465,6 +501,68 @@ TextureSystemImpl::get_texels (ustring filename, TextureOptions &options,
 
 
 
+bool
+TextureSystemImpl::get_texels_gather (ustring filename,
+                                      TextureOptions &options, int npoints,
+                                      const int *x, const int *y,
+                                      const int *level,
+                                      TypeDesc format, void *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = find_texturefile (filename, thread_info);
+    if (! texfile) {
+        error ("Texture file \"%s\" not found", filename.c_str());
+        return false;
+    }
+    return get_texels_gather ((TextureHandle *)texfile, options, npoints,
+                              x, y, level, format, result);
+}
+
+
+
+bool
+TextureSystemImpl::get_texels_gather (TextureHandle *texture_handle,
+                                      TextureOptions &options, int npoints,
+                                      const int *x, const int *y,
+                                      const int *level,
+                                      TypeDesc format, void *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = (TextureFile *) texture_handle;
+    if (! texfile) {
+        error ("Invalid texture handle");
+        return false;
+    }
+    if (texfile->broken()) {
+        error ("Invalid texture file \"%s\"", texfile->filename().c_str());
+        return false;
+    }
+    const ImageSpec &spec (texfile->spec());
+    int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel, 0, options.nchannels);
+    size_t formatsize = format.size();
+    stride_t pixelstride = options.nchannels * formatsize;
+    bool ok = m_imagecache->get_pixels_gather (texfile, thread_info, npoints,
+                                  x, y, level, options.firstchannel,
+                                  options.firstchannel + actualchannels,
+                                  format, result, pixelstride);
+
+    // Fill channels requested but not in the file
+    if (actualchannels < options.nchannels) {
+        char *fill = ALLOCA (char, formatsize);
+        convert_types (TypeDesc::FLOAT, &(options.fill[0]), format, fill, 1);
+        for (int i = 0;  i < npoints;  ++i) {
+            char *dst = (char *)result + i * pixelstride;
+            for (int c = actualchannels;  c < options.nchannels;  ++c)
+                memcpy (dst + c*formatsize, fill, formatsize);
+        }
+    }
+    if (! ok)
+        error ("%s", m_imagecache->geterror().c_str());
+    return ok;
+}
+
+
+
 std::string
 TextureSystemImpl::geterror () const
 {
@@ -516,6 +614,17 @@ TextureSystemImpl::invalidate_all (bool force)
 
 
 
+TextureSystem::TextureHandle *
+TextureSystemImpl::get_texture_handle (ustring filename)
+{
+    if (UdimSet::is_udim (filename))
+        return NULL;
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    return (TextureHandle *) find_texturefile (filename, thread_info);
+}
+
+
+
 bool
 TextureSystemImpl::texture (ustring filename, TextureOptions &options,
                             Runflag *runflags, int beginactive, int endactive,
@@ -523,6 +632,37 @@ TextureSystemImpl::texture (ustring filename, TextureOptions &options,
                             VaryingRef<float> dsdx, VaryingRef<float> dtdx,
                             VaryingRef<float> dsdy, VaryingRef<float> dtdy,
                             float *result)
+{
+    // Per-thread microcache that prevents locking of this mutex
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = thread_info->find_file (filename);
+    if (! texturefile) {
+        // UDIM texture sets resolve to a different file for each point
+        UdimSet *udim = find_udim (filename, thread_info);
+        if (udim)
+            return texture_udim (*udim, options, runflags, beginactive,
+                                 endactive, s, t, dsdx, dtdx, dsdy, dtdy,
+                                 result);
+        // Fall back on the master cache
+        texturefile = find_texturefile (filename, thread_info);
+        thread_info->filename (filename, texturefile);
+    }
+    return texture (texturefile, thread_info, options, runflags,
+                    beginactive, endactive, s, t, dsdx, dtdx, dsdy, dtdy,
+                    result);
+}
+
+
+
+bool
+TextureSystemImpl::texture (TextureFile *texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOptions &options,
+                            Runflag *runflags, int beginactive, int endactive,
+                            VaryingRef<float> s, VaryingRef<float> t,
+                            VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                            VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                            float *result)
 {
     static const texture_lookup_prototype lookup_functions[] = {
         // Must be in the same order as Mipmode enum
@@ -530,22 +670,14 @@ TextureSystemImpl::texture (ustring filename, TextureOptions &options,
         &TextureSystemImpl::texture_lookup_nomip,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture_lookup,
         &TextureSystemImpl::texture_lookup
     };
     texture_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
 
     // FIXME - should we be keeping stats, times?
 
-    // Per-thread microcache that prevents locking of this mutex
-    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
     ImageCacheStatistics &stats (thread_info->m_stats);
-    TextureFile *texturefile = thread_info->find_file (filename);
-    if (! texturefile) {
-        // Fall back on the master cache
-        texturefile = find_texturefile (filename, thread_info);
-        thread_info->filename (filename, texturefile);
-    }
-
     if (! texturefile  ||  texturefile->broken()) {
         int local_stat_texture_queries = 0;
         for (int i = beginactive;  i < endactive;  ++i) {
@@ -610,6 +742,16 @@ TextureSystemImpl::texture (ustring filename, TextureOptions &options,
         return true;
     }
 
+    // Select the filtering inner loops for this texel type and number
+    // of channels, once for the whole batch.
+    options.texel_kernels = texel_kernels (texturefile->datatype(),
+                                           options.actualchannels);
+
+    // Tiles of images with many channels hold only the ones we need
+    options.tile_chbegin = options.firstchannel;
+    options.tile_chend = options.firstchannel + options.actualchannels;
+    m_imagecache->tile_channels (spec, options.tile_chbegin, options.tile_chend);
+
     // Loop over all the points that are active (as given in the
     // runflags), and for each, call texture_lookup.  The separation of
     // power here is that all possible work that can be done for all
@@ -635,6 +777,132 @@ TextureSystemImpl::texture (ustring filename, TextureOptions &options,
 
 
 
+static const char *udim_token = "<UDIM>";
+
+
+
+UdimSet::UdimSet (ustring pattern)
+    : m_tilenames (10*100)
+{
+    const std::string &p (pattern.string());
+    size_t pos = p.find (udim_token);
+    DASSERT (pos != std::string::npos);
+    std::string prefix = p.substr (0, pos);
+    std::string suffix = p.substr (pos + strlen(udim_token));
+    for (int tile = 0;  tile < 10*100;  ++tile)
+        m_tilenames[tile] = ustring (Strutil::format ("%s%d%s", prefix.c_str(),
+                                                      1001+tile, suffix.c_str()));
+}
+
+
+
+bool
+UdimSet::is_udim (ustring filename)
+{
+    return filename.c_str() && strstr (filename.c_str(), udim_token);
+}
+
+
+
+UdimSet *
+TextureSystemImpl::find_udim (ustring filename, PerThreadInfo *thread_info)
+{
+    if (filename == thread_info->last_udim_pattern)
+        return thread_info->last_udim.get();
+    if (! UdimSet::is_udim (filename))
+        return NULL;
+    UdimSetRef udim;
+    {
+        spin_lock lock (m_udim_mutex);
+        UdimMap::iterator found = m_udims.find (filename);
+        if (found != m_udims.end())
+            udim = found->second;
+    }
+    if (! udim) {
+        // Make the tile names outside the lock.  If another thread got
+        // there first, use its set and discard ours.
+        UdimSetRef newudim (new UdimSet (filename));
+        spin_lock lock (m_udim_mutex);
+        UdimSetRef &u (m_udims[filename]);
+        if (! u)
+            u = newudim;
+        udim = u;
+    }
+    thread_info->last_udim_pattern = filename;
+    thread_info->last_udim = udim;
+    return udim.get();
+}
+
+
+
+bool
+TextureSystemImpl::texture_udim (UdimSet &udim, TextureOptions &options,
+                                 Runflag *runflags, int beginactive, int endactive,
+                                 VaryingRef<float> s, VaryingRef<float> t,
+                                 VaryingRef<float> dsdx, VaryingRef<float> dtdx,
+                                 VaryingRef<float> dsdy, VaryingRef<float> dtdy,
+                                 float *result)
+{
+    // Figure out which UDIM tile each point is in, and its (s,t)
+    // relative to that tile.  Points that aren't in any tile get the
+    // fill color right away, as if they were channels not in the file.
+    int *tile = ALLOCA (int, endactive);
+    float *tile_s = ALLOCA (float, endactive);
+    float *tile_t = ALLOCA (float, endactive);
+    Runflag *tile_runflags = ALLOCA (Runflag, endactive);
+    for (int i = beginactive;  i < endactive;  ++i) {
+        tile[i] = -1;
+        if (! runflags[i])
+            continue;
+        int u, v;
+        tile_s[i] = floorfrac (s[i], &u);
+        tile_t[i] = floorfrac (t[i], &v);
+        if (u >= 0 && u < 10 && v >= 0 && v < 100) {
+            tile[i] = u + 10*v;
+        } else {
+            float fill = options.fill[i];
+            for (int c = 0;  c < options.nchannels;  ++c) {
+                result[i*options.nchannels+c] = fill;
+                if (options.dresultds) options.dresultds[i*options.nchannels+c] = 0;
+                if (options.dresultdt) options.dresultdt[i*options.nchannels+c] = 0;
+            }
+        }
+    }
+
+    // Gather all the points on the same tile and look them up with one
+    // batched call, so that each tile's file is found once per batch
+    // rather than once per point.  Usually there are only a few
+    // distinct tiles in a batch.  The per-file texture() resolves the
+    // default wrap modes in the options, so restore the caller's choice
+    // before each tile.
+    TextureOptions::Wrap swrap = options.swrap, twrap = options.twrap;
+    bool ok = true;
+    for (int i = beginactive;  i < endactive;  ++i) {
+        if (tile[i] < 0)
+            continue;   // inactive, out of range, or already done
+        int thistile = tile[i];
+        int groupend = i+1;
+        for (int j = i;  j < endactive;  ++j) {
+            if (tile[j] == thistile) {
+                tile_runflags[j] = RunFlagOn;
+                tile[j] = -1;
+                groupend = j+1;
+            } else {
+                tile_runflags[j] = RunFlagOff;
+            }
+        }
+        options.swrap = swrap;
+        options.twrap = twrap;
+        ok &= texture (udim.tilename (thistile % 10, thistile / 10), options,
+                       tile_runflags, i, groupend,
+                       Varying(tile_s), Varying(tile_t),
+                       dsdx, dtdx, dsdy, dtdy, result);
+    }
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
                             PerThreadInfo *thread_info, 
@@ -690,6 +958,61 @@ TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
 
 
 
+void
+TextureSystemImpl::compute_miplevels (TextureFile &texturefile,
+                                      const TextureOptions &options,
+                                      float filtwidth,
+                                      int miplevel[2], float levelweight[2])
+{
+    // We want the first (finest) level at which the filter is no more
+    // than one texel wide.  Each MIP level halves the resolution of the
+    // one before it, so the ceiling of log2 of the filter width (in
+    // texels) at level 0 is the level we want.  The exponent that frexp
+    // extracts gives us that without a loop or a log call.  Levels that
+    // aren't exactly a power of two apart (odd sizes that get rounded)
+    // may put the estimate off by one, so nudge it until it's right.
+    int nlevels = texturefile.subimages();
+    int exponent;
+    float mantissa = frexpf (texturefile.levelinfo(0).full_width * filtwidth,
+                             &exponent);
+    int lev = Imath::clamp (mantissa == 0.5f ? exponent-1 : exponent,
+                            0, nlevels);
+    while (lev > 0 && texturefile.levelinfo(lev-1).full_width * filtwidth <= 1)
+        --lev;
+    while (lev < nlevels && texturefile.levelinfo(lev).full_width * filtwidth > 1)
+        ++lev;
+
+    float levelblend = 0;
+    if (lev >= nlevels) {
+        // We'd like to blur even more, but make due with the coarsest
+        // MIP level.
+        miplevel[0] = nlevels - 1;
+        miplevel[1] = miplevel[0];
+    } else if (lev == 0) {
+        // We wish we had even more resolution than the finest MIP level,
+        // but tough for us.
+        miplevel[0] = 0;
+        miplevel[1] = 0;
+    } else {
+        // Interpolate the previous level and the current level.  Note
+        // that filtwidth_ras is expected to be >= 0.5, or we would have
+        // stopped one level ago.
+        float filtwidth_ras = texturefile.levelinfo(lev).full_width * filtwidth;
+        miplevel[0] = lev-1;
+        miplevel[1] = lev;
+        levelblend = Imath::clamp (2.0f - 1.0f/filtwidth_ras, 0.0f, 1.0f);
+    }
+    if (options.mipmode == TextureOptions::MipModeOneLevel) {
+        // Force use of just one mipmap level
+        miplevel[0] = miplevel[1];
+        levelblend = 0;
+    }
+    levelweight[0] = 1.0f - levelblend;
+    levelweight[1] = levelblend;
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
                             PerThreadInfo *thread_info,
@@ -729,47 +1052,14 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
     dtdy = dtdy * options.twidth[index] + options.tblur[index];
 
     // Determine the MIP-map level(s) we need: we will blend
-    //    data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
-    int miplevel[2] = { -1, -1 };
-    float levelblend = 0;
+    //    data(miplevel[0]) * levelweight[0] + data(miplevel[1]) * levelweight[1]
     float sfilt = std::max (std::max (dsdx, dsdy), (float)1.0e-8);
     float tfilt = std::max (std::max (dtdx, dtdy), (float)1.0e-8);
     float filtwidth = options.conservative_filter ? std::max (sfilt, tfilt)
                                                   : std::min (sfilt, tfilt);
-    for (int i = 0;  i < texturefile.subimages();  ++i) {
-        // Compute the filter size in raster space at this MIP level
-        float filtwidth_ras = texturefile.spec(i).full_width * filtwidth;
-        // Once the filter width is smaller than one texel at this level,
-        // we've gone too far, so we know that we want to interpolate the
-        // previous level and the current level.  Note that filtwidth_ras
-        // is expected to be >= 0.5, or would have stopped one level ago.
-        if (filtwidth_ras <= 1) {
-            miplevel[0] = i-1;
-            miplevel[1] = i;
-            levelblend = Imath::clamp (2.0f - 1.0f/filtwidth_ras, 0.0f, 1.0f);
-            break;
-        }
-    }
-    if (miplevel[1] < 0) {
-        // We'd like to blur even more, but make due with the coarsest
-        // MIP level.
-        miplevel[0] = texturefile.subimages() - 1;
-        miplevel[1] = miplevel[0];
-        levelblend = 0;
-    } else if (miplevel[0] < 0) {
-        // We wish we had even more resolution than the finest MIP level,
-        // but tough for us.
-        miplevel[0] = 0;
-        miplevel[1] = 0;
-        levelblend = 0;
-    }
-    if (options.mipmode == TextureOptions::MipModeOneLevel) {
-        // Force use of just one mipmap level
-        miplevel[0] = miplevel[1];
-        levelblend = 0;
-    }
-    float levelweight[2] = { 1.0f - levelblend, levelblend };
-//    std::cerr << "Levels " << miplevel[0] << ' ' << miplevel[1] << ' ' << levelblend << "\n";
+    int miplevel[2];
+    float levelweight[2];
+    compute_miplevels (texturefile, options, filtwidth, miplevel, levelweight);
 
     static const accum_prototype accum_functions[] = {
         // Must be in the same order as InterpMode enum
@@ -858,10 +1148,6 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     dsdy = copysignf(fabsf(dsdy) * options.swidth[index] + options.sblur[index], dsdy);
     dtdy = copysignf(fabsf(dtdy) * options.twidth[index] + options.tblur[index], dtdy);
 
-    // Determine the MIP-map level(s) we need: we will blend
-    //    data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
-    int miplevel[2] = { -1, -1 };
-    float levelblend = 0;
     // The ellipse is made up of two axes which correspond to the x and y pixel
     // directions. Pick the longest one and take several samples along it.
     float xfilt = std::max (std::max (fabsf(dsdx), fabsf(dtdx)), 1e-8f);
@@ -905,43 +1191,36 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
         }
     }
 
-    float filtwidth = minorlength;
-    for (int i = 0;  i < texturefile.subimages();  ++i) {
-        // Compute the filter size in raster space at this MIP level
-        float filtwidth_ras = texturefile.spec(i).full_width * filtwidth;
-        // Once the filter width is smaller than one texel at this level,
-        // we've gone too far, so we know that we want to interpolate the
-        // previous level and the current level.  Note that filtwidth_ras
-        // is expected to be >= 0.5, or would have stopped one level ago.
-        if (filtwidth_ras <= 1) {
-            miplevel[0] = i-1;
-            miplevel[1] = i;
-            levelblend = Imath::clamp (2.0f - 1.0f/filtwidth_ras, 0.0f, 1.0f);
-            break;
-        }
-    }
-    if (miplevel[1] < 0) {
-        // We'd like to blur even more, but make due with the coarsest
-        // MIP level.
-        miplevel[0] = texturefile.subimages() - 1;
-        miplevel[1] = miplevel[0];
-        levelblend = 0;
-    } else if (miplevel[0] < 0) {
-        // We wish we had even more resolution than the finest MIP level,
-        // but tough for us.
-        miplevel[0] = 0;
-        miplevel[1] = 0;
-        levelblend = 0;
-    }
-    if (options.mipmode == TextureOptions::MipModeOneLevel) {
-        miplevel[0] = miplevel[1];
-        levelblend = 0;
-    }
-    float levelweight[2] = { 1.0f - levelblend, levelblend };
+    // Determine the MIP-map level(s) we need: we will blend
+    //    data(miplevel[0]) * levelweight[0] + data(miplevel[1]) * levelweight[1]
+    int miplevel[2];
+    float levelweight[2];
+    compute_miplevels (texturefile, options, minorlength,
+                       miplevel, levelweight);
 
     int nsamples = std::max (1, (int) ceilf (aspect - 0.25f));
     float invsamples = 1.0f / nsamples;
 
+    // Stochastic mode: rather than blending two levels with nsamples
+    // probes apiece, use the random number to pick just one level and
+    // one probe, each with probability equal to the weight it would
+    // have had in the full filter.  The expected value is unchanged,
+    // but we only touch one interpolation footprint.
+    int firstsample = 0, lastsample = nsamples;
+    bool stochastic = (options.mipmode == TextureOptions::MipModeStochastic &&
+                       options.random);
+    if (stochastic) {
+        float xi = Imath::clamp (options.random[index], 0.0f, 1.0f);
+        int lev = (xi >= levelweight[0] && levelweight[1] > 0) ? 1 : 0;
+        xi = lev ? (xi - levelweight[0]) / levelweight[1]
+                 : xi / levelweight[0];
+        levelweight[lev] = 1.0f;
+        levelweight[1-lev] = 0.0f;
+        firstsample = Imath::clamp ((int)(xi * nsamples), 0, nsamples-1);
+        lastsample = firstsample + 1;
+    }
+    int nprobes = lastsample - firstsample;
+
     bool ok = true;
     float s = _s[index], t = _t[index];
     int npointson = 0;
@@ -967,8 +1246,9 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
             ++bicubicprobes;
             break;
         case TextureOptions::InterpSmartBicubic :
-            if (lev == 0 || options.interpmode == TextureOptions::InterpBicubic ||
-                (texturefile.spec(lev).full_height < naturalres/2)) {
+            if (lev == 0 ||
+                    options.interpmode == TextureOptions::InterpBicubic ||
+                    (texturefile.levelinfo(lev).full_height < naturalres/2)) {
                 accumer = &TextureSystemImpl::accum_sample_bicubic;
                 ++bicubicprobes;
             } else {
@@ -977,7 +1257,7 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
             }
             break;
         }
-        for (int sample = 0;  sample < nsamples;  ++sample) {
+        for (int sample = firstsample;  sample < lastsample;  ++sample) {
             float pos = (sample + 0.5f) * invsamples - 0.5f;
             ok &= (this->*accumer) (s + pos * smajor, t + pos * tmajor, lev, texturefile,
                                     thread_info, options, index, levelweight[level],
@@ -998,18 +1278,206 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     // Update stats
     ImageCacheStatistics &stats (thread_info->m_stats);
     stats.aniso_queries += npointson;
-    stats.aniso_probes += npointson * nsamples;
+    stats.aniso_probes += npointson * nprobes;
     if (trueaspect > stats.max_aniso)
         stats.max_aniso = trueaspect;   // FIXME?
-    stats.closest_interps += closestprobes * nsamples;
-    stats.bilinear_interps += bilinearprobes * nsamples;
-    stats.cubic_interps += bicubicprobes * nsamples;
+    stats.closest_interps += closestprobes * nprobes;
+    stats.bilinear_interps += bilinearprobes * nprobes;
+    stats.cubic_interps += bicubicprobes * nprobes;
 
     return ok;
 }
 
 
 
+namespace {  // anonymous
+
+// Convert one texel channel value, in its cached data type, to float.
+inline float texel_to_float (unsigned char v) { return uchar2float (v); }
+inline float texel_to_float (unsigned short v) { return v * (1.0f/65535.0f); }
+inline float texel_to_float (half v) { return (float) v; }
+inline float texel_to_float (float v) { return v; }
+
+
+template <typename T>
+inline void evalBSplineWeights (T w[4], T fraction)
+{
+    T one_frac = 1 - fraction;
+    w[0] = T(1.0 / 6.0) * one_frac * one_frac * one_frac;
+    w[1] = T(2.0 / 3.0) - T(0.5) * fraction * fraction * (2 - fraction);
+    w[2] = T(2.0 / 3.0) - T(0.5) * one_frac * one_frac * (2 - one_frac);
+    w[3] = T(1.0 / 6.0) * fraction * fraction * fraction;
+}
+
+template <typename T>
+inline void evalBSplineWeightDerivs (T dw[4], T fraction)
+{
+    T one_frac = 1 - fraction;
+    dw[0] = -T(0.5) * one_frac * one_frac;
+    dw[1] =  T(0.5) * fraction * (3 * fraction - 4);
+    dw[2] = -T(0.5) * one_frac * (3 * one_frac - 4);
+    dw[3] =  T(0.5) * fraction * fraction;
+}
+
+
+
+// The kernels below are templated on the texel data type T and the
+// channel count NC.  NC == 0 means "any number of channels, given by
+// nc at runtime"; otherwise nc is ignored and the channel loops have a
+// constant trip count, so the compiler can unroll them.
+
+template <typename T, int NC>
+void closest_kernel (const unsigned char *texel_, int nc,
+                     float weight, float *accum)
+{
+    if (NC)
+        nc = NC;
+    const T *texel = (const T *) texel_;
+    for (int c = 0;  c < nc;  ++c)
+        accum[c] += weight * texel_to_float (texel[c]);
+}
+
+
+
+template <typename T, int NC>
+void bilinear_kernel (const unsigned char *texel[2][2], int nc,
+                      float sfrac, float tfrac, float weight,
+                      float scalex, float scaley, float *accum,
+                      float *daccumds, float *daccumdt)
+{
+    if (NC)
+        nc = NC;
+    const T *t00 = (const T *) texel[0][0];
+    const T *t01 = (const T *) texel[0][1];
+    const T *t10 = (const T *) texel[1][0];
+    const T *t11 = (const T *) texel[1][1];
+    for (int c = 0;  c < nc;  ++c)
+        accum[c] += weight * bilerp (texel_to_float (t00[c]), texel_to_float (t01[c]),
+                                     texel_to_float (t10[c]), texel_to_float (t11[c]),
+                                     sfrac, tfrac);
+    if (daccumds) {
+        for (int c = 0;  c < nc;  ++c) {
+            float v00 = texel_to_float (t00[c]), v01 = texel_to_float (t01[c]);
+            float v10 = texel_to_float (t10[c]), v11 = texel_to_float (t11[c]);
+            daccumds[c] += scalex * Imath::lerp (v01 - v00, v11 - v10, tfrac);
+            daccumdt[c] += scaley * Imath::lerp (v10 - v00, v11 - v01, sfrac);
+        }
+    }
+}
+
+
+
+template <typename T, int NC>
+void bicubic_kernel (const unsigned char *texel[4][4], int nc,
+                     float sfrac, float tfrac, float weight,
+                     float scalex, float scaley, float *accum,
+                     float *daccumds, float *daccumdt)
+{
+    if (NC)
+        nc = NC;
+    // We use a formulation of cubic B-spline evaluation that reduces to
+    // lerps.  It's tricky to follow, but the references are:
+    //   * Ruijters, Daniel et al, "Efficient GPU-Based Texture
+    //     Interpolation using Uniform B-Splines", Journal of Graphics
+    //     Tools 13(4), pp. 61-69, 2008.
+    //     http://jgt.akpeters.com/papers/RuijtersEtAl08/
+    //   * Sigg, Christian and Markus Hadwiger, "Fast Third-Order Texture 
+    //     Filtering", in GPU Gems 2 (Chapter 20), Pharr and Fernando, ed.
+    //     http://http.developer.nvidia.com/GPUGems2/gpugems2_chapter20.html
+    // We like this formulation because it's slightly faster than any of
+    // the other B-spline evaluation routines we tried, and also the lerp
+    // guarantees that the filtered results will be non-negative for
+    // non-negative texel values (which we had trouble with before due to
+    // numerical imprecision).
+    float wx[4]; evalBSplineWeights (wx, sfrac);
+    float wy[4]; evalBSplineWeights (wy, tfrac);
+    // figure out lerp weights so we can turn the filter into a sequence of lerp's
+    float g0x = wx[0] + wx[1]; float h0x = (wx[1] / g0x); 
+    float g1x = wx[2] + wx[3]; float h1x = (wx[3] / g1x); 
+    float g0y = wy[0] + wy[1]; float h0y = (wy[1] / g0y);
+    float g1y = wy[2] + wy[3]; float h1y = (wy[3] / g1y);
+
+    const T *tx[4][4];
+    for (int j = 0;  j < 4;  ++j)
+        for (int i = 0;  i < 4;  ++i)
+            tx[j][i] = (const T *) texel[j][i];
+
+    for (int c = 0;  c < nc; ++c) {
+        float col[4];
+        for (int j = 0;  j < 4; ++j) {
+            float lx = Imath::lerp (texel_to_float (tx[j][0][c]), texel_to_float (tx[j][1][c]), h0x);
+            float rx = Imath::lerp (texel_to_float (tx[j][2][c]), texel_to_float (tx[j][3][c]), h1x);
+            col[j]   = Imath::lerp (lx, rx, g1x);
+        }
+        float ly = Imath::lerp (col[0], col[1], h0y);
+        float ry = Imath::lerp (col[2], col[3], h1y);
+        accum[c] += weight * Imath::lerp (ly, ry, g1y);
+    }
+    if (daccumds) {
+        float dwx[4]; evalBSplineWeightDerivs (dwx, sfrac);
+        float dwy[4]; evalBSplineWeightDerivs (dwy, tfrac);
+        for (int c = 0;  c < nc; ++c) {
+            float ds = 0, dt = 0;
+            for (int i = 0;  i < 4;  ++i) {
+                float col = 0, row = 0;
+                for (int j = 0;  j < 4;  ++j) {
+                    col += wy[j] * texel_to_float (tx[j][i][c]);
+                    row += wx[j] * texel_to_float (tx[i][j][c]);
+                }
+                ds += dwx[i] * col;
+                dt += dwy[i] * row;
+            }
+            daccumds[c] += scalex * ds;
+            daccumdt[c] += scaley * dt;
+        }
+    }
+}
+
+
+
+#define TEXEL_KERNELS(T,NC) \
+    { closest_kernel<T,NC>, bilinear_kernel<T,NC>, bicubic_kernel<T,NC> }
+
+static const TexelKernels texel_kernel_table[4][4] = {
+    // Rows: uint8, uint16, half, float.  Columns: any nc, 1, 3, 4 chans.
+    { TEXEL_KERNELS(unsigned char,0),  TEXEL_KERNELS(unsigned char,1),
+      TEXEL_KERNELS(unsigned char,3),  TEXEL_KERNELS(unsigned char,4) },
+    { TEXEL_KERNELS(unsigned short,0), TEXEL_KERNELS(unsigned short,1),
+      TEXEL_KERNELS(unsigned short,3), TEXEL_KERNELS(unsigned short,4) },
+    { TEXEL_KERNELS(half,0),           TEXEL_KERNELS(half,1),
+      TEXEL_KERNELS(half,3),           TEXEL_KERNELS(half,4) },
+    { TEXEL_KERNELS(float,0),          TEXEL_KERNELS(float,1),
+      TEXEL_KERNELS(float,3),          TEXEL_KERNELS(float,4) }
+};
+
+#undef TEXEL_KERNELS
+
+};  // end anonymous namespace
+
+
+
+const TexelKernels *
+TextureSystemImpl::texel_kernels (TypeDesc datatype, int nchannels)
+{
+    int type = 3;   // float
+    if (datatype == TypeDesc::UINT8)
+        type = 0;
+    else if (datatype == TypeDesc::UINT16)
+        type = 1;
+    else if (datatype == TypeDesc::HALF)
+        type = 2;
+    int chans = 0;  // general case
+    if (nchannels == 1)
+        chans = 1;
+    else if (nchannels == 3)
+        chans = 2;
+    else if (nchannels == 4)
+        chans = 3;
+    return &texel_kernel_table[type][chans];
+}
+
+
+
 bool
 TextureSystemImpl::accum_sample_closest (float s, float t, int miplevel,
                                  TextureFile &texturefile,
@@ -1040,11 +1508,12 @@ TextureSystemImpl::accum_sample_closest (float s, float t, int miplevel,
         return true;
     }
 
-    int tilewidthmask  = spec.tile_width  - 1;  // e.g. 63
-    int tileheightmask = spec.tile_height - 1;
+    int tilewidthmask  = levelinfo.tilewidthmask;  // e.g. 63
+    int tileheightmask = levelinfo.tileheightmask;
     int tile_s = (stex - spec.x) & tilewidthmask;
     int tile_t = (ttex - spec.y) & tileheightmask;
-    TileID id (texturefile, miplevel, stex - tile_s, ttex - tile_t, 0);
+    TileID id (texturefile, miplevel, stex - tile_s, ttex - tile_t, 0,
+               options.tile_chbegin, options.tile_chend);
     bool ok = find_tile (id, thread_info);
     if (! ok)
         error ("%s", m_imagecache->geterror().c_str());
@@ -1052,19 +1521,13 @@ TextureSystemImpl::accum_sample_closest (float s, float t, int miplevel,
     if (! tile  ||  ! ok)
         return false;
     size_t channelsize = texturefile.channelsize();
-    int offset = spec.nchannels * (tile_t * spec.tile_width + tile_s) + options.firstchannel;
-    DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
-    if (channelsize == 1) {
-        // special case for 8-bit tiles
-        const unsigned char *texel = tile->bytedata() + offset;
-        for (int c = 0;  c < options.actualchannels;  ++c)
-            accum[c] += weight * uchar2float(texel[c]);
-    } else {
-        // General case for float tiles
-        const float *texel = tile->data() + offset;
-        for (int c = 0;  c < options.actualchannels;  ++c)
-            accum[c] += weight * texel[c];
-    }
+    size_t pixelsize = channelsize * (options.tile_chend - options.tile_chbegin);
+    size_t chanoffset = channelsize * (options.firstchannel - options.tile_chbegin);
+    int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
+    DASSERT ((size_t)offset < spec.tile_pixels() * pixelsize);
+    const unsigned char *texel = tile->bytedata() + offset + chanoffset;
+    options.texel_kernels->closest (texel, options.actualchannels,
+                                    weight, accum);
     return true;
 }
 
@@ -1120,8 +1583,8 @@ TextureSystemImpl::accum_sample_bilinear (float s, float t, int miplevel,
     if (valid_storage == none_valid)
         return true; // All texels we need were out of range and using 'black' wrap
 
-    int tilewidthmask  = spec.tile_width  - 1;  // e.g. 63
-    int tileheightmask = spec.tile_height - 1;
+    int tilewidthmask  = levelinfo.tilewidthmask;  // e.g. 63
+    int tileheightmask = levelinfo.tileheightmask;
     const unsigned char *texel[2][2];
     TileRef savetile[2][2];
     static float black[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -1131,13 +1594,15 @@ TextureSystemImpl::accum_sample_bilinear (float s, float t, int miplevel,
     bool t_onetile = (tile_t != tileheightmask) & (ttex[0]+1 == ttex[1]);
     bool onetile = (s_onetile & t_onetile);
     size_t channelsize = texturefile.channelsize();
-    size_t pixelsize = texturefile.pixelsize();
+    size_t pixelsize = channelsize * (options.tile_chend - options.tile_chbegin);
+    size_t chanoffset = channelsize * (options.firstchannel - options.tile_chbegin);
     if (onetile &&
 //        (svalid[0] & svalid[1] & tvalid[0] & tvalid[1])) {
         valid_storage == all_valid) {
         // Shortcut if all the texels we need are on the same tile
         TileID id (texturefile, miplevel,
-                   stex[0] - tile_s, ttex[0] - tile_t, 0);
+                   stex[0] - tile_s, ttex[0] - tile_t, 0,
+                   options.tile_chbegin, options.tile_chend);
         bool ok = find_tile (id, thread_info);
         if (! ok)
             error ("%s", m_imagecache->geterror().c_str());
@@ -1156,7 +1621,7 @@ TextureSystemImpl::accum_sample_bilinear (float s, float t, int miplevel,
             return false;
         }
         int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
-        texel[0][0] = tile->bytedata() + offset + channelsize * options.firstchannel;
+        texel[0][0] = tile->bytedata() + offset + chanoffset;
         texel[0][1] = texel[0][0] + pixelsize;
         texel[1][0] = texel[0][0] + pixelsize * spec.tile_width;
         texel[1][1] = texel[1][0] + pixelsize;
@@ -1170,7 +1635,8 @@ TextureSystemImpl::accum_sample_bilinear (float s, float t, int miplevel,
                 tile_s = (stex[i] - spec.x) & tilewidthmask;
                 tile_t = (ttex[j] - spec.y) & tileheightmask;
                 TileID id (texturefile, miplevel,
-                           stex[i] - tile_s, ttex[j] - tile_t, 0);
+                           stex[i] - tile_s, ttex[j] - tile_t, 0,
+                           options.tile_chbegin, options.tile_chend);
                 bool ok = find_tile (id, thread_info);
                 if (! ok)
                     error ("%s", m_imagecache->geterror().c_str());
@@ -1180,85 +1646,22 @@ TextureSystemImpl::accum_sample_bilinear (float s, float t, int miplevel,
                 savetile[j][i] = tile;
                 int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
                 DASSERT ((size_t)offset < spec.tile_bytes()*spec.nchannels);
-                texel[j][i] = tile->bytedata() + offset + channelsize * options.firstchannel;
+                texel[j][i] = tile->bytedata() + offset + chanoffset;
                 DASSERT (tile->id() == id);
             }
         }
     }
     // FIXME -- optimize the above loop by unrolling
 
-    if (channelsize == 1) {
-        // special case for 8-bit tiles
-        int c;
-        for (c = 0;  c < options.actualchannels;  ++c)
-            accum[c] += weight * bilerp (uchar2float(texel[0][0][c]), uchar2float(texel[0][1][c]),
-                                         uchar2float(texel[1][0][c]), uchar2float(texel[1][1][c]),
-                                         sfrac, tfrac);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            for (c = 0;  c < options.actualchannels;  ++c) {
-                daccumds[c] += scalex * Imath::lerp(
-                    uchar2float(texel[0][1][c]) - uchar2float(texel[0][0][c]),
-                    uchar2float(texel[1][1][c]) - uchar2float(texel[1][0][c]),
-                    tfrac
-                );
-                daccumdt[c] += scaley * Imath::lerp(
-                    uchar2float(texel[1][0][c]) - uchar2float(texel[0][0][c]),
-                    uchar2float(texel[1][1][c]) - uchar2float(texel[0][1][c]),
-                    sfrac
-                );
-            }
-        }
-    } else {
-        // General case for float tiles
-        bilerp_mad ((const float *)texel[0][0], (const float *)texel[0][1],
-                    (const float *)texel[1][0], (const float *)texel[1][1],
-                    sfrac, tfrac, weight, options.actualchannels, accum);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            for (int c = 0;  c < options.actualchannels;  ++c) {
-                daccumds[c] += scalex * Imath::lerp(
-                    ((const float *) texel[0][1])[c] - ((const float *) texel[0][0])[c],
-                    ((const float *) texel[1][1])[c] - ((const float *) texel[1][0])[c],
-                    tfrac
-                );
-                daccumdt[c] += scaley * Imath::lerp(
-                    ((const float *) texel[1][0])[c] - ((const float *) texel[0][0])[c],
-                    ((const float *) texel[1][1])[c] - ((const float *) texel[0][1])[c],
-                    sfrac
-                );
-            }
-        }
-    }
+    float scalex = weight * spec.full_width;
+    float scaley = weight * spec.full_height;
+    options.texel_kernels->bilinear (texel, options.actualchannels,
+                                     sfrac, tfrac, weight, scalex, scaley,
+                                     accum, daccumds, daccumdt);
 
     return true;
 }
 
-namespace {
-
-template <typename T>
-inline void evalBSplineWeights (T w[4], T fraction)
-{
-    T one_frac = 1 - fraction;
-    w[0] = T(1.0 / 6.0) * one_frac * one_frac * one_frac;
-    w[1] = T(2.0 / 3.0) - T(0.5) * fraction * fraction * (2 - fraction);
-    w[2] = T(2.0 / 3.0) - T(0.5) * one_frac * one_frac * (2 - one_frac);
-    w[3] = T(1.0 / 6.0) * fraction * fraction * fraction;
-}
-
-template <typename T>
-inline void evalBSplineWeightDerivs (T dw[4], T fraction)
-{
-    T one_frac = 1 - fraction;
-    dw[0] = -T(0.5) * one_frac * one_frac;
-    dw[1] =  T(0.5) * fraction * (3 * fraction - 4);
-    dw[2] = -T(0.5) * one_frac * (3 * one_frac - 4);
-    dw[3] =  T(0.5) * fraction * fraction;
-}
-
-} // anonymous namesace
 
 bool
 TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
@@ -1328,8 +1731,8 @@ TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
                                          {NULL, NULL, NULL, NULL}, {NULL, NULL, NULL, NULL} };
     TileRef savetile[4][4];
     static float black[4] = { 0, 0, 0, 0 };
-    int tilewidthmask  = spec.tile_width  - 1;  // e.g. 63
-    int tileheightmask = spec.tile_height - 1;
+    int tilewidthmask  = levelinfo.tilewidthmask;  // e.g. 63
+    int tileheightmask = levelinfo.tileheightmask;
     int tile_s = (stex[0] - spec.x) & tilewidthmask;
     int tile_t = (ttex[0] - spec.y) & tileheightmask;
     bool s_onetile = (tile_s <= tilewidthmask-3);
@@ -1342,11 +1745,13 @@ TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
     }
     bool onetile = (s_onetile & t_onetile);
     size_t channelsize = texturefile.channelsize();
-    size_t pixelsize = texturefile.pixelsize();
+    size_t pixelsize = channelsize * (options.tile_chend - options.tile_chbegin);
+    size_t chanoffset = channelsize * (options.firstchannel - options.tile_chbegin);
     if (onetile & allvalid) {
         // Shortcut if all the texels we need are on the same tile
         TileID id (texturefile, miplevel,
-                   stex[0] - tile_s, ttex[0] - tile_t, 0);
+                   stex[0] - tile_s, ttex[0] - tile_t, 0,
+                   options.tile_chbegin, options.tile_chend);
         bool ok = find_tile (id, thread_info);
         if (! ok)
             error ("%s", m_imagecache->geterror().c_str());
@@ -1355,7 +1760,7 @@ TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
             return false;
         }
         int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
-        const unsigned char *base = tile->bytedata() + offset + channelsize * options.firstchannel;
+        const unsigned char *base = tile->bytedata() + offset + chanoffset;
         DASSERT (tile->data());
         for (int j = 0;  j < 4;  ++j)
             for (int i = 0;  i < 4;  ++i)
@@ -1370,7 +1775,8 @@ TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
                 tile_s = (stex[i] - spec.x) & tilewidthmask;
                 tile_t = (ttex[j] - spec.y) & tileheightmask;
                 TileID id (texturefile, miplevel,
-                           stex[i] - tile_s, ttex[j] - tile_t, 0);
+                           stex[i] - tile_s, ttex[j] - tile_t, 0,
+                           options.tile_chbegin, options.tile_chend);
                 bool ok = find_tile (id, thread_info);
                 if (! ok)
                     error ("%s", m_imagecache->geterror().c_str());
@@ -1381,149 +1787,16 @@ TextureSystemImpl::accum_sample_bicubic (float s, float t, int miplevel,
                 DASSERT (tile->id() == id);
                 int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
                 DASSERT (tile->data());
-                texel[j][i] = tile->bytedata() + offset + channelsize * options.firstchannel;
+                texel[j][i] = tile->bytedata() + offset + chanoffset;
             }
         }
     }
 
-    int nc = options.actualchannels;
-
-    // We use a formulation of cubic B-spline evaluation that reduces to
-    // lerps.  It's tricky to follow, but the references are:
-    //   * Ruijters, Daniel et al, "Efficient GPU-Based Texture
-    //     Interpolation using Uniform B-Splines", Journal of Graphics
-    //     Tools 13(4), pp. 61-69, 2008.
-    //     http://jgt.akpeters.com/papers/RuijtersEtAl08/
-    //   * Sigg, Christian and Markus Hadwiger, "Fast Third-Order Texture 
-    //     Filtering", in GPU Gems 2 (Chapter 20), Pharr and Fernando, ed.
-    //     http://http.developer.nvidia.com/GPUGems2/gpugems2_chapter20.html
-    // We like this formulation because it's slightly faster than any of
-    // the other B-spline evaluation routines we tried, and also the lerp
-    // guarantees that the filtered results will be non-negative for
-    // non-negative texel values (which we had trouble with before due to
-    // numerical imprecision).
-    float wx[4]; evalBSplineWeights (wx, sfrac);
-    float wy[4]; evalBSplineWeights (wy, tfrac);
-    // figure out lerp weights so we can turn the filter into a sequence of lerp's
-    float g0x = wx[0] + wx[1]; float h0x = (wx[1] / g0x); 
-    float g1x = wx[2] + wx[3]; float h1x = (wx[3] / g1x); 
-    float g0y = wy[0] + wy[1]; float h0y = (wy[1] / g0y);
-    float g1y = wy[2] + wy[3]; float h1y = (wy[3] / g1y);
-
-    if (texturefile.eightbit()) {
-        for (int c = 0;  c < nc; ++c) {
-            float col[4];
-            for (int j = 0;  j < 4; ++j) {
-                float lx = Imath::lerp (uchar2float(texel[j][0][c]), uchar2float(texel[j][1][c]), h0x);
-                float rx = Imath::lerp (uchar2float(texel[j][2][c]), uchar2float(texel[j][3][c]), h1x);
-                col[j]   = Imath::lerp (lx, rx, g1x);
-            }
-            float ly = Imath::lerp (col[0], col[1], h0y);
-            float ry = Imath::lerp (col[2], col[3], h1y);
-            accum[c] += weight * Imath::lerp (ly, ry, g1y);
-        }
-        if (daccumds) {
-            float dwx[4]; evalBSplineWeightDerivs (dwx, sfrac);
-            float dwy[4]; evalBSplineWeightDerivs (dwy, tfrac);
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            for (int c = 0;  c < nc; ++c) {
-                daccumds[c] += scalex * (
-                    dwx[0] * (wy[0] * uchar2float(texel[0][0][c]) +
-                              wy[1] * uchar2float(texel[1][0][c]) +
-                              wy[2] * uchar2float(texel[2][0][c]) +
-                              wy[3] * uchar2float(texel[3][0][c])) +
-                    dwx[1] * (wy[0] * uchar2float(texel[0][1][c]) +
-                              wy[1] * uchar2float(texel[1][1][c]) +
-                              wy[2] * uchar2float(texel[2][1][c]) +
-                              wy[3] * uchar2float(texel[3][1][c])) +
-                    dwx[2] * (wy[0] * uchar2float(texel[0][2][c]) +
-                              wy[1] * uchar2float(texel[1][2][c]) +
-                              wy[2] * uchar2float(texel[2][2][c]) +
-                              wy[3] * uchar2float(texel[3][2][c])) +
-                    dwx[3] * (wy[0] * uchar2float(texel[0][3][c]) +
-                              wy[1] * uchar2float(texel[1][3][c]) +
-                              wy[2] * uchar2float(texel[2][3][c]) +
-                              wy[3] * uchar2float(texel[3][3][c]))
-                );
-                daccumdt[c] += scaley * (
-                    dwy[0] * (wx[0] * uchar2float(texel[0][0][c]) +
-                              wx[1] * uchar2float(texel[0][1][c]) +
-                              wx[2] * uchar2float(texel[0][2][c]) +
-                              wx[3] * uchar2float(texel[0][3][c])) +
-                    dwy[1] * (wx[0] * uchar2float(texel[1][0][c]) +
-                              wx[1] * uchar2float(texel[1][1][c]) +
-                              wx[2] * uchar2float(texel[1][2][c]) +
-                              wx[3] * uchar2float(texel[1][3][c])) +
-                    dwy[2] * (wx[0] * uchar2float(texel[2][0][c]) +
-                              wx[1] * uchar2float(texel[2][1][c]) +
-                              wx[2] * uchar2float(texel[2][2][c]) +
-                              wx[3] * uchar2float(texel[2][3][c])) +
-                    dwy[3] * (wx[0] * uchar2float(texel[3][0][c]) +
-                              wx[1] * uchar2float(texel[3][1][c]) +
-                              wx[2] * uchar2float(texel[3][2][c]) +
-                              wx[3] * uchar2float(texel[3][3][c]))
-                );
-            }
-        }
-    } else {
-        // float texels
-        for (int c = 0;  c < nc; ++c) {
-           float col[4];
-           for (int j = 0;  j < 4; ++j) {
-               float lx = Imath::lerp (((const float*)(texel[j][0]))[c], ((const float*)(texel[j][1]))[c], h0x);
-               float rx = Imath::lerp (((const float*)(texel[j][2]))[c], ((const float*)(texel[j][3]))[c], h1x);
-               col[j]   = Imath::lerp (lx, rx, g1x);
-           }
-           float ly = Imath::lerp (col[0], col[1], h0y);
-           float ry = Imath::lerp (col[2], col[3], h1y);
-           accum[c] += weight * Imath::lerp (ly, ry, g1y);
-        }
-        if (daccumds) {
-            float dwx[4]; evalBSplineWeightDerivs (dwx, sfrac);
-            float dwy[4]; evalBSplineWeightDerivs (dwy, tfrac);
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            for (int c = 0;  c < nc; ++c) {
-                daccumds[c] += scalex * (
-                    dwx[0] * (wy[0] * ((const float*)(texel[0][0]))[c] +
-                              wy[1] * ((const float*)(texel[1][0]))[c] +
-                              wy[2] * ((const float*)(texel[2][0]))[c] +
-                              wy[3] * ((const float*)(texel[3][0]))[c]) +
-                    dwx[1] * (wy[0] * ((const float*)(texel[0][1]))[c] +
-                              wy[1] * ((const float*)(texel[1][1]))[c] +
-                              wy[2] * ((const float*)(texel[2][1]))[c] +
-                              wy[3] * ((const float*)(texel[3][1]))[c]) +
-                    dwx[2] * (wy[0] * ((const float*)(texel[0][2]))[c] +
-                              wy[1] * ((const float*)(texel[1][2]))[c] +
-                              wy[2] * ((const float*)(texel[2][2]))[c] +
-                              wy[3] * ((const float*)(texel[3][2]))[c]) +
-                    dwx[3] * (wy[0] * ((const float*)(texel[0][3]))[c] +
-                              wy[1] * ((const float*)(texel[1][3]))[c] +
-                              wy[2] * ((const float*)(texel[2][3]))[c] +
-                              wy[3] * ((const float*)(texel[3][3]))[c])
-                );
-                daccumdt[c] += scaley * (
-                    dwy[0] * (wx[0] * ((const float*)(texel[0][0]))[c] +
-                              wx[1] * ((const float*)(texel[0][1]))[c] +
-                              wx[2] * ((const float*)(texel[0][2]))[c] +
-                              wx[3] * ((const float*)(texel[0][3]))[c]) +
-                    dwy[1] * (wx[0] * ((const float*)(texel[1][0]))[c] +
-                              wx[1] * ((const float*)(texel[1][1]))[c] +
-                              wx[2] * ((const float*)(texel[1][2]))[c] +
-                              wx[3] * ((const float*)(texel[1][3]))[c]) +
-                    dwy[2] * (wx[0] * ((const float*)(texel[2][0]))[c] +
-                              wx[1] * ((const float*)(texel[2][1]))[c] +
-                              wx[2] * ((const float*)(texel[2][2]))[c] +
-                              wx[3] * ((const float*)(texel[2][3]))[c]) +
-                    dwy[3] * (wx[0] * ((const float*)(texel[3][0]))[c] +
-                              wx[1] * ((const float*)(texel[3][1]))[c] +
-                              wx[2] * ((const float*)(texel[3][2]))[c] +
-                              wx[3] * ((const float*)(texel[3][3]))[c])
-                );
-            }
-        }
-    }
+    float scalex = weight * spec.full_width;
+    float scaley = weight * spec.full_height;
+    options.texel_kernels->bicubic (texel, options.actualchannels,
+                                    sfrac, tfrac, weight, scalex, scaley,
+                                    accum, daccumds, daccumdt);
 
     return true;
 }
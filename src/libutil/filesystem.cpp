@@ -28,8 +28,15 @@
   (This is the Modified BSD License)
 */
 
+// Give 32 bit builds a 64 bit off_t, for fseeko/ftello on big files
+#ifndef _FILE_OFFSET_BITS
+# define _FILE_OFFSET_BITS 64
+#endif
+
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
 #include <string>
 
@@ -37,6 +44,15 @@
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 
+#ifdef _WIN32
+# include "osdep.h"
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
 #include "dassert.h"
 
 #include "filesystem.h"
@@ -199,3 +215,494 @@ Filesystem::path_is_absolute (const std::string &path, bool dot_is_absolute)
 #endif
         ;
 }
+
+
+
+// ftell and fseek with 64 bit offsets.  The plain ones use long, which
+// is only 32 bits on Windows and in 32 bit builds.
+static int64_t
+ftell64 (FILE *file)
+{
+#ifdef _WIN32
+    return _ftelli64 (file);
+#else
+    return (int64_t) ftello (file);
+#endif
+}
+
+
+
+static int
+fseek64 (FILE *file, int64_t offset, int whence)
+{
+#ifdef _WIN32
+    return _fseeki64 (file, offset, whence);
+#else
+    return fseeko (file, (off_t) offset, whence);
+#endif
+}
+
+
+
+Filesystem::IOFile::IOFile (const std::string &filename, Mode mode,
+                            bool unbuffered)
+    : IOProxy (filename, mode), m_file(NULL), m_size(0), m_auto_close(true)
+{
+    m_file = fopen (filename.c_str(), mode == Write ? "wb" : "rb");
+    if (! m_file) {
+        m_mode = Closed;
+        return;
+    }
+    // setvbuf must come before any other operation on the stream
+    if (unbuffered)
+        setvbuf (m_file, NULL, _IONBF, 0);
+    if (mode == Read) {
+        // Note the size now, so size() doesn't have to move around
+        fseek64 (m_file, 0, SEEK_END);
+        m_size = ftell64 (m_file);
+        fseek64 (m_file, 0, SEEK_SET);
+    }
+}
+
+
+
+Filesystem::IOFile::IOFile (FILE *file, Mode mode)
+    : IOProxy ("", mode), m_file(file), m_size(0), m_auto_close(false)
+{
+    if (! m_file) {
+        m_mode = Closed;
+        return;
+    }
+    m_pos = ftell64 (m_file);
+    if (mode == Read) {
+        fseek64 (m_file, 0, SEEK_END);
+        m_size = ftell64 (m_file);
+        fseek64 (m_file, m_pos, SEEK_SET);
+    }
+}
+
+
+
+Filesystem::IOFile::~IOFile ()
+{
+    close ();
+}
+
+
+
+void
+Filesystem::IOFile::close ()
+{
+    if (m_file && m_auto_close)
+        fclose (m_file);
+    m_file = NULL;
+    m_mode = Closed;
+}
+
+
+
+bool
+Filesystem::IOFile::seek (int64_t offset)
+{
+    if (! m_file || offset < 0)
+        return false;
+    if (fseek64 (m_file, offset, SEEK_SET))
+        return false;
+    m_pos = offset;
+    return true;
+}
+
+
+
+size_t
+Filesystem::IOFile::read (void *buf, size_t size)
+{
+    if (! m_file || m_mode != Read)
+        return 0;
+    size_t r = fread (buf, 1, size, m_file);
+    m_pos += r;
+    return r;
+}
+
+
+
+size_t
+Filesystem::IOFile::write (const void *buf, size_t size)
+{
+    if (! m_file || m_mode != Write)
+        return 0;
+    size_t r = fwrite (buf, 1, size, m_file);
+    m_pos += r;
+    m_size = std::max (m_size, m_pos);
+    return r;
+}
+
+
+
+void
+Filesystem::IOFile::flush () const
+{
+    if (m_file)
+        fflush (m_file);
+}
+
+
+
+size_t
+Filesystem::IOVecOutput::read (void *buf, size_t size)
+{
+    if (m_pos >= (int64_t) m_buf.size())
+        return 0;
+    size = std::min (size, (size_t) (m_buf.size() - m_pos));
+    memcpy (buf, &m_buf[m_pos], size);
+    m_pos += size;
+    return size;
+}
+
+
+
+size_t
+Filesystem::IOVecOutput::write (const void *buf, size_t size)
+{
+    if (size == 0)
+        return 0;
+    // resize() grows geometrically, so appending stays cheap
+    if (m_pos + size > m_buf.size())
+        m_buf.resize (m_pos + size);
+    memcpy (&m_buf[m_pos], buf, size);
+    m_pos += size;
+    return size;
+}
+
+
+
+size_t
+Filesystem::IOMemReader::read (void *buf, size_t size)
+{
+    if (m_pos >= (int64_t) m_size)
+        return 0;
+    size = std::min (size, (size_t) (m_size - m_pos));
+    memcpy (buf, m_buf + m_pos, size);
+    m_pos += size;
+    return size;
+}
+
+
+
+Filesystem::IOMappedFile::IOMappedFile (const std::string &filename)
+    : IOProxy (filename, Read), m_data(NULL), m_size(0)
+{
+#ifdef _WIN32
+    m_mapping = NULL;
+    HANDLE file = CreateFileA (filename.c_str(), GENERIC_READ,
+                               FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        m_mode = Closed;
+        return;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx (file, &size) && size.QuadPart > 0) {
+        m_size = (size_t) size.QuadPart;
+        m_mapping = CreateFileMapping (file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping)
+            m_data = (const unsigned char *) MapViewOfFile (m_mapping,
+                                                  FILE_MAP_READ, 0, 0, 0);
+    }
+    CloseHandle (file);   // the mapping keeps the file open
+#else
+    int fd = ::open (filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_mode = Closed;
+        return;
+    }
+    struct stat st;
+    if (fstat (fd, &st) == 0 && st.st_size > 0) {
+        m_size = (size_t) st.st_size;
+        void *p = mmap (NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+            m_data = (const unsigned char *) p;
+    }
+    ::close (fd);   // the mapping keeps the file open
+#endif
+    // An empty file is fine (there's just nothing to read), but a
+    // nonempty one we couldn't map is not.
+    if (m_size && ! m_data) {
+        m_size = 0;
+        close ();
+    }
+}
+
+
+
+Filesystem::IOMappedFile::~IOMappedFile ()
+{
+    close ();
+}
+
+
+
+void
+Filesystem::IOMappedFile::close ()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile ((LPCVOID) m_data);
+    if (m_mapping)
+        CloseHandle (m_mapping);
+    m_mapping = NULL;
+#else
+    if (m_data)
+        munmap ((void *) m_data, m_size);
+#endif
+    m_data = NULL;
+    m_size = 0;
+    m_mode = Closed;
+}
+
+
+
+size_t
+Filesystem::IOMappedFile::read (void *buf, size_t size)
+{
+    if (m_pos >= (int64_t) m_size)
+        return 0;
+    size = std::min (size, (size_t) (m_size - m_pos));
+    memcpy (buf, m_data + m_pos, size);
+    m_pos += size;
+    return size;
+}
+
+
+
+// All reads that BufferedReader makes from its proxy start on a
+// multiple of this, as do the sizes of its buffer refills.
+static const size_t buffered_read_alignment = 4096;
+
+
+
+Filesystem::BufferedReader::BufferedReader (size_t blocksize)
+    : m_io(NULL), m_own_io(false), m_mem(NULL), m_size(0),
+      m_bufstart(0), m_buflen(0)
+{
+    const size_t align = buffered_read_alignment;
+    m_blocksize = std::max (align, (blocksize + align - 1) / align * align);
+}
+
+
+
+Filesystem::BufferedReader::~BufferedReader ()
+{
+    close ();
+}
+
+
+
+bool
+Filesystem::BufferedReader::open (const std::string &filename, bool use_mmap)
+{
+    close ();
+    IOProxy *io = NULL;
+    if (use_mmap) {
+        io = new IOMappedFile (filename);
+        if (! io->opened ()) {
+            // Fall back to reading it the usual way
+            delete io;
+            io = NULL;
+        }
+    }
+    if (! io) {
+        // We do our own buffering, so don't let stdio copy it all again
+        io = new IOFile (filename, Read, true);
+    }
+    if (! io->opened ()) {
+        delete io;
+        return false;
+    }
+    open (io);
+    m_own_io = true;
+    return true;
+}
+
+
+
+bool
+Filesystem::BufferedReader::open (IOProxy *io)
+{
+    close ();
+    if (! io || ! io->opened ())
+        return false;
+    m_io = io;
+    m_filename = io->filename ();
+    m_mem = (const unsigned char *) io->memory ();
+    m_size = io->size ();
+    if (m_size <= 0 && ! m_mem) {
+        // The proxy can't tell us how big it is (as with the default
+        // IOProxy::size()), so read all it has and work from memory.
+        size_t got = 0;
+        io->seek (0);
+        for (;;) {
+            m_buf.resize (got + m_blocksize);
+            size_t r = io->read (&m_buf[got], m_blocksize);
+            got += r;
+            if (r < m_blocksize)
+                break;
+        }
+        m_size = (int64_t) got;
+        m_mem = got ? &m_buf[0] : NULL;
+    }
+    m_pos = 0;
+    m_mode = Read;
+    return true;
+}
+
+
+
+void
+Filesystem::BufferedReader::close ()
+{
+    if (m_own_io)
+        delete m_io;
+    m_io = NULL;
+    m_own_io = false;
+    if (m_mem && ! m_buf.empty() && m_mem == &m_buf[0]) {
+        // Don't hang on to a whole file we read into memory
+        std::vector<unsigned char> empty;
+        m_buf.swap (empty);
+    }
+    m_mem = NULL;
+    m_size = 0;
+    m_bufstart = 0;
+    m_buflen = 0;      // but keep m_buf's memory for the next file
+    m_pos = 0;
+    m_mode = Closed;
+}
+
+
+
+bool
+Filesystem::BufferedReader::fill (size_t n)
+{
+    if (! m_io || m_pos < 0)
+        return false;
+    const int64_t align = (int64_t) buffered_read_alignment;
+    int64_t end = m_bufstart + (int64_t) m_buflen;
+    size_t keep = 0;
+    size_t toread;
+    if (m_buflen && m_pos >= m_bufstart && m_pos <= end) {
+        // Reading on from the buffered bytes: keep the ones we haven't
+        // used, and carry on reading where the last read stopped (which
+        // is still aligned, unless it hit the end of the file).
+        keep = (size_t) (end - m_pos);
+        if (keep)
+            memmove (&m_buf[0], &m_buf[m_pos - m_bufstart], keep);
+        m_bufstart = m_pos;
+        toread = std::max (m_blocksize, n - std::min (n, keep));
+        toread = (toread + m_blocksize - 1) / m_blocksize * m_blocksize;
+    } else if (m_buflen && m_pos < m_bufstart
+               && m_bufstart - m_pos <= (int64_t) m_blocksize) {
+        // Stepping back just before the buffered bytes, as readers of
+        // bottom-up images do: read the block that ends where this
+        // read does, so the steps after it are already buffered.
+        int64_t start = m_pos + (int64_t) n - (int64_t) m_blocksize;
+        start = std::max ((int64_t) 0, (start + align - 1) / align * align);
+        m_bufstart = std::min (start, m_pos - m_pos % align);
+        end = m_bufstart;
+        toread = (size_t) (m_pos - m_bufstart) + n;
+        toread = (toread + m_blocksize - 1) / m_blocksize * m_blocksize;
+    } else {
+        // Somewhere new, which may be just one of several places the
+        // caller is jumping between: read only the aligned pages that
+        // hold what's needed, and leave bigger reads until it turns
+        // out to be reading on from here.
+        m_bufstart = m_pos - m_pos % align;
+        end = m_bufstart;
+        toread = (size_t) (m_pos - m_bufstart) + n;
+        toread = (size_t) ((toread + align - 1) / align * align);
+    }
+    size_t need = (size_t) (m_pos - m_bufstart) + n;
+    if (m_buf.size() < keep + toread)
+        m_buf.resize (keep + toread);
+    m_buflen = keep;
+    if (end < (int64_t) m_size && m_io->seek (end))
+        m_buflen += m_io->read (&m_buf[keep], toread);
+    return need <= m_buflen;
+}
+
+
+
+size_t
+Filesystem::BufferedReader::read_uncached (void *buf, size_t size)
+{
+    if (m_pos >= (int64_t) m_size || m_pos < 0)
+        return 0;
+    size = std::min (size, (size_t) (m_size - m_pos));
+    if (m_mem) {
+        memcpy (buf, m_mem + m_pos, size);
+        m_pos += size;
+        return size;
+    }
+    if (size < m_blocksize) {
+        fill (size);
+        int64_t offset = m_pos - m_bufstart;
+        if (offset < 0 || (size_t) offset >= m_buflen)
+            return 0;   // the read failed
+        size = std::min (size, m_buflen - (size_t) offset);
+        memcpy (buf, &m_buf[offset], size);
+        m_pos += size;
+        return size;
+    }
+
+    // A big read goes straight from the proxy into the caller's memory,
+    // after whatever part of it we've already got buffered.
+    size_t got = 0;
+    int64_t offset = m_pos - m_bufstart;
+    if (offset >= 0 && (size_t) offset < m_buflen) {
+        got = m_buflen - (size_t) offset;
+        memcpy (buf, &m_buf[offset], got);
+        m_pos += got;
+    }
+    if (m_io->seek (m_pos)) {
+        size_t r = m_io->read ((char *) buf + got, size - got);
+        m_pos += r;
+        got += r;
+    }
+    return got;
+}
+
+
+
+bool
+Filesystem::BufferedReader::getline (std::string &line)
+{
+    line.clear ();
+    if (m_pos >= (int64_t) m_size)
+        return false;
+    while (m_pos < (int64_t) m_size) {
+        // Scan what's buffered (or in memory) for the newline
+        const unsigned char *p;
+        size_t avail;
+        if (m_mem) {
+            p = m_mem + m_pos;
+            avail = (size_t) (m_size - m_pos);
+        } else {
+            int64_t offset = m_pos - m_bufstart;
+            if (offset < 0 || (size_t) offset >= m_buflen) {
+                if (! fill (1))
+                    break;
+                offset = m_pos - m_bufstart;
+            }
+            p = &m_buf[offset];
+            avail = m_buflen - (size_t) offset;
+        }
+        const unsigned char *nl = (const unsigned char *) memchr (p, '\n', avail);
+        if (nl) {
+            line.append ((const char *) p, nl - p);
+            m_pos += (nl - p) + 1;
+            return true;
+        }
+        line.append ((const char *) p, avail);
+        m_pos += avail;
+    }
+    return true;
+}
@@ -0,0 +1,348 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// Implementation of thread_pool, task_set, and parallel_for.
+
+
+#include <algorithm>
+#include <deque>
+
+#include <boost/bind.hpp>
+
+#include "thread.h"
+
+
+#if (BOOST_VERSION >= 103500) && !defined(NOTHREADS)
+#  define USE_THREAD_POOL 1
+#else
+#  define USE_THREAD_POOL 0
+#endif
+
+
+#ifdef OPENIMAGEIO_NAMESPACE
+namespace OPENIMAGEIO_NAMESPACE {
+#endif
+
+
+
+#if USE_THREAD_POOL
+
+class thread_pool::Impl {
+public:
+    Impl () : m_nthreads(0), m_quit(false) { }
+
+    ~Impl () {
+        {
+            boost::unique_lock<boost::mutex> lock (m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all ();
+        m_threads.join_all ();
+    }
+
+    int size () {
+        boost::unique_lock<boost::mutex> lock (m_mutex);
+        return m_nthreads;
+    }
+
+    void reserve (int nthreads) {
+        boost::unique_lock<boost::mutex> lock (m_mutex);
+        for ( ;  m_nthreads < nthreads;  ++m_nthreads)
+            m_threads.add_thread (new boost::thread (boost::bind (&Impl::worker, this)));
+    }
+
+    void push (task_set *set, const task_set::task &t) {
+        {
+            boost::unique_lock<boost::mutex> lock (m_mutex);
+            if (set->m_cancelled)
+                return;
+            m_queue.push_back (Entry (set, t));
+            ++set->m_pending;
+        }
+        m_wake.notify_one ();
+        m_changed.notify_all ();   // the set's waiter may want to run it
+    }
+
+    void wait (task_set *set) {
+        boost::unique_lock<boost::mutex> lock (m_mutex);
+        while (set->m_pending) {
+            // Rather than just block, run one of the set's own tasks
+            Queue::iterator i;
+            for (i = m_queue.begin();  i != m_queue.end();  ++i)
+                if (i->first == set)
+                    break;
+            if (i != m_queue.end())
+                run (lock, i);
+            else
+                m_changed.wait (lock);
+        }
+    }
+
+    void cancel (task_set *set) {
+        boost::unique_lock<boost::mutex> lock (m_mutex);
+        set->m_cancelled = 1;
+        for (Queue::iterator i = m_queue.begin();  i != m_queue.end();  ) {
+            if (i->first == set) {
+                i = m_queue.erase (i);
+                --set->m_pending;
+            } else {
+                ++i;
+            }
+        }
+        if (set->m_pending == 0)
+            m_changed.notify_all ();
+    }
+
+private:
+    typedef std::pair<task_set *, task_set::task> Entry;
+    typedef std::deque<Entry> Queue;
+
+    // Remove the task at i from the queue and run it.  The caller holds
+    // the lock, which we release while the task runs.
+    void run (boost::unique_lock<boost::mutex> &lock, Queue::iterator i) {
+        task_set *set = i->first;
+        task_set::task t;
+        t.swap (i->second);
+        m_queue.erase (i);
+        lock.unlock ();
+        t ();
+        lock.lock ();
+        if (--set->m_pending == 0)
+            m_changed.notify_all ();
+    }
+
+    void worker () {
+        boost::unique_lock<boost::mutex> lock (m_mutex);
+        for (;;) {
+            while (m_queue.empty() && ! m_quit)
+                m_wake.wait (lock);
+            if (m_queue.empty())
+                return;    // quitting, and nothing left to do
+            run (lock, m_queue.begin());
+        }
+    }
+
+    boost::mutex m_mutex;                 // Guards everything below,
+                                          //   and task_set::m_pending
+    boost::condition_variable m_wake;     // Signals a task was queued
+    boost::condition_variable m_changed;  // Signals a set's tasks changed
+    Queue m_queue;                        // Tasks not yet started
+    boost::thread_group m_threads;
+    int m_nthreads;
+    bool m_quit;
+};
+
+#else
+
+// Without threads, tasks just run as soon as they are pushed.
+class thread_pool::Impl {
+public:
+    int size () { return 0; }
+    void reserve (int nthreads) { }
+    void push (task_set *set, const task_set::task &t) {
+        if (! set->m_cancelled)
+            t ();
+    }
+    void wait (task_set *set) { }
+    void cancel (task_set *set) { set->m_cancelled = 1; }
+};
+
+#endif
+
+
+
+thread_pool::thread_pool (int nthreads)
+    : m_impl (new Impl)
+{
+    reserve (nthreads);
+}
+
+
+
+thread_pool::~thread_pool ()
+{
+    delete m_impl;
+}
+
+
+
+thread_pool *
+thread_pool::default_pool ()
+{
+    // Never destroyed: its idle threads just go away with the process,
+    // rather than having to be joined during static destruction.
+    static thread_pool *pool = NULL;
+    static spin_mutex pool_mutex;
+    spin_lock lock (pool_mutex);
+    if (! pool)
+        pool = new thread_pool;
+    return pool;
+}
+
+
+
+int
+thread_pool::size () const
+{
+    return m_impl->size ();
+}
+
+
+
+void
+thread_pool::reserve (int nthreads)
+{
+    m_impl->reserve (nthreads);
+}
+
+
+
+int
+thread_pool::hardware_threads ()
+{
+#if (BOOST_VERSION >= 103500)
+    return std::max (1, (int) boost::thread::hardware_concurrency());
+#else
+    return 1;   // hardware_concurrency not supported in Boost < 1.35
+#endif
+}
+
+
+
+task_set::task_set (thread_pool *pool)
+    : m_pool (pool ? pool : thread_pool::default_pool()),
+      m_pending(0)
+{
+    m_cancelled = 0;
+}
+
+
+
+task_set::~task_set ()
+{
+    wait ();
+}
+
+
+
+void
+task_set::push (const task &t)
+{
+    m_pool->m_impl->push (this, t);
+}
+
+
+
+void
+task_set::wait ()
+{
+    m_pool->m_impl->wait (this);
+}
+
+
+
+void
+task_set::cancel ()
+{
+    m_pool->m_impl->cancel (this);
+}
+
+
+
+namespace {
+
+// The state shared by all the threads running one parallel_for: each
+// repeatedly claims the next chunk until there are none left.
+struct parallel_for_loop {
+    const boost::function<void(int,int)> *func;
+    int begin, end, chunksize;
+    volatile int next;     // Start of the next unclaimed chunk
+    task_set *tasks;
+
+    void run () {
+        while (! tasks->cancelled()) {
+            int b = atomic_exchange_and_add (&next, chunksize);
+            if (b >= end)
+                break;
+            (*func) (b, std::min (b+chunksize, end));
+        }
+    }
+};
+
+};  // end anonymous namespace
+
+
+
+void
+parallel_for (int begin, int end, const boost::function<void(int,int)> &func,
+              int nthreads, int chunksize)
+{
+    if (end <= begin)
+        return;
+    if (nthreads < 1)
+        nthreads = thread_pool::hardware_threads ();
+    int n = end - begin;
+    if (chunksize < 1)
+        chunksize = std::max (1, (n + nthreads*4 - 1) / (nthreads*4));
+    int nchunks = (n + chunksize - 1) / chunksize;
+    nthreads = std::min (nthreads, nchunks);
+    if (nthreads < 2 || ! USE_THREAD_POOL) {
+        // Not worth involving other threads
+        for (int b = begin;  b < end;  b += chunksize)
+            func (b, std::min (b+chunksize, end));
+        return;
+    }
+
+    thread_pool *pool = thread_pool::default_pool ();
+    pool->reserve (nthreads-1);
+    task_set tasks (pool);
+    parallel_for_loop loop;
+    loop.func = &func;
+    loop.begin = begin;
+    loop.end = end;
+    loop.chunksize = chunksize;
+    loop.next = begin;
+    loop.tasks = &tasks;
+    for (int i = 1;  i < nthreads;  ++i)
+        tasks.push (boost::bind (&parallel_for_loop::run, &loop));
+    loop.run ();
+    // Every chunk has been claimed, so helpers that haven't started yet
+    // have nothing to do -- discard them, and wait for the ones that
+    // are still finishing their chunks.
+    tasks.cancel ();
+    tasks.wait ();
+}
+
+
+
+#ifdef OPENIMAGEIO_NAMESPACE
+}; // end namespace OPENIMAGEIO_NAMESPACE
+#endif
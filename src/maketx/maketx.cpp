@@ -42,12 +42,14 @@
 #include "SHA1.h"
 
 #include <boost/version.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <OpenEXR/ImathMatrix.h>
 
 #include "argparse.h"
 #include "dassert.h"
 #include "filesystem.h"
+#include "filter.h"
 #include "fmath.h"
 #include "strutil.h"
 #include "sysutil.h"
@@ -102,6 +104,7 @@ static Imath::M44f Mcam(0.0f), Mscr(0.0f);  // Initialize to 0
 static bool separate = false;
 static bool nomipmap = false;
 static bool embed_hash;
+static std::string filtername;
 
 
 // forward decl
@@ -150,6 +153,7 @@ getargs (int argc, char *argv[])
                   "--resize", &doresize, "Resize textures to power of 2 (default: no)",
                   "--noresize", &noresize, "Do not resize textures to power of 2 (deprecated)",
                   "--nomipmap", &nomipmap, "Do not make multiple MIP-map levels",
+                  "--filter %s", &filtername, "Filter for resizing and MIP-mapping (default: triangle to resize, box to MIP-map)",
                   "--checknan", &checknan, "Check for NaN and Inf values (abort if found)",
                   "--Mcamera %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
                           &Mcam[0][0], &Mcam[0][1], &Mcam[0][2], &Mcam[0][3], 
@@ -203,6 +207,14 @@ getargs (int argc, char *argv[])
         mipmapmode = true;
     if (doresize)
         noresize = false;
+    if (! filtername.empty()) {
+        Filter1D *f = Filter1D::create (filtername, 1.0f);
+        if (! f) {
+            std::cerr << "maketx ERROR: Unknown filter \"" << filtername << "\"\n";
+            exit (EXIT_FAILURE);
+        }
+        delete f;
+    }
 
     if (filenames.size() < 1) {
         std::cerr << "maketx ERROR: Must have at least one input filename specified.\n";
@@ -229,48 +241,15 @@ datestring (time_t t)
 // Run func over all pixels of dst, but split into separate threads for
 // bands of the image.  Assumes that the calling profile of func is:
 //     func (dst, src, xbegin, xend, ybegin, yend);
-// Also assumes that every pixel processed is approximately the same
-// cost, so it just divides the image space into equal-sized bands without
-// worrying about any sophisticated load balancing.
+// The threads come from the shared thread pool, so the many small MIP
+// levels don't each pay to create and join a new set of threads.
 template <class Func>
 void
 parallel_image (Func func, ImageBuf *dst, const ImageBuf *src, 
                 int xbegin, int xend, int ybegin, int yend, int nthreads)
 {
-    const ImageSpec &dstspec (dst->spec());
-
-    // Don't parallelize with too few pixels
-    if (dstspec.image_pixels() < 1000)
-        nthreads = 1;
-    // nthreads < 1 means try to make enough threads to fill all cores
-    if (nthreads < 1) {
-#if (BOOST_VERSION >= 103500)
-        nthreads = boost::thread::hardware_concurrency();
-#else
-        nthreads = 1;   // hardware_concurrency not supported in Boost < 1.35
-#endif
-    }
-
-#if (BOOST_VERSION >= 103500)
-    if (nthreads > 1) {
-        boost::thread_group threads;
-        int blocksize = std::max (1, ((xend-xbegin) + nthreads-1) / nthreads);
-        for (int i = 0;  i < nthreads;  ++i) {
-            int x0 = xbegin + i*blocksize;
-            int x1 = std::min (xbegin + (i+1)*blocksize, xend);
-//            std::cerr << "  launching " << x0 << ' ' << x1 << ' '
-//                      << ybegin << ' ' << yend << "\n";
-            threads.add_thread (new boost::thread (func, dst, src,
-                                                   x0, x1,
-                                                   ybegin, yend));
-        }
-        threads.join_all ();
-    } else {
-#endif // BOOST_VERSION
-        func (dst, src, xbegin, xend, ybegin, yend);
-#if (BOOST_VERSION >= 103500)
-    }
-#endif
+    ImageBufAlgo::parallel_image (boost::bind (func, dst, src, _1, _2, _3, _4),
+                                  xbegin, xend, ybegin, yend, nthreads);
 }
 
 
@@ -293,7 +272,9 @@ copy_block (ImageBuf *dst, const ImageBuf *src,
 
 
 // Resize src into dst, relying on the linear interpolation of
-// interppixel_NDC_full, for the pixel range [x0,x1) x [y0,y1).
+// interppixel_NDC_full, for the pixel range [x0,x1) x [y0,y1).  This
+// maps the full (display) windows onto each other, which is needed
+// when the source data window is a crop of its full window.
 static void
 resize_block (ImageBuf *dst, const ImageBuf *src,
               int x0, int x1, int y0, int y1)
@@ -473,11 +454,9 @@ make_texturemap (const char *maptypename = "texture map")
     dstspec.tile_height = tile[1];
     dstspec.tile_depth  = tile[2];
 
-    // Always use ZIP compression
+    // Always use ZIP compression.  The TIFF writer encodes zip (and
+    // LZW) tiles itself, in parallel, when handed a row of them at once.
     dstspec.attribute ("compression", "zip");
-    // Ugh, the line above seems to trigger a bug in the tiff library.
-    // Maybe a bug in libtiff zip compression for tiles?  So let's
-    // stick to the default compression.
 
     // Put a DateTime in the out file, either now, or matching the date
     // stamp of the input file (if update mode).
@@ -571,9 +550,13 @@ make_texturemap (const char *maptypename = "texture map")
         if (verbose)
             std::cout << "  Resizing image to " << dstspec.width 
                       << " x " << dstspec.height << std::endl;
-        parallel_image (resize_block, &dst, &src,
-                        dstspec.x, dstspec.x+dstspec.width,
-                        dstspec.y, dstspec.y+dstspec.height, nthreads);
+        if (orig_was_crop)
+            parallel_image (resize_block, &dst, &src,
+                            dstspec.x, dstspec.x+dstspec.width,
+                            dstspec.y, dstspec.y+dstspec.height, nthreads);
+        else
+            ImageBufAlgo::resize (dst, src, filtername.empty() ? "triangle"
+                                  : filtername, 0.0f, nthreads);
     }
     stat_resizetime += resizetimer();
 
@@ -655,10 +638,8 @@ write_mipmap (ImageBuf &img, const ImageSpec &outspec_template,
             smallspec.set_format (TypeDesc::FLOAT);
             small->alloc (smallspec);  // Realocate with new size
 
-            parallel_image (resize_block, small, big,
-                            smallspec.x, smallspec.x+smallspec.width,
-                            smallspec.y, smallspec.y+smallspec.height,
-                            nthreads);
+            ImageBufAlgo::resize (*small, *big, filtername.empty() ? "box"
+                                  : filtername, 0.0f, nthreads);
 
             stat_miptime += miptimer();
             outspec = smallspec;
@@ -50,30 +50,97 @@ using boost::algorithm::iends_with;
 #include <OpenEXR/ImfEnvmapAttribute.h>
 #include <OpenEXR/ImfCompressionAttribute.h>
 #include <OpenEXR/ImfCRgbaFile.h>   // JUST to get symbols to figure out version!
+#include <OpenEXR/ImfThreading.h>
+#include <OpenEXR/ImfIO.h>
+#include <OpenEXR/ImfVersion.h>
+#include <OpenEXR/Iex.h>
+// OPENEXR_VERSION (e.g. 10601 for 1.6.1) is defined by the build.
+// Slices whose coordinates are relative to the tile being read (which
+// lets a tile be read straight into a tile-sized buffer) need 1.6.1.
+#if defined(OPENEXR_VERSION) && OPENEXR_VERSION >= 10601
+#define OPENEXR_HAS_TILE_COORDS 1
+#endif
 
 #include "dassert.h"
 #include "imageio.h"
 #include "thread.h"
 #include "strutil.h"
+#include "filesystem.h"
+
+#include "exr_pvt.h"
 
 using namespace OpenImageIO;
+using namespace OpenEXR_imageio_pvt;
+
+
+
+// An Imf::IStream that reads through a Filesystem::IOProxy.  If the
+// proxy's contents are all in memory, OpenEXR is handed pointers into
+// them rather than copies.
+class OpenEXRInputStream : public Imf::IStream {
+public:
+    OpenEXRInputStream (const char *filename, Filesystem::IOProxy *io)
+        : Imf::IStream(filename), m_io(io) { }
+    virtual bool isMemoryMapped () const {
+        return m_io->memory() != NULL;
+    }
+    virtual bool read (char c[], int n) {
+        if (m_io->read (c, n) != (size_t)n)
+            throw Iex::InputExc ("Unexpected end of file.");
+        return m_io->tell() < (Imf::Int64) m_io->size();
+    }
+    virtual char * readMemoryMapped (int n) {
+        Imf::Int64 pos = m_io->tell();
+        if (pos + n > (Imf::Int64) m_io->size())
+            throw Iex::InputExc ("Unexpected end of file.");
+        m_io->seek (pos + n);
+        return (char *)m_io->memory() + pos;
+    }
+    virtual Imf::Int64 tellg () { return m_io->tell(); }
+    virtual void seekg (Imf::Int64 pos) {
+        if (! m_io->seek (pos))
+            throw Iex::IoExc ("File input failed.");
+    }
+    virtual void clear () { }
+
+private:
+    Filesystem::IOProxy *m_io;
+};
 
 
 
 class OpenEXRInput : public ImageInput {
 public:
-    OpenEXRInput () { init(); }
+    OpenEXRInput () : m_io(NULL) { init(); }
     virtual ~OpenEXRInput () { close(); }
     virtual const char * format_name (void) const { return "openexr"; }
-    virtual bool open (const std::string &name, ImageSpec &newspec);
+    virtual bool open (const std::string &name, ImageSpec &newspec) {
+        return open (name, newspec, ImageSpec());
+    }
+    virtual bool open (const std::string &name, ImageSpec &newspec,
+                       const ImageSpec &config);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool seek_subimage (int index, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
     virtual bool read_native_tile (int x, int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    virtual bool read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                    int zbegin, int zend, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        int chbegin, int chend, void *data);
+    virtual bool read_native_tile (int x, int y, int z,
+                                   int chbegin, int chend, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io = ioproxy;
+        return true;
+    }
 
 private:
     const Imf::Header *m_header;          ///< Ptr to image header
+    Filesystem::IOProxy *m_io;            ///< Proxy from set_ioproxy()
+    OpenEXRInputStream *m_istream;        ///< Stream reading from m_io
     Imf::InputFile *m_input_scanline;     ///< Input for scanline files
     Imf::TiledInputFile *m_input_tiled;   ///< Input for tiled files
     Imf::PixelType m_pixeltype;           ///< Imf pixel type
@@ -87,14 +154,36 @@ private:
     std::vector<std::string> m_channelnames;  ///< Order of channels in file
     std::vector<int> m_userchannels;      ///< Map file chans to user chans
     std::vector<unsigned char> m_scratch; ///< Scratch space for us to use
+    Imf::FrameBuffer m_framebuffer;       ///< Cached frame buffer for reads
+    std::vector<Imf::Slice *> m_slices;   ///< Its slice for each channel
+    char *m_framebuffer_base;             ///< Base it was last given to file
+    size_t m_framebuffer_ystride;         ///< Scanline stride of its slices
+    bool m_framebuffer_tilecoords;        ///< Are its slices tile-relative?
+    int m_framebuffer_chbegin;            ///< First channel it reads
+    int m_framebuffer_chend;              ///< One past its last channel
 
     void init () {
         m_header = NULL;
         m_input_scanline = NULL;
         m_input_tiled = NULL;
+        m_istream = NULL;
         m_subimage = -1;
+        m_slices.clear ();
+        m_framebuffer_base = NULL;
     }
 
+    // Make the file read channels [chbegin,chend) into the pixels at
+    // base (the address OpenEXR thinks of as pixel (0,0), or the tile's
+    // upper left corner if tilecoords is true), with the given scanline
+    // stride.  The frame buffer is built only once for the current
+    // subimage, stride and channel range; after that only its slices'
+    // pointers are rebased, and the file is handed the frame buffer
+    // again only if it has actually changed.  Channels outside the range
+    // have no slice at all, so OpenEXR never decodes them.
+    // May throw OpenEXR exceptions.
+    void set_framebuffer (char *base, size_t ystride, bool tilecoords,
+                          int chbegin, int chend);
+
     // Helper for open(): set up m_spec.nchannels, m_spec.channelnames,
     // m_spec.alpha_channel, m_spec.z_channel, m_channelnames,
     // m_userchannels.
@@ -118,6 +207,13 @@ DLLEXPORT const char * openexr_input_extensions[] = {
     "exr", NULL
 };
 
+DLLEXPORT bool
+openexr_input_signature (const unsigned char *header, int nbytes)
+{
+    return (nbytes >= 4 && header[0] == 0x76 && header[1] == 0x2F
+            && header[2] == 0x31 && header[3] == 0x01);
+}
+
 };
 
 
@@ -175,23 +271,75 @@ static StringMap exr_tag_to_ooio_std;
 
 
 
+namespace OpenEXR_imageio_pvt {
+
+static mutex exr_threads_mutex;      // Serializes resizing the pool
+static atomic_int exr_pool_threads;  // Threads in OpenEXR's global pool
+
+
+int
+exr_file_threads (const ImageSpec &spec)
+{
+    int nthreads = 0;
+    OpenImageIO::getattribute ("exr_threads", nthreads);
+    if (nthreads < 0)
+        nthreads = thread_pool::hardware_threads ();
+    if (nthreads != exr_pool_threads) {
+        // Resizing the pool is expensive, so only do it when the
+        // requested number of threads actually changes.
+        lock_guard lock (exr_threads_mutex);
+        if (nthreads != exr_pool_threads) {
+            Imf::setGlobalThreadCount (nthreads);
+            exr_pool_threads = nthreads;
+        }
+    }
+    int filethreads = spec.get_int_attribute ("openexr:threads", nthreads);
+    return std::max (0, std::min (filethreads, nthreads));
+}
+
+};
+
+
+
 bool
-OpenEXRInput::open (const std::string &name, ImageSpec &newspec)
+OpenEXRInput::open (const std::string &name, ImageSpec &newspec,
+                    const ImageSpec &config)
 {
     // Quick check to reject non-exr files
     bool tiled;
-    if (! Imf::isOpenExrFile (name.c_str(), tiled))
+    if (m_io) {
+        char header[8];
+        m_io->seek (0);
+        if (m_io->read (header, 8) != 8 || ! Imf::isImfMagic (header))
+            return false;
+        int version = (unsigned char)header[4]
+                    | ((unsigned char)header[5] << 8)
+                    | ((unsigned char)header[6] << 16)
+                    | ((unsigned char)header[7] << 24);
+        tiled = Imf::isTiled (version);
+        m_io->seek (0);
+    } else if (! Imf::isOpenExrFile (name.c_str(), tiled))
         return false;
 
     m_spec = ImageSpec(); // Clear everything with default constructor
     try {
-        if (tiled) {
-            m_input_tiled = new Imf::TiledInputFile (name.c_str());
-            m_header = &(m_input_tiled->header());
+        // Let OpenEXR decompress with as many threads as we allow
+        int nthreads = exr_file_threads (config);
+        if (m_io) {
+            m_istream = new OpenEXRInputStream (name.c_str(), m_io);
+            if (tiled)
+                m_input_tiled = new Imf::TiledInputFile (*m_istream, nthreads);
+            else
+                m_input_scanline = new Imf::InputFile (*m_istream, nthreads);
+        } else if (tiled) {
+            m_input_tiled = new Imf::TiledInputFile (name.c_str(), nthreads);
         } else {
-            m_input_scanline = new Imf::InputFile (name.c_str());
-            m_header = &(m_input_scanline->header());
+            m_input_scanline = new Imf::InputFile (name.c_str(), nthreads);
         }
+        if (tiled)
+            m_header = &(m_input_tiled->header());
+        else
+            m_header = &(m_input_scanline->header());
     }
     catch (const std::exception &e) {
         error ("OpenEXR exception: %s", e.what());
@@ -433,6 +581,7 @@ OpenEXRInput::seek_subimage (int index, ImageSpec &newspec)
         return false;
 
     m_subimage = index;
+    m_slices.clear ();   // Rebuild the frame buffer for the new subimage
 
     if (index == 0 && m_levelmode == Imf::ONE_LEVEL) {
         newspec = m_spec;
@@ -476,6 +625,7 @@ OpenEXRInput::close ()
 {
     delete m_input_scanline;
     delete m_input_tiled;
+    delete m_istream;
     m_subimage = -1;
     init ();  // Reset to initial state
     return true;
@@ -483,31 +633,135 @@ OpenEXRInput::close ()
 
 
 
+void
+OpenEXRInput::set_framebuffer (char *base, size_t ystride, bool tilecoords,
+                               int chbegin, int chend)
+{
+    size_t channelbytes = m_spec.channel_bytes();
+    size_t pixelbytes = channelbytes * (chend - chbegin);
+    if (m_slices.empty() || ystride != m_framebuffer_ystride ||
+            tilecoords != m_framebuffer_tilecoords ||
+            chbegin != m_framebuffer_chbegin || chend != m_framebuffer_chend) {
+        // (Re)build the frame buffer: one slice per channel read
+        m_framebuffer = Imf::FrameBuffer();
+        for (int c = chbegin;  c < chend;  ++c) {
+            m_framebuffer.insert (m_spec.channelnames[c].c_str(),
+                                  Imf::Slice (m_pixeltype,
+                                              base + (c-chbegin) * channelbytes,
+                                              pixelbytes, ystride
+#ifdef OPENEXR_HAS_TILE_COORDS
+                                              , 1, 1, 0.0,
+                                              tilecoords, tilecoords
+#endif
+                                              ));
+        }
+        m_slices.resize (chend - chbegin);
+        for (int c = chbegin;  c < chend;  ++c)
+            m_slices[c-chbegin] = m_framebuffer.findSlice (m_spec.channelnames[c].c_str());
+        m_framebuffer_ystride = ystride;
+        m_framebuffer_tilecoords = tilecoords;
+        m_framebuffer_chbegin = chbegin;
+        m_framebuffer_chend = chend;
+    } else if (base == m_framebuffer_base) {
+        return;   // The file already has exactly this frame buffer
+    } else {
+        for (int c = chbegin;  c < chend;  ++c)
+            m_slices[c-chbegin]->base = base + (c-chbegin) * channelbytes;
+    }
+    m_framebuffer_base = NULL;   // in case setFrameBuffer throws
+    if (m_input_tiled)
+        m_input_tiled->setFrameBuffer (m_framebuffer);
+    else
+        m_input_scanline->setFrameBuffer (m_framebuffer);
+    m_framebuffer_base = base;
+}
+
+
+
 bool
 OpenEXRInput::read_native_scanline (int y, int z, void *data)
+{
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+OpenEXRInput::read_native_tile (int x, int y, int z, void *data)
+{
+    return read_native_tile (x, y, z, 0, m_spec.nchannels, data);
+}
+
+
+
+bool
+OpenEXRInput::read_native_tile (int x, int y, int z,
+                                int chbegin, int chend, void *data)
+{
+    ASSERT (m_input_tiled != NULL);
+    if (chend <= chbegin)
+        return true;
+
+    // Tile-relative slices let us point OpenEXR straight at 'data', so
+    // reading tile after tile into the same buffer (as read_tile and the
+    // ImageCache do) needs no frame buffer changes at all.  Without
+    // them, the slices are rebased so that this tile lands at 'data'.
+    size_t pixelbytes = m_spec.channel_bytes() * (chend-chbegin);
+    size_t ystride = pixelbytes * m_spec.tile_width;
+    try {
+#ifdef OPENEXR_HAS_TILE_COORDS
+        set_framebuffer ((char *)data, ystride, true, chbegin, chend);
+#else
+        set_framebuffer ((char *)data - x * (stride_t)pixelbytes
+                                      - y * (stride_t)ystride,
+                         ystride, false, chbegin, chend);
+#endif
+        m_input_tiled->readTile ((x - m_spec.x) / m_spec.tile_width,
+                                 (y - m_spec.y) / m_spec.tile_height,
+                                 m_subimage, m_subimage);
+    }
+    catch (const std::exception &e) {
+        error ("Failed OpenEXR read: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+
+
+bool
+OpenEXRInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    return read_native_scanlines (ybegin, yend, z, 0, m_spec.nchannels, data);
+}
+
+
+
+bool
+OpenEXRInput::read_native_scanlines (int ybegin, int yend, int z,
+                                     int chbegin, int chend, void *data)
 {
     ASSERT (m_input_scanline != NULL);
+    if (yend <= ybegin || chend <= chbegin)
+        return true;
 
     // Compute where OpenEXR needs to think the full buffers starts.
     // OpenImageIO requires that 'data' points to where the client wants
     // to put the pixels being read, but OpenEXR's frameBuffer.insert()
     // wants where the address of the "virtual framebuffer" for the
-    // whole image.
+    // whole image.  We let OpenEXR decode the whole range of scanlines
+    // in one call, so it can decompress each of its multi-line blocks
+    // just once.
+    size_t pixelbytes = m_spec.channel_bytes() * (chend-chbegin);
+    size_t scanlinebytes = pixelbytes * m_spec.width;
     char *buf = (char *)data
-              - m_spec.x * m_spec.pixel_bytes() 
-              - y * m_spec.scanline_bytes();
+              - m_spec.x * pixelbytes
+              - ybegin * scanlinebytes;
 
     try {
-        Imf::FrameBuffer frameBuffer;
-        for (int c = 0;  c < m_spec.nchannels;  ++c) {
-            frameBuffer.insert (m_spec.channelnames[c].c_str(),
-                                Imf::Slice (m_pixeltype,
-                                            buf + c * m_spec.channel_bytes(),
-                                            m_spec.pixel_bytes(),
-                                            m_spec.scanline_bytes()));
-        }
-        m_input_scanline->setFrameBuffer (frameBuffer);
-        m_input_scanline->readPixels (y, y);
+        set_framebuffer (buf, scanlinebytes, false, chbegin, chend);
+        m_input_scanline->readPixels (ybegin, yend-1);
     }
     catch (const std::exception &e) {
         error ("Failed OpenEXR read: %s", e.what());
@@ -519,37 +773,33 @@ OpenEXRInput::read_native_scanline (int y, int z, void *data)
 
 
 bool
-OpenEXRInput::read_native_tile (int x, int y, int z, void *data)
+OpenEXRInput::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                 int zbegin, int zend, void *data)
 {
     ASSERT (m_input_tiled != NULL);
+    if (xend <= xbegin || yend <= ybegin)
+        return true;
 
-    // Compute where OpenEXR needs to think the full buffers starts.
-    // OpenImageIO requires that 'data' points to where the client wants
-    // to put the pixels being read, but OpenEXR's frameBuffer.insert()
-    // wants where the address of the "virtual framebuffer" for the
-    // whole image.
+    // The block we're filling is (xend-xbegin) pixels wide, and OpenEXR
+    // wants the address of pixel (0,0) of the "virtual framebuffer".
+    size_t pixelbytes = m_spec.pixel_bytes();
+    size_t scanlinebytes = pixelbytes * (xend-xbegin);
     char *buf = (char *)data
-              - x * m_spec.pixel_bytes() 
-              - y * m_spec.pixel_bytes() * m_spec.tile_width;
+              - xbegin * pixelbytes
+              - ybegin * scanlinebytes;
 
     try {
-        Imf::FrameBuffer frameBuffer;
-        for (int c = 0;  c < m_spec.nchannels;  ++c) {
-            frameBuffer.insert (m_spec.channelnames[c].c_str(),
-                                Imf::Slice (m_pixeltype,
-                                            buf + c * m_spec.channel_bytes(),
-                                            m_spec.pixel_bytes(),
-                                            m_spec.pixel_bytes()*m_spec.tile_width));
-        }
-        m_input_tiled->setFrameBuffer (frameBuffer);
-        m_input_tiled->readTile ((x - m_spec.x) / m_spec.tile_width,
-                                 (y - m_spec.y) / m_spec.tile_height,
-                                 m_subimage, m_subimage);
+        set_framebuffer (buf, scanlinebytes, false, 0, m_spec.nchannels);
+        // Let OpenEXR read the whole range of tiles in one call
+        m_input_tiled->readTiles ((xbegin - m_spec.x) / m_spec.tile_width,
+                                  (xend - 1 - m_spec.x) / m_spec.tile_width,
+                                  (ybegin - m_spec.y) / m_spec.tile_height,
+                                  (yend - 1 - m_spec.y) / m_spec.tile_height,
+                                  m_subimage, m_subimage);
     }
     catch (const std::exception &e) {
-        error ("Filed OpenEXR read: %s", e.what());
+        error ("Failed OpenEXR read: %s", e.what());
         return false;
     }
-
     return true;
 }
@@ -50,6 +50,9 @@ using boost::algorithm::istarts_with;
 #include <OpenEXR/ImfEnvmapAttribute.h>
 #include <OpenEXR/ImfCompressionAttribute.h>
 #include <OpenEXR/ImfCRgbaFile.h>   // JUST to get symbols to figure out version!
+#include <OpenEXR/ImfThreading.h>
+#include <OpenEXR/ImfIO.h>
+#include <OpenEXR/Iex.h>
 #ifdef IMF_B44_COMPRESSION
 #define OPENEXR_VERSION_IS_1_6_OR_LATER
 #endif
@@ -58,11 +61,35 @@ using boost::algorithm::istarts_with;
 #include "imageio.h"
 #include "strutil.h"
 #include "sysutil.h"
+#include "filesystem.h"
+
+#include "exr_pvt.h"
 
 
 using namespace OpenImageIO;
 
 
+// An Imf::OStream that writes through a Filesystem::IOProxy.
+class OpenEXROutputStream : public Imf::OStream {
+public:
+    OpenEXROutputStream (const char *filename, Filesystem::IOProxy *io)
+        : Imf::OStream(filename), m_io(io) { }
+    virtual void write (const char c[], int n) {
+        if (m_io->write (c, n) != (size_t)n)
+            throw Iex::IoExc ("File output failed.");
+    }
+    virtual Imf::Int64 tellp () { return m_io->tell(); }
+    virtual void seekp (Imf::Int64 pos) {
+        if (! m_io->seek (pos))
+            throw Iex::IoExc ("File output failed.");
+    }
+
+private:
+    Filesystem::IOProxy *m_io;
+};
+
+
+
 class OpenEXROutput : public ImageOutput {
 public:
     OpenEXROutput ();
@@ -77,9 +104,22 @@ public:
     virtual bool write_tile (int x, int y, int z,
                              TypeDesc format, const void *data,
                              stride_t xstride, stride_t ystride, stride_t zstride);
+    virtual bool write_scanlines (int ybegin, int yend, int z,
+                                  TypeDesc format, const void *data,
+                                  stride_t xstride, stride_t ystride);
+    virtual bool write_tiles (int xbegin, int xend, int ybegin, int yend,
+                              int zbegin, int zend, TypeDesc format,
+                              const void *data, stride_t xstride,
+                              stride_t ystride, stride_t zstride);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io = ioproxy;
+        return true;
+    }
 
 private:
     Imf::Header *m_header;                ///< Ptr to image header
+    Filesystem::IOProxy *m_io;            ///< Proxy from set_ioproxy()
+    OpenEXROutputStream *m_ostream;       ///< Stream writing to m_io
     Imf::OutputFile *m_output_scanline;   ///< Input for scanline files
     Imf::TiledOutputFile *m_output_tiled; ///< Input for tiled files
     int m_levelmode;                      ///< The level mode of the file
@@ -94,6 +134,7 @@ private:
         m_header = NULL;
         m_output_scanline = NULL;
         m_output_tiled = NULL;
+        m_ostream = NULL;
         m_subimage = -1;
     }
 
@@ -130,6 +171,7 @@ static std::string format_prefix ("openexr_");
 
 
 OpenEXROutput::OpenEXROutput ()
+    : m_io(NULL)
 {
     init ();
 }
@@ -143,6 +185,7 @@ OpenEXROutput::~OpenEXROutput ()
 
     delete m_output_scanline;  m_output_scanline = NULL;
     delete m_output_tiled;  m_output_tiled = NULL;
+    delete m_ostream;  m_ostream = NULL;
     delete m_header;    m_header = NULL;
 }
 
@@ -155,6 +198,8 @@ OpenEXROutput::supports (const std::string &feature) const
         return true;
     if (feature == "multiimage")
         return true;
+    if (feature == "ioproxy")
+        return true;
 
     // EXR supports random write order iff lineOrder is set to 'random Y'
     if (feature == "random_access") {
@@ -323,14 +368,30 @@ OpenEXROutput::open (const std::string &name, const ImageSpec &userspec, bool ap
                        m_spec.extra_attribs[p].data());
 
     try {
+        // Let OpenEXR compress with as many threads as we allow
+        int nthreads = OpenEXR_imageio_pvt::exr_file_threads (m_spec);
+        if (m_io) {
+            m_io->seek (0);
+            m_ostream = new OpenEXROutputStream (name.c_str(), m_io);
+        }
         if (m_spec.tile_width) {
             m_header->setTileDescription (
                 Imf::TileDescription (m_spec.tile_width, m_spec.tile_height,
                                       Imf::LevelMode(m_levelmode),
                                       Imf::LevelRoundingMode(m_roundingmode)));
-            m_output_tiled = new Imf::TiledOutputFile (name.c_str(), *m_header);
+            if (m_ostream)
+                m_output_tiled = new Imf::TiledOutputFile (*m_ostream,
+                                                           *m_header, nthreads);
+            else
+                m_output_tiled = new Imf::TiledOutputFile (name.c_str(),
+                                                           *m_header, nthreads);
         } else {
-            m_output_scanline = new Imf::OutputFile (name.c_str(), *m_header);
+            if (m_ostream)
+                m_output_scanline = new Imf::OutputFile (*m_ostream,
+                                                         *m_header, nthreads);
+            else
+                m_output_scanline = new Imf::OutputFile (name.c_str(),
+                                                         *m_header, nthreads);
         }
     }
     catch (const std::exception &e) {
@@ -423,6 +484,10 @@ OpenEXROutput::put_parameter (const std::string &name, TypeDesc type,
     if (iequals (xname, "planarconfig") || iequals (xname, "tiff:planarconfig"))
         return true;
 
+    // Our own threading hint, not something to store in the file
+    if (iequals (xname, "openexr:threads"))
+        return true;
+
     // General handling of attributes
     // FIXME -- police this if we ever allow arrays
     if (type == TypeDesc::INT || type == TypeDesc::UINT) {
@@ -480,6 +545,7 @@ OpenEXROutput::close ()
 
     delete m_output_scanline;  m_output_scanline = NULL;
     delete m_output_tiled;  m_output_tiled = NULL;
+    delete m_ostream;  m_ostream = NULL;
     delete m_header;    m_header = NULL;
 
     init ();      // re-initialize
@@ -570,3 +636,96 @@ OpenEXROutput::write_tile (int x, int y, int z,
 
     return true;
 }
+
+
+
+bool
+OpenEXROutput::write_scanlines (int ybegin, int yend, int z,
+                                TypeDesc format, const void *data,
+                                stride_t xstride, stride_t ystride)
+{
+    if (yend <= ybegin)
+        return true;
+    stride_t zstride = AutoStride;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        m_spec.width, yend-ybegin);
+    data = to_native_rectangle (0, m_spec.width-1, 0, yend-ybegin-1, 0, 0,
+                                format, data, xstride, ystride, zstride,
+                                m_scratch);
+
+    // Same "virtual framebuffer" offset as write_scanline, but all the
+    // scanlines go to OpenEXR in one writePixels call, so it can encode
+    // whole line blocks at once (in parallel, if its thread pool has
+    // any threads).
+    char *buf = (char *)data
+              - m_spec.x * m_spec.pixel_bytes()
+              - ybegin * m_spec.scanline_bytes();
+
+    try {
+        Imf::FrameBuffer frameBuffer;
+        for (int c = 0;  c < m_spec.nchannels;  ++c) {
+            frameBuffer.insert (m_spec.channelnames[c].c_str(),
+                                Imf::Slice (m_pixeltype,
+                                            buf + c * m_spec.channel_bytes(),
+                                            m_spec.pixel_bytes(),
+                                            m_spec.scanline_bytes()));
+        }
+        m_output_scanline->setFrameBuffer (frameBuffer);
+        m_output_scanline->writePixels (yend-ybegin);
+    }
+    catch (const std::exception &e) {
+        error ("Failed OpenEXR write: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+
+
+bool
+OpenEXROutput::write_tiles (int xbegin, int xend, int ybegin, int yend,
+                            int zbegin, int zend, TypeDesc format,
+                            const void *data, stride_t xstride,
+                            stride_t ystride, stride_t zstride)
+{
+    if (xend <= xbegin || yend <= ybegin)
+        return true;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        xend-xbegin, yend-ybegin);
+    data = to_native_rectangle (0, xend-xbegin-1, 0, yend-ybegin-1, 0, 0,
+                                format, data, xstride, ystride, zstride,
+                                m_scratch);
+
+    // The block is (xend-xbegin) pixels wide, and OpenEXR wants the
+    // address of pixel (0,0) of the "virtual framebuffer".  All the
+    // tiles go to OpenEXR in one writeTiles call, so it can encode them
+    // together (in parallel, if its thread pool has any threads).
+    size_t pixelbytes = m_spec.pixel_bytes();
+    size_t scanlinebytes = pixelbytes * (xend-xbegin);
+    char *buf = (char *)data
+              - xbegin * pixelbytes
+              - ybegin * scanlinebytes;
+
+    try {
+        Imf::FrameBuffer frameBuffer;
+        for (int c = 0;  c < m_spec.nchannels;  ++c) {
+            frameBuffer.insert (m_spec.channelnames[c].c_str(),
+                                Imf::Slice (m_pixeltype,
+                                            buf + c * m_spec.channel_bytes(),
+                                            pixelbytes, scanlinebytes));
+        }
+        m_output_tiled->setFrameBuffer (frameBuffer);
+        m_output_tiled->writeTiles ((xbegin - m_spec.x) / m_spec.tile_width,
+                                    (xend - 1 - m_spec.x) / m_spec.tile_width,
+                                    (ybegin - m_spec.y) / m_spec.tile_height,
+                                    (yend - 1 - m_spec.y) / m_spec.tile_height,
+                                    m_subimage, m_subimage);
+    }
+    catch (const std::exception &e) {
+        error ("Failed OpenEXR write: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
@@ -40,6 +40,7 @@ using boost::algorithm::iequals;
 #include "dassert.h"
 #include "typedesc.h"
 #include "imageio.h"
+#include "filesystem.h"
 #include "strutil.h"
 #include "fmath.h"
 #include "sysutil.h"
@@ -274,6 +275,68 @@ read_next_scanline (png_structp& sp, void *buffer)
 
 
 
+/// Reads the next nrows scanlines from an open PNG file into the
+/// indicated buffer, one after another, each rowbytes long.  The caller
+/// supplies rows, reused across calls to hold the row pointers.
+/// \return empty string on success, error message on failure.
+///
+inline const std::string
+read_next_scanlines (png_structp& sp, int nrows, void *buffer,
+                     size_t rowbytes, std::vector<png_bytep> &rows)
+{
+    rows.resize (nrows);
+    for (int i = 0;  i < nrows;  ++i)
+        rows[i] = (png_bytep)buffer + i * rowbytes;
+
+    // Must call this setjmp in every function that does PNG reads
+    if (setjmp (png_jmpbuf (sp)))
+        return "PNG library error";
+
+    png_read_rows (sp, &rows[0], NULL, nrows);
+
+    // success
+    return "";
+}
+
+
+
+/// libpng read callback, for png_set_read_fn, that reads through the
+/// Filesystem::IOProxy passed as its io_ptr.
+///
+inline void
+read_proxy (png_structp sp, png_bytep data, png_size_t length)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    if (io->read (data, length) != length)
+        png_error (sp, "Read Error");
+}
+
+
+
+/// libpng write callback, for png_set_write_fn, that writes through the
+/// Filesystem::IOProxy passed as its io_ptr.
+///
+inline void
+write_proxy (png_structp sp, png_bytep data, png_size_t length)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    if (io->write (data, length) != length)
+        png_error (sp, "Write Error");
+}
+
+
+
+/// libpng flush callback to go with write_proxy.
+///
+inline void
+flush_proxy (png_structp sp)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    io->flush ();
+}
+
+
+
 /// Destroys a PNG read struct.
 ///
 inline void
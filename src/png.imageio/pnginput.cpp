@@ -44,6 +44,7 @@ using boost::algorithm::iequals;
 #include "thread.h"
 #include "strutil.h"
 #include "fmath.h"
+#include "stripreader.h"
 
 using namespace OpenImageIO;
 
@@ -51,17 +52,25 @@ using namespace OpenImageIO;
 
 class PNGInput : public ImageInput {
 public:
-    PNGInput () { init(); }
+    PNGInput () : m_io_user(NULL) { init(); }
     virtual ~PNGInput () { close(); }
     virtual const char * format_name (void) const { return "png"; }
     virtual bool open (const std::string &name, ImageSpec &newspec);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    using ImageInput::read_native_scanlines;  // Keep the channel subset one
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
 
 private:
     std::string m_filename;           ///< Stash the filename
-    FILE *m_file;                     ///< Open image handle
+    Filesystem::IOProxy *m_io;        ///< Where we read from
+    Filesystem::IOProxy *m_io_user;   ///< Proxy from set_ioproxy(), if any
     png_structp m_png;                ///< PNG read structure pointer
     png_infop m_info;                 ///< PNG image info structure pointer
     int m_bit_depth;                  ///< PNG bit depth
@@ -70,23 +79,45 @@ private:
     std::vector<unsigned char> m_buf; ///< Buffer the image pixels
     int m_subimage;                   ///< What subimage are we looking at?
     Imath::Color3f m_bg;              ///< Background color
-    int m_next_scanline;
+    std::vector<png_bytep> m_rows;    ///< Row pointers for libpng reads
+
+    /// Decodes the rows of a non-interlaced image, a strip at a time
+    struct Strips : public StripReader {
+        PNGInput *in;
+        virtual bool decode (int n, unsigned char *data) {
+            return in->decode_rows (n, data);
+        }
+        virtual bool restart () { return in->restart (); }
+    };
+    Strips m_strips;
 
     /// Reset everything to initial state
     ///
     void init () {
         m_subimage = -1;
-        m_file = NULL;
+        m_io = NULL;
         m_png = NULL;
         m_info = NULL;
         m_buf.clear ();
-        m_next_scanline = 0;
+        m_strips.in = this;
     }
 
     /// Helper function: read the image.
     ///
     bool readimg ();
 
+    /// Helper function: decode the next n scanlines of a non-interlaced
+    /// image into contiguous memory at data, associating alpha.
+    bool decode_rows (int n, unsigned char *data);
+
+    /// Helper function: re-open the file, ready to decode the first
+    /// scanline again.
+    bool restart ();
+
+    /// Helper function: associate alpha for npixels pixels.
+    ///
+    void associate_alpha (void *data, int npixels);
+
     /// Extract the background color.
     ///
     bool get_background (float *red, float *green, float *blue);
@@ -105,6 +136,12 @@ DLLEXPORT const char * png_input_extensions[] = {
     "png", NULL
 };
 
+DLLEXPORT bool
+png_input_signature (const unsigned char *header, int nbytes)
+{
+    return nbytes >= 8 && ! png_sig_cmp ((png_bytep)header, 0, 8);
+}
+
 };
 
 
@@ -115,14 +152,21 @@ PNGInput::open (const std::string &name, ImageSpec &newspec)
     m_filename = name;
     m_subimage = 0;
 
-    m_file = fopen (name.c_str(), "rb");
-    if (! m_file) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
+    if (m_io_user) {
+        m_io = m_io_user;
+        m_io->seek (0);
+    } else {
+        m_io = new Filesystem::IOFile (name, Filesystem::IOProxy::Read);
+        if (! m_io->opened ()) {
+            delete m_io;
+            m_io = NULL;
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     unsigned char sig[8];
-    fread (sig, 1, sizeof(sig), m_file);
+    m_io->read (sig, sizeof(sig));
     if (png_sig_cmp (sig, 0, 7)) {
         error ("File failed PNG signature check");
         return false;
@@ -135,14 +179,14 @@ PNGInput::open (const std::string &name, ImageSpec &newspec)
         return false;
     }
 
-    png_init_io (m_png, m_file);
+    png_set_read_fn (m_png, m_io, PNG_pvt::read_proxy);
     png_set_sig_bytes (m_png, 8);  // already read 8 bytes
 
     PNG_pvt::read_info (m_png, m_info, m_bit_depth, m_color_type,
                         m_interlace_type, m_bg, m_spec);
 
     newspec = spec ();
-    m_next_scanline = 0;
+    m_strips.start (m_spec.height, m_spec.scanline_bytes());
 
     return true;
 }
@@ -161,6 +205,8 @@ PNGInput::readimg ()
         return false;
     }
 
+    // PNG specifically dictates unassociated (un-"premultiplied") alpha
+    associate_alpha (&m_buf[0], m_spec.width * m_spec.height);
     return true;
 }
 
@@ -170,10 +216,9 @@ bool
 PNGInput::close ()
 {
     PNG_pvt::destroy_read_struct (m_png, m_info);
-    if (m_file) {
-        fclose (m_file);
-        m_file = NULL;
-    }
+    if (m_io != m_io_user)
+        delete m_io;
+    m_io = NULL;
 
     init();  // Reset to initial state
     return true;
@@ -209,56 +254,83 @@ associateAlpha (T * data, int size, int channels, int alpha_channel, float gamma
 
 
 
+void
+PNGInput::associate_alpha (void *data, int npixels)
+{
+    if (m_spec.alpha_channel == -1)
+        return;
+    if (m_spec.format == TypeDesc::UINT16)
+        associateAlpha ((unsigned short *)data, npixels,
+                        m_spec.nchannels, m_spec.alpha_channel,
+                        m_spec.gamma);
+    else
+        associateAlpha ((unsigned char *)data, npixels,
+                        m_spec.nchannels, m_spec.alpha_channel,
+                        m_spec.gamma);
+}
+
+
+
+bool
+PNGInput::decode_rows (int n, unsigned char *data)
+{
+    std::string s = PNG_pvt::read_next_scanlines (m_png, n, data,
+                                                  m_spec.scanline_bytes(),
+                                                  m_rows);
+    if (s.length ()) {
+        close ();
+        error ("%s", s.c_str ());
+        return false;
+    }
+    associate_alpha (data, n * m_spec.width);
+    return true;
+}
+
+
+
+bool
+PNGInput::restart ()
+{
+    ImageSpec dummyspec;
+    int subimage = current_subimage();
+    if (! close ()  ||
+        ! open (m_filename, dummyspec)  ||
+        ! seek_subimage (subimage, dummyspec))
+        return false;    // Somehow, the re-open failed
+    assert (m_strips.next_scanline() == 0 && current_subimage() == subimage);
+    return true;
+}
+
+
+
 bool
 PNGInput::read_native_scanline (int y, int z, void *data)
 {
-    y -= m_spec.y;
-    if (y < 0 || y >= m_spec.height)   // out of range scanline
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+PNGInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    ybegin -= m_spec.y;
+    yend -= m_spec.y;
+    if (ybegin < 0 || yend > m_spec.height)   // out of range scanlines
         return false;
+    if (yend <= ybegin)
+        return true;
+    size_t size = m_spec.scanline_bytes();
+    unsigned char *d = (unsigned char *)data;
 
     if (m_interlace_type != 0) {
         // Interlaced.  Punt and read the whole image
-        if (m_buf.empty ())
-            readimg ();
-        size_t size = spec().scanline_bytes();
-        memcpy (data, &m_buf[0] + y * size, size);
-    } else {
-        // Not an interlaced image -- read just one row
-        if (m_next_scanline > y) {
-            // User is trying to read an earlier scanline than the one we're
-            // up to.  Easy fix: close the file and re-open.
-            ImageSpec dummyspec;
-            int subimage = current_subimage();
-            if (! close ()  ||
-                ! open (m_filename, dummyspec)  ||
-                ! seek_subimage (subimage, dummyspec))
-                return false;    // Somehow, the re-open failed
-            assert (m_next_scanline == 0 && current_subimage() == subimage);
-        }
-        while (m_next_scanline <= y) {
-            // Keep reading until we're read the scanline we really need
-            // std::cerr << "reading scanline " << m_next_scanline << "\n";
-            std::string s = PNG_pvt::read_next_scanline (m_png, data);
-            if (s.length ()) {
-                close ();
-                error ("%s", s.c_str ());
-                return false;
-            }
-            ++m_next_scanline;
-        }
-    }
-
-    // PNG specifically dictates unassociated (un-"premultiplied") alpha
-    if (m_spec.alpha_channel != -1) {   // Associate alpha
-        if (m_spec.format == TypeDesc::UINT16)
-            associateAlpha ((unsigned short *)data, m_spec.width,
-                            m_spec.nchannels, m_spec.alpha_channel, 
-                            m_spec.gamma);
-        else
-            associateAlpha ((unsigned char *)data, m_spec.width,
-                            m_spec.nchannels, m_spec.alpha_channel, 
-                            m_spec.gamma);
+        if (m_buf.empty () && ! readimg ())
+            return false;
+        memcpy (data, &m_buf[0] + ybegin * size, (yend-ybegin) * size);
+        return true;
     }
 
-    return true;
+    // Not an interlaced image -- decode a strip at a time
+    return m_strips.read (ybegin, yend, size, d);
 }
@@ -53,8 +53,11 @@ public:
     virtual ~PNGOutput ();
     virtual const char * format_name (void) const { return "png"; }
     virtual bool supports (const std::string &feature) const {
-        // Support nothing nonstandard
-        return false;
+        return (feature == "ioproxy");
+    }
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
     }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        bool append=false);
@@ -64,7 +67,8 @@ public:
 
 private:
     std::string m_filename;           ///< Stash the filename
-    FILE *m_file;                     ///< Open image handle
+    Filesystem::IOProxy *m_io;        ///< Where we write to
+    Filesystem::IOProxy *m_io_user;   ///< Proxy from set_ioproxy(), if any
     png_structp m_png;                ///< PNG read structure pointer
     png_infop m_info;                 ///< PNG image info structure pointer
     int m_color_type;                 ///< PNG color model type
@@ -73,7 +77,7 @@ private:
 
     // Initialize private members to pre-opened state
     void init (void) {
-        m_file = NULL;
+        m_io = NULL;
         m_png = NULL;
         m_info = NULL;
         m_pngtext.clear ();
@@ -105,6 +109,7 @@ DLLEXPORT const char * png_output_extensions[] = {
 
 
 PNGOutput::PNGOutput ()
+    : m_io_user(NULL)
 {
     init ();
 }
@@ -125,10 +130,16 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec, bool append
     close ();  // Close any already-opened file
     m_spec = userspec;  // Stash the spec
 
-    m_file = fopen (name.c_str(), "wb");
-    if (! m_file) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
+    if (m_io_user) {
+        m_io = m_io_user;
+    } else {
+        m_io = new Filesystem::IOFile (name, Filesystem::IOProxy::Write);
+        if (! m_io->opened ()) {
+            delete m_io;
+            m_io = NULL;
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     std::string s = PNG_pvt::create_write_struct (m_png, m_info,
@@ -139,7 +150,7 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec, bool append
         return false;
     }
 
-    png_init_io (m_png, m_file);
+    png_set_write_fn (m_png, m_io, PNG_pvt::write_proxy, PNG_pvt::flush_proxy);
     png_set_compression_level (m_png, 6 /* medium speed vs size tradeoff */);
 
     PNG_pvt::write_info (m_png, m_info, m_color_type, m_spec, m_pngtext);
@@ -156,10 +167,9 @@ PNGOutput::close ()
         PNG_pvt::finish_image (m_png);
     PNG_pvt::destroy_write_struct (m_png, m_info);
 
-    if (m_file) {
-        fclose (m_file);
-        m_file = NULL;
-    }
+    if (m_io != m_io_user)
+        delete m_io;
+    m_io = NULL;
 
     init ();      // re-initialize
     return true;  // How can we fail?
@@ -29,28 +29,37 @@
 */
 
 #include <string>
-#include <fstream>
 #include <cstdlib>
 
 #include "export.h"
 #include "imageio.h"
+#include "fmath.h"
+#include "filesystem.h"
 
 using namespace OpenImageIO;
 
 
 class PNMInput : public ImageInput {
 public:
+    PNMInput () : m_io_user(NULL) { }
     virtual const char* format_name (void) const { return "pnm"; }
     virtual bool open (const std::string &name, ImageSpec &newspec);
     virtual bool close ();
     virtual int current_subimage (void) const { return 0; }
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
 
 private:
-    std::ifstream m_file;
+    Filesystem::BufferedReader m_file;
+    Filesystem::IOProxy *m_io_user;
     std::string m_current_line; ///< Buffer the image pixels
     const char * m_pos;
     unsigned int m_pnm_type, m_max_val;
+    int64_t m_data_start;       ///< Offset of the first scanline
+    int m_scanline_size;        ///< Bytes per scanline (binary types only)
 
     bool read_file_scanline (void * data);
     bool read_file_header ();
@@ -69,17 +78,22 @@ extern "C" {
         "ppm","pgm","pbm","pnm", NULL
     };
 
+    DLLEXPORT bool pnm_input_signature (const unsigned char *header,
+                                        int nbytes) {
+        // "P1" through "P6"
+        return (nbytes >= 2 && header[0] == 'P'
+                && header[1] >= '1' && header[1] <= '6');
+    }
+
 };
 
 
 
 inline bool
-nextLine (std::ifstream &file, std::string &current_line, const char * &pos) 
+nextLine (Filesystem::BufferedReader &file, std::string &current_line,
+          const char * &pos) 
 {   
-    if (!file.good())
-        return false;
-    getline (file, current_line);
-    if (file.fail())
+    if (!file.getline (current_line))
         return false;
     pos = current_line.c_str();
     return true;
@@ -88,15 +102,16 @@ nextLine (std::ifstream &file, std::string &current_line, const char * &pos)
 
 
 inline const char * 
-nextToken (std::ifstream &file, std::string &current_line, const char * &pos)
+nextToken (Filesystem::BufferedReader &file, std::string &current_line,
+           const char * &pos)
 {		
     while (1) {
         while (isspace (*pos)) 
             pos++;
         if (*pos)
             break;
-        else 
-            nextLine (file, current_line, pos);
+        else if (!nextLine (file, current_line, pos))
+            break;   // out of data, leave pos at the end of the string
     }
     return pos;
 }
@@ -104,14 +119,15 @@ nextToken (std::ifstream &file, std::string &current_line, const char * &pos)
 
 
 inline const char *
-skipComments (std::ifstream &file, std::string &current_line, 
+skipComments (Filesystem::BufferedReader &file, std::string &current_line, 
               const char * & pos, char comment = '#')
 {		
     while (1) {
         nextToken (file, current_line, pos);
-        if (*pos == comment)
-            nextLine (file, current_line, pos);
-        else 
+        if (*pos == comment) {
+            if (!nextLine (file, current_line, pos))
+                break;
+        } else 
             break;
     }
     return pos;
@@ -120,7 +136,7 @@ skipComments (std::ifstream &file, std::string &current_line,
 
 
 inline bool
-nextVal (std::ifstream & file, std::string &current_line,
+nextVal (Filesystem::BufferedReader & file, std::string &current_line,
          const char * &pos, int &val, char comment = '#')
 {
     skipComments (file, current_line, pos, comment);
@@ -144,7 +160,7 @@ invert (const T *read, T *write, imagesize_t nvals)
 
 template <class T> 
 inline bool 
-ascii_to_raw (std::ifstream &file, std::string &current_line, const char * &pos,
+ascii_to_raw (Filesystem::BufferedReader &file, std::string &current_line, const char * &pos,
               T *write, imagesize_t nvals, T max)
 {
     if (max)
@@ -152,7 +168,7 @@ ascii_to_raw (std::ifstream &file, std::string &current_line, const char * &pos,
             int tmp;
             if (!nextVal (file, current_line, pos, tmp))
                 return false;
-            write[i] = std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
+            write[i] = (unsigned int) std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
         }
     else
         for (imagesize_t i=0; i < nvals; i++) 
@@ -169,7 +185,7 @@ raw_to_raw (const T *read, T *write, imagesize_t nvals, T max)
     if (max)
         for (imagesize_t i=0; i < nvals; i++) {
             int tmp = read[i];
-            write[i] = std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
+            write[i] = (unsigned int) std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
         }
     else
         for (imagesize_t i=0; i < nvals; i++) 
@@ -195,25 +211,28 @@ unpack (const unsigned char * read, unsigned char * write, imagesize_t size)
 
 template <class T>
 inline bool
-read_int (std::istream &in, T &dest, char comment='#')
+read_int (Filesystem::BufferedReader &in, T &dest, char comment='#')
 {
-    T ret;
-    char c;
-    while (!in.eof()) {
-        in >> ret;
-        if (!in.good()){
-            in.clear();
-            in >> c;
-            if (c == comment)
-                in.ignore (std::numeric_limits<std::streamsize>::max(), '\n');
-            else
-                return false;
-        } else {
-            dest = ret;
-            return true;
-        }
+    // Skip whitespace and comments, which run to the end of the line
+    int c = in.getc();
+    while (c >= 0 && (isspace (c) || c == comment)) {
+        if (c == comment)
+            while (c >= 0 && c != '\n')
+                c = in.getc();
+        c = in.getc();
     }
-    return false;
+    if (c < 0 || !isdigit (c))
+        return false;
+    T ret = 0;
+    do {
+        ret = ret * 10 + (c - '0');
+        c = in.getc();
+    } while (c >= 0 && isdigit (c));
+    // Leave the character that ended the number to be read next
+    if (c >= 0)
+        in.seek (in.tell() - 1);
+    dest = ret;
+    return true;
 }
 
 
@@ -221,21 +240,14 @@ read_int (std::istream &in, T &dest, char comment='#')
 bool 
 PNMInput::read_file_scanline (void * data)
 {
-    std::vector<unsigned char> buf;
+    // Binary scanlines are decoded straight out of the reader's buffer
+    const unsigned char *buf = NULL;
     bool good = true;
-    if (!m_file.is_open())
-        return false;
     int nsamples = m_spec.width * m_spec.nchannels;
 
     if (m_pnm_type >= 4 && m_pnm_type <= 6){
-        int numbytes;
-        if (m_pnm_type == 4)
-            numbytes = (m_spec.width + 7) / 8;
-        else
-            numbytes = m_spec.scanline_bytes();
-        buf.resize (numbytes);
-        m_file.read ((char*)&buf[0], numbytes);
-        if (!m_file.good())
+        buf = m_file.next (m_scanline_size);
+        if (!buf)
             return false;
     }
 
@@ -257,15 +269,20 @@ PNMInput::read_file_scanline (void * data)
             break;
         //Raw
         case 4:
-            unpack (&buf[0], (unsigned char *)data, nsamples);
+            unpack (buf, (unsigned char *)data, nsamples);
             break;
         case 5:
         case 6:
-            if (m_max_val > std::numeric_limits<unsigned char>::max())
-                raw_to_raw ((unsigned short *)&buf[0], (unsigned short *) data, 
+            if (m_max_val > std::numeric_limits<unsigned char>::max()) {
+                // 16 bit samples are stored big endian
+                unsigned short *shorts = (unsigned short *) data;
+                memcpy (shorts, buf, m_scanline_size);
+                if (littleendian())
+                    swap_endian (shorts, nsamples);
+                raw_to_raw (shorts, shorts, 
                             nsamples, (unsigned short)m_max_val);
-            else 
-                raw_to_raw ((unsigned char *)&buf[0], (unsigned char *) data, 
+            } else 
+                raw_to_raw (buf, (unsigned char *) data, 
                             nsamples, (unsigned char)m_max_val);
             break;
         default:
@@ -280,15 +297,12 @@ bool
 PNMInput::read_file_header ()
 {
     unsigned int width, height;
-    char c;
-    if (!m_file.is_open())
-        return false;
+    int c = m_file.getc();
 
-    m_file >> c >> m_pnm_type;
-    
     //MagicNumber
     if (c != 'P')
         return false;
+    m_pnm_type = m_file.getc() - '0';
     if (!(m_pnm_type >= 1 && m_pnm_type <= 6))
         return false;
 
@@ -306,8 +320,10 @@ PNMInput::read_file_header ()
         m_max_val = 1;
     
     //Space before content
-    if (!(isspace (m_file.get()) && m_file.good()))
+    c = m_file.getc();
+    if (!(c >= 0 && isspace (c)))
         return false;
+    m_data_start = m_file.tell();
 
     if (m_pnm_type == 3 || m_pnm_type == 6)
         m_spec =  OpenImageIO::ImageSpec (width, height, 3, 
@@ -326,7 +342,12 @@ PNMInput::read_file_header ()
     else
         m_spec.attribute ("pnm:binary", 1);
 
-    m_spec.attribute ("BitsPerSample", ceilf (logf (m_max_val + 1)/logf (2)));
+    m_spec.attribute ("BitsPerSample", (int) ceilf (logf (m_max_val + 1)/logf (2)));
+
+    if (m_pnm_type == 4)
+        m_scanline_size = (m_spec.width + 7) / 8;
+    else
+        m_scanline_size = (int) m_spec.scanline_bytes();
     return true;
 }
 
@@ -335,10 +356,12 @@ PNMInput::read_file_header ()
 bool
 PNMInput::open (const std::string &name, ImageSpec &newspec)
 {
-    if (m_file.is_open()) //close previously opened file
-        m_file.close();
+    m_file.close(); //close previously opened file
 
-    m_file.open (name.c_str());
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (name))) {
+        error ("Could not open file \"%s\"", name.c_str());
+        return false;
+    }
 
     m_current_line = "";
     m_pos = m_current_line.c_str();
@@ -366,7 +389,13 @@ PNMInput::read_native_scanline (int y, int z, void *data)
 {
     if (z)
         return false;
-    if (!read_file_scanline (data))
+    // Binary scanlines are all the same size, so we can go straight
+    // to any of them; the ascii types can only be read in order.
+    if (m_pnm_type >= 4 && m_pnm_type <= 6)
+        m_file.seek (m_data_start + (int64_t)y * m_scanline_size);
+    if (!read_file_scanline (data)) {
+        error ("Could not read scanline %d", y);
         return false;
+    }
     return true;
 }
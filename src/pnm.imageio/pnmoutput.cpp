@@ -29,8 +29,10 @@
 */
 
 #include <fstream>
+#include <vector>
 
 #include "imageio.h"
+#include "fmath.h"
 
 using namespace OpenImageIO;
 
@@ -54,6 +56,7 @@ private:
     std::string m_filename;           ///< Stash the filename
     std::ofstream m_file;
     unsigned int m_max_val, m_pnm_type;
+    std::vector<unsigned char> m_scratch;
 };
 
 
@@ -126,7 +129,11 @@ write_raw (std::ostream &file, const T *data, const stride_t stride,
         for (int c = 0; c < spec.nchannels; c++) {
             val = data[pixel + c];
             val = val * max_val / std::numeric_limits<T>::max();
-            file.write ((char*)&val, sizeof (T));
+            // Samples are written big endian, as the format requires
+            T out = (T) val;
+            if (littleendian())
+                swap_endian (&out);
+            file.write ((char*)&out, sizeof (T));
         }
     }
 }
@@ -163,6 +170,9 @@ PNMOutput::open (const std::string &name, const ImageSpec &userspec, bool append
         m_pnm_type -= 3;
 
     m_max_val = (1 << bits_per_sample) - 1;
+    // Samples are handed to the writers below as 8 or 16 bit values
+    m_spec.set_format (m_max_val > std::numeric_limits<unsigned char>::max()
+                       ? TypeDesc::UINT16 : TypeDesc::UINT8);
     // Write header
     m_file << "P" << m_pnm_type << std::endl;
     m_file << m_spec.width << " " << m_spec.height << std::endl;
@@ -191,26 +201,30 @@ PNMOutput::write_scanline (int y, int z, TypeDesc format,
         return false;
     if (z)
         return false;
+    // The writers below step through the native scanline a pixel, that
+    // is nchannels values, at a time
+    data = to_native_scanline (format, data, xstride, m_scratch);
+    stride_t pixelvals = m_spec.nchannels;
     switch (m_pnm_type){
         case 1:
-            write_ascii_binary (m_file, (unsigned char *) data, xstride, m_spec);
+            write_ascii_binary (m_file, (unsigned char *) data, pixelvals, m_spec);
             break;
         case 2:
         case 3:
             if (m_max_val > std::numeric_limits<unsigned char>::max())
-                write_ascii (m_file, (unsigned short *) data, xstride, m_spec, m_max_val);
+                write_ascii (m_file, (unsigned short *) data, pixelvals, m_spec, m_max_val);
             else 
-                write_ascii (m_file, (unsigned char *) data, xstride, m_spec, m_max_val);
+                write_ascii (m_file, (unsigned char *) data, pixelvals, m_spec, m_max_val);
             break;
         case 4:
-            write_raw_binary (m_file, (unsigned char *) data, xstride, m_spec);
+            write_raw_binary (m_file, (unsigned char *) data, pixelvals, m_spec);
             break;
         case 5:
         case 6:
             if (m_max_val > std::numeric_limits<unsigned char>::max())
-                write_raw (m_file, (unsigned short *) data, xstride, m_spec, m_max_val);
+                write_raw (m_file, (unsigned short *) data, pixelvals, m_spec, m_max_val);
             else 
-                write_raw (m_file, (unsigned char *) data, xstride, m_spec, m_max_val);
+                write_raw (m_file, (unsigned char *) data, pixelvals, m_spec, m_max_val);
             break;
         default:
             return false;
@@ -36,6 +36,7 @@
 #include "imageio.h"
 using namespace OpenImageIO;
 #include "fmath.h"
+#include "filesystem.h"
 
 
 
@@ -89,36 +90,43 @@ namespace sgi_pvt {
 
 class SgiInput : public ImageInput {
  public:
-    SgiInput () { init(); }
-    virtual ~SgiInput () { }
+    SgiInput () : m_io_user(NULL) { init(); }
+    virtual ~SgiInput () { close(); }
     virtual const char *format_name (void) const { return "sgi"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool close (void);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
  private:
-    FILE *m_fd;
+    Filesystem::BufferedReader m_file;  // Where we read from
+    Filesystem::IOProxy *m_io_user;     // Proxy from set_ioproxy(), if any
     std::string m_filename;
     sgi_pvt::SgiHeader m_sgi_header;
     std::vector<uint32_t> start_tab;
     std::vector<uint32_t> length_tab;
+    std::vector<unsigned char> m_channel;  // One uncompressed RLE channel
 
     void init() {
-        m_fd = NULL;
+        m_file.close ();
         memset (&m_sgi_header, 0, sizeof(m_sgi_header));
     }
 
     // reads SGI file header (512 bytes) into m_sgi_header
-    void read_header();
+    bool read_header();
 
     // reads RLE scanline start offset and RLE scanline length tables
     // RLE scanline start offset is stored in start_tab
     // RLE scanline length is stored in length_tab
-    void read_offset_tables();
+    bool read_offset_tables();
 
-    // read channel scanline data from file, uncompress it and save the data to
-    // 'out' buffer; 'out' should be allocate before call to this method
-    void uncompress_rle_channel (int scanline_off, int scanline_len,
-                                 unsigned char *out);
+    // uncompress the scanline_len bytes of one channel's RLE scanline
+    // data and save them to 'out' buffer, which must have room for the
+    // whole scanline of that channel
+    bool uncompress_rle_channel (const unsigned char *rle_scanline,
+                                 int scanline_len, unsigned char *out);
 };
 
 
@@ -41,6 +41,12 @@ extern "C" {
     DLLEXPORT const char *sgi_input_extensions[] = {
         "sgi", "rgb", "rgba", "bw", "int", "inta", NULL
     };
+    DLLEXPORT bool sgi_input_signature (const unsigned char *header,
+                                        int nbytes) {
+        // Big-endian magic number
+        return (nbytes >= 2 &&
+                ((header[0] << 8) | header[1]) == sgi_pvt::SGI_MAGIC);
+    }
 }
 
 
@@ -51,13 +57,16 @@ SgiInput::open (const std::string &name, ImageSpec &spec)
     // saving name for later use
     m_filename = name;
 
-    m_fd = fopen (m_filename.c_str (), "rb");
-    if (!m_fd) {
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (m_filename))) {
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
 
-    read_header ();
+    if (! read_header ()) {
+        error ("\"%s\": could not read the header", m_filename.c_str());
+        close ();
+        return false;
+    }
 
     const short SGI_MAGIC = 0x01DA;
     if (m_sgi_header.magic != SGI_MAGIC) {
@@ -102,7 +111,13 @@ SgiInput::open (const std::string &name, ImageSpec &spec)
 
     if (m_sgi_header.storage == sgi_pvt::RLE) {
         m_spec.attribute("compression", "rle");
-        read_offset_tables ();
+        if (! read_offset_tables ()) {
+            error ("\"%s\": could not read the RLE offset tables",
+                   m_filename.c_str());
+            close ();
+            return false;
+        }
+        m_channel.resize (m_spec.width * m_sgi_header.bpc);
     }
 
     spec = m_spec;
@@ -114,121 +129,73 @@ SgiInput::open (const std::string &name, ImageSpec &spec)
 bool
 SgiInput::read_native_scanline (int y, int z, void *data)
 {
-    if (y < 0 || y > m_spec.height)
+    if (y < 0 || y >= m_spec.height)
         return false;
 
     y = m_spec.height - y - 1;
 
+    // The file stores each channel's scanline separately, so fetch them
+    // one at a time straight from the reader's buffer (uncompressing RLE
+    // data into m_channel), and interleave them into the caller's data.
+    // The reader only fetches the pages it needs when we jump from one
+    // channel's part of the file to the next.
     int bpc = m_sgi_header.bpc;
-    std::vector<unsigned char> scanline (m_spec.scanline_bytes());
-    long scanline_off_chan1 = 0;
-    long scanline_off_chan2 = 0;
-    long scanline_off_chan3 = 0;
-    long scanline_off_chan4 = 0;
-    std::vector<unsigned char> first_channel;
-    std::vector<unsigned char> second_channel;
-    std::vector<unsigned char> third_channel;
-    std::vector<unsigned char> fourth_channel;
-    if (m_sgi_header.storage == sgi_pvt::RLE) {
-        // reading and uncompressing first channel (red in RGBA images)
-        scanline_off_chan1 = start_tab[y];
-        int scanline_len_chan1 = length_tab[y];
-        first_channel.resize (m_spec.width * bpc);
-        uncompress_rle_channel (scanline_off_chan1, scanline_len_chan1,
-                                &first_channel[0]);
-        if (m_spec.nchannels >= 3) {
-            // reading and uncompressing second channel (green in RGBA images)
-            scanline_off_chan2 = start_tab[y + m_spec.height];
-            int scanline_len_chan2 = length_tab[y + m_spec.height];
-            second_channel.resize (m_spec.width * bpc);
-            uncompress_rle_channel (scanline_off_chan2, scanline_len_chan2,
-                                    &second_channel[0]);
-            // reading and uncompressing third channel (blue in RGBA images)
-            scanline_off_chan3 = start_tab[y + m_spec.height * 2];
-            int scanline_len_chan3 = length_tab[y + m_spec.height * 2];
-            third_channel.resize (m_spec.width * bpc);
-            uncompress_rle_channel (scanline_off_chan3, scanline_len_chan3,
-                                    &third_channel[0]);
-            if (m_spec.nchannels == 4) {
-                // reading and uncompressing fourth channel (alpha in RGBA images)
-                scanline_off_chan4 = start_tab[y + m_spec.height * 3];
-                int scanline_len_chan4 = length_tab[y + m_spec.height * 3];
-                fourth_channel.resize (m_spec.width * bpc);
-                uncompress_rle_channel (scanline_off_chan4, scanline_len_chan4,
-                                        &fourth_channel[0]);
+    int nchannels = m_spec.nchannels;
+    int channel_bytes = m_spec.width * bpc;
+    unsigned char *out = (unsigned char *)data;
+    for (int c = 0;  c < nchannels;  ++c) {
+        const unsigned char *chan;
+        if (m_sgi_header.storage == sgi_pvt::RLE) {
+            int scanline_len = length_tab[y + c * m_spec.height];
+            // The length comes from the file; no real scanline's RLE
+            // data is more than about twice its uncompressed size.
+            if (scanline_len < 0 || scanline_len > 2 + 2*channel_bytes) {
+                error ("Corrupt RLE data");
+                return false;
             }
-        }
-    }
-    else {
-        // first channel (red in RGBA)
-        scanline_off_chan1 = sgi_pvt::SGI_HEADER_LEN + y * m_spec.width * bpc;
-        fseek (m_fd, scanline_off_chan1, SEEK_SET);
-        first_channel.resize (m_spec.width * bpc);
-        fread (&first_channel[0], 1, m_spec.width * bpc, m_fd);
-        if (m_spec.nchannels >= 3) {
-            // second channel (breen in RGBA)
-            scanline_off_chan2 = sgi_pvt::SGI_HEADER_LEN +  (m_spec.height + y)
-                                 * m_spec.width * bpc;
-            fseek (m_fd, scanline_off_chan2, SEEK_SET);
-            second_channel.resize (m_spec.width * bpc);
-            fread (&second_channel[0], 1, m_spec.width * bpc, m_fd);
-            
-            // third channel (blue in RGBA)
-            scanline_off_chan3 = sgi_pvt::SGI_HEADER_LEN + (2 * m_spec.height + y)
-                                 * m_spec.width * bpc;
-            fseek (m_fd, scanline_off_chan3, SEEK_SET);
-            third_channel.resize (m_spec.width * bpc);
-            fread (&third_channel[0], 1, m_spec.width * bpc, m_fd);
-
-            if (m_spec.nchannels == 4) {
-                // fourth channel (alpha in RGBA)
-                scanline_off_chan4 = sgi_pvt::SGI_HEADER_LEN + (3 * m_spec.height + y)
-                                     * m_spec.width * bpc;
-                fseek (m_fd, scanline_off_chan4, SEEK_SET);
-                fourth_channel.resize (m_spec.width * bpc);
-                fread (&fourth_channel[0], 1, m_spec.width * bpc, m_fd);
+            m_file.seek (start_tab[y + c * m_spec.height]);
+            const unsigned char *rle = m_file.next (scanline_len);
+            if (! rle) {
+                error ("Unexpected end of file");
+                return false;
+            }
+            if (! uncompress_rle_channel (rle, scanline_len, &m_channel[0]))
+                return false;
+            chan = &m_channel[0];
+        } else {
+            m_file.seek (sgi_pvt::SGI_HEADER_LEN
+                         + (imagesize_t)(c * m_spec.height + y) * channel_bytes);
+            chan = m_file.next (channel_bytes);
+            if (! chan) {
+                error ("Unexpected end of file");
+                return false;
             }
         }
-    }
-
-    if (m_spec.nchannels == 1) {
-        memcpy (data, &first_channel[0], first_channel.size());
-        if (bpc == 2 && littleendian())
-            swap_endian ((unsigned short *)data, m_spec.width);
-        return true;
-    }
-
-    for (int i = 0, j = 0; i < m_spec.width; i++, j += m_spec.nchannels*bpc) {
-        scanline[j] = first_channel[i*bpc];
-        scanline[j+1*bpc] = second_channel[i*bpc];
-        scanline[j+2*bpc] = third_channel[i*bpc];
-        if (m_spec.nchannels == 4)
-            scanline[j+3*bpc] = fourth_channel[i*bpc];
-        if (bpc == 2) {
-            scanline[j+1] = first_channel[i*bpc+1];
-            scanline[j+1*bpc+1] = second_channel[i*bpc+1];
-            scanline[j+2*bpc+1] = third_channel[i*bpc+1];
-            if (m_spec.nchannels == 4)
-                scanline[j+3*bpc+1] = fourth_channel[i*bpc+1];
+        if (nchannels == 1) {
+            memcpy (out, chan, channel_bytes);
+        } else if (bpc == 1) {
+            for (int i = 0;  i < m_spec.width;  ++i)
+                out[i * nchannels + c] = chan[i];
+        } else {
+            for (int i = 0;  i < m_spec.width;  ++i) {
+                out[(i * nchannels + c) * 2] = chan[i * 2];
+                out[(i * nchannels + c) * 2 + 1] = chan[i * 2 + 1];
+            }
         }
     }
 
-    memcpy (data, &scanline[0], scanline.size());
     if (bpc == 2 && littleendian())
-        swap_endian ((unsigned short *)data, m_spec.width*m_spec.nchannels);
+        swap_endian ((unsigned short *)data, m_spec.width*nchannels);
     return true;
 }
 
 
 
-void
-SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
-                                 unsigned char *out)
+bool
+SgiInput::uncompress_rle_channel (const unsigned char *rle_scanline,
+                                  int scanline_len, unsigned char *out)
 {
     int bpc = m_sgi_header.bpc;
-    std::vector<unsigned char> rle_scanline (scanline_len);
-    fseek (m_fd, scanline_off, SEEK_SET);
-    fread (&rle_scanline[0], 1, scanline_len, m_fd);
     int limit = m_spec.width;
     int i = 0;
     if (bpc == 1) {
@@ -240,10 +207,13 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
             // If the count is zero, we're done
             if (! count)
                 break;
+            // Don't run past the end of the data or of the scanline
+            if (count > limit
+                || i + ((value & 0x80) ? count : 1) > scanline_len)
+                break;
             // If the high bit is set, we just copy the next 'count' values
             if (value & 0x80) {
                 while (count--) {
-                    DASSERT (i < scanline_len && limit > 0);
                     *(out++) = rle_scanline[i++];
                     --limit;
                 }
@@ -252,7 +222,6 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
             else {
                 value = rle_scanline[i++];
                 while (count--) {
-                    DASSERT (limit > 0);
                     *(out++) = value;
                     --limit;
                 }
@@ -261,7 +230,7 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
     } else {
         // 2 bits per channel
         ASSERT (bpc == 2);
-        while (i < scanline_len) {
+        while (i + 1 < scanline_len) {
             // Read a byte, it is the count.
             unsigned short value = (rle_scanline[i] << 8) | rle_scanline[i+1];
             i += 2;
@@ -269,23 +238,26 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
             // If the count is zero, we're done
             if (! count)
                 break;
+            // Don't run past the end of the data or of the scanline
+            if (count > limit
+                || i + 2 * ((value & 0x80) ? count : 1) > scanline_len)
+                break;
             // If the high bit is set, we just copy the next 'count' values
             if (value & 0x80) {
                 while (count--) {
-                    DASSERT (i+1 < scanline_len && limit > 0);
                     *(out++) = rle_scanline[i++];
                     *(out++) = rle_scanline[i++];
                     --limit;
                 }
             }
-            // If the high bit is zero, we copy the NEXT value, count times
+            // If the high bit is zero, we copy the NEXT value, count times,
+            // keeping it big-endian like the copied values above
             else {
-                value = (rle_scanline[i] << 8) | rle_scanline[i+1];
+                unsigned char hi = rle_scanline[i], lo = rle_scanline[i+1];
                 i += 2;
                 while (count--) {
-                    DASSERT (limit > 0);
-                    *(unsigned short *)out = value;
-                    out += 2;
+                    *(out++) = hi;
+                    *(out++) = lo;
                     --limit;
                 }
             }
@@ -293,7 +265,9 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
     }
     if (i != scanline_len || limit != 0) {
         error ("Corrupt RLE data");
+        return false;
     }
+    return true;
 }
 
 
@@ -301,58 +275,43 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
 bool
 SgiInput::close()
 {
-    if (m_fd)
-        fclose (m_fd);
     init ();
     return true;
 }
 
 
 
-void
+bool
 SgiInput::read_header()
 {
-    fread(&m_sgi_header.magic, sizeof(m_sgi_header.magic), 1, m_fd);
-    fread(&m_sgi_header.storage, sizeof(m_sgi_header.storage), 1, m_fd);
-    fread(&m_sgi_header.bpc, sizeof(m_sgi_header.bpc), 1, m_fd);
-    fread(&m_sgi_header.dimension, sizeof(m_sgi_header.dimension), 1, m_fd);
-    fread(&m_sgi_header.xsize, sizeof(m_sgi_header.xsize), 1, m_fd);
-    fread(&m_sgi_header.ysize, sizeof(m_sgi_header.ysize), 1, m_fd);
-    fread(&m_sgi_header.zsize, sizeof(m_sgi_header.zsize), 1, m_fd);
-    fread(&m_sgi_header.pixmin, sizeof(m_sgi_header.pixmin), 1, m_fd);
-    fread(&m_sgi_header.pixmax, sizeof(m_sgi_header.pixmax), 1, m_fd);
-    fread(&m_sgi_header.dummy, sizeof(m_sgi_header.dummy), 1, m_fd);
-    fread(&m_sgi_header.imagename, sizeof(m_sgi_header.imagename), 1, m_fd);
+    // All fields are big-endian
+    if (! m_file.read_be (&m_sgi_header.magic) ||
+        ! m_file.read_be (&m_sgi_header.storage) ||
+        ! m_file.read_be (&m_sgi_header.bpc) ||
+        ! m_file.read_be (&m_sgi_header.dimension) ||
+        ! m_file.read_be (&m_sgi_header.xsize) ||
+        ! m_file.read_be (&m_sgi_header.ysize) ||
+        ! m_file.read_be (&m_sgi_header.zsize) ||
+        ! m_file.read_be (&m_sgi_header.pixmin) ||
+        ! m_file.read_be (&m_sgi_header.pixmax) ||
+        ! m_file.read_be (&m_sgi_header.dummy) ||
+        ! m_file.read_be (m_sgi_header.imagename, 80) ||
+        ! m_file.read_be (&m_sgi_header.colormap))
+        return false;
     m_sgi_header.imagename[79] = '\0';
-    fread(&m_sgi_header.colormap, sizeof(m_sgi_header.colormap), 1, m_fd);
     //dont' read dummy bytes
-    fseek (m_fd, 404, SEEK_CUR);
-
-    if (littleendian()) {
-        swap_endian(&m_sgi_header.magic);
-        swap_endian(&m_sgi_header.dimension);
-        swap_endian(&m_sgi_header.xsize);
-        swap_endian(&m_sgi_header.ysize);
-        swap_endian(&m_sgi_header.zsize);
-        swap_endian(&m_sgi_header.pixmin);
-        swap_endian(&m_sgi_header.pixmax);
-        swap_endian(&m_sgi_header.colormap);
-    }
+    m_file.seek (sgi_pvt::SGI_HEADER_LEN);
+    return true;
 }
 
 
 
-void
+bool
 SgiInput::read_offset_tables ()
 {
     int tables_size = m_sgi_header.ysize * m_sgi_header.zsize;
     start_tab.resize(tables_size);
     length_tab.resize(tables_size);
-    fread (&start_tab[0], sizeof(uint32_t), tables_size, m_fd);
-    fread (&length_tab[0], sizeof(uint32_t), tables_size, m_fd);
-
-    if (littleendian ()) {
-        swap_endian (&length_tab[0], length_tab.size ());
-        swap_endian (&start_tab[0], start_tab.size());
-    }
+    return m_file.read_be (&start_tab[0], tables_size) &&
+           m_file.read_be (&length_tab[0], tables_size);
 }
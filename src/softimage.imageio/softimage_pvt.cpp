@@ -45,30 +45,16 @@ DLLEXPORT int softimage_imageio_version = OPENIMAGEIO_PLUGIN_VERSION;
 namespace softimage_pvt {
 
 
-void
-PicFileHeader::swap_endian()
-{
-    ::swap_endian (&magic);
-    ::swap_endian (&width);
-    ::swap_endian (&height);
-    ::swap_endian (&version);
-    ::swap_endian (&ratio);
-    ::swap_endian (&fields);
-}
-
-
-
 bool
-PicFileHeader::read_header (FILE* fd)
+PicFileHeader::read_header (Filesystem::BufferedReader &file)
 {
-    int byte_count = 0;
-    byte_count += fread (this, 1, sizeof (PicFileHeader), fd);
-    
-    // Check if we're running on a little endian processor
-    if (littleendian ())
-        swap_endian();
-        
-    return (byte_count == sizeof (PicFileHeader));
+    // All the numeric fields are stored big endian
+    return file.read_be (&magic) && file.read_be (&version)
+        && file.read (comment, sizeof (comment)) == sizeof (comment)
+        && file.read (id, sizeof (id)) == sizeof (id)
+        && file.read_be (&width) && file.read_be (&height)
+        && file.read_be (&ratio) && file.read_be (&fields)
+        && file.read_be (&pad);
 }
 
 
@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstdio>
 #include <fmath.h>
 #include <imageio.h>
+#include <filesystem.h>
 using namespace OpenImageIO;
 
 
@@ -47,7 +48,7 @@ namespace softimage_pvt
     {
     public:
         // Read pic header from file
-        bool read_header (FILE *fd);
+        bool read_header (Filesystem::BufferedReader &file);
         
         // PIC header
         uint32_t magic; // Softimage magic number
@@ -59,9 +60,6 @@ namespace softimage_pvt
         float ratio; // Pixel aspect ratio
         uint16_t fields; // The scanline setting - No Pictures, Odd, Even or every
         uint16_t pad; // unused
-
-    private:
-        void swap_endian();
     }; // class PicFileHeader
 
 
@@ -95,7 +93,8 @@ namespace softimage_pvt
     {
         UNCOMPRESSED,
         PURE_RUN_LENGTH,
-        MIXED_RUN_LENGTH
+        MIXED_RUN_LENGTH,
+        ENCODING_MASK = 0x3
     }; // enum encoding
 
 }; //namespace softimage_pvt
@@ -39,7 +39,7 @@ using namespace softimage_pvt;
 class SoftimageInput : public ImageInput
 {
 public:
-    SoftimageInput() {
+    SoftimageInput() : m_io_user(NULL) {
         init();
     }
     virtual ~SoftimageInput() {
@@ -51,32 +51,48 @@ public:
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool close();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
 
 private:
     /// Resets the core data members to defaults.
     ///
     void init ();
-    /// Read a scanline from m_fd.
+    /// Read a scanline from m_file.
     ///
     bool read_scanline (void * data);
-    /// Read uncompressed pixel data from m_fd.
+    /// Read uncompressed pixel data from m_file.
     ///
     bool read_pixels_uncompressed (const softimage_pvt::ChannelPacket & curPacket,
+                                   const std::vector<int> & channels,
                                    void * data);
     /// Read pure run length encoded pixels.
     ///
     bool read_pixels_pure_run_length (const softimage_pvt::ChannelPacket & curPacket,
+                                      const std::vector<int> & channels,
                                       void * data);
     /// Read mixed run length encoded pixels.
     ///
     bool read_pixels_mixed_run_length (const softimage_pvt::ChannelPacket & curPacket,
+                                       const std::vector<int> & channels,
                                        void * data);
+    /// Copy count pixels of big endian channel values, laid out one after
+    /// another in src (or the same pixel count times, if repeat is set),
+    /// into the native scanline data starting at pixel x.
+    ///
+    void put_pixels (const unsigned char *src, const std::vector<int> & channels,
+                     size_t pixelChannelSize, size_t x, size_t count,
+                     bool repeat, void * data);
     
-    FILE *m_fd;
+    Filesystem::BufferedReader m_file;
+    Filesystem::IOProxy *m_io_user;
     softimage_pvt::PicFileHeader m_pic_header;
     std::vector<softimage_pvt::ChannelPacket> m_channel_packets;
+    std::vector<std::vector<int> > m_packet_channels;  ///< channels() per packet
     std::string m_filename;
-    std::vector<fpos_t> m_scanline_markers;
+    std::vector<int64_t> m_scanline_markers;
 };
 
 
@@ -89,6 +105,12 @@ extern "C" {
     DLLEXPORT const char *softimage_input_extensions[] = {
         "pic", NULL
     };
+    DLLEXPORT bool softimage_input_signature (const unsigned char *header,
+                                              int nbytes) {
+        // Big-endian Pic magic number, 0x5380f634
+        return (nbytes >= 4 && header[0] == 0x53 && header[1] == 0x80
+                && header[2] == 0xF6 && header[3] == 0x34);
+    }
 }
 
 
@@ -96,9 +118,10 @@ extern "C" {
 void
 SoftimageInput::init ()
 {
-    m_fd = NULL;
+    m_file.close();
     m_filename.clear();
     m_channel_packets.clear();
+    m_packet_channels.clear();
     m_scanline_markers.clear();
 }
 
@@ -110,14 +133,13 @@ SoftimageInput::open (const std::string& name, ImageSpec& spec)
     // Remember the filename
     m_filename = name;
     
-    m_fd = fopen (m_filename.c_str(), "rb");
-    if (!m_fd) {
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (m_filename))) {
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
     
     // Try read the header
-    if (! m_pic_header.read_header (m_fd)) {
+    if (! m_pic_header.read_header (m_file)) {
         error ("\"%s\": failed to read header", m_filename.c_str());
         close();
         return false;
@@ -136,15 +158,16 @@ SoftimageInput::open (const std::string& name, ImageSpec& spec)
     int nchannels = 0;
     do {
         // Read the next packet into curPacket and store it off
-        if (fread (&curPacket, 1, sizeof (ChannelPacket), m_fd) != sizeof (ChannelPacket)) {
+        if (m_file.read (&curPacket, sizeof (ChannelPacket)) != sizeof (ChannelPacket)) {
             error ("Unexpected end of file \"%s\".", m_filename.c_str());
             close();
             return false;
         }
         m_channel_packets.push_back (curPacket);
+        m_packet_channels.push_back (curPacket.channels());
 
         // Add the number of channels in this packet to nchannels
-        nchannels += curPacket.channels().size();
+        nchannels += m_packet_channels.back().size();
     } while (curPacket.chained);
 
     // Get the depth per pixel per channel
@@ -157,9 +180,7 @@ SoftimageInput::open (const std::string& name, ImageSpec& spec)
     m_spec.attribute ("BitsPerSample", (int)curPacket.size);
     
     // Build the scanline index
-    fpos_t curPos;
-    fgetpos (m_fd, &curPos);
-    m_scanline_markers.push_back(curPos);
+    m_scanline_markers.push_back (m_file.tell());
 
     spec = m_spec;
     return true;
@@ -176,31 +197,25 @@ SoftimageInput::read_native_scanline (int y, int z, void* data)
         result = read_scanline(data);
         
         // save the marker for the next scanline if we haven't got the who images
-        if (m_scanline_markers.size() < m_pic_header.height) {
-            fpos_t curPos;
-            fgetpos(m_fd, &curPos);
-            m_scanline_markers.push_back(curPos);
-        }
+        if (m_scanline_markers.size() < m_pic_header.height)
+            m_scanline_markers.push_back (m_file.tell());
     } else if (y >= (int)m_scanline_markers.size()) {
         // we haven't yet read this far
-        fpos_t curPos;
         // Store the ones before this without pulling the pixels
         do {
             if (!read_scanline(NULL))
                 return false;
             
-            fgetpos(m_fd, &curPos);
-            m_scanline_markers.push_back(curPos);
+            m_scanline_markers.push_back (m_file.tell());
         } while ((int)m_scanline_markers.size() <= y);
         
         result = read_scanline(data);
-        fgetpos(m_fd, &curPos);
-        m_scanline_markers.push_back(curPos);
+        m_scanline_markers.push_back (m_file.tell());
     } else {
         // We've already got the index for this scanline and moved past
 
         // Let's seek to the scanline's data
-        if (fsetpos (m_fd, &m_scanline_markers[y])) {
+        if (! m_file.seek (m_scanline_markers[y])) {
             error ("Failed to seek to scanline %d in \"%s\"", y, m_filename.c_str());
             close();
             return false;
@@ -210,7 +225,7 @@ SoftimageInput::read_native_scanline (int y, int z, void* data)
 
         // If the index isn't complete let's shift the file pointer back to the latest readline
         if (m_scanline_markers.size() < m_pic_header.height) {
-            if (fsetpos (m_fd, &m_scanline_markers[m_scanline_markers.size() - 1])) {
+            if (! m_file.seek (m_scanline_markers[m_scanline_markers.size() - 1])) {
                 error ("Failed to restore to scanline %lu in \"%s\"", m_scanline_markers.size() - 1, m_filename.c_str());
                 close();
                 return false;
@@ -226,10 +241,6 @@ SoftimageInput::read_native_scanline (int y, int z, void* data)
 bool
 SoftimageInput::close()
 {
-    if (m_fd) {
-        fclose (m_fd);
-        m_fd = NULL;
-    }
     init ();
     return true;
 }
@@ -242,24 +253,34 @@ SoftimageInput::read_scanline (void * data)
     // Each scanline is stored using one or more channel packets.
     // We go through each of those to pull the data
     for (size_t i = 0;  i < m_channel_packets.size();  i++) {
-        if (m_channel_packets[i].type & UNCOMPRESSED) {
-            if (!read_pixels_uncompressed (m_channel_packets[i], data)) {
+        const ChannelPacket &packet (m_channel_packets[i]);
+        const std::vector<int> &channels (m_packet_channels[i]);
+        switch (packet.type & ENCODING_MASK) {
+        case UNCOMPRESSED :
+            if (!read_pixels_uncompressed (packet, channels, data)) {
                 error ("Failed to read uncompressed pixel data from \"%s\"", m_filename.c_str());
                 close();
                 return false;
             }
-        } else if (m_channel_packets[i].type & PURE_RUN_LENGTH) {
-            if (!read_pixels_pure_run_length (m_channel_packets[i], data)) {
+            break;
+        case PURE_RUN_LENGTH :
+            if (!read_pixels_pure_run_length (packet, channels, data)) {
                 error ("Failed to read pure run length encoded pixel data from \"%s\"", m_filename.c_str());
                 close();
                 return false;
             }
-        } else if (m_channel_packets[i].type & MIXED_RUN_LENGTH) {
-            if (!read_pixels_mixed_run_length (m_channel_packets[i], data)) {
+            break;
+        case MIXED_RUN_LENGTH :
+            if (!read_pixels_mixed_run_length (packet, channels, data)) {
                 error ("Failed to read mixed run length encoded pixel data from \"%s\"", m_filename.c_str());
                 close();
                 return false;
             }
+            break;
+        default :
+            error ("Unknown pixel encoding %d in \"%s\"", (int)packet.type, m_filename.c_str());
+            close();
+            return false;
         }
     }
     return true;
@@ -267,90 +288,83 @@ SoftimageInput::read_scanline (void * data)
 
 
 
+inline void
+SoftimageInput::put_pixels (const unsigned char *src, const std::vector<int> & channels,
+                            size_t pixelChannelSize, size_t x, size_t count,
+                            bool repeat, void * data)
+{
+    uint8_t * scanlineData = (uint8_t *)data;
+    size_t pixelSize = pixelChannelSize * channels.size();
+    size_t dstPixelSize = pixelChannelSize * m_spec.nchannels;
+    // Channel values are big endian in the file; reverse the bytes of
+    // each one on a little endian machine
+    bool swap = littleendian();
+    for (size_t pixelX = x;  pixelX < x + count;  pixelX++) {
+        uint8_t * dst = scanlineData + pixelX * dstPixelSize;
+        for (size_t curChan = 0;  curChan < channels.size();  curChan++) {
+            uint8_t * chanDst = dst + channels[curChan] * pixelChannelSize;
+            const unsigned char *chanSrc = src + curChan * pixelChannelSize;
+            for (size_t byte = 0;  byte < pixelChannelSize;  byte++)
+                chanDst[swap ? pixelChannelSize - 1 - byte : byte] = chanSrc[byte];
+        }
+        if (! repeat)
+            src += pixelSize;
+    }
+}
+
+
+
 inline bool
-SoftimageInput::read_pixels_uncompressed (const softimage_pvt::ChannelPacket & curPacket, void * data)
+SoftimageInput::read_pixels_uncompressed (const softimage_pvt::ChannelPacket & curPacket,
+                                          const std::vector<int> & channels,
+                                          void * data)
 {
-    // We're going to need to use the channels more than once
-    std::vector<int> channels = curPacket.channels();
     // We'll need to use the pixelChannelSize a bit
     size_t pixelChannelSize = curPacket.size / 8;
-    
-    if (data) {
-        // data pointer is set so we're supposed to write data there
-        uint8_t * scanlineData = (uint8_t *)data;
-        for (size_t pixelX=0; pixelX < m_pic_header.width; pixelX++) {
-            for (size_t curChan=0; curChan < channels.size(); curChan++) {
-                for (size_t byte=0; byte < pixelChannelSize; byte++) {
-                    // Get which byte we should be placing this in depending on endianness
-                    size_t curByte = byte;
-                    if (littleendian())
-                        curByte = ((pixelChannelSize) - 1) - curByte;
-
-                    //read the data into the correct place
-                    if (fread (&scanlineData[(pixelX * pixelChannelSize * m_spec.nchannels) + (channels[curChan] * pixelChannelSize) + curByte],
-                        1, 1, m_fd) != 1)
-                        return false;
-                }
-            }
-        }
-    } else {
-        // data pointer is null so we should just seek to the next scanline
-        // If the seek fails return false
-        if (fseek (m_fd, m_pic_header.width * pixelChannelSize * channels.size(), SEEK_CUR))
-            return false;
-    }
+    size_t pixelSize = pixelChannelSize * channels.size();
+
+    // Take the whole row straight from the reader's buffer
+    const unsigned char *src = m_file.next (m_pic_header.width * pixelSize);
+    if (! src)
+        return false;
+    // If the data pointer is null we're just moving on to the next scanline
+    if (data)
+        put_pixels (src, channels, pixelChannelSize, 0, m_pic_header.width,
+                    false, data);
     return true;
 }
 
 
 
 inline bool
-SoftimageInput::read_pixels_pure_run_length (const softimage_pvt::ChannelPacket & curPacket, void * data)
+SoftimageInput::read_pixels_pure_run_length (const softimage_pvt::ChannelPacket & curPacket,
+                                             const std::vector<int> & channels,
+                                             void * data)
 {
     // How many pixels we've read so far this line
     size_t linePixelCount = 0;
-    // Number of repeats of this value
-    uint8_t curCount = 0;
     // We'll need to use the pixelChannelSize a bit
     size_t pixelChannelSize = curPacket.size / 8;
-    // We're going to need to use the channels more than once
-    std::vector<int> channels = curPacket.channels();
+    size_t pixelSize = pixelChannelSize * channels.size();
     // Read the pixels until we've read them all
     while (linePixelCount < m_pic_header.width) {
-        // Read the repeats for the run length - return false if read fails
-        if (fread (&curCount, 1, 1, m_fd) != 1)
+        // Read the repeats for the run length and the pixel value that
+        // follows them - return false if read fails
+        const unsigned char *packet = m_file.next (1 + pixelSize);
+        if (! packet)
             return false;
+        size_t curCount = packet[0];
 
-        if (data) {
-            // data pointer is set so we're supposed to write data there
-            size_t pixelSize = pixelChannelSize * channels.size();
-            uint8_t * pixelData = new uint8_t[pixelSize];
-            if (fread (pixelData, pixelSize, 1, m_fd) != pixelSize)
-                return false;
+        // Just to be safe let's make sure this wouldn't take us
+        // past the end of this scanline
+        if (curCount + linePixelCount > m_pic_header.width)
+            curCount = m_pic_header.width - linePixelCount;
 
-            // Now we've got the pixel value we need to push it into the data
-            uint8_t * scanlineData = (uint8_t *)data;
-            for (size_t pixelX=linePixelCount; pixelX < linePixelCount+curCount; pixelX++) {
-                for (size_t curChan=0; curChan < channels.size(); curChan++) {
-                    for (size_t byte=0; byte < pixelChannelSize; byte++) {
-                        // Get which byte we should be placing this in depending on endianness
-                        size_t curByte = byte;
-                        if (littleendian())
-                            curByte = ((pixelChannelSize) - 1) - curByte;
-                        
-                        //put the data into the correct place
-                        scanlineData[(pixelX * pixelChannelSize * m_spec.nchannels) + (channels[curChan] * pixelChannelSize) + curByte] =
-                            pixelData[(curChan * pixelChannelSize) + curByte];
-                    }
-                }
-            }
-            delete[] pixelData;
-        } else {
-            // data pointer is null so we should just seek to the next scanline
-            // If the seek fails return false
-            if (fseek (m_fd, pixelChannelSize * channels.size(), SEEK_CUR))
-                return false;
-        }
+        // If the data pointer is null we're just moving on to the next
+        // scanline
+        if (data)
+            put_pixels (packet + 1, channels, pixelChannelSize,
+                        linePixelCount, curCount, true, data);
 
         // Add these pixels to the current pixel count
         linePixelCount += curCount;
@@ -361,55 +375,40 @@ SoftimageInput::read_pixels_pure_run_length (const softimage_pvt::ChannelPacket
 
 
 inline bool
-SoftimageInput::read_pixels_mixed_run_length (const softimage_pvt::ChannelPacket & curPacket, void * data)
+SoftimageInput::read_pixels_mixed_run_length (const softimage_pvt::ChannelPacket & curPacket,
+                                              const std::vector<int> & channels,
+                                              void * data)
 {
     // How many pixels we've read so far this line
     size_t linePixelCount = 0;
-    // Number of repeats of this value
-    uint8_t curCount = 0;
     // We'll need to use the pixelChannelSize a bit
     size_t pixelChannelSize = curPacket.size / 8;
-    // We're going to need to use the channels more than once
-    std::vector<int> channels = curPacket.channels();
+    size_t pixelSize = pixelChannelSize * channels.size();
     // Read the pixels until we've read them all
     while (linePixelCount < m_pic_header.width) {
         // Read the repeats for the run length - return false if read fails
-        if (fread (&curCount, 1, 1, m_fd) != 1)
+        int curCount = m_file.getc();
+        if (curCount < 0)
             return false;
 
         if (curCount < 128) {
             // It's a raw packet - so this means the count is 1 less then the actual value
             curCount++;
+
+            const unsigned char *src = m_file.next (curCount * pixelSize);
+            if (! src)
+                return false;
             
             // Just to be safe let's make sure this wouldn't take us
             // past the end of this scanline
             if (curCount + linePixelCount > m_pic_header.width)
                 curCount = m_pic_header.width - linePixelCount;
             
-            if (data) {
-                // data pointer is set so we're supposed to write data there
-                uint8_t * scanlineData = (uint8_t *)data;
-                for (size_t pixelX=linePixelCount; pixelX < linePixelCount+curCount; pixelX++) {
-                    for (size_t curChan=0; curChan < channels.size(); curChan++) {
-                        for (size_t byte=0; byte < pixelChannelSize; byte++) {
-                            // Get which byte we should be placing this in depending on endianness
-                            size_t curByte = byte;
-                            if (littleendian())
-                                curByte = ((pixelChannelSize) - 1) - curByte;
-                            
-                            //read the data into the correct place
-                            if (fread (&scanlineData[(pixelX * pixelChannelSize * m_spec.nchannels) + (channels[curChan] * pixelChannelSize) + curByte],
-                                1, 1, m_fd) != 1)
-                                return false;
-                        }
-                    }
-                }
-            } else {
-                // data pointer is null so we should just seek to the
-                // next scanline If the seek fails return false.
-                if (fseek (m_fd, curCount * pixelChannelSize * channels.size(), SEEK_CUR))
-                    return false;
-            }
+            // If the data pointer is null we're just moving on to the
+            // next scanline
+            if (data)
+                put_pixels (src, channels, pixelChannelSize, linePixelCount,
+                            curCount, false, data);
 
             // Add these pixels to the current pixel count
             linePixelCount += curCount;
@@ -421,49 +420,26 @@ SoftimageInput::read_pixels_mixed_run_length (const softimage_pvt::ChannelPacket
                 // This is a long count so the next 16bits of the file
                 // are an unsigned int containing the count.  If the
                 // read fails we should return false.
-                if (fread (&longCount, 1, 2, m_fd) != 2)
+                if (! m_file.read_be (&longCount))
                     return false;
-
-                // longCount is in big endian format - if we're not
-                // let's swap it
-                if (littleendian())
-                    ::swap_endian (&longCount);
             } else {
                 longCount = curCount - 127;
             }
 
-            if (data) {
-                // data pointer is set so we're supposed to write data there
-                size_t pixelSize = pixelChannelSize * channels.size();
-                uint8_t * pixelData = new uint8_t[pixelSize];
-                if (fread (pixelData, 1, pixelSize, m_fd) != pixelSize)
-                    return false;
-                
-                // Now we've got the pixel value we need to push it into
-                // the data.
-                uint8_t * scanlineData = (uint8_t *)data;
-                for (size_t pixelX=linePixelCount; pixelX < linePixelCount+longCount; pixelX++) {
-                    for (size_t curChan=0; curChan < channels.size(); curChan++) {
-                        for (size_t byte=0; byte < pixelChannelSize; byte++) {
-                            // Get which byte we should be placing this
-                            // in depending on endianness.
-                            size_t curByte = byte;
-                            if (littleendian())
-                                curByte = ((pixelChannelSize) - 1) - curByte;
-                            
-                            //put the data into the correct place
-                            scanlineData[(pixelX * pixelChannelSize * m_spec.nchannels) + (channels[curChan] * pixelChannelSize) + curByte] =
-                                pixelData[(curChan * pixelChannelSize) + curByte];
-                        }
-                    }
-                }
-                delete[] pixelData;
-            } else {
-                // data pointer is null so we should just seek to the
-                // next scanline.  If the seek fails return false.
-                if (fseek (m_fd, pixelChannelSize * channels.size(), SEEK_CUR))
-                    return false;
-            }
+            const unsigned char *src = m_file.next (pixelSize);
+            if (! src)
+                return false;
+
+            // Just to be safe let's make sure this wouldn't take us
+            // past the end of this scanline
+            if (longCount + linePixelCount > m_pic_header.width)
+                longCount = m_pic_header.width - linePixelCount;
+
+            // If the data pointer is null we're just moving on to the
+            // next scanline
+            if (data)
+                put_pixels (src, channels, pixelChannelSize, linePixelCount,
+                            longCount, true, data);
             
             // Add these pixels to the current pixel count.
             linePixelCount += longCount;
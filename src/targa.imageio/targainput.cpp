@@ -39,6 +39,7 @@ using namespace TGA_pvt;
 #include "typedesc.h"
 #include "imageio.h"
 #include "fmath.h"
+#include "filesystem.h"
 
 using namespace OpenImageIO;
 
@@ -46,16 +47,21 @@ using namespace OpenImageIO;
 
 class TGAInput : public ImageInput {
 public:
-    TGAInput () { init(); }
+    TGAInput () : m_io_user(NULL) { init(); }
     virtual ~TGAInput () { close(); }
     virtual const char * format_name (void) const { return "targa"; }
     virtual bool open (const std::string &name, ImageSpec &newspec);
     virtual bool close ();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io_user = ioproxy;
+        return true;
+    }
 
 private:
     std::string m_filename;           ///< Stash the filename
-    FILE *m_file;                     ///< Open image handle
+    Filesystem::BufferedReader m_file;  ///< Where we read from
+    Filesystem::IOProxy *m_io_user;   ///< Proxy from set_ioproxy(), if any
     tga_header m_tga;                 ///< Targa header
     tga_footer m_foot;                ///< Targa 2.0 footer
     unsigned int m_ofs_colcorr_tbl;   ///< Offset to colour correction table
@@ -65,7 +71,6 @@ private:
     /// Reset everything to initial state
     ///
     void init () {
-        m_file = NULL;
         m_buf.clear ();
         m_ofs_colcorr_tbl = 0;
         m_alpha = TGA_ALPHA_NONE;
@@ -94,6 +99,31 @@ DLLEXPORT const char * targa_input_extensions[] = {
     "tga", NULL
 };
 
+DLLEXPORT bool
+targa_input_signature (const unsigned char *header, int nbytes)
+{
+    // TGA has no magic number, so make the same sanity checks of the
+    // 18-byte header that open() does.
+    if (nbytes < 18)
+        return false;
+    int cmap_type = header[1], type = header[2];
+    int cmap_size = header[7], bpp = header[16];
+    if (cmap_type != 0 && cmap_type != 1)
+        return false;
+    if (type != TYPE_PALETTED && type != TYPE_RGB && type != TYPE_GRAY
+        && type != TYPE_PALETTED_RLE && type != TYPE_RGB_RLE
+        && type != TYPE_GRAY_RLE)
+        return false;
+    if (bpp != 8 && bpp != 15 && bpp != 16 && bpp != 24 && bpp != 32)
+        return false;
+    if (cmap_type && (type == TYPE_GRAY || type == TYPE_GRAY_RLE))
+        return false;
+    if (cmap_type && cmap_size != 15 && cmap_size != 16
+        && cmap_size != 24 && cmap_size != 32)
+        return false;
+    return true;
+}
+
 };
 
 
@@ -103,44 +133,24 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
 {
     m_filename = name;
 
-    m_file = fopen (name.c_str(), "rb");
-    if (! m_file) {
+    if (! (m_io_user ? m_file.open (m_io_user) : m_file.open (name))) {
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
 
     // due to struct packing, we may get a corrupt header if we just load the
     // struct from file; to adress that, read every member individually
+    // (TGAs are little-endian)
     // save some typing
-#define RH(memb)    fread (&m_tga.memb, sizeof (m_tga.memb), 1, m_file)
-    RH(idlen);
-    RH(cmap_type);
-    RH(type);
-    RH(cmap_first);
-    RH(cmap_length);
-    RH(cmap_size);
-    RH(x_origin);
-    RH(y_origin);
-    RH(width);
-    RH(height);
-    RH(bpp);
-    RH(attr);
-#undef RH
-    if (bigendian()) {
-        // TGAs are little-endian
-        swap_endian (&m_tga.idlen);
-        swap_endian (&m_tga.cmap_type);
-        swap_endian (&m_tga.type);
-        swap_endian (&m_tga.cmap_first);
-        swap_endian (&m_tga.cmap_length);
-        swap_endian (&m_tga.cmap_size);
-        swap_endian (&m_tga.x_origin);
-        swap_endian (&m_tga.y_origin);
-        swap_endian (&m_tga.width);
-        swap_endian (&m_tga.height);
-        swap_endian (&m_tga.bpp);
-        swap_endian (&m_tga.attr);
+#define RH(memb)    m_file.read_le (&m_tga.memb)
+    if (! (RH(idlen) && RH(cmap_type) && RH(type) && RH(cmap_first)
+           && RH(cmap_length) && RH(cmap_size) && RH(x_origin)
+           && RH(y_origin) && RH(width) && RH(height) && RH(bpp)
+           && RH(attr))) {
+        error ("\"%s\": could not read the header", name.c_str());
+        return false;
     }
+#undef RH
 
     if (m_tga.bpp != 8 && m_tga.bpp != 15 && m_tga.bpp != 16
         && m_tga.bpp != 24 && m_tga.bpp != 32) {
@@ -210,35 +220,32 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
         // in case the comment lacks null termination
         char id[256];
         memset (id, 0, sizeof (id));
-        fread (id, m_tga.idlen, 1, m_file);
+        m_file.read (id, m_tga.idlen);
         m_spec.attribute ("targa:ImageID", id);
     }
 
-    int ofs = ftell (m_file);
+    int64_t ofs = m_file.tell ();
     // now try and see if it's a TGA 2.0 image
-    fseek (m_file, -26, SEEK_END);
-    fread (&m_foot.ofs_ext, sizeof (m_foot.ofs_ext), 1, m_file);
-    fread (&m_foot.ofs_dev, sizeof (m_foot.ofs_dev), 1, m_file);
-    fread (&m_foot.signature, sizeof (m_foot.signature), 1, m_file);
+    memset (&m_foot, 0, sizeof (m_foot));
+    if (m_file.size () >= 26) {
+        m_file.seek (m_file.size () - 26);
+        m_file.read_le (&m_foot.ofs_ext);
+        m_file.read_le (&m_foot.ofs_dev);
+        m_file.read (&m_foot.signature, sizeof (m_foot.signature));
+    }
     // TGA 2.0 files are identified by a nifty "TRUEVISION-XFILE.\0" signature
     if (!strncmp (m_foot.signature, "TRUEVISION-XFILE.", 17)) {
         //std::cerr << "[tga] this is a TGA 2.0 file\n";
-        if (bigendian()) {
-            swap_endian (&m_foot.ofs_ext);
-            swap_endian (&m_foot.ofs_dev);
-        }
 
         // read the extension area
-        fseek (m_file, m_foot.ofs_ext, SEEK_SET);
+        m_file.seek (m_foot.ofs_ext);
         // check if this is a TGA 2.0 extension area
         // according to the 2.0 spec, the size for valid 2.0 files is exactly
         // 495 bytes, and the reader should only read as much as it understands
         // for < 495, we ignore this section of the file altogether
         // for > 495, we only read what we know
-        uint16_t s;
-        fread (&s, 2, 1, m_file);
-        if (bigendian())
-            swap_endian (&s);
+        uint16_t s = 0;
+        m_file.read_le (&s);
         //std::cerr << "[tga] extension area size: " << s << "\n";
         if (s >= 495) {
             union {
@@ -248,12 +255,12 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
             } buf;
             
             // load image author
-            fread (buf.c, 41, 1, m_file);
+            m_file.read (buf.c, 41);
             if (buf.c[0])
                 m_spec.attribute ("Artist", (char *)buf.c);
             
             // load image comments
-            fread (buf.c, 324, 1, m_file);
+            m_file.read (buf.c, 324);
             // concatenate the lines into a single string
             std::string tmpstr ((const char *)buf.c);
             if (buf.c[81]) {
@@ -272,17 +279,9 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
                 m_spec.attribute ("ImageDescription", tmpstr);
 
             // timestamp
-            fread (buf.s, 2, 6, m_file);
+            m_file.read_le (buf.s, 6);
             if (buf.s[0] || buf.s[1] || buf.s[2]
                 || buf.s[3] || buf.s[4] || buf.s[5]) {
-                if (bigendian()) {
-                    swap_endian (&buf.s[0]);
-                    swap_endian (&buf.s[1]);
-                    swap_endian (&buf.s[2]);
-                    swap_endian (&buf.s[3]);
-                    swap_endian (&buf.s[4]);
-                    swap_endian (&buf.s[5]);
-                }
                 sprintf ((char *)&buf.c[12], "%04u:%02u:%02u %02u:%02u:%02u",
                          buf.s[2], buf.s[0], buf.s[1],
                          buf.s[3], buf.s[4], buf.s[5]);
@@ -290,59 +289,46 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
             }
 
             // job name/ID
-            fread (buf.c, 41, 1, m_file);
+            m_file.read (buf.c, 41);
             if (buf.c[0])
                 m_spec.attribute ("DocumentName", (char *)buf.c);
 
             // job time
-            fread (buf.s, 2, 3, m_file);
+            m_file.read_le (buf.s, 3);
             if (buf.s[0] || buf.s[1] || buf.s[2]) {
-                if (bigendian()) {
-                    swap_endian (&buf.s[0]);
-                    swap_endian (&buf.s[1]);
-                    swap_endian (&buf.s[2]);
-                }
                 sprintf ((char *)&buf.c[6], "%u:%02u:%02u",
                           buf.s[0], buf.s[1], buf.s[2]);
                 m_spec.attribute ("targa:JobTime", (char *)&buf.c[6]);
             }
 
             // software
-            fread (buf.c, 41, 1, m_file);
+            m_file.read (buf.c, 41);
             if (buf.c[0]) {
                 // tack on the version number and letter
-                uint16_t n;
-                char l;
-                fread (&n, 2, 1, m_file);
-                fread (&l, 1, 1, m_file);
+                uint16_t n = 0;
+                char l = 0;
+                m_file.read_le (&n);
+                m_file.read (&l, 1);
                 sprintf ((char *)&buf.c[strlen ((char *)buf.c)], " %u.%u%c",
                          n / 100, n % 100, l != ' ' ? l : 0);
                 m_spec.attribute ("Software", (char *)buf.c);
             }
 
             // background (key) colour
-            fread (buf.c, 4, 1, m_file);
+            m_file.read (buf.c, 4);
             // FIXME: what do we do with it?
 
             // aspect ratio
-            fread (buf.s, 2, 2, m_file);
+            m_file.read_le (buf.s, 2);
             // if the denominator is zero, it's unused
             if (buf.s[1]) {
-                if (bigendian()) {
-                    swap_endian (&buf.s[0]);
-                    swap_endian (&buf.s[1]);
-                }
                 m_spec.attribute ("PixelAspectRatio", (float)buf.s[0] / (float)buf.s[1]);
             }
 
             // gamma
-            fread (buf.s, 2, 2, m_file);
+            m_file.read_le (buf.s, 2);
             // if the denominator is zero, it's unused
             if (buf.s[1]) {
-                if (bigendian()) {
-                    swap_endian (&buf.s[0]);
-                    swap_endian (&buf.s[1]);
-                }
                 m_spec.gamma = (float)buf.s[0] / (float)buf.s[1];
                 if (m_spec.gamma == 1.f)
                     m_spec.linearity = ImageSpec::Linear;
@@ -351,39 +337,35 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
             }
 
             // offset to colour correction table
-            fread (&buf.l, 4, 1, m_file);
-            if (bigendian())
-                swap_endian (&buf.l);
+            m_file.read_le (&buf.l);
             m_ofs_colcorr_tbl = buf.l;
             /*std::cerr << "[tga] colour correction table offset: "
                       << (int)m_ofs_colcorr_tbl << "\n";*/
 
             // offset to thumbnail
-            fread (&buf.l, 4, 1, m_file);
-            if (bigendian())
-                swap_endian (&buf.l);
+            m_file.read_le (&buf.l);
             unsigned int ofs_thumb = buf.l;
 
             // offset to scan-line table
-            fread (&buf.l, 4, 1, m_file);
+            m_file.read_le (&buf.l);
             // TODO: can we find any use for this? we can't advertise random
             // access anyway, because not all RLE-compressed files will have
             // this table
 
             // alpha type
-            fread (buf.c, 1, 1, m_file);
+            m_file.read (buf.c, 1);
             m_alpha = (tga_alpha_type)buf.c[0];
 
             // now load the thumbnail
             if (ofs_thumb) {
-                fseek (m_file, ofs_thumb, SEEK_SET);
+                m_file.seek (ofs_thumb);
                 
                 // most of this code is a dupe of readimg(); according to the
                 // spec, the thumbnail is in the same format as the main image
                 // but uncompressed
 
                 // thumbnail dimensions
-                fread (&buf.c, 2, 1, m_file);
+                m_file.read (buf.c, 2);
                 m_spec.attribute ("thumbnail_width", (int)buf.c[0]);
                 m_spec.attribute ("thumbnail_height", (int)buf.c[1]);
                 m_spec.attribute ("thumbnail_nchannels", m_spec.nchannels);
@@ -400,17 +382,17 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
                 // read palette, if there is any
                 unsigned char *palette = NULL;
                 if (m_tga.cmap_type) {
-                    fseek (m_file, ofs, SEEK_SET);
+                    m_file.seek (ofs);
                     palette = new unsigned char[palbytespp
                                                 * m_tga.cmap_length];
-                    fread (palette, palbytespp, m_tga.cmap_length, m_file);
-                    fseek (m_file, ofs_thumb + 2, SEEK_SET);
+                    m_file.read (palette, palbytespp * m_tga.cmap_length);
+                    m_file.seek (ofs_thumb + 2);
                 }
                 unsigned char pixel[4];
                 unsigned char in[4];
                 for (int y = buf.c[1] - 1; y >= 0; y--) {
                     for (int x = 0; x < buf.c[0]; x++) {
-                        fread (in, bytespp, 1, m_file);
+                        m_file.read (in, bytespp);
                         decode_pixel (in, pixel, palette,
                                       bytespp, palbytespp, alphabits);
                         memcpy (&m_buf[y * buf.c[0] * m_spec.nchannels
@@ -432,7 +414,7 @@ TGAInput::open (const std::string &name, ImageSpec &newspec)
         // that it's missing :)
     }
 
-    fseek (m_file, ofs, SEEK_SET);
+    m_file.seek (ofs);
 
     newspec = spec ();
     return true;
@@ -574,16 +556,23 @@ TGAInput::readimg ()
     unsigned char *palette = NULL;
     if (m_tga.cmap_type) {
         palette = new unsigned char[palbytespp * m_tga.cmap_length];
-        fread (palette, palbytespp, m_tga.cmap_length, m_file);
+        m_file.read (palette, palbytespp * m_tga.cmap_length);
     }
 
     unsigned char pixel[4];
     if (m_tga.type < TYPE_PALETTED_RLE) {
-        // uncompressed image data
+        // uncompressed image data, taken a whole scanline at a time
+        // straight from the reader's buffer
         unsigned char in[4];
         for (int y = m_spec.height - 1; y >= 0; y--) {
+            const unsigned char *row = m_file.next (m_spec.width * bytespp);
+            if (! row) {
+                error ("Unexpected end of file");
+                delete [] palette;
+                return false;
+            }
             for (int x = 0; x < m_spec.width; x++) {
-                fread (in, bytespp, 1, m_file);
+                memcpy (in, row + x * bytespp, bytespp);
                 decode_pixel (in, pixel, palette,
                               bytespp, palbytespp, alphabits);
                 memcpy (&m_buf[y * m_spec.width * m_spec.nchannels
@@ -597,7 +586,7 @@ TGAInput::readimg ()
         int packet_size;
         for (int y = m_spec.height - 1; y >= 0; y--) {
             for (int x = 0; x < m_spec.width; x++) {
-                fread (in, 1 + bytespp, 1, m_file);
+                m_file.read (in, 1 + bytespp);
                 packet_size = 1 + (in[0] & 0x7f);
                 decode_pixel (&in[1], pixel, palette,
                               bytespp, palbytespp, alphabits);
@@ -638,7 +627,7 @@ TGAInput::readimg ()
                                     goto loop_break;
                             }
                             // skip the packet header byte
-                            fread (&in[1], bytespp, 1, m_file);
+                            m_file.read (&in[1], bytespp);
                             decode_pixel(&in[1], pixel, palette,
                                          bytespp, palbytespp, alphabits);
                         }
@@ -692,11 +681,7 @@ TGAInput::readimg ()
 bool
 TGAInput::close ()
 {
-    if (m_file) {
-        fclose (m_file);
-        m_file = NULL;
-    }
-
+    m_file.close ();
     init();  // Reset to initial state
     return true;
 }
@@ -706,8 +691,8 @@ TGAInput::close ()
 bool
 TGAInput::read_native_scanline (int y, int z, void *data)
 {
-    if (m_buf.empty ())
-        readimg ();
+    if (m_buf.empty () && ! readimg ())
+        return false;
 
     if (m_tga.attr & FLAG_Y_FLIP)
         y = m_spec.height - y - 1;
@@ -48,6 +48,7 @@ using namespace OpenImageIO;
 #include "fmath.h"
 #include "sysutil.h"
 #include "strutil.h"
+#include "timer.h"
 
 
 static std::vector<std::string> filenames;
@@ -66,6 +67,8 @@ static bool nowarp = false;
 static float cachesize = -1;
 static int maxfiles = -1;
 static float missing[4] = {-1, 0, 0, 1};
+static bool bench = false;
+static bool stochastic = false;
 
 
 
@@ -104,6 +107,8 @@ getargs (int argc, const char *argv[])
                   "--nowarp", &nowarp, "Do not warp the image->texture mapping",
                   "--cachesize %g", &cachesize, "Set cache size, in MB",
                   "--maxfiles %d", &maxfiles, "Set maximum open files",
+                  "--bench", &bench, "Time the texture lookups only (no output image)",
+                  "--stochastic", &stochastic, "Use stochastic MIP/aniso sampling",
                   NULL);
     if (ap.parse (argc, argv) < 0) {
         std::cerr << ap.geterror() << std::endl;
@@ -215,8 +220,15 @@ test_plain_texture ()
     float *dsdy = ALLOCA (float, shadepoints);
     float *dtdy = ALLOCA (float, shadepoints);
     float *result = ALLOCA (float, shadepoints*nchannels);
+    float *rnd = ALLOCA (float, shadepoints);
+    if (stochastic) {
+        opt.mipmode = TextureOptions::MipModeStochastic;
+        opt.random.init (rnd, sizeof(float));
+    }
     
     ustring filename = ustring (filenames[0]);
+    Timer lookuptimer (false);
+    long long nlookups = 0;
 
     for (int iter = 0;  iter < iters;  ++iter) {
         if (iters > 1 && filenames.size() > 1) {
@@ -265,7 +277,13 @@ test_plain_texture ()
                                 dsdy[idx] = coordy[0] - coord[0];
                                 dtdy[idx] = coordy[1] - coord[1];
                             }
+                            // Cheap hash of the pixel for a repeatable
+                            // random number in [0,1)
+                            unsigned int h = (x * 73856093u) ^ (y * 19349663u) ^ (iter * 83492791u);
+                            h ^= h >> 13;  h *= 0x5bd1e995u;  h ^= h >> 15;
+                            rnd[idx] = (h & 0xffffff) * (1.0f / 16777216.0f);
                             runflags[idx] = RunFlagOn;
+                            ++nlookups;
                         } else {
                             runflags[idx] = RunFlagOff;
                         }
@@ -273,10 +291,12 @@ test_plain_texture ()
                     }
                 }
                 // Call the texture system to do the filtering.
+                lookuptimer.start ();
                 bool ok = texsys->texture (filename, opt, runflags, 0, shadepoints,
                                            Varying(s), Varying(t),
                                            Varying(dsdx), Varying(dtdx),
                                            Varying(dsdy), Varying(dtdy), result);
+                lookuptimer.stop ();
                 if (! ok) {
                     std::string e = texsys->geterror ();
                     if (! e.empty())
@@ -296,7 +316,16 @@ test_plain_texture ()
             }
         }
     }
-    
+
+    if (bench) {
+        double t = lookuptimer ();
+        std::cout << "Texture lookups: " << nlookups << " in "
+                  << Strutil::timeintervalformat (t, 3) << " = "
+                  << Strutil::format ("%.1f", t > 0 ? nlookups / t * 1.0e-6 : 0.0)
+                  << " Mlookups/sec\n";
+        return;
+    }
+
     if (! image.save ()) 
         std::cerr << "Error writing " << output_filename 
                   << " : " << image.geterror() << "\n";
@@ -318,7 +347,8 @@ test_environment (ustring filename)
 
 
 
-static void
+// Return false if get_texels_gather failed or disagreed with get_texels.
+static bool
 test_getimagespec_gettexels (ustring filename)
 {
     ImageSpec spec;
@@ -327,7 +357,7 @@ test_getimagespec_gettexels (ustring filename)
         std::string e = texsys->geterror ();
         if (! e.empty())
             std::cerr << "ERROR: " << e << "\n";
-        return;
+        return true;
     }
     int w = spec.width/2, h = spec.height/2;
     ImageSpec postagespec (w, h, spec.nchannels, TypeDesc::FLOAT);
@@ -347,6 +377,30 @@ test_getimagespec_gettexels (ustring filename)
             buf.setpixel (x, y, &tmp[offset]);
         }
     buf.save ();
+
+    // Gather a scattered set of the same texels, back to front, and
+    // make sure they match what get_texels gave us.
+    int npoints = std::min (w, h);
+    std::vector<int> gx (npoints), gy (npoints);
+    for (int i = 0;  i < npoints;  ++i) {
+        gx[i] = w/2 + (npoints-1-i);
+        gy[i] = h/2 + (i*7) % h;
+    }
+    std::vector<float> gathered (npoints*spec.nchannels);
+    ok = texsys->get_texels_gather (filename, opt, npoints, &gx[0], &gy[0],
+                                    NULL, TypeDesc::FLOAT, &gathered[0]);
+    if (! ok)
+        std::cerr << texsys->geterror() << "\n";
+    int mismatches = 0;
+    for (int i = 0;  i < npoints;  ++i) {
+        imagesize_t offset = ((gy[i]-h/2)*w + (gx[i]-w/2)) * spec.nchannels;
+        for (int c = 0;  c < spec.nchannels;  ++c)
+            if (gathered[i*spec.nchannels+c] != tmp[offset+c])
+                ++mismatches;
+    }
+    std::cerr << "get_texels_gather: " << npoints << " points, "
+              << mismatches << " mismatches\n";
+    return ok && mismatches == 0;
 }
 
 
@@ -368,6 +422,7 @@ main (int argc, const char *argv[])
     if (searchpath.length())
         texsys->attribute ("searchpath", searchpath);
 
+    bool ok = true;
     if (iters > 0) {
         ustring filename (filenames[0]);
         test_gettextureinfo (filename);
@@ -383,11 +438,12 @@ main (int argc, const char *argv[])
         if (! strcmp (texturetype, "Environment")) {
             test_environment (filename);
         }
-        test_getimagespec_gettexels (filename);
+        if (! bench)
+            ok = test_getimagespec_gettexels (filename);
     }
     
     std::cout << "Memory use: "
               << Strutil::memformat (Sysutil::memory_used(true)) << "\n";
     TextureSystem::destroy (texsys);
-    return 0;
+    return ok ? 0 : EXIT_FAILURE;
 }
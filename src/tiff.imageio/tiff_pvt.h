@@ -0,0 +1,147 @@
+/*
+  Copyright 2011 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+#ifndef OPENIMAGEIO_TIFF_PVT_H
+#define OPENIMAGEIO_TIFF_PVT_H
+
+#include <tiffio.h>
+
+#include "imageio.h"
+#include "filesystem.h"
+
+
+/*
+Glue that lets libtiff read and write through a Filesystem::IOProxy by
+way of TIFFClientOpen, shared by the TIFF reader and writer.
+*/
+
+#ifdef OPENIMAGEIO_NAMESPACE
+namespace OPENIMAGEIO_NAMESPACE {
+#endif
+
+namespace TIFF_pvt {
+
+inline tsize_t
+proxy_read (thandle_t handle, tdata_t data, tsize_t size)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return (tsize_t) io->read (data, size);
+}
+
+
+
+inline tsize_t
+proxy_write (thandle_t handle, tdata_t data, tsize_t size)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return (tsize_t) io->write (data, size);
+}
+
+
+
+inline toff_t
+proxy_seek (thandle_t handle, toff_t offset, int whence)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    int64_t pos = (int64_t) offset;
+    // toff_t is unsigned, and only 32 bits before libtiff 4, so a
+    // negative relative offset must be sign-extended from that width.
+    if (whence != SEEK_SET && sizeof(toff_t) == 4)
+        pos = (int64_t) (int32_t) offset;
+    if (whence == SEEK_CUR)
+        pos += io->tell ();
+    else if (whence == SEEK_END)
+        pos += (int64_t) io->size ();
+    if (! io->seek (pos))
+        return (toff_t) -1;
+    return (toff_t) io->tell ();
+}
+
+
+
+inline int
+proxy_close (thandle_t handle)
+{
+    // The proxy belongs to whoever handed it to us
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    io->flush ();
+    return 0;
+}
+
+
+
+inline toff_t
+proxy_size (thandle_t handle)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return (toff_t) io->size ();
+}
+
+
+
+/// If the proxy's contents are all in memory, hand them to libtiff as
+/// its "mapped file", so that strips and tiles are decoded in place.
+inline int
+proxy_map (thandle_t handle, tdata_t *base, toff_t *size)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    *base = (tdata_t) io->memory ();
+    *size = (toff_t) io->size ();
+    return *base != NULL;
+}
+
+
+
+inline void
+proxy_unmap (thandle_t handle, tdata_t base, toff_t size)
+{
+}
+
+
+
+/// Open a TIFF that reads or writes through io; name is only used in
+/// libtiff's messages.
+inline TIFF *
+open_proxy (const std::string &name, const char *mode,
+            Filesystem::IOProxy *io)
+{
+    return TIFFClientOpen (name.c_str(), mode, (thandle_t) io,
+                           proxy_read, proxy_write, proxy_seek, proxy_close,
+                           proxy_size, proxy_map, proxy_unmap);
+}
+
+};  // namespace TIFF_pvt
+
+#ifdef OPENIMAGEIO_NAMESPACE
+}; // end namespace OPENIMAGEIO_NAMESPACE
+using namespace OPENIMAGEIO_NAMESPACE;
+#endif
+
+#endif  // OPENIMAGEIO_TIFF_PVT_H
@@ -33,7 +33,7 @@
 #include <cstdlib>
 #include <cmath>
 
-#include <tiffio.h>
+#include "tiff_pvt.h"
 
 #include "dassert.h"
 #include "typedesc.h"
@@ -57,7 +57,7 @@ struct TIFF_tag_info {
 
 class TIFFInput : public ImageInput {
 public:
-    TIFFInput () { init(); }
+    TIFFInput () : m_io(NULL) { init(); }
     virtual ~TIFFInput () { close(); }
     virtual const char * format_name (void) const { return "tiff"; }
     virtual bool open (const std::string &name, ImageSpec &newspec);
@@ -66,14 +66,27 @@ public:
     virtual bool seek_subimage (int index, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
     virtual bool read_native_tile (int x, int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        int chbegin, int chend, void *data);
+    virtual bool read_native_tile (int x, int y, int z,
+                                   int chbegin, int chend, void *data);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io = ioproxy;
+        return true;
+    }
 
 private:
     TIFF *m_tif;                     ///< libtiff handle
+    Filesystem::IOProxy *m_io;       ///< Proxy from set_ioproxy(), if any
     std::string m_filename;          ///< Stash the filename
     std::vector<unsigned char> m_scratch; ///< Scratch space for us to use
     int m_subimage;                  ///< What subimage are we looking at?
     int m_next_scanline;             ///< Next scanline we'll read
     bool m_no_random_access;         ///< Should we avoid random access?
+    int m_rowsperstrip;              ///< Rows per strip (untiled only)
+    int m_read_strip;                ///< Strip last decoded whole, or -1
     unsigned short m_planarconfig;   ///< Planar config of the file
     unsigned short m_bitspersample;  ///< Of the *file*, not the client's view
     unsigned short m_photometric;    ///< Of the *file*, not the client's view
@@ -86,6 +99,15 @@ private:
         m_colormap.clear();
     }
 
+    // Open m_filename, or the proxy if we were given one
+    TIFF *open_tif () {
+        if (m_io) {
+            m_io->seek (0);
+            return TIFF_pvt::open_proxy (m_filename, "r", m_io);
+        }
+        return TIFFOpen (m_filename.c_str(), "rm");
+    }
+
     void close_tif () {
         if (m_tif) {
             TIFFClose (m_tif);
@@ -96,10 +118,29 @@ private:
     // Read tags from the current directory of m_tif and fill out spec
     void readspec ();
 
-    // Convert planar separate to contiguous data format
-    void separate_to_contig (int n, const unsigned char *separate,
+    // Convert nplanes planes of planar separate to contiguous data format
+    void separate_to_contig (int nplanes, int n, const unsigned char *separate,
                              unsigned char *contig);
 
+    // TIFFReadEncodedStrip leaves libtiff thinking it's still at the
+    // start of the last strip it decoded, which would confuse a
+    // subsequent TIFFReadScanline of row y within that same strip.
+    // Re-seeking the directory resets its notion of the current strip;
+    // reads that land in any other strip need no help.
+    void restart_strip (int y, int sample) {
+        if (m_read_strip >= 0) {
+            if ((int)TIFFComputeStrip (m_tif, y, sample) == m_read_strip)
+                TIFFSetDirectory (m_tif, m_subimage);
+            m_read_strip = -1;
+        }
+    }
+
+    // Can we read a subset of channels by reading just their planes?
+    bool separate_planes () const {
+        return m_planarconfig == PLANARCONFIG_SEPARATE && m_spec.nchannels > 1
+            && m_photometric != PHOTOMETRIC_PALETTE;
+    }
+
     // Convert palette to RGB
     void palette_to_rgb (int n, const unsigned char *palettepels,
                          unsigned char *rgb);
@@ -207,6 +248,19 @@ DLLEXPORT const char * tiff_input_extensions[] = {
     "tiff", "tif", "tx", "env", "sm", "vsm", NULL
 };
 
+DLLEXPORT bool
+tiff_input_signature (const unsigned char *header, int nbytes)
+{
+    // Byte order, then 42 (or 43 for BigTIFF) in that byte order
+    if (nbytes < 4)
+        return false;
+    if (header[0] == 'I' && header[1] == 'I')
+        return (header[2] == 42 || header[2] == 43) && header[3] == 0;
+    if (header[0] == 'M' && header[1] == 'M')
+        return header[2] == 0 && (header[3] == 42 || header[3] == 43);
+    return false;
+}
+
 };
 
 
@@ -254,7 +308,7 @@ TIFFInput::seek_subimage (int index, ImageSpec &newspec)
     }
 
     if (! m_tif) {
-        m_tif = TIFFOpen (m_filename.c_str(), "rm");
+        m_tif = open_tif ();
         if (m_tif == NULL) {
             error ("Could not open file: %s",
                    lasterr.length() ? lasterr.c_str() : m_filename.c_str());
@@ -264,6 +318,7 @@ TIFFInput::seek_subimage (int index, ImageSpec &newspec)
     }
     
     m_next_scanline = 0;   // next scanline we'll read
+    m_read_strip = -1;
     if (TIFFSetDirectory (m_tif, index)) {
         m_subimage = index;
         readspec ();
@@ -509,6 +564,7 @@ TIFFInput::readspec ()
         if (rowsperstrip > 0)
             m_spec.attribute ("tiff:RowsPerStrip", rowsperstrip);
     }
+    m_rowsperstrip = rowsperstrip;
 
     // The libtiff docs say that only uncompressed images, or those with
     // rowsperstrip==1, support random access to scanlines.
@@ -557,7 +613,7 @@ TIFFInput::readspec ()
         // I'm not sure what state TIFFReadEXIFDirectory leaves us.
         // So to be safe, close and re-seek.
         TIFFClose (m_tif);
-        m_tif = TIFFOpen (m_filename.c_str(), "rm");
+        m_tif = open_tif ();
         TIFFSetDirectory (m_tif, m_subimage);
 
         // A few tidbits to look for
@@ -623,17 +679,18 @@ TIFFInput::close ()
 
 
 
-/// Helper: Convert n pixels from separate (RRRGGGBBB) to contiguous
-/// (RGBRGBRGB) planarconfig.
+/// Helper: Convert n pixels of nplanes channels from separate
+/// (RRRGGGBBB) to contiguous (RGBRGBRGB) planarconfig.
 void
-TIFFInput::separate_to_contig (int n, const unsigned char *separate,
+TIFFInput::separate_to_contig (int nplanes, int n,
+                               const unsigned char *separate,
                                unsigned char *contig)
 {
     int channelbytes = m_spec.channel_bytes();
     for (int p = 0;  p < n;  ++p)                     // loop over pixels
-        for (int c = 0;  c < m_spec.nchannels;  ++c)    // loop over channels
+        for (int c = 0;  c < nplanes;  ++c)           // loop over channels
             for (int i = 0;  i < channelbytes;  ++i)  // loop over data bytes
-                contig[(p*m_spec.nchannels+c)*channelbytes+i] =
+                contig[(p*nplanes+c)*channelbytes+i] =
                     separate[(c*n+p)*channelbytes+i];
 }
 
@@ -698,6 +755,8 @@ TIFFInput::read_native_scanline (int y, int z, void *data)
 {
     y -= m_spec.y;
 
+    restart_strip (y, 0);
+
     // For compression modes that don't support random access to scanlines
     // (which I *think* is only LZW), we need to emulate random access by
     // re-seeking.
@@ -747,7 +806,7 @@ TIFFInput::read_native_scanline (int y, int z, void *data)
                 error ("%s", lasterr.c_str());
                 return false;
             }
-        separate_to_contig (m_spec.width, &m_scratch[0], (unsigned char *)data);
+        separate_to_contig (m_spec.nchannels, m_spec.width, &m_scratch[0], (unsigned char *)data);
     } else if (m_bitspersample == 1 || m_bitspersample == 2 || 
                m_bitspersample == 4) {
         // <8 bit images
@@ -774,6 +833,87 @@ TIFFInput::read_native_scanline (int y, int z, void *data)
 
 
 
+bool
+TIFFInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    // Only the "usual" case -- contiguous, >= 8 bits per sample, not
+    // palette -- is decoded straight into the caller's memory a whole
+    // strip at a time.  Everything else goes a scanline at a time.
+    if (m_rowsperstrip < 1 || m_photometric == PHOTOMETRIC_PALETTE ||
+        (m_planarconfig == PLANARCONFIG_SEPARATE && m_spec.nchannels > 1) ||
+        m_bitspersample < 8)
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+
+    size_t scanline_bytes = m_spec.scanline_bytes();
+    char *d = (char *)data;
+    int y = ybegin - m_spec.y;
+    int y1 = yend - m_spec.y;
+    // Scanlines before the first strip boundary are read one at a time
+    for ( ;  y < y1 && (y % m_rowsperstrip) != 0;  ++y, d += scanline_bytes)
+        if (! read_native_scanline (y+m_spec.y, z, d))
+            return false;
+    // Whole strips (the last strip of the image may be short)
+    while (y < y1) {
+        int n = std::min (m_rowsperstrip, m_spec.height - y);
+        if (y + n > y1)
+            break;
+        tstrip_t strip = TIFFComputeStrip (m_tif, y, 0);
+        if (TIFFReadEncodedStrip (m_tif, strip, d, n*scanline_bytes) < 0) {
+            error ("%s", lasterr.c_str());
+            return false;
+        }
+        m_read_strip = strip;
+        if (m_photometric == PHOTOMETRIC_MINISWHITE)
+            invert_photometric (n * m_spec.width * m_spec.nchannels, d);
+        y += n;
+        d += n * scanline_bytes;
+        m_next_scanline = y;
+    }
+    // Any remaining partial strip is read a scanline at a time
+    for ( ;  y < y1;  ++y, d += scanline_bytes)
+        if (! read_native_scanline (y+m_spec.y, z, d))
+            return false;
+    return true;
+}
+
+
+
+bool
+TIFFInput::read_native_scanlines (int ybegin, int yend, int z,
+                                  int chbegin, int chend, void *data)
+{
+    // Planar separate files keep each channel in its own plane, so we
+    // read only the planes asked for.  Everything else reads all the
+    // channels and copies out the ones requested.
+    if ((chbegin == 0 && chend == m_spec.nchannels) || ! separate_planes () ||
+            m_no_random_access)
+        return ImageInput::read_native_scanlines (ybegin, yend, z,
+                                                  chbegin, chend, data);
+
+    restart_strip (ybegin - m_spec.y, chbegin);
+    int nchans = chend - chbegin;
+    int plane_bytes = m_spec.width * m_spec.format.size();
+    m_scratch.resize (plane_bytes * nchans);
+    char *d = (char *)data;
+    for (int y = ybegin - m_spec.y;  y < yend - m_spec.y;  ++y) {
+        for (int c = chbegin;  c < chend;  ++c)
+            if (TIFFReadScanline (m_tif, &m_scratch[plane_bytes*(c-chbegin)],
+                                  y, c) < 0) {
+                error ("%s", lasterr.c_str());
+                return false;
+            }
+        separate_to_contig (nchans, m_spec.width, &m_scratch[0],
+                            (unsigned char *)d);
+        if (m_photometric == PHOTOMETRIC_MINISWHITE)
+            invert_photometric (m_spec.width * nchans, d);
+        d += plane_bytes * nchans;
+        m_next_scanline = y+1;
+    }
+    return true;
+}
+
+
+
 bool
 TIFFInput::read_native_tile (int x, int y, int z, void *data)
 {
@@ -800,7 +940,7 @@ TIFFInput::read_native_tile (int x, int y, int z, void *data)
                        errno ? strerror(errno) : "unknown");
                 return false;
             }
-        separate_to_contig (tile_pixels, &m_scratch[0], (unsigned char *)data);
+        separate_to_contig (m_spec.nchannels, tile_pixels, &m_scratch[0], (unsigned char *)data);
     } else {
         // Contiguous, >= 8 bit per sample -- the "usual" case
         if (TIFFReadTile (m_tif, data, x, y, z, 0) < 0) {
@@ -815,3 +955,36 @@ TIFFInput::read_native_tile (int x, int y, int z, void *data)
 
     return true;
 }
+
+
+
+bool
+TIFFInput::read_native_tile (int x, int y, int z,
+                             int chbegin, int chend, void *data)
+{
+    if ((chbegin == 0 && chend == m_spec.nchannels) || ! separate_planes ())
+        return ImageInput::read_native_tile (x, y, z, chbegin, chend, data);
+
+    // Read only the planes of the channels asked for
+    x -= m_spec.x;
+    y -= m_spec.y;
+    int nchans = chend - chbegin;
+    int tile_pixels = m_spec.tile_width * m_spec.tile_height 
+                      * std::max (m_spec.tile_depth, 1);
+    int plane_bytes = tile_pixels * m_spec.format.size();
+    m_scratch.resize (plane_bytes * nchans);
+    for (int c = chbegin;  c < chend;  ++c)
+        if (TIFFReadTile (m_tif, &m_scratch[plane_bytes*(c-chbegin)],
+                          x, y, z, c) < 0) {
+            error ("%s (errno '%s')", lasterr.c_str(),
+                   errno ? strerror(errno) : "unknown");
+            return false;
+        }
+    separate_to_contig (nchans, tile_pixels, &m_scratch[0],
+                        (unsigned char *)data);
+
+    if (m_photometric == PHOTOMETRIC_MINISWHITE)
+        invert_photometric (tile_pixels * nchans, data);
+
+    return true;
+}
@@ -34,15 +34,18 @@
 #include <cmath>
 #include <iostream>
 
-#include <tiffio.h>
+#include <zlib.h>
 
 #include <boost/algorithm/string.hpp>
 using boost::algorithm::iequals;
+#include <boost/bind.hpp>
 
 #include "dassert.h"
 #include "imageio.h"
+#include "tiff_pvt.h"
 #include "strutil.h"
 #include "sysutil.h"
+#include "thread.h"
 
 
 using namespace OpenImageIO;
@@ -62,11 +65,25 @@ public:
     virtual bool write_tile (int x, int y, int z,
                              TypeDesc format, const void *data,
                              stride_t xstride, stride_t ystride, stride_t zstride);
+    virtual bool write_scanlines (int ybegin, int yend, int z,
+                                  TypeDesc format, const void *data,
+                                  stride_t xstride, stride_t ystride);
+    virtual bool write_tiles (int xbegin, int xend, int ybegin, int yend,
+                              int zbegin, int zend, TypeDesc format,
+                              const void *data, stride_t xstride,
+                              stride_t ystride, stride_t zstride);
+    virtual bool set_ioproxy (Filesystem::IOProxy *ioproxy) {
+        m_io = ioproxy;
+        return true;
+    }
 
 private:
     TIFF *m_tif;
+    Filesystem::IOProxy *m_io;   ///< Proxy from set_ioproxy(), if any
     std::vector<unsigned char> m_scratch;
     int m_planarconfig;
+    std::vector<unsigned char> m_native;  ///< Strips/tiles to be encoded
+    std::vector<std::vector<unsigned char> > m_encoded;  ///< Encoded chunks
 
     // Initialize private members to pre-opened state
     void init (void) {
@@ -79,6 +96,23 @@ private:
     // Add a parameter to the output
     bool put_parameter (const std::string &name, TypeDesc type,
                         const void *data);
+
+    // Is the file being written with deflate (zip) or LZW compression,
+    // in a layout simple enough that we can do the encoding ourselves
+    // (and thus in parallel) rather than leaving it to libtiff?  If so,
+    // set compress to the codec and predict to whether the horizontal
+    // predictor must be applied first.  Other codecs, and planar
+    // separate files, are left to libtiff.
+    bool can_encode_ourselves (int &compress, bool &predict);
+
+    // Encode chunks [begin,end) of the native pixels at chunks, each
+    // chunkbytes long (except perhaps the last, which ends at
+    // totalbytes) and made of rows of rowpixels pixels, into m_encoded,
+    // exactly as libtiff's codec for compress would.  The predictor is
+    // applied in place, so chunks is only written to if predict is set.
+    void encode_chunks (unsigned char *chunks, size_t chunkbytes,
+                        size_t totalbytes, int rowpixels, bool predict,
+                        int compress, int begin, int end);
 };
 
 
@@ -100,6 +134,7 @@ DLLEXPORT const char * tiff_output_extensions[] = {
 
 
 TIFFOutput::TIFFOutput ()
+    : m_io(NULL)
 {
     init ();
 }
@@ -121,6 +156,8 @@ TIFFOutput::supports (const std::string &feature) const
         return true;
     if (feature == "multiimage")
         return true;
+    if (feature == "ioproxy")
+        return true;
 
     // FIXME: we could support "volumes" and "empty"
 
@@ -145,8 +182,14 @@ TIFFOutput::open (const std::string &name, const ImageSpec &userspec, bool appen
     if (m_spec.depth < 1)
         m_spec.depth = 1;
 
-    // Open the file
-    m_tif = TIFFOpen (name.c_str(), append ? "a" : "w");
+    // Open the file, or the proxy if we were given one
+    if (m_io) {
+        if (! append)
+            m_io->seek (0);
+        m_tif = TIFF_pvt::open_proxy (name, append ? "a" : "w", m_io);
+    } else {
+        m_tif = TIFFOpen (name.c_str(), append ? "a" : "w");
+    }
     if (! m_tif) {
         error ("Can't open \"%s\" for output.", name.c_str());
         return false;
@@ -511,3 +554,340 @@ TIFFOutput::write_tile (int x, int y, int z,
 
     return true;
 }
+
+
+
+// Apply the TIFF horizontal differencing predictor, in place, to nrows
+// rows of rowpixels pixels each with nchannels samples of type T.
+template<typename T>
+static void
+horizontal_predictor (T *data, int nrows, int rowpixels, int nchannels)
+{
+    int rowvalues = rowpixels * nchannels;
+    for (int r = 0;  r < nrows;  ++r, data += rowvalues)
+        for (int i = rowvalues-1;  i >= nchannels;  --i)
+            data[i] -= data[i-nchannels];
+}
+
+
+
+// Packs LZW codes of the current width into bytes, most significant
+// bit first, as TIFF requires.
+struct LZWCodePacker {
+    std::vector<unsigned char> &out;
+    unsigned long bits;        // Bits not yet written, in the low nbits
+    int nbits;
+    int width;                 // Current code width
+    LZWCodePacker (std::vector<unsigned char> &out)
+        : out(out), bits(0), nbits(0), width(9) { }
+    void put (int code) {
+        bits = (bits << width) | (unsigned long) code;
+        nbits += width;
+        while (nbits >= 8) {
+            nbits -= 8;
+            out.push_back ((unsigned char)(bits >> nbits));
+        }
+    }
+    void flush () {
+        if (nbits)
+            out.push_back ((unsigned char)(bits << (8 - nbits)));
+        nbits = 0;
+    }
+};
+
+
+
+// Append n bytes, LZW-encoded the way TIFF (and libtiff) does it, to
+// out: codes are 9 to 12 bits wide, widened one code earlier than
+// plain LZW would, and the string table is cleared whenever it fills.
+static void
+lzw_encode (const unsigned char *in, size_t n, std::vector<unsigned char> &out)
+{
+    const int CODE_CLEAR = 256, CODE_EOI = 257, CODE_FIRST = 258;
+    const int CODE_FULL = 4094;
+    const int HBITS = 13, HSIZE = 1 << HBITS;
+    // Open-addressed hash of (prefix code << 8 | byte) -> code
+    std::vector<int> hkey (HSIZE, -1), hcode (HSIZE);
+    LZWCodePacker codes (out);
+    int next = CODE_FIRST;
+    codes.put (CODE_CLEAR);
+    if (n) {
+        int ent = in[0];
+        for (size_t i = 1;  i < n;  ++i) {
+            int key = (ent << 8) | in[i];
+            unsigned int h = ((unsigned int)key * 2654435761u) >> (32 - HBITS);
+            while (hkey[h] != -1 && hkey[h] != key)
+                h = (h + 1) & (HSIZE - 1);
+            if (hkey[h] == key) {
+                ent = hcode[h];
+                continue;
+            }
+            codes.put (ent);
+            ent = in[i];
+            hkey[h] = key;
+            hcode[h] = next++;
+            if (next == CODE_FULL) {
+                codes.put (CODE_CLEAR);
+                std::fill (hkey.begin(), hkey.end(), -1);
+                next = CODE_FIRST;
+                codes.width = 9;
+            } else if (next > (1 << codes.width) - 1) {
+                ++codes.width;
+            }
+        }
+        // The decoder adds one more entry after the last code, so
+        // follow along to agree on the width of the end code.
+        codes.put (ent);
+        if (++next == CODE_FULL) {
+            codes.put (CODE_CLEAR);
+            codes.width = 9;
+        } else if (next > (1 << codes.width) - 1) {
+            ++codes.width;
+        }
+    }
+    codes.put (CODE_EOI);
+    codes.flush ();
+}
+
+
+
+bool
+TIFFOutput::can_encode_ourselves (int &compress, bool &predict)
+{
+    unsigned short c = COMPRESSION_NONE;
+    TIFFGetField (m_tif, TIFFTAG_COMPRESSION, &c);
+    if (c != COMPRESSION_ADOBE_DEFLATE && c != COMPRESSION_DEFLATE &&
+            c != COMPRESSION_LZW)
+        return false;
+    compress = c;
+    if (m_planarconfig == PLANARCONFIG_SEPARATE && m_spec.nchannels > 1)
+        return false;
+    unsigned short predictor = PREDICTOR_NONE;
+    TIFFGetField (m_tif, TIFFTAG_PREDICTOR, &predictor);
+    size_t size = m_spec.format.size();
+    if (predictor == PREDICTOR_HORIZONTAL &&
+            (size == 1 || size == 2 || size == 4)) {
+        predict = true;
+        return true;
+    }
+    predict = false;
+    return (predictor == PREDICTOR_NONE);
+}
+
+
+
+void
+TIFFOutput::encode_chunks (unsigned char *chunks, size_t chunkbytes,
+                           size_t totalbytes, int rowpixels, bool predict,
+                           int compress, int begin, int end)
+{
+    size_t rowbytes = rowpixels * m_spec.pixel_bytes();
+    for (int i = begin;  i < end;  ++i) {
+        unsigned char *chunk = chunks + i * chunkbytes;
+        size_t nbytes = std::min (chunkbytes, totalbytes - i * chunkbytes);
+        if (predict) {
+            int nrows = (int) (nbytes / rowbytes);
+            switch (m_spec.format.size()) {
+            case 1 :
+                horizontal_predictor ((unsigned char *)chunk, nrows,
+                                      rowpixels, m_spec.nchannels);
+                break;
+            case 2 :
+                horizontal_predictor ((unsigned short *)chunk, nrows,
+                                      rowpixels, m_spec.nchannels);
+                break;
+            case 4 :
+                horizontal_predictor ((unsigned int *)chunk, nrows,
+                                      rowpixels, m_spec.nchannels);
+                break;
+            }
+        }
+        std::vector<unsigned char> &out (m_encoded[i]);
+        if (compress == COMPRESSION_LZW) {
+            out.clear ();
+            lzw_encode (chunk, nbytes, out);
+            continue;
+        }
+        uLongf outsize = compressBound (nbytes);
+        out.resize (outsize);
+        if (compress2 (&out[0], &outsize, chunk, nbytes,
+                       Z_DEFAULT_COMPRESSION) == Z_OK)
+            out.resize (outsize);
+        else
+            out.clear ();   // signals the failure to our caller
+    }
+}
+
+
+
+bool
+TIFFOutput::write_scanlines (int ybegin, int yend, int z,
+                             TypeDesc format, const void *data,
+                             stride_t xstride, stride_t ystride)
+{
+    int compress = COMPRESSION_NONE;
+    bool predict = false;
+    if (m_spec.tile_width || ! can_encode_ourselves (compress, predict))
+        return ImageOutput::write_scanlines (ybegin, yend, z, format, data,
+                                             xstride, ystride);
+    stride_t zstride = AutoStride;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        m_spec.width, yend-ybegin);
+    unsigned int rowsperstrip = 0;
+    TIFFGetField (m_tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+    int rps = std::max (1, (int) std::min (rowsperstrip,
+                                           (unsigned int) m_spec.height));
+
+    // Scanlines before the first strip boundary go one at a time
+    const char *d = (const char *)data;
+    int y = ybegin - m_spec.y;
+    int y1 = yend - m_spec.y;
+    for ( ;  y < y1 && (y % rps) != 0;  ++y, d += ystride)
+        if (! write_scanline (y+m_spec.y, z, format, d, xstride))
+            return false;
+
+    // Find the whole strips (the last strip of the image may be short)
+    int ystrips = y;
+    while (ystrips < y1 &&
+           ystrips + std::min (rps, m_spec.height - ystrips) <= y1)
+        ystrips += std::min (rps, m_spec.height - ystrips);
+    if (ystrips > y) {
+        // Convert to native format (in m_scratch, unless the caller's
+        // pixels already are native), encode the strips in parallel,
+        // and then hand them to libtiff, in order, to be written as
+        // they are.  The predictor works in place, so only then must
+        // the caller's own pixels be copied.
+        int nlines = ystrips - y;
+        size_t stripbytes = rps * m_spec.scanline_bytes();
+        size_t totalbytes = nlines * m_spec.scanline_bytes();
+        int nstrips = (nlines + rps - 1) / rps;
+        const void *native = to_native_rectangle (0, m_spec.width-1,
+                                                  0, nlines-1, 0, 0,
+                                                  format, d, xstride,
+                                                  ystride, AutoStride,
+                                                  m_scratch);
+        if (predict && native == (const void *)d) {
+            m_native.assign ((const unsigned char *)native,
+                             (const unsigned char *)native + totalbytes);
+            native = &m_native[0];
+        }
+        m_encoded.resize (nstrips);
+        parallel_for (0, nstrips,
+                      boost::bind (&TIFFOutput::encode_chunks, this,
+                                   (unsigned char *)native, stripbytes,
+                                   totalbytes, m_spec.width, predict,
+                                   compress, _1, _2),
+                      0, 1);
+        // Finish any strip that libtiff is in the middle of encoding
+        TIFFFlushData (m_tif);
+        tstrip_t firststrip = TIFFComputeStrip (m_tif, y, 0);
+        for (int s = 0;  s < nstrips;  ++s) {
+            if (m_encoded[s].empty () ||
+                TIFFWriteRawStrip (m_tif, firststrip + s, &m_encoded[s][0],
+                                   m_encoded[s].size()) < 0) {
+                error ("Failed TIFF write of strip %d", (int) firststrip + s);
+                return false;
+            }
+        }
+        d += nlines * ystride;
+        y = ystrips;
+    }
+
+    // Any remaining partial strip goes a scanline at a time
+    for ( ;  y < y1;  ++y, d += ystride)
+        if (! write_scanline (y+m_spec.y, z, format, d, xstride))
+            return false;
+    return true;
+}
+
+
+
+bool
+TIFFOutput::write_tiles (int xbegin, int xend, int ybegin, int yend,
+                         int zbegin, int zend, TypeDesc format,
+                         const void *data, stride_t xstride,
+                         stride_t ystride, stride_t zstride)
+{
+    int compress = COMPRESSION_NONE;
+    bool predict = false;
+    if (! m_spec.tile_width || ! can_encode_ourselves (compress, predict))
+        return ImageOutput::write_tiles (xbegin, xend, ybegin, yend,
+                                         zbegin, zend, format, data,
+                                         xstride, ystride, zstride);
+    if (xend <= xbegin || yend <= ybegin || zend <= zbegin)
+        return true;
+    int width = xend - xbegin, height = yend - ybegin, depth = zend - zbegin;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        width, height);
+    const void *native = to_native_rectangle (0, width-1, 0, height-1,
+                                              0, depth-1, format, data,
+                                              xstride, ystride, zstride,
+                                              m_scratch);
+
+    // Encode full-size tiles, one after another, in parallel and hand
+    // them to libtiff, in order, to be written as they are.  If the
+    // region is a single column of whole tiles, the native pixels
+    // already are such a sequence; otherwise they are gathered (and
+    // zero-padded) into m_native.
+    int tile_depth = std::max (1, m_spec.tile_depth);
+    int ntilesx = (width + m_spec.tile_width - 1) / m_spec.tile_width;
+    int ntilesy = (height + m_spec.tile_height - 1) / m_spec.tile_height;
+    int ntilesz = (depth + tile_depth - 1) / tile_depth;
+    int ntiles = ntilesx * ntilesy * ntilesz;
+    size_t tilebytes = m_spec.tile_bytes();
+    stride_t pixelbytes = m_spec.pixel_bytes();
+    stride_t tileystride = pixelbytes * m_spec.tile_width;
+    stride_t tilezstride = tileystride * m_spec.tile_height;
+    stride_t nativeystride = pixelbytes * width;
+    stride_t nativezstride = nativeystride * height;
+    bool gather = (width != m_spec.tile_width ||
+                   height % m_spec.tile_height != 0 ||
+                   (tile_depth > 1 && (height != m_spec.tile_height ||
+                                       depth % tile_depth != 0)));
+    unsigned char *tiles = (unsigned char *) native;
+    if (gather) {
+        m_native.assign (ntiles * tilebytes, 0);
+        tiles = &m_native[0];
+    } else if (predict && native == data) {
+        m_native.assign (tiles, tiles + ntiles * tilebytes);
+        tiles = &m_native[0];
+    }
+    std::vector<int> tilex (ntiles), tiley (ntiles), tilez (ntiles);
+    int t = 0;
+    for (int z = 0;  z < depth;  z += tile_depth)
+        for (int y = 0;  y < height;  y += m_spec.tile_height)
+            for (int x = 0;  x < width;  x += m_spec.tile_width, ++t) {
+                if (gather) {
+                    int ntz = std::min (z+tile_depth, depth) - z;
+                    int nty = std::min (y+m_spec.tile_height, height) - y;
+                    int ntx = std::min (x+m_spec.tile_width, width) - x;
+                    convert_image (m_spec.nchannels, ntx, nty, ntz,
+                                   (const char *)native + z*nativezstride
+                                       + y*nativeystride + x*pixelbytes,
+                                   m_spec.format, pixelbytes,
+                                   nativeystride, nativezstride,
+                                   tiles + t * tilebytes, m_spec.format,
+                                   pixelbytes, tileystride, tilezstride);
+                }
+                tilex[t] = xbegin - m_spec.x + x;
+                tiley[t] = ybegin - m_spec.y + y;
+                tilez[t] = zbegin + z;   // as in write_tile
+            }
+    m_encoded.resize (ntiles);
+    parallel_for (0, ntiles,
+                  boost::bind (&TIFFOutput::encode_chunks, this, tiles,
+                               tilebytes, ntiles * tilebytes,
+                               m_spec.tile_width, predict, compress,
+                               _1, _2),
+                  0, 1);
+    for (t = 0;  t < ntiles;  ++t) {
+        ttile_t tile = TIFFComputeTile (m_tif, tilex[t], tiley[t], tilez[t], 0);
+        if (m_encoded[t].empty () ||
+            TIFFWriteRawTile (m_tif, tile, &m_encoded[t][0],
+                              m_encoded[t].size()) < 0) {
+            error ("Failed TIFF write of tile %d", (int) tile);
+            return false;
+        }
+    }
+    return true;
+}
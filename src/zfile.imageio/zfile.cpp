@@ -125,6 +125,16 @@ DLLEXPORT const char * zfile_input_extensions[] = {
     "zfile", NULL
 };
 
+DLLEXPORT bool
+zfile_input_signature (const unsigned char *header, int nbytes)
+{
+    if (nbytes < (int)sizeof(int))
+        return false;
+    int magic;
+    memcpy (&magic, header, sizeof(int));
+    return (magic == zfile_magic || magic == zfile_magic_endian);
+}
+
 DLLEXPORT ImageOutput *zfile_output_imageio_create () { return new ZfileOutput; }
 
 DLLEXPORT const char * zfile_output_extensions[] = {
@@ -0,0 +1,49 @@
+#!/usr/bin/python 
+
+import os
+import sys
+import struct
+
+path = ""
+command = ""
+if len(sys.argv) > 2 :
+    os.chdir (sys.argv[1])
+    path = sys.argv[2] + "/"
+
+sys.path = [".."] + sys.path
+import runtest
+
+# A 3x2 RGB image
+rows = [ [ (10, 20, 30), (40, 50, 60), (70, 80, 90) ],
+         [ (100, 110, 120), (130, 140, 150), (160, 170, 180) ] ]
+
+# Write it as a 24 bit BMP with an OS/2 (12 byte) bitmap header, whose
+# width and height are only 16 bits
+data = b""
+for r in reversed (rows) :
+    line = b"".join ([ struct.pack ("BBB", p[2], p[1], p[0]) for p in r ])
+    data += line + b"\0" * (-len(line) % 4)
+header = struct.pack ("<2sIHHI", b"BM", 26 + len(data), 0, 0, 26)
+header += struct.pack ("<IHHHH", 12, len(rows[0]), len(rows), 1, 24)
+f = open ("os2.bmp", "wb")
+f.write (header + data)
+f.close ()
+
+# And as an ascii PPM
+vals = [ str(v) for r in rows for p in r for v in p ]
+f = open ("ref.ppm", "wb")
+f.write (("P3\n%d %d\n255\n%s\n" % (len(rows[0]), len(rows), " ".join (vals))).encode())
+f.close ()
+
+command = path + runtest.oiio_app("idiff") + "os2.bmp ref.ppm > out.txt"
+
+# Outputs to check against references
+outputs = [ ]
+
+# Files that need to be cleaned up, IN ADDITION to outputs
+cleanfiles = [ "out.txt", "os2.bmp", "ref.ppm" ]
+
+
+# boilerplate
+ret = runtest.runtest (command, outputs, cleanfiles)
+sys.exit (ret)
@@ -0,0 +1,34 @@
+#!/usr/bin/python 
+
+import os
+import sys
+
+path = ""
+command = ""
+if len(sys.argv) > 2 :
+    os.chdir (sys.argv[1])
+    path = sys.argv[2] + "/"
+
+sys.path = [".."] + sys.path
+import runtest
+
+# Make four copies with different orientations, then rotate them all
+# clockwise in place, several at a time.  Each file must be rotated
+# from its own orientation, not from whichever file was done before it.
+src = "../../../oiio-testimages/tahoe-gps.jpg"
+command = ""
+for (f, o) in [ ("a.tif", 1), ("b.tif", 6), ("c.tif", 3), ("d.tif", 8) ] :
+    command = command + path + runtest.oiio_app("iconvert") + "--orientation " + str(o) + " " + src + " " + f + " > /dev/null ; "
+command = command + path + runtest.oiio_app("iconvert") + "--inplace -t 0 --rotcw a.tif b.tif c.tif d.tif > /dev/null ; "
+command = command + path + runtest.oiio_app("iinfo") + "-v -f -m Orientation a.tif b.tif c.tif d.tif > out.txt"
+
+# Outputs to check against references
+outputs = [ "out.txt" ]
+
+# Files that need to be cleaned up, IN ADDITION to outputs
+cleanfiles = [ "a.tif", "b.tif", "c.tif", "d.tif" ]
+
+
+# boilerplate
+ret = runtest.runtest (command, outputs, cleanfiles)
+sys.exit (ret)
@@ -0,0 +1,48 @@
+#!/usr/bin/python 
+
+import os
+import sys
+
+path = ""
+command = ""
+if len(sys.argv) > 2 :
+    os.chdir (sys.argv[1])
+    path = sys.argv[2] + "/"
+
+sys.path = [".."] + sys.path
+import runtest
+
+# Write a tiny test image
+def write (name, data) :
+    f = open (name, "wb")
+    f.write (data)
+    f.close ()
+
+# The same four gray values at 16 and at 8 bits.  Rescaling the 16 bit
+# values must not overflow, even near the top of the range.
+write ("ascii16.pgm", b"P2\n4 1\n65535\n0 32896 51400 65535\n")
+write ("ascii8.pgm", b"P2\n4 1\n255\n0 128 200 255\n")
+command = path + runtest.oiio_app("idiff") + "ascii16.pgm ascii8.pgm > out.txt && "
+
+# Copying a 16 bit image must keep all 16 bits of each value
+write ("values16.pgm", b"P2\n4 1\n65535\n1 4660 43981 65534\n")
+command = command + path + runtest.oiio_app("iconvert") + "values16.pgm copy16.pgm >> out.txt && "
+command = command + path + runtest.oiio_app("idiff") + "copy16.pgm values16.pgm >> out.txt && "
+
+# Binary 16 bit samples are big endian, both when read and when written
+write ("binary16.pgm", b"P5\n4 1\n65535\n\x00\x01\x12\x34\xab\xcd\xff\xfe")
+command = command + path + runtest.oiio_app("idiff") + "binary16.pgm values16.pgm >> out.txt && "
+command = command + path + runtest.oiio_app("iconvert") + "binary16.pgm written16.pgm >> out.txt && "
+command = command + path + runtest.oiio_app("idiff") + "written16.pgm values16.pgm >> out.txt"
+
+# Outputs to check against references
+outputs = [ ]
+
+# Files that need to be cleaned up, IN ADDITION to outputs
+cleanfiles = [ "out.txt", "ascii16.pgm", "ascii8.pgm",
+               "values16.pgm", "copy16.pgm", "binary16.pgm", "written16.pgm" ]
+
+
+# boilerplate
+ret = runtest.runtest (command, outputs, cleanfiles)
+sys.exit (ret)
@@ -0,0 +1,52 @@
+#!/usr/bin/python 
+
+import os
+import sys
+import struct
+
+path = ""
+command = ""
+if len(sys.argv) > 2 :
+    os.chdir (sys.argv[1])
+    path = sys.argv[2] + "/"
+
+sys.path = [".."] + sys.path
+import runtest
+
+# Write a 16 bit, one channel SGI file with the given scanlines, which
+# are either lists of values (verbatim) or RLE data (lists of 16 bit words)
+def write_sgi (name, rle, rows) :
+    header = struct.pack (">hbbHHHHiii80si", 0x01DA, rle, 2, 2,
+                          4, len(rows), 1, 0, 65535, 0, b"", 0)
+    data = header + b"\0" * (512 - len(header))
+    if rle :
+        start = len(data) + 8 * len(rows)
+        for r in rows :
+            data += struct.pack (">I", start)
+            start += 2 * len(r)
+        for r in rows :
+            data += struct.pack (">I", 2 * len(r))
+    for r in rows :
+        data += struct.pack (">%dH" % len(r), *r)
+    f = open (name, "wb")
+    f.write (data)
+    f.close ()
+
+# The same pixels, uncompressed and RLE compressed.  RLE runs and copied
+# values must both come out big endian.
+write_sgi ("verbatim16.sgi", 0, [ [ 0x1234, 0x1234, 0x1234, 0xabcd ],
+                                  [ 0x0102, 0x0304, 0x0506, 0x0708 ] ])
+write_sgi ("rle16.sgi", 1, [ [ 0x0003, 0x1234, 0x0081, 0xabcd, 0 ],
+                             [ 0x0084, 0x0102, 0x0304, 0x0506, 0x0708, 0 ] ])
+command = path + runtest.oiio_app("idiff") + "rle16.sgi verbatim16.sgi > out.txt"
+
+# Outputs to check against references
+outputs = [ ]
+
+# Files that need to be cleaned up, IN ADDITION to outputs
+cleanfiles = [ "out.txt", "verbatim16.sgi", "rle16.sgi" ]
+
+
+# boilerplate
+ret = runtest.runtest (command, outputs, cleanfiles)
+sys.exit (ret)
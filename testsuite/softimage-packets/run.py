@@ -0,0 +1,81 @@
+#!/usr/bin/python 
+
+import os
+import sys
+import struct
+
+path = ""
+command = ""
+if len(sys.argv) > 2 :
+    os.chdir (sys.argv[1])
+    path = sys.argv[2] + "/"
+
+sys.path = [".."] + sys.path
+import runtest
+
+# A 4x2 RGB image: a run of three pixels and one more, then two single
+# pixels and a run of two
+A = (0x1234, 0x5678, 0x9abc)
+B = (0x0102, 0x0304, 0x0506)
+C = (0xfedc, 0xba98, 0x7654)
+D = (0x1111, 0x2222, 0x3333)
+E = (0xa0b0, 0xc0d0, 0xe0f0)
+rows = [ [ A, A, A, B ], [ C, D, E, E ] ]
+
+# Pixel values at 8 or 16 bits
+def pixels (bits, *pix) :
+    vals = [ v >> (16 - bits) for p in pix for v in p ]
+    return struct.pack (">%d%s" % (len(vals), "B" if bits == 8 else "H"), *vals)
+
+# Write a Softimage PIC file with one RGB channel packet, given each
+# scanline's encoded data
+def write_pic (name, bits, encoding, scanlines) :
+    data = struct.pack (">If80s4sHHfHH", 0x5380f634, 3.71, b"", b"PICT",
+                        4, len(scanlines), 1.0, 3, 0)
+    data += struct.pack ("BBBB", 0, bits, encoding, 0xe0)
+    for s in scanlines :
+        data += s
+    f = open (name, "wb")
+    f.write (data)
+    f.close ()
+
+# Write the same pixels as an ascii PPM
+def write_ppm (name, bits) :
+    vals = [ str(v >> (16 - bits)) for r in rows for p in r for v in p ]
+    f = open (name, "wb")
+    f.write (("P3\n4 %d\n%d\n%s\n" % (len(rows), (1 << bits) - 1, " ".join (vals))).encode())
+    f.close ()
+
+for bits in [ 8, 16 ] :
+    write_ppm ("ref%d.ppm" % bits, bits)
+    # Uncompressed: every pixel in turn
+    write_pic ("uncompressed%d.pic" % bits, bits, 0,
+               [ pixels (bits, *r) for r in rows ])
+    # Pure run length: a count and a pixel, over and over
+    write_pic ("pure%d.pic" % bits, bits, 1,
+               [ b"\x03" + pixels (bits, A) + b"\x01" + pixels (bits, B),
+                 b"\x01" + pixels (bits, C) + b"\x01" + pixels (bits, D)
+                 + b"\x02" + pixels (bits, E) ])
+    # Mixed run length: runs (128 + count-1) and raw packets (count-1)
+    write_pic ("mixed%d.pic" % bits, bits, 2,
+               [ b"\x82" + pixels (bits, A) + b"\x00" + pixels (bits, B),
+                 b"\x01" + pixels (bits, C, D) + b"\x81" + pixels (bits, E) ])
+
+command = "echo hi > out.txt"
+for bits in [ 8, 16 ] :
+    for encoding in [ "uncompressed", "pure", "mixed" ] :
+        command = command + " && " + path + runtest.oiio_app("idiff") + "%s%d.pic ref%d.ppm >> out.txt" % (encoding, bits, bits)
+
+# Outputs to check against references
+outputs = [ ]
+
+# Files that need to be cleaned up, IN ADDITION to outputs
+cleanfiles = [ "out.txt" ]
+for bits in [ 8, 16 ] :
+    cleanfiles += [ "ref%d.ppm" % bits, "uncompressed%d.pic" % bits,
+                    "pure%d.pic" % bits, "mixed%d.pic" % bits ]
+
+
+# boilerplate
+ret = runtest.runtest (command, outputs, cleanfiles)
+sys.exit (ret)